@@ -0,0 +1,29 @@
+#ifndef _ASYNC_OTA_WEB_UPDATE_H
+#define _ASYNC_OTA_WEB_UPDATE_H
+
+#include <functional>
+#include "Update.h"
+#include "ESPAsyncWebServer.h"
+
+typedef std::function<void(AsyncResponseStream *response, boolean hasError)> OTAInfoSender;
+
+// Serves the form, but any upload is answered as failed since Update can't begin
+class ASyncOTAWebUpdate {
+public:
+	ASyncOTAWebUpdate(UpdateClass &update, const char *user, const char *password) : update(update) {}
+
+	void init(AsyncWebServer &server, const char *path, ArRequestHandlerFunction formSender, OTAInfoSender infoSender) {
+		server.on(path, HTTP_GET, formSender);
+		server.on(path, HTTP_POST, [this, infoSender](AsyncWebServerRequest *request) {
+			this->update.begin();
+			AsyncResponseStream *response = request->beginResponseStream("text/html");
+			infoSender(response, this->update.hasError());
+			request->send(response);
+		});
+	}
+
+private:
+	UpdateClass &update;
+};
+
+#endif
@@ -0,0 +1,53 @@
+#include <unistd.h>
+#include <atomic>
+#include "Arduino.h"
+#include "NativeHAL.h"
+
+#define NATIVE_PINS 64
+
+static std::atomic<uint8_t> pins[NATIVE_PINS];
+
+unsigned long millis() {
+	return esp_timer_get_time() / 1000;
+}
+
+unsigned long micros() {
+	return esp_timer_get_time();
+}
+
+void delay(uint32_t ms) {
+	usleep(ms * 1000);
+}
+
+void delayMicroseconds(uint32_t us) {
+	usleep(us);
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+	if (pin < NATIVE_PINS) {
+		pins[pin] = val;
+	}
+}
+
+int digitalRead(uint8_t pin) {
+	return pin < NATIVE_PINS ? pins[pin].load() : LOW;
+}
+
+int nativePinState(uint8_t pin) {
+	return digitalRead(pin);
+}
+
+long random(long max) {
+	return max <= 0 ? 0 : esp_random() % max;
+}
+
+long random(long min, long max) {
+	return min >= max ? min : min + random(max - min);
+}
+
+void randomSeed(unsigned long seed) {
+	srand(seed);
+}
@@ -0,0 +1,453 @@
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include "AsyncWebSocket.h"
+#include "NativeSocket.h"
+#include "esp_log.h"
+
+#define MAX_FRAME_LENGTH 65536
+
+static const char *TAG = "websocket";
+
+static uint32_t rol(uint32_t value, int bits) {
+	return (value << bits) | (value >> (32 - bits));
+}
+
+static void sha1(const uint8_t *data, size_t len, uint8_t digest[20]) {
+	uint32_t h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+
+	std::vector<uint8_t> msg(data, data + len);
+	msg.push_back(0x80);
+	while (msg.size() % 64 != 56) {
+		msg.push_back(0);
+	}
+	for (int i=7; i >= 0; i--) {
+		msg.push_back((uint64_t)len * 8 >> (i * 8));
+	}
+
+	for (size_t chunk=0; chunk < msg.size(); chunk += 64) {
+		uint32_t w[80];
+		for (int i=0; i < 16; i++) {
+			w[i] = msg[chunk + i*4] << 24 | msg[chunk + i*4 + 1] << 16 | msg[chunk + i*4 + 2] << 8 | msg[chunk + i*4 + 3];
+		}
+		for (int i=16; i < 80; i++) {
+			w[i] = rol(w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16], 1);
+		}
+
+		uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+		for (int i=0; i < 80; i++) {
+			uint32_t f, k;
+			if (i < 20) {
+				f = (b & c) | (~b & d);
+				k = 0x5A827999;
+			} else if (i < 40) {
+				f = b ^ c ^ d;
+				k = 0x6ED9EBA1;
+			} else if (i < 60) {
+				f = (b & c) | (b & d) | (c & d);
+				k = 0x8F1BBCDC;
+			} else {
+				f = b ^ c ^ d;
+				k = 0xCA62C1D6;
+			}
+
+			uint32_t temp = rol(a, 5) + f + e + k + w[i];
+			e = d;
+			d = c;
+			c = rol(b, 30);
+			b = a;
+			a = temp;
+		}
+
+		h[0] += a;
+		h[1] += b;
+		h[2] += c;
+		h[3] += d;
+		h[4] += e;
+	}
+
+	for (int i=0; i < 20; i++) {
+		digest[i] = h[i / 4] >> (24 - (i % 4) * 8);
+	}
+}
+
+static String base64(const uint8_t *data, size_t len) {
+	static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	String encoded;
+
+	for (size_t i=0; i < len; i += 3) {
+		uint32_t n = data[i] << 16 | (i + 1 < len ? data[i+1] << 8 : 0) | (i + 2 < len ? data[i+2] : 0);
+		encoded += alphabet[(n >> 18) & 63];
+		encoded += alphabet[(n >> 12) & 63];
+		encoded += i + 1 < len ? alphabet[(n >> 6) & 63] : '=';
+		encoded += i + 2 < len ? alphabet[n & 63] : '=';
+	}
+
+	return encoded;
+}
+
+static bool recvAll(int fd, uint8_t *buf, size_t len) {
+	while (len > 0) {
+		ssize_t n = recv(fd, buf, len, 0);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			return false;
+		}
+
+		buf += n;
+		len -= n;
+	}
+
+	return true;
+}
+
+IPAddress AsyncWebSocketClient::remoteIP() const {
+	struct sockaddr_in addr = {};
+	socklen_t len = sizeof(addr);
+	if (getpeername(_fd, (struct sockaddr *)&addr, &len) != 0) {
+		return IPAddress();
+	}
+
+	return IPAddress(addr.sin_addr.s_addr);
+}
+
+size_t AsyncWebSocketClient::queueLen() {
+	std::lock_guard<std::mutex> lock(_queueMutex);
+	return _queue.size();
+}
+
+bool AsyncWebSocketClient::queue(uint8_t opcode, const uint8_t *data, size_t len) {
+	std::string frame;
+	frame += (char)(0x80 | opcode);
+	if (len < 126) {
+		frame += (char)len;
+	} else if (len < 65536) {
+		frame += (char)126;
+		frame += (char)(len >> 8);
+		frame += (char)len;
+	} else {
+		frame += (char)127;
+		for (int i=7; i >= 0; i--) {
+			frame += (char)((uint64_t)len >> (i * 8));
+		}
+	}
+	frame.append((const char *)data, len);
+
+	std::lock_guard<std::mutex> lock(_queueMutex);
+	if (_closing) {
+		return false;
+	}
+
+	if (_queue.size() >= WS_MAX_QUEUED_MESSAGES) {
+		ESP_LOGW(TAG, "Too many messages queued for client %u", _id);
+		return false;
+	}
+
+	_closing = opcode == WS_DISCONNECT;
+	_queue.push_back(frame);
+	_queueChanged.notify_one();
+
+	return true;
+}
+
+void AsyncWebSocketClient::text(const char *message, size_t len) {
+	if (_status == WS_CONNECTED) {
+		queue(WS_TEXT, (const uint8_t *)message, len);
+	}
+}
+
+void AsyncWebSocketClient::text(AsyncWebSocketMessageBuffer *buffer) {
+	if (buffer != NULL) {
+		text((const char *)buffer->get(), buffer->length());
+		delete buffer;
+	}
+}
+
+void AsyncWebSocketClient::binary(const uint8_t *message, size_t len) {
+	if (_status == WS_CONNECTED) {
+		queue(WS_BINARY, message, len);
+	}
+}
+
+void AsyncWebSocketClient::ping(const uint8_t *data, size_t len) {
+	if (_status == WS_CONNECTED) {
+		queue(WS_PING, data, len);
+	}
+}
+
+void AsyncWebSocketClient::close(uint16_t code, const char *message) {
+	if (_status != WS_CONNECTED) {
+		return;
+	}
+
+	_status = WS_DISCONNECTING;
+	std::string payload;
+	if (code != 0) {
+		payload += (char)(code >> 8);
+		payload += (char)code;
+		if (message != NULL) {
+			payload += message;
+		}
+	}
+
+	queue(WS_DISCONNECT, (const uint8_t *)payload.data(), payload.length());
+}
+
+void AsyncWebSocketClient::writeLoop() {
+	pthread_setname_np(pthread_self(), "ws_writer");
+	std::unique_lock<std::mutex> lock(_queueMutex);
+
+	while (true) {
+		_queueChanged.wait(lock, [this]() { return !_queue.empty() || _status == WS_DISCONNECTED; });
+		if (_status == WS_DISCONNECTED) {
+			return;
+		}
+
+		std::string frame = _queue.front();
+		_queue.pop_front();
+		lock.unlock();
+
+		bool sent = socketSendAll(_fd, frame.data(), frame.length());
+		if (!sent || (uint8_t)frame[0] == (0x80 | WS_DISCONNECT)) {
+			// The reader sees the connection end, and tidies up
+			shutdown(_fd, SHUT_RDWR);
+		}
+
+		lock.lock();
+	}
+}
+
+bool AsyncWebSocketClient::readFrame(AwsFrameInfo &info, std::vector<uint8_t> &payload) {
+	uint8_t head[2];
+	if (!recvAll(_fd, head, 2)) {
+		return false;
+	}
+
+	info.final = (head[0] & 0x80) != 0;
+	info.opcode = head[0] & 0x0f;
+	info.masked = (head[1] & 0x80) != 0;
+	info.len = head[1] & 0x7f;
+
+	uint8_t ext[8];
+	if (info.len == 126) {
+		if (!recvAll(_fd, ext, 2)) {
+			return false;
+		}
+		info.len = ext[0] << 8 | ext[1];
+	} else if (info.len == 127) {
+		if (!recvAll(_fd, ext, 8)) {
+			return false;
+		}
+		info.len = 0;
+		for (int i=0; i < 8; i++) {
+			info.len = info.len << 8 | ext[i];
+		}
+	}
+
+	if (info.len > MAX_FRAME_LENGTH) {
+		ESP_LOGE(TAG, "Frame of %llu bytes from client %u is too long", (unsigned long long)info.len, _id);
+		return false;
+	}
+
+	if (info.masked && !recvAll(_fd, info.mask, 4)) {
+		return false;
+	}
+
+	// One spare byte, handlers put a terminator there
+	payload.assign(info.len + 1, 0);
+	if (!recvAll(_fd, payload.data(), info.len)) {
+		return false;
+	}
+
+	if (info.masked) {
+		for (uint64_t i=0; i < info.len; i++) {
+			payload[i] ^= info.mask[i % 4];
+		}
+	}
+
+	return true;
+}
+
+void AsyncWebSocketClient::run(const String &accept) {
+	pthread_setname_np(pthread_self(), "async_tcp");
+
+	String response = String("HTTP/1.1 101 Switching Protocols\r\n"
+		"Upgrade: websocket\r\n"
+		"Connection: Upgrade\r\n"
+		"Sec-WebSocket-Accept: ") + accept + "\r\n\r\n";
+
+	if (!socketSendAll(_fd, response.c_str(), response.length())) {
+		_status = WS_DISCONNECTED;
+		::close(_fd);
+		_finished = true;
+		return;
+	}
+
+	std::thread writer(&AsyncWebSocketClient::writeLoop, this);
+	{
+		std::lock_guard<std::recursive_mutex> lock(asyncTcpMutex);
+		_server->event(this, WS_EVT_CONNECT, NULL, NULL, 0);
+	}
+
+	AwsFrameInfo info = {};
+	std::vector<uint8_t> payload;
+	uint8_t messageOpcode = WS_TEXT;
+	uint64_t messageIndex = 0;
+	uint32_t num = 0;
+
+	while (readFrame(info, payload)) {
+		if (info.opcode == WS_PING) {
+			queue(WS_PONG, payload.data(), info.len);
+		} else if (info.opcode == WS_PONG) {
+			std::lock_guard<std::recursive_mutex> lock(asyncTcpMutex);
+			_server->event(this, WS_EVT_PONG, NULL, payload.data(), info.len);
+		} else if (info.opcode == WS_DISCONNECT) {
+			close();
+		} else {
+			if (info.opcode != WS_CONTINUATION) {
+				messageOpcode = info.opcode;
+				messageIndex = 0;
+			}
+
+			info.message_opcode = messageOpcode;
+			info.index = messageIndex;
+			info.num = num;
+			messageIndex += info.len;
+			if (info.final) {
+				num++;
+			}
+
+			std::lock_guard<std::recursive_mutex> lock(asyncTcpMutex);
+			_server->event(this, WS_EVT_DATA, &info, payload.data(), info.len);
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(_queueMutex);
+		_status = WS_DISCONNECTED;
+		_closing = true;
+		_queueChanged.notify_one();
+	}
+	writer.join();
+
+	{
+		std::lock_guard<std::recursive_mutex> lock(asyncTcpMutex);
+		_server->event(this, WS_EVT_DISCONNECT, NULL, NULL, 0);
+	}
+
+	::close(_fd);
+	_finished = true;
+}
+
+size_t AsyncWebSocket::count() {
+	std::lock_guard<std::mutex> lock(_clientsMutex);
+	size_t n = 0;
+	for (AsyncWebSocketClient *client : _clients) {
+		if (client->status() == WS_CONNECTED) {
+			n++;
+		}
+	}
+
+	return n;
+}
+
+AsyncWebSocketClient *AsyncWebSocket::client(uint32_t id) {
+	std::lock_guard<std::mutex> lock(_clientsMutex);
+	for (AsyncWebSocketClient *client : _clients) {
+		if (client->id() == id && client->status() == WS_CONNECTED) {
+			return client;
+		}
+	}
+
+	return NULL;
+}
+
+void AsyncWebSocket::cleanupClients(uint16_t maxClients) {
+	std::lock_guard<std::mutex> lock(_clientsMutex);
+	size_t connected = 0;
+
+	for (auto it = _clients.begin(); it != _clients.end();) {
+		if ((*it)->finished()) {
+			delete *it;
+			it = _clients.erase(it);
+		} else {
+			if ((*it)->status() == WS_CONNECTED) {
+				connected++;
+			}
+			++it;
+		}
+	}
+
+	if (connected > maxClients) {
+		for (AsyncWebSocketClient *client : _clients) {
+			if (client->status() == WS_CONNECTED) {
+				client->close();
+				break;
+			}
+		}
+	}
+}
+
+void AsyncWebSocket::textAll(const char *message, size_t len) {
+	std::lock_guard<std::mutex> lock(_clientsMutex);
+	for (AsyncWebSocketClient *client : _clients) {
+		client->text(message, len);
+	}
+}
+
+void AsyncWebSocket::textAll(AsyncWebSocketMessageBuffer *buffer) {
+	if (buffer != NULL) {
+		textAll((const char *)buffer->get(), buffer->length());
+		delete buffer;
+	}
+}
+
+void AsyncWebSocket::pingAll(const uint8_t *data, size_t len) {
+	std::lock_guard<std::mutex> lock(_clientsMutex);
+	for (AsyncWebSocketClient *client : _clients) {
+		client->ping(data, len);
+	}
+}
+
+void AsyncWebSocket::closeAll(uint16_t code, const char *message) {
+	std::lock_guard<std::mutex> lock(_clientsMutex);
+	for (AsyncWebSocketClient *client : _clients) {
+		client->close(code, message);
+	}
+}
+
+bool AsyncWebSocket::canHandle(AsyncWebServerRequest *request) {
+	return _enabled && request->method() == HTTP_GET && request->url() == _url &&
+		request->header("Upgrade").equalsIgnoreCase("websocket");
+}
+
+void AsyncWebSocket::handleRequest(AsyncWebServerRequest *request) {
+	String key = request->header("Sec-WebSocket-Key");
+	if (key.length() == 0) {
+		request->send(400);
+		return;
+	}
+
+	uint8_t digest[20];
+	String accept = key + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+	sha1((const uint8_t *)accept.c_str(), accept.length(), digest);
+	accept = base64(digest, sizeof(digest));
+
+	AsyncWebSocketClient *client;
+	{
+		std::lock_guard<std::mutex> lock(_clientsMutex);
+		client = new AsyncWebSocketClient(this, request->fd(), _nextId++);
+		_clients.push_back(client);
+	}
+
+	request->takeOver([client, accept]() { client->run(accept); });
+}
+
+void AsyncWebSocket::event(AsyncWebSocketClient *client, AwsEventType type, void *arg, uint8_t *data, size_t len) {
+	if (_eventHandler) {
+		_eventHandler(this, client, type, arg, data, len);
+	}
+}
@@ -0,0 +1,136 @@
+#ifndef _ASYNCWEBSOCKET_H
+#define _ASYNCWEBSOCKET_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include "ESPAsyncWebServer.h"
+
+#ifndef WS_MAX_QUEUED_MESSAGES
+#define WS_MAX_QUEUED_MESSAGES 32
+#endif
+
+#ifndef DEFAULT_MAX_WS_CLIENTS
+#define DEFAULT_MAX_WS_CLIENTS 8
+#endif
+
+typedef enum { WS_DISCONNECTED, WS_CONNECTED, WS_DISCONNECTING } AwsClientStatus;
+typedef enum { WS_CONTINUATION, WS_TEXT, WS_BINARY, WS_DISCONNECT = 0x08, WS_PING, WS_PONG } AwsFrameType;
+typedef enum { WS_EVT_CONNECT, WS_EVT_DISCONNECT, WS_EVT_PONG, WS_EVT_ERROR, WS_EVT_DATA } AwsEventType;
+
+typedef struct {
+	uint8_t message_opcode;		// Of the message this frame is part of
+	uint32_t num;
+	uint8_t final;
+	uint8_t masked;
+	uint8_t opcode;
+	uint64_t len;
+	uint8_t mask[4];
+	uint64_t index;				// Of the first byte of this frame in the message
+} AwsFrameInfo;
+
+class AsyncWebSocket;
+
+class AsyncWebSocketMessageBuffer {
+public:
+	AsyncWebSocketMessageBuffer(size_t size) : _data(size + 1, 0), _len(size) {}
+
+	uint8_t *get() { return _data.data(); }
+	size_t length() const { return _len; }
+
+private:
+	std::vector<uint8_t> _data;
+	size_t _len;
+};
+
+/*
+ * Messages are queued and written by a thread of the client's own, so a slow
+ * client fills its queue rather than holding up the sender. Past
+ * WS_MAX_QUEUED_MESSAGES they are dropped, as on the ESP32.
+ */
+class AsyncWebSocketClient {
+public:
+	AsyncWebSocketClient(AsyncWebSocket *server, int fd, uint32_t id) : _server(server), _fd(fd), _id(id) {}
+
+	uint32_t id() const { return _id; }
+	AsyncWebSocket *server() const { return _server; }
+	AwsClientStatus status() const { return _status; }
+	IPAddress remoteIP() const;
+
+	size_t queueLen();
+	bool queueIsFull() { return queueLen() >= WS_MAX_QUEUED_MESSAGES; }
+	bool canSend() { return !queueIsFull(); }
+
+	void text(const char *message, size_t len);
+	void text(const char *message) { text(message, strlen(message)); }
+	void text(const String &message) { text(message.c_str(), message.length()); }
+	void text(AsyncWebSocketMessageBuffer *buffer);
+	void binary(const uint8_t *message, size_t len);
+	void ping(const uint8_t *data = NULL, size_t len = 0);
+	void close(uint16_t code = 0, const char *message = NULL);
+
+	// Internal: runs the connection on the thread that accepted it
+	void run(const String &accept);
+	bool finished() const { return _finished; }
+
+private:
+	bool queue(uint8_t opcode, const uint8_t *data, size_t len);
+	void writeLoop();
+	bool readFrame(AwsFrameInfo &info, std::vector<uint8_t> &payload);
+
+	AsyncWebSocket *_server;
+	int _fd;
+	uint32_t _id;
+	volatile AwsClientStatus _status = WS_CONNECTED;
+	volatile bool _finished = false;
+
+	std::mutex _queueMutex;
+	std::condition_variable _queueChanged;
+	std::deque<std::string> _queue;
+	bool _closing = false;
+};
+
+typedef std::function<void(AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType type, void *arg, uint8_t *data, size_t len)> AwsEventHandler;
+
+class AsyncWebSocket : public AsyncWebHandler {
+public:
+	AsyncWebSocket(const String &url) : _url(url) {}
+
+	const char *url() const { return _url.c_str(); }
+	void enable(bool e) { _enabled = e; }
+	bool enabled() const { return _enabled; }
+	void onEvent(AwsEventHandler handler) { _eventHandler = handler; }
+
+	size_t count();
+	AsyncWebSocketClient *client(uint32_t id);
+	bool hasClient(uint32_t id) { return client(id) != NULL; }
+
+	// Closes the oldest clients past maxClients, and frees those that have gone
+	void cleanupClients(uint16_t maxClients = DEFAULT_MAX_WS_CLIENTS);
+
+	AsyncWebSocketMessageBuffer *makeBuffer(size_t size = 0) { return new AsyncWebSocketMessageBuffer(size); }
+	void textAll(const char *message, size_t len);
+	void textAll(const char *message) { textAll(message, strlen(message)); }
+	void textAll(const String &message) { textAll(message.c_str(), message.length()); }
+	void textAll(AsyncWebSocketMessageBuffer *buffer);
+	void pingAll(const uint8_t *data = NULL, size_t len = 0);
+	void closeAll(uint16_t code = 0, const char *message = NULL);
+
+	virtual bool canHandle(AsyncWebServerRequest *request);
+	virtual void handleRequest(AsyncWebServerRequest *request);
+
+	// Internal: called by clients, with asyncTcpMutex held
+	void event(AsyncWebSocketClient *client, AwsEventType type, void *arg, uint8_t *data, size_t len);
+
+private:
+	String _url;
+	bool _enabled = true;
+	AwsEventHandler _eventHandler;
+	uint32_t _nextId = 1;
+
+	std::mutex _clientsMutex;
+	std::list<AsyncWebSocketClient *> _clients;
+};
+
+#endif
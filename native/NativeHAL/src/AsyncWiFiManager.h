@@ -0,0 +1,60 @@
+#ifndef _ASYNC_WIFI_MANAGER_H
+#define _ASYNC_WIFI_MANAGER_H
+
+#include <functional>
+#include "Arduino.h"
+#include "WiFi.h"
+#include "DNSServer.h"
+#include "ESPAsyncWebServer.h"
+
+class AsyncWiFiManagerParameter {
+public:
+	AsyncWiFiManagerParameter(const char *id, const char *placeholder, const char *defaultValue, int length) :
+		id(id), placeholder(placeholder), value(defaultValue), length(length) {}
+
+	const char *getID() const { return id.c_str(); }
+	const char *getPlaceholder() const { return placeholder.c_str(); }
+	const char *getValue() const { return value.c_str(); }
+	int getValueLength() const { return length; }
+
+private:
+	String id;
+	String placeholder;
+	String value;
+	int length;
+};
+
+/*
+ * WiFi is always up, so start() reports a connection straight away and there
+ * is never a portal. Parameters are never saved.
+ */
+class AsyncWiFiManager {
+public:
+	AsyncWiFiManager(AsyncWebServer *server, DNSServer *dns) {}
+
+	void setDebugOutput(bool debug) {}
+	void setHostname(const char *hostname) { WiFi.setHostname(hostname); }
+	void setCustomOptionsHTML(const char *html) {}
+	void addParameter(AsyncWiFiManagerParameter *p) {}
+	void setSaveConfigCallback(std::function<void()> callback) {}
+	void setConnectedCallback(std::function<void()> callback) { connectedCallback = callback; }
+	void setConnectTimeout(unsigned long timeout) {}
+	void setAPCallback(std::function<void(AsyncWiFiManager *)> callback) {}
+	void setAPCredentials(const char *ssid, const char *password) {}
+
+	void start() {
+		if (connectedCallback) {
+			connectedCallback();
+		}
+	}
+
+	void loop() {}
+	bool isAP() { return false; }
+	void startConfigPortal(const char *ssid, const char *password) {}
+	void stopConfigPortal() {}
+
+private:
+	std::function<void()> connectedCallback;
+};
+
+#endif
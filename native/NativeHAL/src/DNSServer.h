@@ -0,0 +1,13 @@
+#ifndef _DNSSERVER_H
+#define _DNSSERVER_H
+
+#include "Arduino.h"
+
+class DNSServer {
+public:
+	bool start(uint16_t port, const String &domainName, const IPAddress &resolvedIP) { return true; }
+	void stop() {}
+	void processNextRequest() {}
+};
+
+#endif
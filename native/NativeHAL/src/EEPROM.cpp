@@ -0,0 +1,107 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "WString.h"
+#include "EEPROM.h"
+#include "esp_log.h"
+
+static const char *TAG = "eeprom";
+
+EEPROMClass EEPROM;
+
+static const char *eepromPath() {
+	const char *path = getenv("TIMEFLIES_EEPROM");
+	return path == NULL ? "eeprom.bin" : path;
+}
+
+bool EEPROMClass::begin(size_t size) {
+	if (size == 0) {
+		return false;
+	}
+
+	end();
+	data = (uint8_t *)malloc(size);
+	if (data == NULL) {
+		ESP_LOGE(TAG, "Not enough memory for %u bytes", (unsigned)size);
+		return false;
+	}
+
+	// An erased flash page reads as all ones
+	memset(data, 0xff, size);
+	this->size = size;
+
+	FILE *f = fopen(eepromPath(), "rb");
+	if (f != NULL) {
+		size_t n = fread(data, 1, size, f);
+		fclose(f);
+		ESP_LOGI(TAG, "Read %u bytes from %s", (unsigned)n, eepromPath());
+	}
+
+	return true;
+}
+
+void EEPROMClass::end() {
+	if (data != NULL) {
+		commit();
+		free(data);
+	}
+
+	data = NULL;
+	size = 0;
+}
+
+void EEPROMClass::write(int address, uint8_t val) {
+	if (address >= 0 && (size_t)address < size && data[address] != val) {
+		data[address] = val;
+		dirty = true;
+	}
+}
+
+size_t EEPROMClass::readBytes(int address, void *value, size_t len) {
+	if (address < 0 || address + len > size) {
+		return 0;
+	}
+
+	memcpy(value, data + address, len);
+	return len;
+}
+
+size_t EEPROMClass::writeBytes(int address, const void *value, size_t len) {
+	if (address < 0 || address + len > size) {
+		return 0;
+	}
+
+	if (memcmp(data + address, value, len) != 0) {
+		memcpy(data + address, value, len);
+		dirty = true;
+	}
+
+	return len;
+}
+
+bool EEPROMClass::commit() {
+	if (data == NULL) {
+		return false;
+	}
+
+	if (!dirty) {
+		return true;
+	}
+
+	// Write then rename, so a kill part way through leaves the old contents
+	String tmp = String(eepromPath()) + ".tmp";
+	FILE *f = fopen(tmp.c_str(), "wb");
+	if (f == NULL) {
+		ESP_LOGE(TAG, "Failed to open %s", tmp.c_str());
+		return false;
+	}
+
+	bool ok = fwrite(data, 1, size, f) == size;
+	ok = fclose(f) == 0 && ok;
+	if (!ok || rename(tmp.c_str(), eepromPath()) != 0) {
+		ESP_LOGE(TAG, "Failed to write %s", eepromPath());
+		return false;
+	}
+
+	dirty = false;
+	return true;
+}
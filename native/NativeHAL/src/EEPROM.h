@@ -0,0 +1,47 @@
+#ifndef _EEPROM_H
+#define _EEPROM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+/*
+ * Kept in RAM and written to the file named by TIMEFLIES_EEPROM (eeprom.bin by
+ * default) on commit(), so settings survive a restart like they do on the ESP32.
+ */
+class EEPROMClass {
+public:
+	~EEPROMClass() { end(); }
+
+	bool begin(size_t size);
+	void end();
+	bool commit();
+
+	uint8_t read(int address) { return address >= 0 && (size_t)address < size ? data[address] : 0; }
+	void write(int address, uint8_t val);
+
+	size_t readBytes(int address, void *value, size_t len);
+	size_t writeBytes(int address, const void *value, size_t len);
+
+	template<typename T> T &get(int address, T &t) {
+		readBytes(address, &t, sizeof(T));
+		return t;
+	}
+
+	template<typename T> const T &put(int address, const T &t) {
+		writeBytes(address, &t, sizeof(T));
+		return t;
+	}
+
+	uint8_t *getDataPtr() { dirty = true; return data; }
+	uint16_t length() { return size; }
+
+private:
+	uint8_t *data = NULL;
+	size_t size = 0;
+	bool dirty = false;
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
@@ -0,0 +1,654 @@
+#include <errno.h>
+#include <unistd.h>
+#include <thread>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "ESPAsyncWebServer.h"
+#include "NativeSocket.h"
+#include "WiFi.h"
+#include "esp_log.h"
+
+#define MAX_HEAD_LENGTH 8192
+#define MAX_BODY_LENGTH 65536
+#define CHUNK_SIZE 1460
+
+static const char *TAG = "webserver";
+
+std::recursive_mutex asyncTcpMutex;
+
+bool socketSendAll(int fd, const void *data, size_t len) {
+	const uint8_t *p = (const uint8_t *)data;
+	while (len > 0) {
+		ssize_t n = ::send(fd, p, len, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+
+		if (n <= 0) {
+			return false;
+		}
+
+		p += n;
+		len -= n;
+	}
+
+	return true;
+}
+
+static String urlDecode(const String &s) {
+	String decoded;
+	decoded.reserve(s.length());
+
+	for (unsigned int i=0; i < s.length(); i++) {
+		char c = s[i];
+		if (c == '+') {
+			decoded += ' ';
+		} else if (c == '%' && i + 2 < s.length()) {
+			char hex[3] = { s[i+1], s[i+2], 0 };
+			decoded += (char)strtol(hex, NULL, 16);
+			i += 2;
+		} else {
+			decoded += c;
+		}
+	}
+
+	return decoded;
+}
+
+bool ON_STA_FILTER(AsyncWebServerRequest *request) {
+	return (WiFi.getMode() & WIFI_MODE_STA) != 0;
+}
+
+bool ON_AP_FILTER(AsyncWebServerRequest *request) {
+	return (WiFi.getMode() & WIFI_MODE_AP) != 0;
+}
+
+const char *AsyncWebServerResponse::responseCodeToString(int code) {
+	switch (code) {
+	case 101: return "Switching Protocols";
+	case 200: return "OK";
+	case 204: return "No Content";
+	case 301: return "Moved Permanently";
+	case 302: return "Found";
+	case 304: return "Not Modified";
+	case 400: return "Bad Request";
+	case 403: return "Forbidden";
+	case 404: return "Not Found";
+	case 405: return "Method Not Allowed";
+	case 413: return "Request Entity Too Large";
+	case 500: return "Internal Server Error";
+	case 503: return "Service Unavailable";
+	default: return "";
+	}
+}
+
+bool AsyncWebServerResponse::sendHead(int fd, bool chunked) {
+	String head = String("HTTP/1.1 ") + _code + " " + responseCodeToString(_code) + "\r\n";
+	if (_contentType.length() > 0) {
+		head += String("Content-Type: ") + _contentType + "\r\n";
+	}
+
+	if (chunked) {
+		head += "Transfer-Encoding: chunked\r\n";
+	} else {
+		head += String("Content-Length: ") + (unsigned long)_contentLength + "\r\n";
+	}
+
+	for (const AsyncWebHeader &header : _headers) {
+		head += header.name() + ": " + header.value() + "\r\n";
+	}
+	head += "Connection: close\r\n\r\n";
+
+	return socketSendAll(fd, head.c_str(), head.length());
+}
+
+bool AsyncWebServerResponse::send(int fd) {
+	return sendHead(fd, false);
+}
+
+AsyncBasicResponse::AsyncBasicResponse(int code, const String &contentType, const String &content) :
+		AsyncWebServerResponse(code, contentType), _content(content) {
+	if (_content.length() > 0 && _contentType.length() == 0) {
+		_contentType = "text/plain";
+	}
+	_contentLength = _content.length();
+}
+
+bool AsyncBasicResponse::send(int fd) {
+	return sendHead(fd, false) && socketSendAll(fd, _content.c_str(), _content.length());
+}
+
+String AsyncFileResponse::contentTypeFor(const String &path) {
+	static const char *types[][2] = {
+		{ ".html", "text/html" },
+		{ ".htm", "text/html" },
+		{ ".css", "text/css" },
+		{ ".js", "application/javascript" },
+		{ ".json", "application/json" },
+		{ ".png", "image/png" },
+		{ ".gif", "image/gif" },
+		{ ".jpg", "image/jpeg" },
+		{ ".ico", "image/x-icon" },
+		{ ".svg", "image/svg+xml" },
+		{ ".xml", "text/xml" },
+		{ ".pdf", "application/pdf" },
+		{ ".zip", "application/zip" },
+		{ ".gz", "application/x-gzip" },
+	};
+
+	for (auto &type : types) {
+		if (path.endsWith(type[0])) {
+			return type[1];
+		}
+	}
+
+	return "text/plain";
+}
+
+AsyncFileResponse::AsyncFileResponse(FS &fs, const String &path, const String &contentType, bool download) :
+		AsyncWebServerResponse(200, contentType) {
+	// The web build only ships compressed pages
+	String filePath = path;
+	if (!download && !fs.exists(filePath) && fs.exists(filePath + ".gz")) {
+		filePath += ".gz";
+		addHeader("Content-Encoding", "gzip");
+	}
+
+	if (_contentType.length() == 0) {
+		_contentType = download ? "application/octet-stream" : contentTypeFor(path);
+	}
+
+	if (download) {
+		addHeader("Content-Disposition", String("attachment; filename=\"") + path.substring(path.lastIndexOf('/') + 1) + "\"");
+	}
+
+	_content = fs.open(filePath, FILE_READ);
+	if (!_content || _content.isDirectory()) {
+		_code = 404;
+		_content = File();
+	} else {
+		_contentLength = _content.size();
+	}
+}
+
+bool AsyncFileResponse::send(int fd) {
+	if (!sendHead(fd, false)) {
+		return false;
+	}
+
+	uint8_t buf[CHUNK_SIZE];
+	size_t n;
+	while (_content && (n = _content.read(buf, sizeof(buf))) > 0) {
+		if (!socketSendAll(fd, buf, n)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool AsyncChunkedResponse::send(int fd) {
+	if (!sendHead(fd, true)) {
+		return false;
+	}
+
+	uint8_t buf[CHUNK_SIZE];
+	size_t index = 0;
+	while (true) {
+		size_t n;
+		{
+			std::lock_guard<std::recursive_mutex> lock(asyncTcpMutex);
+			n = _callback(buf, sizeof(buf), index);
+		}
+
+		if (n == RESPONSE_TRY_AGAIN) {
+			delay(1);
+			continue;
+		}
+
+		char size[16];
+		snprintf(size, sizeof(size), "%x\r\n", (unsigned)n);
+		if (!socketSendAll(fd, size, strlen(size)) || !socketSendAll(fd, buf, n) || !socketSendAll(fd, "\r\n", 2)) {
+			return false;
+		}
+
+		if (n == 0) {
+			return true;
+		}
+
+		index += n;
+	}
+}
+
+AsyncResponseStream::AsyncResponseStream(const String &contentType, size_t bufferSize) :
+		AsyncWebServerResponse(200, contentType) {
+	_content.reserve(bufferSize);
+}
+
+size_t AsyncResponseStream::write(const uint8_t *data, size_t len) {
+	_content.append((const char *)data, len);
+	return len;
+}
+
+bool AsyncResponseStream::send(int fd) {
+	_contentLength = _content.length();
+	return sendHead(fd, false) && socketSendAll(fd, _content.data(), _content.length());
+}
+
+AsyncWebServerRequest::~AsyncWebServerRequest() {
+	delete _response;
+}
+
+const char *AsyncWebServerRequest::methodToString() const {
+	switch (_method) {
+	case HTTP_GET: return "GET";
+	case HTTP_POST: return "POST";
+	case HTTP_DELETE: return "DELETE";
+	case HTTP_PUT: return "PUT";
+	case HTTP_PATCH: return "PATCH";
+	case HTTP_HEAD: return "HEAD";
+	case HTTP_OPTIONS: return "OPTIONS";
+	default: return "UNKNOWN";
+	}
+}
+
+void AsyncWebServerRequest::addParams(const String &query, bool form) {
+	int start = 0;
+	while (start < (int)query.length()) {
+		int end = query.indexOf('&', start);
+		if (end < 0) {
+			end = query.length();
+		}
+
+		String pair = query.substring(start, end);
+		int equals = pair.indexOf('=');
+		if (pair.length() > 0) {
+			if (equals < 0) {
+				_params.push_back(AsyncWebParameter(urlDecode(pair), "", form));
+			} else {
+				_params.push_back(AsyncWebParameter(urlDecode(pair.substring(0, equals)), urlDecode(pair.substring(equals + 1)), form));
+			}
+		}
+
+		start = end + 1;
+	}
+}
+
+bool AsyncWebServerRequest::parse() {
+	std::string in;
+	size_t headEnd;
+	char buf[1024];
+
+	while ((headEnd = in.find("\r\n\r\n")) == std::string::npos) {
+		if (in.length() > MAX_HEAD_LENGTH) {
+			return false;
+		}
+
+		ssize_t n = recv(_fd, buf, sizeof(buf), 0);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			return false;
+		}
+		in.append(buf, n);
+	}
+
+	String head(in.c_str(), headEnd);
+	_body = in.substr(headEnd + 4);
+
+	int lineEnd = head.indexOf("\r\n");
+	String requestLine = lineEnd < 0 ? head : head.substring(0, lineEnd);
+	int space1 = requestLine.indexOf(' ');
+	int space2 = requestLine.indexOf(' ', space1 + 1);
+	if (space1 < 0 || space2 < 0) {
+		return false;
+	}
+
+	String method = requestLine.substring(0, space1);
+	static const WebRequestMethod methods[] = { HTTP_GET, HTTP_POST, HTTP_DELETE, HTTP_PUT, HTTP_PATCH, HTTP_HEAD, HTTP_OPTIONS };
+	for (WebRequestMethod m : methods) {
+		_method = m;
+		if (method == methodToString()) {
+			break;
+		}
+		_method = 0;
+	}
+
+	String target = requestLine.substring(space1 + 1, space2);
+	int question = target.indexOf('?');
+	_url = urlDecode(question < 0 ? target : target.substring(0, question));
+	if (question >= 0) {
+		addParams(target.substring(question + 1), false);
+	}
+
+	while (lineEnd >= 0) {
+		int next = head.indexOf("\r\n", lineEnd + 2);
+		String line = head.substring(lineEnd + 2, next < 0 ? head.length() : next);
+		int colon = line.indexOf(':');
+		if (colon > 0) {
+			String value = line.substring(colon + 1);
+			value.trim();
+			_headers.push_back(AsyncWebHeader(line.substring(0, colon), value));
+		}
+		lineEnd = next;
+	}
+
+	String host = header("Host");
+	_host = host.indexOf(':') < 0 ? host : host.substring(0, host.indexOf(':'));
+
+	size_t length = header("Content-Length").toInt();
+	if (length > MAX_BODY_LENGTH) {
+		return false;
+	}
+
+	while (_body.length() < length) {
+		ssize_t n = recv(_fd, buf, std::min(sizeof(buf), length - _body.length()), 0);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			return false;
+		}
+		_body.append(buf, n);
+	}
+
+	if (header("Content-Type").startsWith("application/x-www-form-urlencoded")) {
+		addParams(String(_body.c_str()), true);
+	}
+
+	return true;
+}
+
+const AsyncWebHeader *AsyncWebServerRequest::getHeader(const String &name) const {
+	for (const AsyncWebHeader &header : _headers) {
+		if (header.name().equalsIgnoreCase(name)) {
+			return &header;
+		}
+	}
+
+	return NULL;
+}
+
+String AsyncWebServerRequest::header(const char *name) const {
+	const AsyncWebHeader *header = getHeader(name);
+	return header == NULL ? String() : header->value();
+}
+
+const AsyncWebParameter *AsyncWebServerRequest::getParam(const String &name, bool post) const {
+	for (const AsyncWebParameter &param : _params) {
+		if (param.name() == name && param.isPost() == post) {
+			return &param;
+		}
+	}
+
+	return NULL;
+}
+
+const AsyncWebParameter *AsyncWebServerRequest::getParam(size_t num) const {
+	for (const AsyncWebParameter &param : _params) {
+		if (num-- == 0) {
+			return &param;
+		}
+	}
+
+	return NULL;
+}
+
+const String &AsyncWebServerRequest::arg(const String &name) const {
+	static const String empty;
+	const AsyncWebParameter *param = getParam(name, false);
+	if (param == NULL) {
+		param = getParam(name, true);
+	}
+
+	return param == NULL ? empty : param->value();
+}
+
+void AsyncWebServerRequest::send(AsyncWebServerResponse *response) {
+	if (_response != NULL) {
+		ESP_LOGW(TAG, "%s %s answered twice", methodToString(), _url.c_str());
+		delete response;
+		return;
+	}
+
+	_response = response;
+}
+
+void AsyncWebServerRequest::send(int code, const String &contentType, const String &content) {
+	send(beginResponse(code, contentType, content));
+}
+
+void AsyncWebServerRequest::send(FS &fs, const String &path, const String &contentType, bool download) {
+	if (fs.exists(path) || (!download && fs.exists(path + ".gz"))) {
+		send(beginResponse(fs, path, contentType, download));
+	} else {
+		send(404);
+	}
+}
+
+void AsyncWebServerRequest::redirect(const String &url) {
+	AsyncWebServerResponse *response = beginResponse(302);
+	response->addHeader("Location", url);
+	send(response);
+}
+
+AsyncWebServerResponse *AsyncWebServerRequest::beginResponse(int code, const String &contentType, const String &content) {
+	return new AsyncBasicResponse(code, contentType, content);
+}
+
+AsyncWebServerResponse *AsyncWebServerRequest::beginResponse(FS &fs, const String &path, const String &contentType, bool download) {
+	return new AsyncFileResponse(fs, path, contentType, download);
+}
+
+AsyncWebServerResponse *AsyncWebServerRequest::beginChunkedResponse(const String &contentType, AwsResponseFiller callback) {
+	return new AsyncChunkedResponse(contentType, callback);
+}
+
+AsyncResponseStream *AsyncWebServerRequest::beginResponseStream(const String &contentType, size_t bufferSize) {
+	return new AsyncResponseStream(contentType, bufferSize);
+}
+
+bool AsyncCallbackWebHandler::canHandle(AsyncWebServerRequest *request) {
+	if (!_onRequest || !(_method & request->method())) {
+		return false;
+	}
+
+	if (_uri.length() > 0 && _uri.endsWith("*")) {
+		return request->url().startsWith(_uri.substring(0, _uri.length() - 1));
+	}
+
+	return _uri.length() == 0 || _uri == request->url() || request->url().startsWith(_uri + "/");
+}
+
+void AsyncCallbackWebHandler::handleRequest(AsyncWebServerRequest *request) {
+	_onRequest(request);
+}
+
+AsyncStaticWebHandler::AsyncStaticWebHandler(const char *uri, FS &fs, const char *path, const char *cacheControl) :
+		_uri(uri), _fs(fs), _path(path), _cacheControl(cacheControl == NULL ? "" : cacheControl) {
+	if (_uri.endsWith("/")) {
+		_uri.remove(_uri.length() - 1);
+	}
+	if (_path.endsWith("/")) {
+		_path.remove(_path.length() - 1);
+	}
+}
+
+String AsyncStaticWebHandler::filePath(AsyncWebServerRequest *request) {
+	String path = _path + request->url().substring(_uri.length());
+	if (path.length() == 0 || path.endsWith("/")) {
+		path += (path.endsWith("/") ? "" : "/") + _defaultFile;
+	}
+
+	return path;
+}
+
+bool AsyncStaticWebHandler::canHandle(AsyncWebServerRequest *request) {
+	if (!(request->method() & (HTTP_GET | HTTP_HEAD)) || !request->url().startsWith(_uri)) {
+		return false;
+	}
+
+	String path = filePath(request);
+	File file = _fs.open(path, FILE_READ);
+	if (!file) {
+		file = _fs.open(path + ".gz", FILE_READ);
+	}
+
+	return file && !file.isDirectory();
+}
+
+void AsyncStaticWebHandler::handleRequest(AsyncWebServerRequest *request) {
+	AsyncWebServerResponse *response = new AsyncFileResponse(_fs, filePath(request));
+	if (_cacheControl.length() > 0) {
+		response->addHeader("Cache-Control", _cacheControl);
+	}
+
+	request->send(response);
+}
+
+AsyncWebServer::~AsyncWebServer() {
+	end();
+	reset();
+}
+
+AsyncWebHandler &AsyncWebServer::addHandler(AsyncWebHandler *handler) {
+	std::lock_guard<std::recursive_mutex> lock(asyncTcpMutex);
+	_handlers.push_back(handler);
+	return *handler;
+}
+
+AsyncCallbackWebHandler &AsyncWebServer::on(const char *uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest) {
+	AsyncCallbackWebHandler *handler = new AsyncCallbackWebHandler(uri, method, onRequest);
+	_owned.push_back(handler);
+	addHandler(handler);
+	return *handler;
+}
+
+AsyncStaticWebHandler &AsyncWebServer::serveStatic(const char *uri, FS &fs, const char *path, const char *cacheControl) {
+	AsyncStaticWebHandler *handler = new AsyncStaticWebHandler(uri, fs, path, cacheControl);
+	_owned.push_back(handler);
+	addHandler(handler);
+	return *handler;
+}
+
+void AsyncWebServer::reset() {
+	std::lock_guard<std::recursive_mutex> lock(asyncTcpMutex);
+	for (AsyncWebHandler *handler : _owned) {
+		delete handler;
+	}
+
+	_owned.clear();
+	_handlers.clear();
+	_notFound = NULL;
+}
+
+void AsyncWebServer::begin() {
+	if (_listener >= 0) {
+		return;
+	}
+
+	uint16_t port = _port;
+	const char *env = getenv("TIMEFLIES_HTTP_PORT");
+	if (env != NULL) {
+		port = atoi(env);
+	} else if (port < 1024 && geteuid() != 0) {
+		port += 8000;
+	}
+
+	_listener = socket(AF_INET, SOCK_STREAM, 0);
+	if (_listener < 0) {
+		ESP_LOGE(TAG, "Failed to create socket: %s", strerror(errno));
+		return;
+	}
+
+	int on = 1;
+	setsockopt(_listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+	struct sockaddr_in addr = {};
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(port);
+	if (bind(_listener, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(_listener, 16) != 0) {
+		ESP_LOGE(TAG, "Failed to listen on port %u: %s", port, strerror(errno));
+		close(_listener);
+		_listener = -1;
+		return;
+	}
+
+	ESP_LOGI(TAG, "Listening on http://localhost:%u/", port);
+	std::thread(&AsyncWebServer::acceptLoop, this).detach();
+}
+
+void AsyncWebServer::end() {
+	if (_listener >= 0) {
+		shutdown(_listener, SHUT_RDWR);
+		close(_listener);
+		_listener = -1;
+	}
+}
+
+void AsyncWebServer::acceptLoop() {
+	pthread_setname_np(pthread_self(), "async_tcp");
+
+	while (_listener >= 0) {
+		int fd = accept(_listener, NULL, NULL);
+		if (fd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED) {
+				continue;
+			}
+			break;
+		}
+
+		int on = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+		std::thread(&AsyncWebServer::serve, this, fd).detach();
+	}
+}
+
+void AsyncWebServer::serve(int fd) {
+	pthread_setname_np(pthread_self(), "async_tcp");
+
+	AsyncWebServerRequest request(this, fd);
+	if (!request.parse()) {
+		AsyncBasicResponse(400).send(fd);
+		close(fd);
+		return;
+	}
+
+	{
+		std::lock_guard<std::recursive_mutex> lock(asyncTcpMutex);
+
+		AsyncWebHandler *found = NULL;
+		for (AsyncWebHandler *handler : _handlers) {
+			if (handler->filter(&request) && handler->canHandle(&request)) {
+				found = handler;
+				break;
+			}
+		}
+
+		if (found != NULL) {
+			found->handleRequest(&request);
+		} else if (_notFound) {
+			_notFound(&request);
+		} else {
+			request.send(404);
+		}
+	}
+
+	// A WebSocket keeps the connection, and this thread, for itself
+	if (request.takeover()) {
+		request.takeover()();
+		return;
+	}
+
+	if (request.response() == NULL) {
+		ESP_LOGE(TAG, "%s %s wasn't answered", request.methodToString(), request.url().c_str());
+		request.send(500);
+	}
+
+	request.response()->send(fd);
+	shutdown(fd, SHUT_WR);
+	close(fd);
+}
@@ -0,0 +1,276 @@
+#ifndef _ESPASYNCWEBSERVER_H
+#define _ESPASYNCWEBSERVER_H
+
+#include <functional>
+#include <list>
+#include <vector>
+#include <string>
+#include "Arduino.h"
+#include "FS.h"
+#include "WiFi.h"
+
+/*
+ * The parts of ESPAsyncWebServer the bridge uses, over blocking POSIX sockets.
+ * Each connection gets a thread, but handlers and WebSocket events are run
+ * one at a time as they are on the ESP32's single async_tcp task.
+ *
+ * The port is TIMEFLIES_HTTP_PORT if set. Otherwise ports below 1024 get 8000
+ * added unless running as root, so AsyncWebServer(80) listens on 8080.
+ */
+
+#define RESPONSE_TRY_AGAIN 0xFFFFFFFF
+
+typedef enum {
+	HTTP_GET = 0b00000001,
+	HTTP_POST = 0b00000010,
+	HTTP_DELETE = 0b00000100,
+	HTTP_PUT = 0b00001000,
+	HTTP_PATCH = 0b00010000,
+	HTTP_HEAD = 0b00100000,
+	HTTP_OPTIONS = 0b01000000,
+	HTTP_ANY = 0b01111111,
+} WebRequestMethod;
+
+typedef uint8_t WebRequestMethodComposite;
+
+class AsyncWebServer;
+class AsyncWebServerRequest;
+class AsyncWebServerResponse;
+class AsyncResponseStream;
+
+typedef std::function<void(AsyncWebServerRequest *request)> ArRequestHandlerFunction;
+typedef std::function<bool(AsyncWebServerRequest *request)> ArRequestFilterFunction;
+typedef std::function<size_t(uint8_t *buffer, size_t maxLen, size_t index)> AwsResponseFiller;
+
+class AsyncWebParameter {
+public:
+	AsyncWebParameter(const String &name, const String &value, bool form) : _name(name), _value(value), _isForm(form) {}
+
+	const String &name() const { return _name; }
+	const String &value() const { return _value; }
+	bool isPost() const { return _isForm; }
+
+private:
+	String _name;
+	String _value;
+	bool _isForm;
+};
+
+class AsyncWebHeader {
+public:
+	AsyncWebHeader(const String &name, const String &value) : _name(name), _value(value) {}
+
+	const String &name() const { return _name; }
+	const String &value() const { return _value; }
+
+private:
+	String _name;
+	String _value;
+};
+
+class AsyncWebServerResponse {
+public:
+	AsyncWebServerResponse(int code, const String &contentType) : _code(code), _contentType(contentType) {}
+	virtual ~AsyncWebServerResponse() {}
+
+	void setCode(int code) { _code = code; }
+	void setContentLength(size_t len) { _contentLength = len; }
+	void setContentType(const String &type) { _contentType = type; }
+	void addHeader(const String &name, const String &value) { _headers.push_back(AsyncWebHeader(name, value)); }
+
+	// Writes the whole response, false if the connection went away part way through
+	virtual bool send(int fd);
+
+	static const char *responseCodeToString(int code);
+
+protected:
+	bool sendHead(int fd, bool chunked);
+
+	int _code;
+	String _contentType;
+	size_t _contentLength = 0;
+	std::list<AsyncWebHeader> _headers;
+};
+
+class AsyncBasicResponse : public AsyncWebServerResponse {
+public:
+	AsyncBasicResponse(int code, const String &contentType = String(), const String &content = String());
+	virtual bool send(int fd);
+
+private:
+	String _content;
+};
+
+class AsyncFileResponse : public AsyncWebServerResponse {
+public:
+	AsyncFileResponse(FS &fs, const String &path, const String &contentType = String(), bool download = false);
+	virtual bool send(int fd);
+
+	static String contentTypeFor(const String &path);
+
+private:
+	File _content;
+};
+
+class AsyncChunkedResponse : public AsyncWebServerResponse {
+public:
+	AsyncChunkedResponse(const String &contentType, AwsResponseFiller callback) :
+		AsyncWebServerResponse(200, contentType), _callback(callback) {}
+	virtual bool send(int fd);
+
+private:
+	AwsResponseFiller _callback;
+};
+
+class AsyncResponseStream : public AsyncWebServerResponse, public Print {
+public:
+	AsyncResponseStream(const String &contentType, size_t bufferSize);
+	virtual bool send(int fd);
+
+	virtual size_t write(uint8_t data) { return write(&data, 1); }
+	virtual size_t write(const uint8_t *data, size_t len);
+	using Print::write;
+
+private:
+	std::string _content;
+};
+
+class AsyncWebServerRequest {
+public:
+	AsyncWebServerRequest(AsyncWebServer *server, int fd) : _server(server), _fd(fd) {}
+	~AsyncWebServerRequest();
+
+	AsyncWebServer *server() const { return _server; }
+	WebRequestMethodComposite method() const { return _method; }
+	const char *methodToString() const;
+	const String &url() const { return _url; }
+	const String &host() const { return _host; }
+	size_t contentLength() const { return _body.length(); }
+
+	size_t headers() const { return _headers.size(); }
+	bool hasHeader(const String &name) const { return getHeader(name) != NULL; }
+	const AsyncWebHeader *getHeader(const String &name) const;
+	String header(const char *name) const;
+
+	size_t params() const { return _params.size(); }
+	bool hasParam(const String &name, bool post = false) const { return getParam(name, post) != NULL; }
+	const AsyncWebParameter *getParam(const String &name, bool post = false) const;
+	const AsyncWebParameter *getParam(size_t num) const;
+	bool hasArg(const char *name) const { return hasParam(name, false) || hasParam(name, true); }
+	const String &arg(const String &name) const;
+
+	void send(AsyncWebServerResponse *response);
+	void send(int code, const String &contentType = String(), const String &content = String());
+	void send(FS &fs, const String &path, const String &contentType = String(), bool download = false);
+	void redirect(const String &url);
+
+	AsyncWebServerResponse *beginResponse(int code, const String &contentType = String(), const String &content = String());
+	AsyncWebServerResponse *beginResponse(FS &fs, const String &path, const String &contentType = String(), bool download = false);
+	AsyncWebServerResponse *beginChunkedResponse(const String &contentType, AwsResponseFiller callback);
+	AsyncResponseStream *beginResponseStream(const String &contentType, size_t bufferSize = 1460);
+
+	// Internal: parsing, and handing the socket to a WebSocket after the handler returns
+	bool parse();
+	int fd() const { return _fd; }
+	AsyncWebServerResponse *response() { return _response; }
+	void takeOver(std::function<void()> fn) { _takeover = fn; }
+	std::function<void()> &takeover() { return _takeover; }
+
+private:
+	void addParams(const String &query, bool form);
+
+	AsyncWebServer *_server;
+	int _fd;
+	WebRequestMethodComposite _method = 0;
+	String _url;
+	String _host;
+	std::string _body;
+	std::list<AsyncWebHeader> _headers;
+	std::list<AsyncWebParameter> _params;
+	AsyncWebServerResponse *_response = NULL;
+	std::function<void()> _takeover;
+};
+
+bool ON_STA_FILTER(AsyncWebServerRequest *request);
+bool ON_AP_FILTER(AsyncWebServerRequest *request);
+
+class AsyncWebHandler {
+public:
+	virtual ~AsyncWebHandler() {}
+
+	AsyncWebHandler &setFilter(ArRequestFilterFunction fn) { _filter = fn; return *this; }
+	bool filter(AsyncWebServerRequest *request) { return _filter == NULL || _filter(request); }
+
+	virtual bool canHandle(AsyncWebServerRequest *request) { return false; }
+	virtual void handleRequest(AsyncWebServerRequest *request) {}
+
+protected:
+	ArRequestFilterFunction _filter;
+};
+
+class AsyncCallbackWebHandler : public AsyncWebHandler {
+public:
+	AsyncCallbackWebHandler(const String &uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest) :
+		_uri(uri), _method(method), _onRequest(onRequest) {}
+
+	virtual bool canHandle(AsyncWebServerRequest *request);
+	virtual void handleRequest(AsyncWebServerRequest *request);
+
+private:
+	String _uri;
+	WebRequestMethodComposite _method;
+	ArRequestHandlerFunction _onRequest;
+};
+
+// Only claims requests for files that exist, so later handlers see the rest
+class AsyncStaticWebHandler : public AsyncWebHandler {
+public:
+	AsyncStaticWebHandler(const char *uri, FS &fs, const char *path, const char *cacheControl);
+
+	virtual bool canHandle(AsyncWebServerRequest *request);
+	virtual void handleRequest(AsyncWebServerRequest *request);
+
+	AsyncStaticWebHandler &setDefaultFile(const char *filename) { _defaultFile = filename; return *this; }
+	AsyncStaticWebHandler &setCacheControl(const char *cacheControl) { _cacheControl = cacheControl; return *this; }
+
+private:
+	String filePath(AsyncWebServerRequest *request);
+
+	String _uri;
+	FS &_fs;
+	String _path;
+	String _defaultFile = "index.htm";
+	String _cacheControl;
+};
+
+class AsyncWebServer {
+public:
+	AsyncWebServer(uint16_t port) : _port(port) {}
+	~AsyncWebServer();
+
+	void begin();
+	void end();
+
+	AsyncWebHandler &addHandler(AsyncWebHandler *handler);
+	AsyncCallbackWebHandler &on(const char *uri, ArRequestHandlerFunction onRequest) { return on(uri, HTTP_ANY, onRequest); }
+	AsyncCallbackWebHandler &on(const char *uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest);
+	AsyncStaticWebHandler &serveStatic(const char *uri, FS &fs, const char *path, const char *cacheControl = NULL);
+	void onNotFound(ArRequestHandlerFunction fn) { _notFound = fn; }
+	void reset();
+
+	uint16_t port() const { return _port; }
+
+private:
+	void acceptLoop();
+	void serve(int fd);
+
+	uint16_t _port;
+	int _listener = -1;
+	std::vector<AsyncWebHandler *> _handlers;
+	std::vector<AsyncWebHandler *> _owned;
+	ArRequestHandlerFunction _notFound;
+};
+
+#include "AsyncWebSocket.h"
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef _ESPMDNS_H
+#define _ESPMDNS_H
+
+#include "Arduino.h"
+
+// Nothing is advertised, the bridge is found at localhost
+class MDNSResponder {
+public:
+	bool begin(const char *hostName) { return true; }
+	void end() {}
+	bool addService(const char *service, const char *proto, uint16_t port) { return true; }
+	bool addService(const String &service, const String &proto, uint16_t port) { return true; }
+};
+
+extern MDNSResponder MDNS;
+
+#endif
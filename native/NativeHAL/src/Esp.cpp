@@ -0,0 +1,225 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/random.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include <mutex>
+#include <vector>
+#include "Esp.h"
+#include "NativeHAL.h"
+#include "NativeAlloc.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_ota_ops.h"
+#include "esp_image_format.h"
+#include "rom/crc.h"
+
+static const char *TAG = "system";
+
+EspClass ESP;
+
+static int savedArgc = 0;
+static char **savedArgv = NULL;
+static std::mutex shutdownMutex;
+static std::vector<shutdown_handler_t> shutdownHandlers;
+static bool shutDown = false;
+
+void nativeSetArgs(int argc, char **argv) {
+	savedArgc = argc;
+	savedArgv = argv;
+}
+
+void nativeShutdown() {
+	std::lock_guard<std::mutex> lock(shutdownMutex);
+	if (shutDown) {
+		return;
+	}
+
+	shutDown = true;
+	for (shutdown_handler_t handler : shutdownHandlers) {
+		handler();
+	}
+}
+
+uint32_t esp_random() {
+	uint32_t r;
+	esp_fill_random(&r, sizeof(r));
+	return r;
+}
+
+void esp_fill_random(void *buf, size_t len) {
+	if (getrandom(buf, len, 0) != (ssize_t)len) {
+		for (size_t i=0; i < len; i++) {
+			((uint8_t *)buf)[i] = rand();
+		}
+	}
+}
+
+esp_reset_reason_t esp_reset_reason() {
+	const char *reason = getenv("TIMEFLIES_RESET_REASON");
+	return reason == NULL ? ESP_RST_POWERON : (esp_reset_reason_t)atoi(reason);
+}
+
+esp_err_t esp_register_shutdown_handler(shutdown_handler_t handler) {
+	std::lock_guard<std::mutex> lock(shutdownMutex);
+	shutdownHandlers.push_back(handler);
+	return ESP_OK;
+}
+
+void esp_restart() {
+	nativeShutdown();
+	ESP_LOGI(TAG, "Restarting");
+	fflush(NULL);
+
+	char reason[8];
+	snprintf(reason, sizeof(reason), "%d", ESP_RST_SW);
+	setenv("TIMEFLIES_RESET_REASON", reason, 1);
+
+	if (savedArgv != NULL) {
+		execv("/proc/self/exe", savedArgv);
+		ESP_LOGE(TAG, "Failed to restart: %s", strerror(errno));
+	}
+
+	_exit(1);
+}
+
+esp_err_t esp_efuse_mac_get_default(uint8_t *mac) {
+	unsigned int b[6];
+	const char *env = getenv("TIMEFLIES_MAC");
+	if (env != NULL && sscanf(env, "%x:%x:%x:%x:%x:%x", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5]) == 6) {
+		for (int i=0; i < 6; i++) {
+			mac[i] = b[i];
+		}
+		return ESP_OK;
+	}
+
+	// Locally administered, and different for each host
+	char host[64] = "";
+	gethostname(host, sizeof(host) - 1);
+	uint32_t crc = crc32_le(0, (const uint8_t *)host, strlen(host));
+	mac[0] = 0x02;
+	mac[1] = 0x00;
+	memcpy(mac + 2, &crc, 4);
+
+	return ESP_OK;
+}
+
+size_t heap_caps_get_total_size(uint32_t caps) {
+	NativeHeapInfo info;
+	nativeHeapInfo(caps, &info);
+	return info.total;
+}
+
+size_t heap_caps_get_free_size(uint32_t caps) {
+	NativeHeapInfo info;
+	nativeHeapInfo(caps, &info);
+	return info.free;
+}
+
+size_t heap_caps_get_minimum_free_size(uint32_t caps) {
+	NativeHeapInfo info;
+	nativeHeapInfo(caps, &info);
+	return info.minimumFree;
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps) {
+	NativeHeapInfo info;
+	nativeHeapInfo(caps, &info);
+	return info.largestFree;
+}
+
+const esp_partition_t *esp_ota_get_running_partition() {
+	return NULL;
+}
+
+esp_err_t esp_image_verify(esp_image_load_mode_t mode, const esp_partition_pos_t *part, esp_image_metadata_t *data) {
+	data->image_len = 0;
+	return ESP_FAIL;
+}
+
+uint32_t crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len) {
+	crc = ~crc;
+	while (len--) {
+		crc ^= *buf++;
+		for (int i=0; i < 8; i++) {
+			crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+		}
+	}
+
+	return ~crc;
+}
+
+uint32_t esp_log_timestamp() {
+	return esp_timer_get_time() / 1000;
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...) {
+	static const char letters[] = "NEWIDV";
+	static esp_log_level_t limit = ESP_LOG_VERBOSE;
+	static bool checked = false;
+
+	if (!checked) {
+		const char *env = getenv("TIMEFLIES_LOG");
+		const char *found = env == NULL || env[0] == 0 ? NULL : strchr(letters, env[0]);
+		limit = found == NULL ? ESP_LOG_VERBOSE : (esp_log_level_t)(found - letters);
+		checked = true;
+	}
+
+	if (level > limit) {
+		return;
+	}
+
+	va_list args;
+	va_start(args, format);
+	flockfile(stderr);
+	fprintf(stderr, "%c (%lu) %s: ", letters[level], (unsigned long)esp_log_timestamp(), tag);
+	vfprintf(stderr, format, args);
+	fputc('\n', stderr);
+	funlockfile(stderr);
+	va_end(args);
+}
+
+// As the Arduino core has them, IRAM included
+uint32_t EspClass::getHeapSize() {
+	return heap_caps_get_total_size(MALLOC_CAP_INTERNAL);
+}
+
+uint32_t EspClass::getFreeHeap() {
+	return heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+}
+
+uint32_t EspClass::getMinFreeHeap() {
+	return heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL);
+}
+
+uint32_t EspClass::getMaxAllocHeap() {
+	return heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL);
+}
+
+uint32_t EspClass::getCycleCount() {
+#if defined(__x86_64__) || defined(__i386__)
+	return (uint32_t)__rdtsc();
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint32_t)(ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+#endif
+}
+
+uint64_t EspClass::getEfuseMac() {
+	uint64_t mac = 0;
+	esp_efuse_mac_get_default((uint8_t *)&mac);
+	return mac;
+}
+
+void EspClass::restart() {
+	esp_restart();
+}
@@ -0,0 +1,30 @@
+#ifndef _ESP_H
+#define _ESP_H
+
+#include <stdint.h>
+
+typedef enum {
+	SKETCH_SIZE_TOTAL = 0,
+	SKETCH_SIZE_FREE = 1
+} sketchSize_t;
+
+class EspClass {
+public:
+	uint32_t getHeapSize();
+	uint32_t getFreeHeap();
+	uint32_t getMinFreeHeap();
+	uint32_t getMaxAllocHeap();
+
+	uint8_t getChipRevision() { return 3; }
+	const char *getChipModel() { return "native"; }
+	uint32_t getCpuFreqMHz() { return 240; }
+	const char *getSdkVersion() { return "native"; }
+	uint32_t getCycleCount();	// The TSC on x86, otherwise nanoseconds
+	uint64_t getEfuseMac();
+
+	void restart() __attribute__((noreturn));
+};
+
+extern EspClass ESP;
+
+#endif
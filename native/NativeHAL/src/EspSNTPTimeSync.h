@@ -0,0 +1,60 @@
+#ifndef _ESP_SNTP_TIMESYNC_H
+#define _ESP_SNTP_TIMESYNC_H
+
+#include <stdlib.h>
+#include <string.h>
+#include "TimeSync.h"
+#include "NativeHAL.h"
+#include "esp_timer.h"
+
+/*
+ * The host keeps its own clock in sync, so this only sets the timezone and
+ * reports one successful sync a second after init(), roughly when SNTP would.
+ * SIGUSR1 reports another. With TIMEFLIES_NTP=signal only SIGUSR1 does, which
+ * is what a replay wants.
+ */
+class EspSNTPTimeSync : public TimeSync {
+public:
+	EspSNTPTimeSync(const String &tz, TimeSyncCallback timeSetCallback, TimeSyncCallback errorCallback) :
+		tz(tz), timeSetCallback(timeSetCallback), errorCallback(errorCallback) {}
+
+	virtual void init() {
+		setTz(tz);
+		nativeOnSync(synced, this);
+
+		const char *mode = getenv("TIMEFLIES_NTP");
+		if (mode != NULL && strcmp(mode, "signal") == 0) {
+			return;
+		}
+
+		esp_timer_create_args_t args = {};
+		args.callback = synced;
+		args.arg = this;
+		args.name = "sntp";
+		esp_timer_handle_t timer;
+		if (esp_timer_create(&args, &timer) == ESP_OK) {
+			esp_timer_start_once(timer, 1000000);
+		}
+	}
+
+private:
+	static void synced(void *arg) {
+		EspSNTPTimeSync *self = (EspSNTPTimeSync *)arg;
+		struct tm now;
+		char buf[32];
+
+		self->getLocalTime(&now);
+		strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &now);
+		self->stats.lastUpdateTime = buf;
+
+		if (self->timeSetCallback != NULL) {
+			self->timeSetCallback(buf);
+		}
+	}
+
+	String tz;
+	TimeSyncCallback timeSetCallback;
+	TimeSyncCallback errorCallback;
+};
+
+#endif
@@ -0,0 +1,245 @@
+#include <stdio.h>
+#include <dirent.h>
+#include <ftw.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <mutex>
+#include "FS.h"
+#include "LittleFS.h"
+#include "esp_log.h"
+#include "NativeAlloc.h"
+
+static const char *TAG = "fs";
+
+namespace fs {
+
+struct FileImpl {
+	~FileImpl() { close(); }
+
+	void close() {
+		if (file != NULL) {
+			fclose(file);
+			file = NULL;
+		}
+		if (dir != NULL) {
+			closedir(dir);
+			dir = NULL;
+		}
+	}
+
+	FS *fs = NULL;
+	FILE *file = NULL;
+	DIR *dir = NULL;
+	String path;
+};
+
+size_t File::write(const uint8_t *buf, size_t size) {
+	return impl && impl->file ? fwrite(buf, 1, size, impl->file) : 0;
+}
+
+int File::available() {
+	return impl && impl->file ? size() - position() : 0;
+}
+
+int File::read() {
+	return impl && impl->file ? fgetc(impl->file) : -1;
+}
+
+int File::peek() {
+	if (!impl || !impl->file) {
+		return -1;
+	}
+
+	int c = fgetc(impl->file);
+	if (c != EOF) {
+		ungetc(c, impl->file);
+	}
+
+	return c;
+}
+
+void File::flush() {
+	if (impl && impl->file) {
+		fflush(impl->file);
+	}
+}
+
+size_t File::read(uint8_t *buf, size_t size) {
+	return impl && impl->file ? fread(buf, 1, size, impl->file) : 0;
+}
+
+bool File::seek(uint32_t pos, SeekMode mode) {
+	static const int whence[] = { SEEK_SET, SEEK_CUR, SEEK_END };
+	return impl && impl->file && fseek(impl->file, pos, whence[mode]) == 0;
+}
+
+size_t File::position() const {
+	return impl && impl->file ? ftell(impl->file) : 0;
+}
+
+size_t File::size() const {
+	struct stat st;
+	if (!impl || !impl->file || fstat(fileno(impl->file), &st) != 0) {
+		return 0;
+	}
+
+	// Include anything still in the stdio buffer
+	return std::max((size_t)st.st_size, (size_t)ftell(impl->file));
+}
+
+void File::close() {
+	if (impl) {
+		impl->close();
+	}
+}
+
+File::operator bool() const {
+	return impl && (impl->file != NULL || impl->dir != NULL);
+}
+
+const char *File::name() const {
+	if (!impl) {
+		return NULL;
+	}
+
+	const char *slash = strrchr(impl->path.c_str(), '/');
+	return slash == NULL ? impl->path.c_str() : slash + 1;
+}
+
+const char *File::path() const {
+	return impl ? impl->path.c_str() : NULL;
+}
+
+bool File::isDirectory() const {
+	return impl && impl->dir != NULL;
+}
+
+File File::openNextFile(const char *mode) {
+	if (!impl || !impl->dir) {
+		return File();
+	}
+
+	struct dirent *entry;
+	while ((entry = readdir(impl->dir)) != NULL) {
+		if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+			String path = impl->path;
+			if (!path.endsWith("/")) {
+				path += "/";
+			}
+			return impl->fs->open(path + entry->d_name, mode);
+		}
+	}
+
+	return File();
+}
+
+time_t File::getLastWrite() {
+	struct stat st;
+	if (!impl || stat(impl->fs->hostPath(impl->path.c_str()).c_str(), &st) != 0) {
+		return 0;
+	}
+
+	return st.st_mtime;
+}
+
+String FS::hostPath(const char *path) const {
+	return path[0] == '/' ? root + path : root + "/" + path;
+}
+
+File FS::open(const char *path, const char *mode, const bool create) {
+	String host = hostPath(path);
+	std::shared_ptr<FileImpl> impl = std::make_shared<FileImpl>();
+	impl->fs = this;
+	impl->path = path;
+
+	struct stat st;
+	if (strcmp(mode, FILE_READ) == 0 && stat(host.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+		impl->dir = opendir(host.c_str());
+	} else {
+		impl->file = fopen(host.c_str(), mode);
+	}
+
+	if (impl->file == NULL && impl->dir == NULL) {
+		return File();
+	}
+
+	return File(impl);
+}
+
+bool FS::exists(const char *path) {
+	return access(hostPath(path).c_str(), F_OK) == 0;
+}
+
+bool FS::remove(const char *path) {
+	return unlink(hostPath(path).c_str()) == 0;
+}
+
+bool FS::rename(const char *pathFrom, const char *pathTo) {
+	return ::rename(hostPath(pathFrom).c_str(), hostPath(pathTo).c_str()) == 0;
+}
+
+bool FS::mkdir(const char *path) {
+	return ::mkdir(hostPath(path).c_str(), 0755) == 0;
+}
+
+bool FS::rmdir(const char *path) {
+	return ::rmdir(hostPath(path).c_str()) == 0;
+}
+
+static const char *fsRoot() {
+	const char *root = getenv("TIMEFLIES_FS");
+	return root == NULL ? "data" : root;
+}
+
+LittleFSFS::LittleFSFS() : FS(fsRoot()) {
+}
+
+bool LittleFSFS::begin(bool formatOnFail, const char *basePath, uint8_t maxOpenFiles, const char *partitionLabel) {
+	struct stat st;
+	if (stat(root.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+		return true;
+	}
+
+	if (formatOnFail && ::mkdir(root.c_str(), 0755) == 0) {
+		return true;
+	}
+
+	ESP_LOGE(TAG, "%s isn't a directory", root.c_str());
+	return false;
+}
+
+bool LittleFSFS::format() {
+	ESP_LOGW(TAG, "Not formatting %s", root.c_str());
+	return false;
+}
+
+size_t LittleFSFS::totalBytes() {
+	return 0x160000;
+}
+
+static size_t usedTotal;
+
+static int addUsed(const char *path, const struct stat *st, int flag, struct FTW *ftw) {
+	if (flag == FTW_F) {
+		// LittleFS allocates whole 4K blocks
+		usedTotal += (st->st_size + 4095) & ~4095;
+	}
+
+	return 0;
+}
+
+size_t LittleFSFS::usedBytes() {
+	static std::mutex usedMutex;
+	std::lock_guard<std::mutex> lock(usedMutex);
+
+	usedTotal = 0;
+	nativeHeapExclude(true);	// opendir() takes 32KB, LittleFS doesn't
+	nftw(root.c_str(), addUsed, 8, FTW_PHYS);
+	nativeHeapExclude(false);
+
+	return usedTotal;
+}
+
+}
+
+fs::LittleFSFS LittleFS;
@@ -0,0 +1,86 @@
+#ifndef _FS_H
+#define _FS_H
+
+#include <memory>
+#include "Arduino.h"
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+namespace fs {
+
+enum SeekMode {
+	SeekSet = 0,
+	SeekCur = 1,
+	SeekEnd = 2
+};
+
+struct FileImpl;
+
+// Copies share the underlying file, like the ESP32 core's File
+class File : public Stream {
+public:
+	File() {}
+	File(std::shared_ptr<FileImpl> impl) : impl(impl) {}
+
+	virtual size_t write(uint8_t c) { return write(&c, 1); }
+	virtual size_t write(const uint8_t *buf, size_t size);
+	using Print::write;
+	virtual int available();
+	virtual int read();
+	virtual int peek();
+	virtual void flush();
+	size_t read(uint8_t *buf, size_t size);
+
+	bool seek(uint32_t pos, SeekMode mode = SeekSet);
+	size_t position() const;
+	size_t size() const;
+	void close();
+	operator bool() const;
+
+	const char *name() const;
+	const char *path() const;
+	bool isDirectory() const;
+	File openNextFile(const char *mode = FILE_READ);
+	time_t getLastWrite();
+
+private:
+	std::shared_ptr<FileImpl> impl;
+};
+
+/*
+ * Rooted at a host directory, so "/index.html" is <root>/index.html.
+ */
+class FS {
+public:
+	FS(const char *root) : root(root) {}
+
+	File open(const char *path, const char *mode = FILE_READ, const bool create = false);
+	File open(const String &path, const char *mode = FILE_READ, const bool create = false) { return open(path.c_str(), mode, create); }
+	bool exists(const char *path);
+	bool exists(const String &path) { return exists(path.c_str()); }
+	bool remove(const char *path);
+	bool remove(const String &path) { return remove(path.c_str()); }
+	bool rename(const char *pathFrom, const char *pathTo);
+	bool rename(const String &pathFrom, const String &pathTo) { return rename(pathFrom.c_str(), pathTo.c_str()); }
+	bool mkdir(const char *path);
+	bool mkdir(const String &path) { return mkdir(path.c_str()); }
+	bool rmdir(const char *path);
+	bool rmdir(const String &path) { return rmdir(path.c_str()); }
+
+	String hostPath(const char *path) const;
+
+protected:
+	String root;
+};
+
+}
+
+using fs::FS;
+using fs::File;
+using fs::SeekSet;
+using fs::SeekCur;
+using fs::SeekEnd;
+
+#endif
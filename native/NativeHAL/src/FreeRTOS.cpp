@@ -0,0 +1,206 @@
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static const char *TAG = "freertos";
+
+struct NativeTask {
+	char name[16];
+	TaskFunction_t fn;
+	void *param;
+	uint32_t stackDepth;
+	void *stack;	// Never used, but it takes the heap the ESP32's would
+
+	std::mutex mutex;
+	std::condition_variable cv;
+	uint32_t notifications = 0;
+};
+
+struct NativeSemaphore {
+	std::mutex mutex;
+	std::condition_variable cv;
+	UBaseType_t count;
+	UBaseType_t maxCount;
+};
+
+static thread_local NativeTask *currentTask = NULL;
+
+static void *taskEntry(void *arg) {
+	NativeTask *task = (NativeTask *)arg;
+	currentTask = task;
+	pthread_setname_np(pthread_self(), task->name);
+	task->fn(task->param);
+
+	// Returning from a task function is a bug on the ESP32, but here it just ends the thread
+	ESP_LOGW(TAG, "Task %s returned", task->name);
+	return NULL;
+}
+
+BaseType_t xPortGetCoreID() {
+	return 1;	// Where the Arduino loop runs
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stackDepth, void *param,
+		UBaseType_t priority, TaskHandle_t *created, BaseType_t coreId) {
+	NativeTask *task = new NativeTask();
+	strncpy(task->name, name, sizeof(task->name) - 1);
+	task->fn = fn;
+	task->param = param;
+	task->stackDepth = stackDepth;
+	task->stack = malloc(stackDepth);
+
+	if (created != NULL) {
+		*created = task;	// Before it runs, as it may well look at its own handle
+	}
+
+	pthread_t thread;
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	int err = pthread_create(&thread, &attr, taskEntry, task);
+	pthread_attr_destroy(&attr);
+
+	if (err != 0) {
+		ESP_LOGE(TAG, "Failed to create task %s: %s", name, strerror(err));
+		if (created != NULL) {
+			*created = NULL;
+		}
+		free(task->stack);
+		delete task;
+		return pdFAIL;
+	}
+
+	return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stackDepth, void *param,
+		UBaseType_t priority, TaskHandle_t *created) {
+	return xTaskCreatePinnedToCore(fn, name, stackDepth, param, priority, created, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t task) {
+	if (task == NULL || task == currentTask) {
+		pthread_exit(NULL);	// The process keeps going while other threads do, even from main()
+	}
+
+	ESP_LOGE(TAG, "Can't delete another task (%s)", task->name);
+}
+
+void vTaskDelay(TickType_t ticks) {
+	std::this_thread::sleep_for(std::chrono::milliseconds(ticks * portTICK_PERIOD_MS));
+}
+
+TickType_t xTaskGetTickCount() {
+	return esp_timer_get_time() / 1000 / portTICK_PERIOD_MS;
+}
+
+// Threads the HAL starts itself, and main(), get a handle the first time they ask
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+	if (currentTask == NULL) {
+		NativeTask *task = new NativeTask();
+		pthread_getname_np(pthread_self(), task->name, sizeof(task->name));
+		currentTask = task;
+	}
+
+	return currentTask;
+}
+
+char *pcTaskGetName(TaskHandle_t task) {
+	if (task == NULL) {
+		task = xTaskGetCurrentTaskHandle();
+	}
+
+	return task->name;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+	return task == NULL ? 0 : task->stackDepth;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+	{
+		std::lock_guard<std::mutex> lock(task->mutex);
+		task->notifications++;
+	}
+	task->cv.notify_one();
+
+	return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearCountOnExit, TickType_t ticksToWait) {
+	NativeTask *task = xTaskGetCurrentTaskHandle();
+	std::unique_lock<std::mutex> lock(task->mutex);
+
+	if (ticksToWait == portMAX_DELAY) {
+		task->cv.wait(lock, [task] { return task->notifications != 0; });
+	} else {
+		task->cv.wait_for(lock, std::chrono::milliseconds(ticksToWait * portTICK_PERIOD_MS), [task] { return task->notifications != 0; });
+	}
+
+	uint32_t count = task->notifications;
+	if (count != 0) {
+		task->notifications = clearCountOnExit ? 0 : count - 1;
+	}
+
+	return count;
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t maxCount, UBaseType_t initialCount) {
+	NativeSemaphore *semaphore = new NativeSemaphore();
+	semaphore->count = initialCount;
+	semaphore->maxCount = maxCount;
+
+	return semaphore;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+	return xSemaphoreCreateCounting(1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary() {
+	return xSemaphoreCreateCounting(1, 0);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticksToWait) {
+	std::unique_lock<std::mutex> lock(semaphore->mutex);
+
+	if (ticksToWait == portMAX_DELAY) {
+		semaphore->cv.wait(lock, [semaphore] { return semaphore->count != 0; });
+	} else if (!semaphore->cv.wait_for(lock, std::chrono::milliseconds(ticksToWait * portTICK_PERIOD_MS),
+			[semaphore] { return semaphore->count != 0; })) {
+		return pdFALSE;
+	}
+
+	semaphore->count--;
+	return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+	{
+		std::lock_guard<std::mutex> lock(semaphore->mutex);
+		if (semaphore->count >= semaphore->maxCount) {
+			return pdFALSE;
+		}
+		semaphore->count++;
+	}
+	semaphore->cv.notify_one();
+
+	return pdTRUE;
+}
+
+UBaseType_t uxSemaphoreGetCount(SemaphoreHandle_t semaphore) {
+	std::lock_guard<std::mutex> lock(semaphore->mutex);
+	return semaphore->count;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore) {
+	delete semaphore;
+}
@@ -0,0 +1,143 @@
+#include <Arduino.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include "esp_log.h"
+#include "HardwareSerial.h"
+
+static const char *TAG = "uart";
+
+HardwareSerial Serial(0);
+HardwareSerial Serial1(1);
+
+static void makeRaw(int fd) {
+	struct termios tio;
+	if (tcgetattr(fd, &tio) == 0) {
+		cfmakeraw(&tio);
+		tcsetattr(fd, TCSANOW, &tio);
+	}
+}
+
+void HardwareSerial::begin(unsigned long baud, uint32_t config, int8_t rxPin, int8_t txPin) {
+	end();
+
+	if (uartNum == 0) {
+		out = STDOUT_FILENO;
+		return;
+	}
+
+	const char *device = getenv(uartNum == 1 ? "TIMEFLIES_SERIAL1" : "TIMEFLIES_SERIAL2");
+	if (device != NULL) {
+		in = open(device, O_RDWR | O_NOCTTY | O_NONBLOCK);
+		if (in < 0) {
+			ESP_LOGE(TAG, "Failed to open %s: %s", device, strerror(errno));
+			return;
+		}
+		path = device;
+	} else {
+		in = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+		if (in < 0 || grantpt(in) != 0 || unlockpt(in) != 0) {
+			ESP_LOGE(TAG, "Failed to make a pty: %s", strerror(errno));
+			end();
+			return;
+		}
+		path = ptsname(in);
+		slave = open(path.c_str(), O_RDWR | O_NOCTTY);
+	}
+
+	makeRaw(in);
+	out = in;
+	ESP_LOGI(TAG, "Serial%d (%lu baud) is %s", uartNum, baud, path.c_str());
+}
+
+void HardwareSerial::end() {
+	if (in >= 0) {
+		close(in);
+	}
+	if (slave >= 0) {
+		close(slave);
+	}
+	in = out = slave = peeked = -1;
+}
+
+int HardwareSerial::available() {
+	if (in < 0) {
+		return 0;
+	}
+
+	int n = 0;
+	ioctl(in, FIONREAD, &n);
+	return n + (peeked >= 0 ? 1 : 0);
+}
+
+int HardwareSerial::read() {
+	if (peeked >= 0) {
+		int c = peeked;
+		peeked = -1;
+		return c;
+	}
+
+	uint8_t c;
+	if (in < 0 || ::read(in, &c, 1) != 1) {
+		return -1;
+	}
+
+	return c;
+}
+
+int HardwareSerial::peek() {
+	if (peeked < 0) {
+		peeked = read();
+	}
+
+	return peeked;
+}
+
+int HardwareSerial::timedRead() {
+	unsigned long start = millis();
+	while (true) {
+		int c = read();
+		if (c >= 0) {
+			return c;
+		}
+
+		unsigned long elapsed = millis() - start;
+		if (in < 0 || elapsed >= timeout) {
+			return -1;
+		}
+
+		struct pollfd pfd = { in, POLLIN, 0 };
+		if (poll(&pfd, 1, timeout - elapsed) < 0 && errno != EINTR) {
+			return -1;
+		}
+	}
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size) {
+	size_t written = 0;
+	while (out >= 0 && written < size) {
+		ssize_t n = ::write(out, buffer + written, size - written);
+		if (n > 0) {
+			written += n;
+		} else if (n < 0 && errno == EAGAIN) {
+			// Nothing is reading the other end, a UART would just send it into the void
+			struct pollfd pfd = { out, POLLOUT, 0 };
+			if (poll(&pfd, 1, 100) <= 0) {
+				break;
+			}
+		} else if (n < 0 && errno != EINTR) {
+			break;
+		}
+	}
+
+	return written;
+}
+
+void HardwareSerial::flush() {
+	if (out >= 0 && out != STDOUT_FILENO) {
+		tcdrain(out);
+	}
+}
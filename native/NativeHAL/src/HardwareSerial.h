@@ -0,0 +1,46 @@
+#ifndef _HARDWARE_SERIAL_H
+#define _HARDWARE_SERIAL_H
+
+#include "Stream.h"
+
+#define SERIAL_8N1 0x800001c
+
+/*
+ * Serial writes to stdout. Serial1 opens the device named by TIMEFLIES_SERIAL1,
+ * or makes a pty for something like tools/clock_emulator.py to open.
+ */
+class HardwareSerial : public Stream {
+public:
+	HardwareSerial(int uartNum) : uartNum(uartNum) {}
+
+	void begin(unsigned long baud, uint32_t config = SERIAL_8N1, int8_t rxPin = -1, int8_t txPin = -1);
+	void end();
+	void setDebugOutput(bool on) {}
+
+	virtual int available();
+	virtual int read();
+	virtual int peek();
+	virtual size_t write(uint8_t c) { return write(&c, 1); }
+	virtual size_t write(const uint8_t *buffer, size_t size);
+	using Print::write;
+	virtual void flush();
+
+	const char *getPath() const { return path.c_str(); }
+	operator bool() const { return out >= 0; }
+
+protected:
+	virtual int timedRead();
+
+private:
+	int uartNum;
+	int in = -1;
+	int out = -1;
+	int slave = -1;		// Kept open so reads don't fail while nothing is on the other end
+	int peeked = -1;
+	String path;
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef _IPADDRESS_H
+#define _IPADDRESS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "WString.h"
+
+// Kept in network order, as on the ESP32, so it can go straight into a sockaddr
+class IPAddress {
+public:
+	IPAddress() : address(0) {}
+	IPAddress(uint32_t address) : address(address) {}
+	IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) {
+		bytes[0] = a;
+		bytes[1] = b;
+		bytes[2] = c;
+		bytes[3] = d;
+	}
+
+	operator uint32_t() const { return address; }
+	uint8_t operator[](int index) const { return bytes[index]; }
+	uint8_t &operator[](int index) { return bytes[index]; }
+	bool operator==(const IPAddress &rhs) const { return address == rhs.address; }
+	bool operator!=(const IPAddress &rhs) const { return address != rhs.address; }
+
+	bool fromString(const String &s) { return fromString(s.c_str()); }
+	bool fromString(const char *s) {
+		unsigned int a, b, c, d;
+		char extra;
+		if (sscanf(s, "%u.%u.%u.%u%c", &a, &b, &c, &d, &extra) != 4 || a > 255 || b > 255 || c > 255 || d > 255) {
+			return false;
+		}
+
+		*this = IPAddress(a, b, c, d);
+		return true;
+	}
+
+	String toString() const {
+		char buf[16];
+		snprintf(buf, sizeof(buf), "%u.%u.%u.%u", bytes[0], bytes[1], bytes[2], bytes[3]);
+		return String(buf);
+	}
+
+private:
+	union {
+		uint8_t bytes[4];
+		uint32_t address;
+	};
+};
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef _IMPROV_WIFI_H
+#define _IMPROV_WIFI_H
+
+// Provisioning over serial means nothing without a radio
+class ImprovWiFi {
+};
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef _LITTLEFS_H
+#define _LITTLEFS_H
+
+#include "FS.h"
+
+/*
+ * The directory named by TIMEFLIES_FS, "data" by default, which is where the
+ * web build puts its output. Sizes are those of the esp32dev littlefs partition.
+ */
+namespace fs {
+
+class LittleFSFS : public FS {
+public:
+	LittleFSFS();
+
+	bool begin(bool formatOnFail = false, const char *basePath = "/littlefs", uint8_t maxOpenFiles = 10, const char *partitionLabel = "spiffs");
+	void end() {}
+	bool format();
+	size_t totalBytes();
+	size_t usedBytes();
+};
+
+}
+
+extern fs::LittleFSFS LittleFS;
+
+#endif
@@ -0,0 +1,676 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <cxxabi.h>
+#include "NativeAlloc.h"
+#include "esp_heap_caps.h"
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t n, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void __libc_free(void *ptr);
+}
+
+// Plain data, so no constructor has to run before the first malloc on a thread
+static thread_local NativeAllocCounts counts;
+static thread_local bool inside;	// Backtraces and symbol lookups allocate too
+
+NativeAllocCounts nativeAllocCounts() {
+	return counts;
+}
+
+/*
+ * The regions an ESP32 without PSRAM registers at boot. malloc() only uses
+ * the ones with MALLOC_CAP_DEFAULT, in this order.
+ */
+#define DRAM_CAPS (MALLOC_CAP_8BIT | MALLOC_CAP_32BIT | MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL | MALLOC_CAP_DEFAULT)
+#define IRAM_CAPS (MALLOC_CAP_32BIT | MALLOC_CAP_EXEC | MALLOC_CAP_INTERNAL)
+
+static const struct { uint32_t size; uint32_t caps; } layout[] = {
+	{ 0x1920, DRAM_CAPS },
+	{ 0x1b0c8, DRAM_CAPS },
+	{ 0x3ae0, DRAM_CAPS },
+	{ 0x1bcb0, DRAM_CAPS },
+	{ 0x1074c, IRAM_CAPS },
+};
+
+#define NUM_REGIONS (sizeof(layout) / sizeof(layout[0]))
+#define ARENA_SIZE (0x1920 + 0x1b0c8 + 0x3ae0 + 0x1bcb0 + 0x1074c + NUM_REGIONS * 8)
+
+/*
+ * TLSF as the IDF configures it: 4 byte alignment and 32 lists per power of
+ * two. A block is its size word, then the payload. Free blocks keep their
+ * free list links in the payload, and the word before a block points back to
+ * the previous block when that one is free. Only the headers are ever written,
+ * into a shadow of each region, and blocks are offsets into it.
+ */
+#define SL_LOG2 5
+#define SL_COUNT (1 << SL_LOG2)
+#define FL_SHIFT (SL_LOG2 + 2)
+#define FL_COUNT (18 - FL_SHIFT + 1)	// Blocks up to 256KB
+#define SMALL_BLOCK (1 << FL_SHIFT)
+#define OVERHEAD 4
+#define MIN_BLOCK 12
+#define HEADER 16
+#define NIL UINT32_MAX
+#define FREE_BIT 1
+#define PREV_FREE_BIT 2
+
+struct Region {
+	uint8_t *mem;
+	uint32_t caps;
+	uint32_t total;
+	uint32_t free;
+	uint32_t minimumFree;
+	uint32_t allocatedBlocks;
+	uint32_t freeBlocks;
+	uint32_t flMap;
+	uint32_t slMap[FL_COUNT];
+	uint32_t heads[FL_COUNT][SL_COUNT];
+};
+
+struct Entry {
+	uintptr_t key;		// The pointer the C library gave out, 0 for an empty slot
+	uint32_t block;
+	uint32_t size;
+	uint16_t site;
+	uint8_t region;
+};
+
+#define TABLE_LOG2 16
+#define TABLE_SIZE (1 << TABLE_LOG2)
+#define MAX_SITES 1024
+#define NO_SITE UINT16_MAX
+#define SKIP_FRAMES 2		// siteOf() and the wrapper
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static bool initialised = false;
+static volatile bool modelling = false;
+static uint8_t arena[ARENA_SIZE] __attribute__((aligned(4)));
+static Region regions[NUM_REGIONS];
+static Entry table[TABLE_SIZE];
+static NativeHeapSite sites[MAX_SITES];	// The first is everything once the rest are used
+static int numSites = 0;
+static volatile bool tracking = false;
+static uint32_t failures = 0;
+static size_t largestFailure = 0;
+
+static inline uint32_t &word(Region &r, uint32_t offset) {
+	return *(uint32_t *)(r.mem + offset);
+}
+
+#define PREV(r, b) word(r, b)
+#define SIZE(r, b) word(r, (b) + 4)
+#define NEXT_FREE(r, b) word(r, (b) + 8)
+#define PREV_FREE(r, b) word(r, (b) + 12)
+
+static inline uint32_t sizeOf(Region &r, uint32_t b) {
+	return SIZE(r, b) & ~3u;
+}
+
+static inline uint32_t nextPhys(Region &r, uint32_t b) {
+	return b + OVERHEAD + sizeOf(r, b);
+}
+
+static inline int fls(uint32_t x) {
+	return 31 - __builtin_clz(x);
+}
+
+static void mappingInsert(uint32_t size, int *fl, int *sl) {
+	if (size < SMALL_BLOCK) {
+		*fl = 0;
+		*sl = size / (SMALL_BLOCK / SL_COUNT);
+	} else {
+		int f = fls(size);
+		*sl = (size >> (f - SL_LOG2)) ^ SL_COUNT;
+		*fl = f - (FL_SHIFT - 1);
+	}
+}
+
+// Rounds up to the next list, so any block on the one found is big enough
+static void mappingSearch(uint32_t size, int *fl, int *sl) {
+	if (size >= SMALL_BLOCK) {
+		size += (1 << (fls(size) - SL_LOG2)) - 1;
+	}
+	mappingInsert(size, fl, sl);
+}
+
+static void insertFree(Region &r, uint32_t b) {
+	int fl, sl;
+	mappingInsert(sizeOf(r, b), &fl, &sl);
+	uint32_t head = r.heads[fl][sl];
+	NEXT_FREE(r, b) = head;
+	PREV_FREE(r, b) = NIL;
+	if (head != NIL) {
+		PREV_FREE(r, head) = b;
+	}
+	r.heads[fl][sl] = b;
+	r.flMap |= 1u << fl;
+	r.slMap[fl] |= 1u << sl;
+	r.free += sizeOf(r, b);
+	r.freeBlocks++;
+}
+
+static void removeFree(Region &r, uint32_t b) {
+	int fl, sl;
+	mappingInsert(sizeOf(r, b), &fl, &sl);
+	uint32_t prev = PREV_FREE(r, b);
+	uint32_t next = NEXT_FREE(r, b);
+	if (next != NIL) {
+		PREV_FREE(r, next) = prev;
+	}
+	if (prev != NIL) {
+		NEXT_FREE(r, prev) = next;
+	} else {
+		r.heads[fl][sl] = next;
+		if (next == NIL) {
+			r.slMap[fl] &= ~(1u << sl);
+			if (r.slMap[fl] == 0) {
+				r.flMap &= ~(1u << fl);
+			}
+		}
+	}
+	r.free -= sizeOf(r, b);
+	r.freeBlocks--;
+}
+
+// Frees a used block, merging it with free neighbours
+static void release(Region &r, uint32_t b) {
+	r.allocatedBlocks--;
+
+	if (SIZE(r, b) & PREV_FREE_BIT) {
+		uint32_t prev = PREV(r, b);
+		removeFree(r, prev);
+		SIZE(r, prev) += sizeOf(r, b) + OVERHEAD;
+		b = prev;
+	}
+
+	uint32_t next = nextPhys(r, b);
+	if (SIZE(r, next) & FREE_BIT) {
+		removeFree(r, next);
+		SIZE(r, b) += sizeOf(r, next) + OVERHEAD;
+		next = nextPhys(r, b);
+	}
+
+	SIZE(r, b) |= FREE_BIT;
+	PREV(r, next) = b;
+	SIZE(r, next) |= PREV_FREE_BIT;
+	insertFree(r, b);
+}
+
+// Marks b, which is off the free lists, used and gives back what it doesn't need
+static void use(Region &r, uint32_t b, uint32_t size) {
+	SIZE(r, b) &= ~FREE_BIT;
+	SIZE(r, nextPhys(r, b)) &= ~PREV_FREE_BIT;
+	r.allocatedBlocks++;
+
+	if (sizeOf(r, b) >= HEADER + size) {
+		uint32_t rest = b + OVERHEAD + size;
+		SIZE(r, rest) = sizeOf(r, b) - size - OVERHEAD;
+		SIZE(r, b) = (SIZE(r, b) & 3) | size;
+		r.allocatedBlocks++;
+		release(r, rest);
+	}
+
+	if (r.free < r.minimumFree) {
+		r.minimumFree = r.free;
+	}
+}
+
+static uint32_t allocate(Region &r, uint32_t size) {
+	int fl, sl;
+	mappingSearch(size, &fl, &sl);
+	if (fl >= FL_COUNT) {
+		return NIL;
+	}
+
+	uint32_t slMap = r.slMap[fl] & (~0u << sl);
+	if (slMap == 0) {
+		uint32_t flMap = fl + 1 < 32 ? r.flMap & (~0u << (fl + 1)) : 0;
+		if (flMap == 0) {
+			return NIL;
+		}
+		fl = __builtin_ctz(flMap);
+		slMap = r.slMap[fl];
+	}
+	sl = __builtin_ctz(slMap);
+
+	uint32_t b = r.heads[fl][sl];
+	removeFree(r, b);
+	use(r, b, size);
+	return b;
+}
+
+// Grows into a free block after it, or shrinks, as tlsf_realloc() would
+static bool resize(Region &r, uint32_t b, uint32_t size) {
+	uint32_t next = nextPhys(r, b);
+	if (size > sizeOf(r, b)) {
+		if (!(SIZE(r, next) & FREE_BIT) || sizeOf(r, b) + OVERHEAD + sizeOf(r, next) < size) {
+			return false;
+		}
+		removeFree(r, next);
+		SIZE(r, b) += sizeOf(r, next) + OVERHEAD;
+	}
+
+	r.allocatedBlocks--;
+	SIZE(r, b) |= FREE_BIT;
+	use(r, b, size);
+	return true;
+}
+
+static uint32_t largestFree(Region &r) {
+	if (r.flMap == 0) {
+		return 0;
+	}
+
+	int fl = fls(r.flMap);
+	uint32_t largest = 0;
+	for (uint32_t b = r.heads[fl][fls(r.slMap[fl])]; b != NIL; b = NEXT_FREE(r, b)) {
+		if (sizeOf(r, b) > largest) {
+			largest = sizeOf(r, b);
+		}
+	}
+
+	return largest;
+}
+
+static void init() {
+	uint8_t *mem = arena;
+	for (size_t i=0; i < NUM_REGIONS; i++) {
+		Region &r = regions[i];
+		r.mem = mem;
+		r.caps = layout[i].caps;
+		memset(r.heads, 0xff, sizeof(r.heads));
+
+		// One free block, then a used one of no size so nothing merges past the end
+		uint32_t size = (layout[i].size - 2 * OVERHEAD) & ~3u;
+		SIZE(r, 0) = size | FREE_BIT;
+		uint32_t end = nextPhys(r, 0);
+		PREV(r, end) = 0;
+		SIZE(r, end) = PREV_FREE_BIT;
+		insertFree(r, 0);
+
+		r.total = r.free;
+		r.minimumFree = r.free;
+		mem += layout[i].size + 8;
+	}
+	initialised = true;
+}
+
+static inline uint32_t slotOf(uintptr_t key) {
+	return (uint32_t)(((uint64_t)key * 0x9e3779b97f4a7c15ull) >> (64 - TABLE_LOG2));
+}
+
+static Entry *find(uintptr_t key) {
+	for (uint32_t i = slotOf(key); table[i].key != 0; i = (i + 1) & (TABLE_SIZE - 1)) {
+		if (table[i].key == key) {
+			return &table[i];
+		}
+	}
+
+	return NULL;
+}
+
+static Entry *insert(uintptr_t key) {
+	uint32_t i = slotOf(key);
+	while (table[i].key != 0) {
+		i = (i + 1) & (TABLE_SIZE - 1);
+	}
+	table[i].key = key;
+	return &table[i];
+}
+
+// Moves later entries back into the hole, so lookups never need tombstones
+static void erase(Entry *entry) {
+	uint32_t hole = entry - table;
+	uint32_t i = hole;
+	while (true) {
+		i = (i + 1) & (TABLE_SIZE - 1);
+		if (table[i].key == 0) {
+			break;
+		}
+		uint32_t home = slotOf(table[i].key);
+		if (((i - home) & (TABLE_SIZE - 1)) >= ((i - hole) & (TABLE_SIZE - 1))) {
+			table[hole] = table[i];
+			hole = i;
+		}
+	}
+	table[hole].key = 0;
+}
+
+static uint32_t adjust(size_t size) {
+	size = (size + 3) & ~(size_t)3;
+	return size < MIN_BLOCK ? MIN_BLOCK : size > UINT32_MAX / 2 ? UINT32_MAX / 2 : size;
+}
+
+static bool place(uint32_t size, Entry *entry) {
+	for (size_t i=0; i < NUM_REGIONS; i++) {
+		if ((regions[i].caps & MALLOC_CAP_DEFAULT) == 0) {
+			continue;
+		}
+		uint32_t b = allocate(regions[i], size);
+		if (b != NIL) {
+			entry->region = i;
+			entry->block = b;
+			return true;
+		}
+	}
+
+	failures++;
+	if (size > largestFailure) {
+		largestFailure = size;
+	}
+
+	return false;
+}
+
+static void charge(uint16_t site, size_t size) {
+	if (site != NO_SITE) {
+		sites[site].allocations++;
+		sites[site].bytes += size;
+		sites[site].live += size;
+	}
+}
+
+static void discharge(Entry *entry) {
+	if (entry->site != NO_SITE) {
+		sites[entry->site].frees++;
+		sites[entry->site].live -= entry->size;
+	}
+}
+
+static uint16_t siteOf() {
+	if (!tracking || inside) {
+		return NO_SITE;
+	}
+
+	void *frames[NATIVE_SITE_FRAMES + SKIP_FRAMES] = {};
+	inside = true;
+	backtrace(frames, NATIVE_SITE_FRAMES + SKIP_FRAMES);
+	inside = false;
+
+	uint64_t hash = 14695981039346656037ull;
+	for (int i=SKIP_FRAMES; i < NATIVE_SITE_FRAMES + SKIP_FRAMES; i++) {
+		hash = (hash ^ (uintptr_t)frames[i]) * 1099511628211ull;
+	}
+
+	pthread_mutex_lock(&lock);
+	uint16_t site = 0;
+	for (int n=0, i=hash % (MAX_SITES - 1) + 1; n < MAX_SITES - 1; n++, i = i % (MAX_SITES - 1) + 1) {
+		if (sites[i].frames[0] == NULL) {
+			memcpy(sites[i].frames, frames + SKIP_FRAMES, sizeof(sites[i].frames));
+			numSites++;
+			site = i;
+			break;
+		}
+		if (memcmp(sites[i].frames, frames + SKIP_FRAMES, sizeof(sites[i].frames)) == 0) {
+			site = i;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&lock);
+
+	return site;
+}
+
+static void modelMalloc(void *ptr, size_t size, uint16_t site) {
+	if (ptr == NULL || size == 0 || inside || !modelling) {
+		return;
+	}
+
+	pthread_mutex_lock(&lock);
+	if (!initialised) {
+		init();
+	}
+
+	Entry entry = {};
+	if (place(adjust(size), &entry)) {
+		Entry *e = insert((uintptr_t)ptr);
+		e->block = entry.block;
+		e->region = entry.region;
+		e->size = size;
+		e->site = site;
+		charge(site, size);
+	}
+	pthread_mutex_unlock(&lock);
+}
+
+static void modelFree(void *ptr) {
+	if (ptr == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&lock);
+	Entry *entry = find((uintptr_t)ptr);
+	if (entry != NULL) {
+		release(regions[entry->region], entry->block);
+		discharge(entry);
+		erase(entry);
+	}
+	pthread_mutex_unlock(&lock);
+}
+
+// Called with lock held, from before the C library freed old until now
+static void modelRealloc(void *old, void *ptr, size_t size, uint16_t site) {
+	if (!initialised) {
+		init();
+	}
+
+	Entry *found = old ? find((uintptr_t)old) : NULL;
+	if (found == NULL) {
+		Entry entry = {};
+		if (!inside && modelling && place(adjust(size), &entry)) {
+			Entry *e = insert((uintptr_t)ptr);
+			*e = entry;
+			e->key = (uintptr_t)ptr;
+			e->size = size;
+			e->site = site;
+			charge(site, size);
+		}
+		return;
+	}
+
+	Entry entry = *found;
+	discharge(found);
+	erase(found);
+
+	// If it can't move the ESP32 would have kept the old block and returned NULL
+	uint32_t need = adjust(size);
+	Entry moved = {};
+	if (!resize(regions[entry.region], entry.block, need) && place(need, &moved)) {
+		release(regions[entry.region], entry.block);
+		entry.region = moved.region;
+		entry.block = moved.block;
+	}
+
+	Entry *e = insert((uintptr_t)ptr);
+	e->block = entry.block;
+	e->region = entry.region;
+	e->size = size;
+	e->site = site;
+	charge(site, size);
+}
+
+/*
+ * The shared libraries are set up by the time the program's own constructors
+ * run. What they allocated, like the C++ runtime's emergency exception pool,
+ * has no counterpart on the ESP32.
+ */
+__attribute__((constructor(101))) static void startModelling() {
+	modelling = true;
+}
+
+extern "C" void *malloc(size_t size) {
+	counts.allocations++;
+	counts.bytes += size;
+	void *ptr = __libc_malloc(size);
+	modelMalloc(ptr, size, siteOf());
+	return ptr;
+}
+
+extern "C" void *calloc(size_t n, size_t size) {
+	counts.allocations++;
+	counts.bytes += n * size;
+	void *ptr = __libc_calloc(n, size);
+	modelMalloc(ptr, n * size, siteOf());
+	return ptr;
+}
+
+extern "C" void *realloc(void *ptr, size_t size) {
+	counts.allocations++;
+	counts.bytes += size;
+	if (ptr != NULL && size == 0) {
+		modelFree(ptr);
+		return __libc_realloc(ptr, size);
+	}
+
+	// Held across the C library's realloc, so nothing else gets the old address while it's in the table
+	uint16_t site = siteOf();
+	pthread_mutex_lock(&lock);
+	void *moved = __libc_realloc(ptr, size);
+	if (moved != NULL) {
+		modelRealloc(ptr, moved, size, site);
+	}
+	pthread_mutex_unlock(&lock);
+	return moved;
+}
+
+extern "C" void free(void *ptr) {
+	modelFree(ptr);
+	__libc_free(ptr);
+}
+
+void nativeHeapInfo(uint32_t caps, NativeHeapInfo *info) {
+	*info = {};
+
+	pthread_mutex_lock(&lock);
+	if (!initialised) {
+		init();
+	}
+
+	for (size_t i=0; i < NUM_REGIONS; i++) {
+		Region &r = regions[i];
+		if ((r.caps & caps) != caps) {
+			continue;
+		}
+		info->total += r.total;
+		info->free += r.free;
+		info->minimumFree += r.minimumFree;
+		info->allocatedBlocks += r.allocatedBlocks;
+		info->freeBlocks += r.freeBlocks;
+		uint32_t largest = largestFree(r);
+		if (largest > info->largestFree) {
+			info->largestFree = largest;
+		}
+	}
+	info->failures = failures;
+	info->largestFailure = largestFailure;
+	pthread_mutex_unlock(&lock);
+}
+
+void nativeHeapTrackSites(bool on) {
+	if (on) {
+		// The first backtrace loads the unwinder, better here than in the middle of a malloc
+		void *frame;
+		inside = true;
+		backtrace(&frame, 1);
+		inside = false;
+	}
+
+	pthread_mutex_lock(&lock);
+	if (on && !tracking) {
+		memset(sites, 0, sizeof(sites));
+		numSites = 0;
+		for (int i=0; i < TABLE_SIZE; i++) {
+			table[i].site = NO_SITE;
+		}
+	}
+	tracking = on;
+	pthread_mutex_unlock(&lock);
+}
+
+int nativeHeapTopSites(NativeHeapSite *top, int max) {
+	int n = 0;
+
+	pthread_mutex_lock(&lock);
+	for (int i=0; i < MAX_SITES; i++) {
+		if (sites[i].allocations == 0) {
+			continue;
+		}
+
+		// Insertion into what is kept so far, biggest first
+		int j = n < max ? n++ : max;
+		while (j > 0 && top[j - 1].bytes < sites[i].bytes) {
+			if (j < max) {
+				top[j] = top[j - 1];
+			}
+			j--;
+		}
+		if (j < max) {
+			top[j] = sites[i];
+		}
+	}
+	pthread_mutex_unlock(&lock);
+
+	return n;
+}
+
+void nativeHeapExclude(bool on) {
+	inside = on;
+}
+
+void nativeHeapDescribe(const NativeHeapSite &site, int depth, char *buf, size_t len) {
+	static void *self = NULL;
+	size_t used = 0;
+	buf[0] = 0;
+
+	inside = true;
+	Dl_info exe;
+	if (self == NULL && dladdr((void *)nativeHeapDescribe, &exe)) {
+		self = exe.dli_fbase;
+	}
+
+	for (int i=0; i < NATIVE_SITE_FRAMES && depth > 0 && used < len; i++) {
+		Dl_info info;
+		if (site.frames[i] == NULL || !dladdr(site.frames[i], &info)) {
+			continue;
+		}
+		if (info.dli_fbase != self) {
+			continue;	// operator new, strdup and the like
+		}
+
+		char name[128];
+		int status = -1;
+		char *demangled = info.dli_sname ? abi::__cxa_demangle(info.dli_sname, NULL, NULL, &status) : NULL;
+		if (demangled != NULL) {
+			snprintf(name, sizeof(name), "%s", demangled);
+			char *args = strchr(name, '(');
+			if (args != NULL) {
+				*args = 0;
+			}
+			free(demangled);
+			if (strncmp(name, "std::", 5) == 0 || strstr(name, " std::") != NULL) {
+				continue;	// The C++ library's templates, built into the executable
+			}
+		} else if (info.dli_sname != NULL) {
+			snprintf(name, sizeof(name), "%s", info.dli_sname);
+		} else {
+			const char *file = strrchr(info.dli_fname, '/');
+			snprintf(name, sizeof(name), "%s+0x%lx", file ? file + 1 : info.dli_fname,
+				(unsigned long)((uintptr_t)site.frames[i] - (uintptr_t)info.dli_fbase));
+		}
+
+		used += snprintf(buf + used, len - used, "%s%s", used ? " < " : "", name);
+		depth--;
+	}
+	inside = false;
+
+	if (site.frames[0] == NULL && used == 0) {
+		snprintf(buf, len, "(everywhere else)");
+	}
+}
@@ -0,0 +1,62 @@
+#ifndef _NATIVE_ALLOC_H
+#define _NATIVE_ALLOC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * malloc, calloc, realloc and free are wrapped to count what each thread
+ * allocates, which the ESP32 can't do without a heap tracing build, and to
+ * play every allocation into a model of the ESP32's heap: the regions it has,
+ * their capabilities and the block sizes and placement of its TLSF allocator.
+ * Memory still comes from, and goes back to, the C library, so running out of
+ * model heap only counts a failure. The heap_caps_*() calls report on the model.
+ *
+ * With site tracking on, allocations are also charged to where they were made
+ * from, which costs a backtrace each.
+ */
+struct NativeAllocCounts {
+	uint64_t allocations;
+	uint64_t bytes;
+};
+
+// Since the calling thread started
+NativeAllocCounts nativeAllocCounts();
+
+#define NATIVE_SITE_FRAMES 8
+
+struct NativeHeapInfo {
+	size_t total;
+	size_t free;
+	size_t minimumFree;		// Since the program started
+	size_t largestFree;		// The biggest allocation that would succeed
+	uint32_t allocatedBlocks;
+	uint32_t freeBlocks;
+	uint32_t failures;		// Allocations from anywhere that wouldn't have fitted
+	size_t largestFailure;
+};
+
+struct NativeHeapSite {
+	void *frames[NATIVE_SITE_FRAMES];	// Return addresses, the allocator's own left out
+	uint64_t allocations;
+	uint64_t bytes;
+	uint64_t frees;
+	size_t live;						// Allocated here and not freed yet
+};
+
+// Summed over the regions that have all of caps
+void nativeHeapInfo(uint32_t caps, NativeHeapInfo *info);
+
+// Turning it on forgets the sites seen before
+void nativeHeapTrackSites(bool on);
+
+// The sites that allocated the most bytes, returns how many it filled in
+int nativeHeapTopSites(NativeHeapSite *sites, int max);
+
+// While on, what the calling thread allocates is the host's own and left out of the model
+void nativeHeapExclude(bool on);
+
+// Up to depth frames of a site, outermost last, skipping the C and C++ libraries
+void nativeHeapDescribe(const NativeHeapSite &site, int depth, char *buf, size_t len);
+
+#endif
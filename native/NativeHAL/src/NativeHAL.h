@@ -0,0 +1,23 @@
+#ifndef _NATIVE_HAL_H
+#define _NATIVE_HAL_H
+
+#include <stdint.h>
+
+/*
+ * Things only the native build has. Firmware code shouldn't need any of this,
+ * it is for the HAL itself and for host tools linked against it.
+ */
+
+// Remembered by main() so esp_restart() can start the program again
+void nativeSetArgs(int argc, char **argv);
+
+// Runs the handlers registered with esp_register_shutdown_handler(), at most once
+void nativeShutdown();
+
+// The value last given to digitalWrite() for a pin
+int nativePinState(uint8_t pin);
+
+// Called for each SIGUSR1, which is how tools/replay.py makes NTP sync
+void nativeOnSync(void (*fn)(void *arg), void *arg);
+
+#endif
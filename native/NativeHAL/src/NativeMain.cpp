@@ -0,0 +1,59 @@
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <thread>
+#include "Arduino.h"
+#include "NativeHAL.h"
+#include "esp_log.h"
+
+static const char *TAG = "main";
+
+static void (*syncFn)(void *arg) = NULL;
+static void *syncArg = NULL;
+
+void nativeOnSync(void (*fn)(void *arg), void *arg) {
+	syncFn = fn;
+	syncArg = arg;
+}
+
+// Ctrl-C and kill shut down the way esp_restart() does, so pending config is committed
+static void waitForSignal(sigset_t signals) {
+	pthread_setname_np(pthread_self(), "signals");
+
+	int signal;
+	while (sigwait(&signals, &signal) == 0 && signal == SIGUSR1) {
+		if (syncFn != NULL) {
+			syncFn(syncArg);
+		}
+	}
+	ESP_LOGI(TAG, "Got %s, shutting down", strsignal(signal));
+
+	nativeShutdown();
+	fflush(NULL);
+	_exit(0);
+}
+
+// pio test links the tests' own main() against setup() and the rest of src
+#ifndef PIO_UNIT_TESTING
+int main(int argc, char **argv) {
+	nativeSetArgs(argc, argv);
+	setvbuf(stdout, NULL, _IOLBF, 0);
+	signal(SIGPIPE, SIG_IGN);
+
+	// Blocked before any other thread starts, so only waitForSignal() sees them
+	sigset_t signals;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	sigaddset(&signals, SIGUSR1);
+	pthread_sigmask(SIG_BLOCK, &signals, NULL);
+	std::thread(waitForSignal, signals).detach();
+
+	pthread_setname_np(pthread_self(), "loopTask");
+	setup();
+	while (true) {
+		loop();
+		delay(1);
+	}
+}
+#endif
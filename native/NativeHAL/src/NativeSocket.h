@@ -0,0 +1,16 @@
+#ifndef _NATIVE_SOCKET_H
+#define _NATIVE_SOCKET_H
+
+#include <stddef.h>
+#include <mutex>
+
+/*
+ * Shared by the web server and WebSocket. Handlers and events hold
+ * asyncTcpMutex, standing in for the ESP32's one async_tcp task.
+ */
+extern std::recursive_mutex asyncTcpMutex;
+
+// False if the peer has gone
+bool socketSendAll(int fd, const void *data, size_t len);
+
+#endif
@@ -0,0 +1,53 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include "Print.h"
+
+size_t Print::write(const uint8_t *buffer, size_t size) {
+	size_t n = 0;
+	while (size--) {
+		if (write(*buffer++) == 0) {
+			break;
+		}
+		n++;
+	}
+
+	return n;
+}
+
+size_t Print::printf(const char *format, ...) {
+	char buf[64];
+	va_list args;
+
+	va_start(args, format);
+	int len = vsnprintf(buf, sizeof(buf), format, args);
+	va_end(args);
+
+	if (len < 0) {
+		return 0;
+	}
+
+	if ((size_t)len < sizeof(buf)) {
+		return write((const uint8_t *)buf, len);
+	}
+
+	char *big = new char[len + 1];
+	va_start(args, format);
+	vsnprintf(big, len + 1, format, args);
+	va_end(args);
+	size_t n = write((const uint8_t *)big, len);
+	delete[] big;
+
+	return n;
+}
+
+size_t Print::print(long long n, int base) {
+	return print(String(n, (unsigned char)base));
+}
+
+size_t Print::print(unsigned long long n, int base) {
+	return print(String(n, (unsigned char)base));
+}
+
+size_t Print::print(double n, int digits) {
+	return print(String(n, (unsigned int)digits));
+}
@@ -0,0 +1,46 @@
+#ifndef _PRINT_H
+#define _PRINT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "WString.h"
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+class Print {
+public:
+	virtual ~Print() {}
+
+	virtual size_t write(uint8_t c) = 0;
+	virtual size_t write(const uint8_t *buffer, size_t size);
+	size_t write(const char *str) { return str == NULL ? 0 : write((const uint8_t *)str, strlen(str)); }
+	size_t write(const char *buffer, size_t size) { return write((const uint8_t *)buffer, size); }
+	virtual int availableForWrite() { return 0; }
+	virtual void flush() {}
+
+	size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+	size_t print(const String &s) { return write(s.c_str(), s.length()); }
+	size_t print(const char str[]) { return write(str); }
+	size_t print(char c) { return write((uint8_t)c); }
+	size_t print(unsigned char n, int base = DEC) { return print((unsigned long long)n, base); }
+	size_t print(int n, int base = DEC) { return print((long long)n, base); }
+	size_t print(unsigned int n, int base = DEC) { return print((unsigned long long)n, base); }
+	size_t print(long n, int base = DEC) { return print((long long)n, base); }
+	size_t print(unsigned long n, int base = DEC) { return print((unsigned long long)n, base); }
+	size_t print(long long n, int base = DEC);
+	size_t print(unsigned long long n, int base = DEC);
+	size_t print(double n, int digits = 2);
+
+	size_t println() { return write("\r\n"); }
+	template<typename T>
+	size_t println(const T &value) { return print(value) + println(); }
+	template<typename T>
+	size_t println(const T &value, int format) { return print(value, format) + println(); }
+};
+
+#endif
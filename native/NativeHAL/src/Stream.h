@@ -0,0 +1,28 @@
+#ifndef _STREAM_H
+#define _STREAM_H
+
+#include "Print.h"
+
+class Stream : public Print {
+public:
+	virtual int available() = 0;
+	virtual int read() = 0;
+	virtual int peek() = 0;
+
+	void setTimeout(unsigned long timeout) { this->timeout = timeout; }
+	unsigned long getTimeout() const { return timeout; }
+
+	size_t readBytes(char *buffer, size_t length);
+	size_t readBytes(uint8_t *buffer, size_t length) { return readBytes((char *)buffer, length); }
+	size_t readBytesUntil(char terminator, char *buffer, size_t length);
+	String readString();
+	String readStringUntil(char terminator);
+
+protected:
+	// Unlike the Arduino one this can be overridden, so a stream with a descriptor can sleep in poll()
+	virtual int timedRead();
+
+	unsigned long timeout = 1000;
+};
+
+#endif
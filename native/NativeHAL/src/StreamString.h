@@ -0,0 +1,27 @@
+#ifndef _STREAM_STRING_H
+#define _STREAM_STRING_H
+
+#include "Stream.h"
+#include "WString.h"
+
+// A String that can be printed to and read back, like the ESP32 core's
+class StreamString : public Stream, public String {
+public:
+	virtual size_t write(const uint8_t *buffer, size_t size) { return concat((const char *)buffer, size) ? size : 0; }
+	virtual size_t write(uint8_t c) { return concat((char)c) ? 1 : 0; }
+	using Print::write;
+
+	virtual int available() { return length(); }
+	virtual int read() {
+		if (length() == 0) {
+			return -1;
+		}
+		char c = charAt(0);
+		remove(0, 1);
+		return c;
+	}
+	virtual int peek() { return length() ? charAt(0) : -1; }
+	virtual void flush() {}
+};
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef _TIMESYNC_H
+#define _TIMESYNC_H
+
+#include <sys/time.h>
+#include "Arduino.h"
+
+typedef void (*TimeSyncCallback)(String);
+
+class TimeSync {
+public:
+	struct SyncStats {
+		String failedCount = "0";
+		String lastFailedMessage = "";
+		String lastUpdateTime = "";
+	};
+
+	virtual ~TimeSync() {}
+
+	virtual void init() = 0;
+	virtual void setTz(const String &tz) {
+		setenv("TZ", tz.c_str(), 1);
+		tzset();
+	}
+
+	virtual struct tm *getLocalTime(struct tm *local, suseconds_t *uSec = NULL) {
+		struct timeval tv;
+		gettimeofday(&tv, NULL);
+		if (uSec != NULL) {
+			*uSec = tv.tv_usec;
+		}
+
+		return localtime_r(&tv.tv_sec, local);
+	}
+
+	virtual SyncStats &getStats() { return stats; }
+
+protected:
+	SyncStats stats;
+};
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef _UPDATE_H
+#define _UPDATE_H
+
+#include "Arduino.h"
+
+#define UPDATE_SIZE_UNKNOWN 0xFFFFFFFF
+
+// There is nowhere to flash an image to, every update fails to begin
+class UpdateClass {
+public:
+	bool begin(size_t size = UPDATE_SIZE_UNKNOWN, int command = 0) { error = true; return false; }
+	size_t write(uint8_t *data, size_t len) { return 0; }
+	bool end(bool evenIfRemaining = false) { return false; }
+	void abort() {}
+	bool isRunning() { return false; }
+	bool hasError() { return error; }
+	const char *errorString() { return error ? "Not supported" : "No Error"; }
+	void printError(Print &out) { out.println(errorString()); }
+
+private:
+	bool error = false;
+};
+
+extern UpdateClass Update;
+
+#endif
@@ -0,0 +1,194 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <string.h>
+#include "WString.h"
+
+static std::string toBase(unsigned long long value, unsigned char base) {
+	if (base < 2 || base > 36) {
+		base = 10;
+	}
+
+	char buf[65];
+	int pos = sizeof(buf);
+	buf[--pos] = 0;
+	do {
+		int digit = value % base;
+		buf[--pos] = digit < 10 ? '0' + digit : 'a' + digit - 10;
+		value /= base;
+	} while (value != 0);
+
+	return std::string(buf + pos);
+}
+
+static std::string toBase(long long value, unsigned char base) {
+	if (value < 0 && base == 10) {
+		return "-" + toBase((unsigned long long)-value, base);
+	}
+
+	return toBase((unsigned long long)value, base);
+}
+
+static std::string toFixed(double value, unsigned int decimalPlaces) {
+	char buf[64];
+	snprintf(buf, sizeof(buf), "%.*f", decimalPlaces, value);
+	return std::string(buf);
+}
+
+String::String(const char *cstr) : s(cstr ? cstr : "") {}
+String::String(const char *cstr, unsigned int length) : s(cstr ? std::string(cstr, length) : "") {}
+String::String(char c) : s(1, c) {}
+String::String(unsigned char value, unsigned char base) : s(toBase((unsigned long long)value, base)) {}
+String::String(int value, unsigned char base) : s(toBase((long long)value, base)) {}
+String::String(unsigned int value, unsigned char base) : s(toBase((unsigned long long)value, base)) {}
+String::String(long value, unsigned char base) : s(toBase((long long)value, base)) {}
+String::String(unsigned long value, unsigned char base) : s(toBase((unsigned long long)value, base)) {}
+String::String(long long value, unsigned char base) : s(toBase(value, base)) {}
+String::String(unsigned long long value, unsigned char base) : s(toBase(value, base)) {}
+String::String(float value, unsigned int decimalPlaces) : s(toFixed(value, decimalPlaces)) {}
+String::String(double value, unsigned int decimalPlaces) : s(toFixed(value, decimalPlaces)) {}
+
+bool String::equalsIgnoreCase(const String &str) const {
+	return strcasecmp(c_str(), str.c_str()) == 0 && length() == str.length();
+}
+
+bool String::startsWith(const String &prefix, unsigned int offset) const {
+	return offset <= s.length() && s.compare(offset, prefix.s.length(), prefix.s) == 0;
+}
+
+bool String::endsWith(const String &suffix) const {
+	return suffix.s.length() <= s.length() && s.compare(s.length() - suffix.s.length(), suffix.s.length(), suffix.s) == 0;
+}
+
+char &String::operator[](unsigned int index) {
+	static char dummy;
+	if (index >= s.length()) {
+		dummy = 0;
+		return dummy;
+	}
+
+	return s[index];
+}
+
+void String::getBytes(unsigned char *buf, unsigned int bufsize, unsigned int index) const {
+	if (bufsize == 0 || buf == NULL) {
+		return;
+	}
+
+	if (index >= s.length()) {
+		buf[0] = 0;
+		return;
+	}
+
+	unsigned int n = std::min(bufsize - 1, (unsigned int)s.length() - index);
+	memcpy(buf, s.data() + index, n);
+	buf[n] = 0;
+}
+
+int String::indexOf(char c, unsigned int fromIndex) const {
+	size_t pos = s.find(c, fromIndex);
+	return pos == std::string::npos ? -1 : (int)pos;
+}
+
+int String::indexOf(const String &str, unsigned int fromIndex) const {
+	size_t pos = s.find(str.s, fromIndex);
+	return pos == std::string::npos ? -1 : (int)pos;
+}
+
+int String::lastIndexOf(char c) const {
+	size_t pos = s.rfind(c);
+	return pos == std::string::npos ? -1 : (int)pos;
+}
+
+int String::lastIndexOf(char c, unsigned int fromIndex) const {
+	size_t pos = s.rfind(c, fromIndex);
+	return pos == std::string::npos ? -1 : (int)pos;
+}
+
+int String::lastIndexOf(const String &str) const {
+	size_t pos = s.rfind(str.s);
+	return pos == std::string::npos ? -1 : (int)pos;
+}
+
+int String::lastIndexOf(const String &str, unsigned int fromIndex) const {
+	size_t pos = s.rfind(str.s, fromIndex);
+	return pos == std::string::npos ? -1 : (int)pos;
+}
+
+// Like the Arduino one, the indexes are swapped if they are the wrong way round
+String String::substring(unsigned int beginIndex, unsigned int endIndex) const {
+	if (beginIndex > endIndex) {
+		std::swap(beginIndex, endIndex);
+	}
+
+	if (beginIndex >= s.length()) {
+		return String();
+	}
+
+	endIndex = std::min(endIndex, (unsigned int)s.length());
+	return String(s.data() + beginIndex, endIndex - beginIndex);
+}
+
+void String::replace(char find, char replace) {
+	for (char &c : s) {
+		if (c == find) {
+			c = replace;
+		}
+	}
+}
+
+void String::replace(const String &find, const String &replace) {
+	if (find.s.empty()) {
+		return;
+	}
+
+	size_t pos = 0;
+	while ((pos = s.find(find.s, pos)) != std::string::npos) {
+		s.replace(pos, find.s.length(), replace.s);
+		pos += replace.s.length();
+	}
+}
+
+void String::remove(unsigned int index, unsigned int count) {
+	if (index < s.length()) {
+		s.erase(index, count);
+	}
+}
+
+void String::toLowerCase() {
+	for (char &c : s) {
+		c = tolower((unsigned char)c);
+	}
+}
+
+void String::toUpperCase() {
+	for (char &c : s) {
+		c = toupper((unsigned char)c);
+	}
+}
+
+void String::trim() {
+	size_t first = 0;
+	while (first < s.length() && isspace((unsigned char)s[first])) {
+		first++;
+	}
+
+	size_t last = s.length();
+	while (last > first && isspace((unsigned char)s[last - 1])) {
+		last--;
+	}
+
+	s = s.substr(first, last - first);
+}
+
+long String::toInt() const {
+	return atol(s.c_str());
+}
+
+float String::toFloat() const {
+	return atof(s.c_str());
+}
+
+double String::toDouble() const {
+	return atof(s.c_str());
+}
@@ -0,0 +1,131 @@
+#ifndef _WSTRING_H
+#define _WSTRING_H
+
+#include <stdint.h>
+#include <string>
+
+class StringSumHelper;
+
+// The Arduino String API over std::string
+class String {
+public:
+	String(const char *cstr = "");
+	String(const char *cstr, unsigned int length);
+	String(const String &str) : s(str.s) {}
+	String(String &&str) : s(std::move(str.s)) {}
+	explicit String(char c);
+	explicit String(unsigned char value, unsigned char base = 10);
+	explicit String(int value, unsigned char base = 10);
+	explicit String(unsigned int value, unsigned char base = 10);
+	explicit String(long value, unsigned char base = 10);
+	explicit String(unsigned long value, unsigned char base = 10);
+	explicit String(long long value, unsigned char base = 10);
+	explicit String(unsigned long long value, unsigned char base = 10);
+	explicit String(float value, unsigned int decimalPlaces = 2);
+	explicit String(double value, unsigned int decimalPlaces = 2);
+
+	String &operator=(const String &rhs) { s = rhs.s; return *this; }
+	String &operator=(String &&rhs) { s = std::move(rhs.s); return *this; }
+	String &operator=(const char *cstr) { s = cstr ? cstr : ""; return *this; }
+
+	bool reserve(unsigned int size) { s.reserve(size); return true; }
+	unsigned int length() const { return s.length(); }
+	bool isEmpty() const { return s.empty(); }
+	const char *c_str() const { return s.c_str(); }
+	char *begin() { return &s[0]; }
+	char *end() { return &s[0] + s.length(); }
+	const char *begin() const { return c_str(); }
+	const char *end() const { return c_str() + s.length(); }
+	explicit operator bool() const { return true; }
+
+	bool concat(const String &str) { s += str.s; return true; }
+	bool concat(const char *cstr) { if (!cstr) return false; s += cstr; return true; }
+	bool concat(const char *cstr, unsigned int length) { if (!cstr) return false; s.append(cstr, length); return true; }
+	bool concat(char c) { s += c; return true; }
+	bool concat(unsigned char num) { return concat(String(num)); }
+	bool concat(int num) { return concat(String(num)); }
+	bool concat(unsigned int num) { return concat(String(num)); }
+	bool concat(long num) { return concat(String(num)); }
+	bool concat(unsigned long num) { return concat(String(num)); }
+	bool concat(long long num) { return concat(String(num)); }
+	bool concat(unsigned long long num) { return concat(String(num)); }
+	bool concat(float num) { return concat(String(num)); }
+	bool concat(double num) { return concat(String(num)); }
+
+	template<typename T>
+	String &operator+=(const T &rhs) { concat(rhs); return *this; }
+
+	int compareTo(const String &str) const { return s.compare(str.s); }
+	bool equals(const String &str) const { return s == str.s; }
+	bool equals(const char *cstr) const { return s == (cstr ? cstr : ""); }
+	bool equalsIgnoreCase(const String &str) const;
+	bool operator==(const String &rhs) const { return equals(rhs); }
+	bool operator==(const char *cstr) const { return equals(cstr); }
+	bool operator!=(const String &rhs) const { return !equals(rhs); }
+	bool operator!=(const char *cstr) const { return !equals(cstr); }
+	bool operator<(const String &rhs) const { return compareTo(rhs) < 0; }
+	bool operator>(const String &rhs) const { return compareTo(rhs) > 0; }
+	bool operator<=(const String &rhs) const { return compareTo(rhs) <= 0; }
+	bool operator>=(const String &rhs) const { return compareTo(rhs) >= 0; }
+
+	bool startsWith(const String &prefix) const { return startsWith(prefix, 0); }
+	bool startsWith(const String &prefix, unsigned int offset) const;
+	bool endsWith(const String &suffix) const;
+
+	char charAt(unsigned int index) const { return index < s.length() ? s[index] : 0; }
+	void setCharAt(unsigned int index, char c) { if (index < s.length()) s[index] = c; }
+	char operator[](unsigned int index) const { return charAt(index); }
+	char &operator[](unsigned int index);
+	void getBytes(unsigned char *buf, unsigned int bufsize, unsigned int index = 0) const;
+	void toCharArray(char *buf, unsigned int bufsize, unsigned int index = 0) const { getBytes((unsigned char *)buf, bufsize, index); }
+
+	int indexOf(char c) const { return indexOf(c, 0); }
+	int indexOf(char c, unsigned int fromIndex) const;
+	int indexOf(const String &str) const { return indexOf(str, 0); }
+	int indexOf(const String &str, unsigned int fromIndex) const;
+	int lastIndexOf(char c) const;
+	int lastIndexOf(char c, unsigned int fromIndex) const;
+	int lastIndexOf(const String &str) const;
+	int lastIndexOf(const String &str, unsigned int fromIndex) const;
+	String substring(unsigned int beginIndex) const { return substring(beginIndex, s.length()); }
+	String substring(unsigned int beginIndex, unsigned int endIndex) const;
+
+	void replace(char find, char replace);
+	void replace(const String &find, const String &replace);
+	void remove(unsigned int index) { remove(index, (unsigned int)-1); }
+	void remove(unsigned int index, unsigned int count);
+	void toLowerCase();
+	void toUpperCase();
+	void trim();
+
+	long toInt() const;
+	float toFloat() const;
+	double toDouble() const;
+
+private:
+	std::string s;
+};
+
+class StringSumHelper : public String {
+public:
+	StringSumHelper(const String &s) : String(s) {}
+	StringSumHelper(const char *p) : String(p) {}
+};
+
+template<typename T>
+StringSumHelper operator+(const String &lhs, const T &rhs) {
+	StringSumHelper sum(lhs);
+	sum.concat(rhs);
+	return sum;
+}
+
+inline StringSumHelper operator+(const char *lhs, const String &rhs) {
+	StringSumHelper sum(lhs);
+	sum.concat(rhs);
+	return sum;
+}
+
+inline bool operator==(const char *lhs, const String &rhs) { return rhs.equals(lhs); }
+inline bool operator!=(const char *lhs, const String &rhs) { return !rhs.equals(lhs); }
+
+#endif
@@ -0,0 +1,15 @@
+#include "WiFi.h"
+#include "ESPmDNS.h"
+
+WiFiClass WiFi;
+MDNSResponder MDNS;
+
+String WiFiClass::macAddress() {
+	uint8_t mac[6];
+	char buf[18];
+
+	esp_efuse_mac_get_default(mac);
+	snprintf(buf, sizeof(buf), "%02X:%02X:%02X:%02X:%02X:%02X", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+
+	return buf;
+}
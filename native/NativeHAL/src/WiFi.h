@@ -0,0 +1,32 @@
+#ifndef _WIFI_H
+#define _WIFI_H
+
+#include "Arduino.h"
+#include "esp_wifi.h"
+
+// Always connected in station mode, on loopback
+class WiFiClass {
+public:
+	wifi_mode_t getMode() { return WIFI_MODE_STA; }
+	bool mode(wifi_mode_t mode) { return true; }
+	bool isConnected() { return true; }
+	bool setSleep(bool enabled) { return true; }
+	bool setHostname(const char *hostname) { this->hostname = hostname; return true; }
+	const char *getHostname() { return hostname.c_str(); }
+
+	IPAddress localIP() { return IPAddress(127, 0, 0, 1); }
+	IPAddress gatewayIP() { return IPAddress(127, 0, 0, 1); }
+	IPAddress subnetMask() { return IPAddress(255, 0, 0, 0); }
+	IPAddress softAPIP() { return IPAddress(); }
+
+	String SSID() { return "native"; }
+	int8_t RSSI() { return -50; }
+	String macAddress();
+
+private:
+	String hostname;
+};
+
+extern WiFiClass WiFi;
+
+#endif
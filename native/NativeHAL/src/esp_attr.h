@@ -0,0 +1,10 @@
+#ifndef _ESP_ATTR_H
+#define _ESP_ATTR_H
+
+// There is no RTC memory, so RTC_NOINIT data doesn't survive esp_restart()
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define RTC_DATA_ATTR
+#define RTC_NOINIT_ATTR
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef _ESP_IMAGE_FORMAT_H
+#define _ESP_IMAGE_FORMAT_H
+
+#include "esp_system.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+	uint32_t offset;
+	uint32_t size;
+} esp_partition_pos_t;
+
+typedef struct {
+	uint32_t start_addr;
+	uint32_t image_len;
+} esp_image_metadata_t;
+
+typedef enum {
+	ESP_IMAGE_VERIFY,
+	ESP_IMAGE_VERIFY_SILENT,
+	ESP_IMAGE_LOAD
+} esp_image_load_mode_t;
+
+esp_err_t esp_image_verify(esp_image_load_mode_t mode, const esp_partition_pos_t *part, esp_image_metadata_t *data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
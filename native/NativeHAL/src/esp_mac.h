@@ -0,0 +1,6 @@
+#ifndef _ESP_MAC_H
+#define _ESP_MAC_H
+
+#include "esp_system.h"
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef _ESP_OTA_OPS_H
+#define _ESP_OTA_OPS_H
+
+#include "esp_system.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+	uint32_t address;
+	uint32_t size;
+	char label[17];
+} esp_partition_t;
+
+// There are no partitions, so callers see NULL and report nothing
+const esp_partition_t *esp_ota_get_running_partition();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
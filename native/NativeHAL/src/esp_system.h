@@ -0,0 +1,50 @@
+#ifndef _ESP_SYSTEM_H
+#define _ESP_SYSTEM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef int esp_err_t;
+
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_NO_MEM 0x101
+#define ESP_ERR_INVALID_ARG 0x102
+#define ESP_ERR_INVALID_STATE 0x103
+
+typedef enum {
+	ESP_RST_UNKNOWN,
+	ESP_RST_POWERON,
+	ESP_RST_EXT,
+	ESP_RST_SW,
+	ESP_RST_PANIC,
+	ESP_RST_INT_WDT,
+	ESP_RST_TASK_WDT,
+	ESP_RST_WDT,
+	ESP_RST_DEEPSLEEP,
+	ESP_RST_BROWNOUT,
+	ESP_RST_SDIO
+} esp_reset_reason_t;
+
+typedef void (*shutdown_handler_t)();
+
+uint32_t esp_random();
+void esp_fill_random(void *buf, size_t len);
+
+// esp_restart() runs the shutdown handlers and re-executes the program, which then reports ESP_RST_SW
+esp_reset_reason_t esp_reset_reason();
+esp_err_t esp_register_shutdown_handler(shutdown_handler_t handler);
+void esp_restart() __attribute__((noreturn));
+
+// The MAC comes from TIMEFLIES_MAC (aa:bb:cc:dd:ee:ff) so several bridges can share a host
+esp_err_t esp_efuse_mac_get_default(uint8_t *mac);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,127 @@
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <list>
+#include <pthread.h>
+#include "esp_timer.h"
+
+struct esp_timer {
+	esp_timer_create_args_t args;
+	int64_t due = 0;		// 0 when not armed
+	uint64_t period = 0;
+};
+
+static std::mutex timerMutex;
+static std::condition_variable timerChanged;
+static std::list<esp_timer *> timers;
+static bool dispatching = false;
+
+int64_t esp_timer_get_time() {
+	static const std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - origin).count();
+}
+
+static void dispatch() {
+	pthread_setname_np(pthread_self(), "esp_timer");
+	std::unique_lock<std::mutex> lock(timerMutex);
+
+	while (true) {
+		esp_timer *next = NULL;
+		for (esp_timer *timer : timers) {
+			if (timer->due != 0 && (next == NULL || timer->due < next->due)) {
+				next = timer;
+			}
+		}
+
+		if (next == NULL) {
+			timerChanged.wait(lock);
+			continue;
+		}
+
+		int64_t now = esp_timer_get_time();
+		if (next->due > now) {
+			timerChanged.wait_for(lock, std::chrono::microseconds(next->due - now));
+			continue;
+		}
+
+		// Periodic timers keep their phase, and missed periods are skipped rather than run back to back
+		if (next->period != 0) {
+			next->due += next->period;
+			if (next->due <= now) {
+				next->due = now + next->period;
+			}
+		} else {
+			next->due = 0;
+		}
+
+		esp_timer_create_args_t args = next->args;
+		lock.unlock();
+		args.callback(args.arg);
+		lock.lock();
+	}
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *handle) {
+	if (args == NULL || args->callback == NULL || handle == NULL) {
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	std::lock_guard<std::mutex> lock(timerMutex);
+	if (!dispatching) {
+		dispatching = true;
+		std::thread(dispatch).detach();
+	}
+
+	esp_timer *timer = new esp_timer();
+	timer->args = *args;
+	timers.push_back(timer);
+	*handle = timer;
+
+	return ESP_OK;
+}
+
+static esp_err_t start(esp_timer_handle_t timer, uint64_t timeoutUs, uint64_t periodUs) {
+	std::lock_guard<std::mutex> lock(timerMutex);
+	if (timer->due != 0) {
+		return ESP_ERR_INVALID_STATE;
+	}
+
+	timer->due = esp_timer_get_time() + timeoutUs;
+	timer->period = periodUs;
+	timerChanged.notify_one();
+
+	return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeoutUs) {
+	return start(timer, timeoutUs, 0);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t periodUs) {
+	return start(timer, periodUs, periodUs);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+	std::lock_guard<std::mutex> lock(timerMutex);
+	if (timer->due == 0) {
+		return ESP_ERR_INVALID_STATE;
+	}
+
+	timer->due = 0;
+	timerChanged.notify_one();
+
+	return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+	std::lock_guard<std::mutex> lock(timerMutex);
+	if (timer->due != 0) {
+		return ESP_ERR_INVALID_STATE;
+	}
+
+	timers.remove(timer);
+	delete timer;
+
+	return ESP_OK;
+}
@@ -0,0 +1,13 @@
+#ifndef _ESP_WIFI_H
+#define _ESP_WIFI_H
+
+#include "esp_system.h"
+
+typedef enum {
+	WIFI_MODE_NULL = 0,
+	WIFI_MODE_STA,
+	WIFI_MODE_AP,
+	WIFI_MODE_APSTA
+} wifi_mode_t;
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef _FREERTOS_TASK_H
+#define _FREERTOS_TASK_H
+
+#include <sched.h>
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct NativeTask *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+/*
+ * Tasks are detached pthreads. Priorities and cores are ignored and stacks are
+ * whatever the host gives a thread, so the high water mark is just the size asked for.
+ */
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stackDepth, void *param,
+	UBaseType_t priority, TaskHandle_t *created, BaseType_t coreId);
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stackDepth, void *param,
+	UBaseType_t priority, TaskHandle_t *created);
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount();
+TaskHandle_t xTaskGetCurrentTaskHandle();
+char *pcTaskGetName(TaskHandle_t task);
+#define pcTaskGetTaskName pcTaskGetName
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clearCountOnExit, TickType_t ticksToWait);
+
+#define taskYIELD() sched_yield()
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
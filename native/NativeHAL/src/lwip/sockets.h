@@ -0,0 +1,13 @@
+#ifndef _LWIP_SOCKETS_H
+#define _LWIP_SOCKETS_H
+
+// lwIP's BSD socket API is the host's
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#endif
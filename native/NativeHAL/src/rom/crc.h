@@ -0,0 +1,17 @@
+#ifndef _ROM_CRC_H
+#define _ROM_CRC_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Same result as the ROM's, i.e. the usual CRC-32 when crc starts at 0
+uint32_t crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
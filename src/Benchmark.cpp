@@ -0,0 +1,77 @@
+#include "Benchmark.h"
+#include "esp_timer.h"
+#ifdef NATIVE_HAL
+#include <NativeAlloc.h>
+#endif
+
+Benchmark *Benchmark::first = 0;
+Benchmark *Benchmark::last = 0;
+
+Benchmark::Benchmark(const char *name, Kernel kernel) : name(name), kernel(kernel) {
+	if (last == 0) {
+		first = this;
+	} else {
+		last->next = this;
+	}
+	last = this;
+}
+
+Benchmark::Result Benchmark::measure(uint32_t minMs) {
+	Result result = {};
+	uint64_t minUs = minMs * 1000ULL;
+	uint32_t iterations = 1;
+
+	kernel();	// Anything done only the first time isn't what we are after
+
+	while (true) {
+#ifdef NATIVE_HAL
+		NativeAllocCounts allocStart = nativeAllocCounts();
+#endif
+		uint32_t cycleStart = ESP.getCycleCount();
+		int64_t start = esp_timer_get_time();
+
+		for (uint32_t i=0; i < iterations; i++) {
+			kernel();
+		}
+
+		result.us = esp_timer_get_time() - start;
+		result.cycles = ESP.getCycleCount() - cycleStart;
+		result.iterations = iterations;
+#ifdef NATIVE_HAL
+		NativeAllocCounts allocEnd = nativeAllocCounts();
+		result.allocations = allocEnd.allocations - allocStart.allocations;
+		result.bytes = allocEnd.bytes - allocStart.bytes;
+#endif
+
+		if (result.us >= minUs || iterations >= BENCHMARK_MAX_ITERATIONS) {
+			return result;
+		}
+
+		// Aim a little past minMs from what this batch took, but grow at most 10x at a time
+		uint64_t next = result.us > 0 ? iterations * minUs * 14 / (result.us * 10) : (uint64_t)iterations * 10;
+		next = max(next, (uint64_t)iterations + 1);
+		next = min(next, (uint64_t)iterations * 10);
+		iterations = min(next, (uint64_t)BENCHMARK_MAX_ITERATIONS);
+	}
+}
+
+void Benchmark::runAll(Print &out, const char *filter, uint32_t minMs) {
+	out.printf("%-36s %10s %10s %8s %8s %10s\n", "Benchmark", "ns/op", "cycles/op", "allocs", "bytes", "iterations");
+
+	for (Benchmark *benchmark = first; benchmark != 0; benchmark = benchmark->next) {
+		if (filter != NULL && *filter && strstr(benchmark->name, filter) == NULL) {
+			continue;
+		}
+
+		Result result = benchmark->measure(minMs);
+		double n = result.iterations;
+
+		out.printf("%-36s %10.0f %10.0f", benchmark->name, result.us * 1000.0 / n, result.cycles / n);
+#ifdef NATIVE_HAL
+		out.printf(" %8.2f %8.0f", result.allocations / n, result.bytes / n);
+#else
+		out.printf(" %8s %8s", "-", "-");
+#endif
+		out.printf(" %10lu\n", (unsigned long)result.iterations);
+	}
+}
@@ -0,0 +1,47 @@
+#ifndef _BENCHMARK_H
+#define _BENCHMARK_H
+
+#include <Arduino.h>
+#include <functional>
+
+#define BENCHMARK_MAX_ITERATIONS 1000000
+
+/*
+ * Microbenchmarks that register themselves when constructed, like Metrics. Each
+ * kernel is run in batches, growing the batch until one takes at least minMs,
+ * and that batch is reported per iteration, as Google Benchmark does.
+ *
+ * Time and cycles are reported everywhere. Allocations are only counted on the
+ * host, the ESP32 shows them as -.
+ */
+class Benchmark {
+public:
+	typedef std::function<void()> Kernel;
+
+	struct Result {
+		uint32_t iterations;
+		uint64_t us;
+		uint32_t cycles;	// Keep batches under 2^32 cycles, ~1.4s on the host
+		uint64_t allocations;
+		uint64_t bytes;
+	};
+
+	Benchmark(const char *name, Kernel kernel);
+
+	Result measure(uint32_t minMs);
+
+	// One line for each benchmark whose name contains filter (all if NULL or empty)
+	static void runAll(Print &out, const char *filter, uint32_t minMs);
+
+	const char *getName() const { return name; }
+
+private:
+	const char *name;
+	Kernel kernel;
+	Benchmark *next = 0;
+
+	static Benchmark *first;
+	static Benchmark *last;
+};
+
+#endif
@@ -0,0 +1,215 @@
+#include <algorithm>
+#include "esp_log.h"
+#include "BlankingSchedule.h"
+
+extern const char* TIME_FLIES_TAG;
+
+BlankingSchedule::BlankingSchedule() {
+	mutex = xSemaphoreCreateMutex();
+	segments[0].start = 0;
+	segments[0].state = DISPLAY_ON;
+	numSegments = 1;
+}
+
+bool BlankingSchedule::parseTime(const char *s, uint16_t &minutes) {
+	int hours, mins;
+	if (sscanf(s, "%d:%d", &hours, &mins) != 2 || hours < 0 || hours > 24 || mins < 0 || mins > 59) {
+		return false;
+	}
+
+	minutes = (hours * 60 + mins) % MINUTES_PER_DAY;
+	return true;
+}
+
+// Windows are kept within the week, one that runs past the end of Saturday is split
+void BlankingSchedule::addWindow(uint16_t start, uint16_t end, uint8_t state) {
+	if (end > MINUTES_PER_WEEK) {
+		addWindow(start, MINUTES_PER_WEEK, state);
+		addWindow(0, end - MINUTES_PER_WEEK, state);
+		return;
+	}
+
+	if (numWindows < SCHEDULE_MAX_WINDOWS) {
+		windows[numWindows].start = start;
+		windows[numWindows].end = end;
+		windows[numWindows].state = state;
+		numWindows++;
+	}
+}
+
+bool BlankingSchedule::parseEntry(char *entry, bool offStateOff) {
+	char *days = strtok(entry, ",");
+	char *times = strtok(NULL, ",");
+	char *mode = strtok(NULL, ",");
+
+	if (days == NULL || times == NULL) {
+		return false;
+	}
+
+	char *dash = strchr(times, '-');
+	uint16_t start, end;
+	if (dash == NULL) {
+		return false;
+	}
+	*dash = 0;
+	if (!parseTime(times, start) || !parseTime(dash + 1, end)) {
+		return false;
+	}
+
+	uint8_t state = offStateOff ? DISPLAY_OFF : DISPLAY_DIM;
+	if (mode != NULL) {
+		if (*mode == 'd') {
+			state = DISPLAY_DIM;
+		} else if (*mode == 'o') {
+			state = DISPLAY_OFF;
+		} else {
+			return false;
+		}
+	}
+
+	uint8_t dayMask = 0;
+	if (strcmp(days, "*") == 0) {
+		dayMask = 0x7f;
+	} else {
+		for (const char *p = days; *p; p++) {
+			if (*p < '0' || *p > '6') {
+				return false;
+			}
+			int from = *p - '0';
+			int to = from;
+			if (p[1] == '-') {
+				if (p[2] < '0' || p[2] > '6' || p[2] - '0' < from) {
+					return false;
+				}
+				to = p[2] - '0';
+				p += 2;
+			}
+			for (int day=from; day <= to; day++) {
+				dayMask |= 1 << day;
+			}
+		}
+	}
+
+	uint16_t length = end > start ? end - start : end + MINUTES_PER_DAY - start;
+	for (int day=0; day < 7; day++) {
+		if (dayMask & (1 << day)) {
+			addWindow(day * MINUTES_PER_DAY + start, day * MINUTES_PER_DAY + start + length, state);
+		}
+	}
+
+	return true;
+}
+
+int BlankingSchedule::compile(const char *spec, uint8_t displayOn, uint8_t displayOff, bool offStateOff) {
+	char buf[128];
+	strncpy(buf, spec, sizeof(buf) - 1);
+	buf[sizeof(buf) - 1] = 0;
+
+	numWindows = 0;
+	int badEntries = 0;
+
+	if (buf[0] == 0) {
+		// The old single window: off from display_off until display_on, every day
+		if (displayOn % 24 != displayOff % 24) {
+			snprintf(buf, sizeof(buf), "*,%d:00-%d:00", displayOff % 24, displayOn % 24);
+		}
+	}
+
+	// strtok is used per entry, so split the entries by hand
+	char *entry = buf;
+	while (entry != NULL && *entry) {
+		char *next = strchr(entry, ';');
+		if (next != NULL) {
+			*next++ = 0;
+		}
+
+		if (!parseEntry(entry, offStateOff)) {
+			badEntries++;
+		}
+
+		entry = next;
+	}
+
+	// Every window edge is a potential segment start
+	uint16_t edges[SCHEDULE_MAX_WINDOWS * 2 + 1];
+	int numEdges = 0;
+	edges[numEdges++] = 0;
+	for (int i=0; i < numWindows; i++) {
+		edges[numEdges++] = windows[i].start;
+		if (windows[i].end < MINUTES_PER_WEEK) {
+			edges[numEdges++] = windows[i].end;
+		}
+	}
+	std::sort(edges, edges + numEdges);
+
+	Segment compiled[SCHEDULE_MAX_SEGMENTS];
+	int count = 0;
+	for (int i=0; i < numEdges && count < SCHEDULE_MAX_SEGMENTS; i++) {
+		if (i > 0 && edges[i] == edges[i - 1]) {
+			continue;
+		}
+
+		uint8_t state = DISPLAY_ON;
+		for (int j=0; j < numWindows; j++) {
+			if (edges[i] >= windows[j].start && edges[i] < windows[j].end) {
+				state = max(state, windows[j].state);
+			}
+		}
+
+		// Merge runs of the same state so the next segment is always a change
+		if (count == 0 || compiled[count - 1].state != state) {
+			compiled[count].start = edges[i];
+			compiled[count].state = state;
+			count++;
+		}
+	}
+
+	if (xSemaphoreTake(mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+		ESP_LOGE(TIME_FLIES_TAG, "Failed to obtain schedule mutex");
+		return badEntries;
+	}
+
+	memcpy(segments, compiled, count * sizeof(Segment));
+	numSegments = count;
+	errors = badEntries;
+
+	xSemaphoreGive(mutex);
+
+	return badEntries;
+}
+
+DisplayState BlankingSchedule::lookup(uint16_t minuteOfWeek, uint16_t &untilMinutes) {
+	if (xSemaphoreTake(mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+		ESP_LOGE(TIME_FLIES_TAG, "Failed to obtain schedule mutex");
+		untilMinutes = 1;
+		return DISPLAY_ON;
+	}
+
+	// Last segment starting at or before minuteOfWeek. The first one always starts at 0.
+	int lo = 0, hi = numSegments - 1;
+	while (lo < hi) {
+		int mid = (lo + hi + 1) / 2;
+		if (segments[mid].start <= minuteOfWeek) {
+			lo = mid;
+		} else {
+			hi = mid - 1;
+		}
+	}
+
+	DisplayState state = (DisplayState)segments[lo].state;
+
+	if (numSegments == 1) {
+		untilMinutes = SCHEDULE_NEVER;
+	} else if (lo + 1 < numSegments) {
+		untilMinutes = segments[lo + 1].start - minuteOfWeek;
+	} else if (segments[0].state != state) {
+		untilMinutes = MINUTES_PER_WEEK - minuteOfWeek;
+	} else {
+		// The week wraps into the same state, so the change is at the second segment
+		untilMinutes = MINUTES_PER_WEEK - minuteOfWeek + segments[1].start;
+	}
+
+	xSemaphoreGive(mutex);
+
+	return state;
+}
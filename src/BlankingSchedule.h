@@ -0,0 +1,71 @@
+#ifndef _BLANKING_SCHEDULE_H
+#define _BLANKING_SCHEDULE_H
+
+#include <Arduino.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#define MINUTES_PER_DAY 1440
+#define MINUTES_PER_WEEK 10080
+#define SCHEDULE_MAX_WINDOWS 64		// After expanding days, e.g. "1-5,..." is 5 windows
+#define SCHEDULE_MAX_SEGMENTS 130
+#define SCHEDULE_NEVER 0xffff
+
+typedef enum {
+	DISPLAY_ON = 0,
+	DISPLAY_DIM,
+	DISPLAY_OFF
+} DisplayState;
+
+/*
+ * A week of blanking windows, compiled from a string like
+ *
+ *   1-5,12:00-13:00,d;*,23:00-06:30,o
+ *
+ * Each entry is days (0 = Sunday, digits and ranges, or * for every day), a start
+ * and end time (a window ending earlier than it starts runs past midnight) and
+ * optionally d (dim) or o (off). Without one it does whatever off_state_off says.
+ * Where windows overlap, off beats dim. An empty string gives the old single
+ * display_on/display_off window every day.
+ *
+ * Compiling turns the windows into a sorted list of minute-of-week segments
+ * with the state from each start, so a lookup is a binary search.
+ */
+class BlankingSchedule {
+public:
+	BlankingSchedule();
+
+	// Returns the number of entries that couldn't be parsed, they are left out
+	int compile(const char *spec, uint8_t displayOn, uint8_t displayOff, bool offStateOff);
+
+	// untilMinutes is set to how long until the state changes, or SCHEDULE_NEVER
+	DisplayState lookup(uint16_t minuteOfWeek, uint16_t &untilMinutes);
+
+	int getNumSegments() const { return numSegments; }
+	int getErrors() const { return errors; }
+
+private:
+	struct Window {
+		uint16_t start;
+		uint16_t end;
+		uint8_t state;
+	};
+
+	struct Segment {
+		uint16_t start;
+		uint8_t state;
+	};
+
+	static bool parseTime(const char *s, uint16_t &minutes);
+	bool parseEntry(char *entry, bool offStateOff);
+	void addWindow(uint16_t start, uint16_t end, uint8_t state);
+
+	SemaphoreHandle_t mutex;
+	Window windows[SCHEDULE_MAX_WINDOWS];
+	int numWindows = 0;
+	Segment segments[SCHEDULE_MAX_SEGMENTS];
+	int numSegments = 0;
+	int errors = 0;
+};
+
+#endif
@@ -0,0 +1,76 @@
+#include "BlankingScheduler.h"
+
+/*
+ * mktime() takes care of DST, so a change due at a time that gets skipped still
+ * lands on a real instant.
+ */
+void BlankingScheduler::recompute(time_t now) {
+	struct tm local;
+	localtime_r(&now, &local);
+
+	valid = true;
+	stats.recomputes++;
+
+	uint16_t untilMinutes;
+	scheduled = schedule.lookup(local.tm_wday * MINUTES_PER_DAY + local.tm_hour * 60 + local.tm_min, untilMinutes);
+
+	if (untilMinutes == SCHEDULE_NEVER) {
+		nextChange = 0;
+		return;
+	}
+
+	struct tm change = local;
+	change.tm_sec = 0;
+	change.tm_min += untilMinutes;
+	change.tm_isdst = -1;
+
+	nextChange = mktime(&change);
+	if (nextChange <= now) {
+		nextChange = now + 60;
+	}
+}
+
+bool BlankingScheduler::movementOn(uint32_t nowMs, uint32_t &untilMs) {
+	untilMs = UINT32_MAX;	// Only a trigger or a config change turns it back on
+
+	if (!mov.isEnabled() || mov.getDelayMs() == 0) {
+		return true;
+	}
+
+	uint32_t elapsed = nowMs - mov.getOnTime();
+	if (elapsed >= mov.getDelayMs()) {
+		return false;
+	}
+
+	untilMs = mov.getDelayMs() - elapsed;
+	return true;
+}
+
+DisplayState BlankingScheduler::state() {
+	stats.evaluations++;
+
+	time_t now = time.now();
+	if (!valid || (nextChange != 0 && now >= nextChange)) {
+		recompute(now);
+	}
+
+	uint32_t untilMs;
+	if (movementOn(time.ms(), untilMs)) {
+		return scheduled;
+	}
+
+	return max(scheduled, idleState);	// Off beats dim beats on
+}
+
+uint32_t BlankingScheduler::msUntilChange() {
+	uint32_t untilMs;
+	movementOn(time.ms(), untilMs);
+
+	if (nextChange != 0) {
+		time_t now = time.now();
+		uint32_t scheduleMs = nextChange > now ? (nextChange - now) * 1000 : 0;
+		untilMs = min(untilMs, scheduleMs);
+	}
+
+	return min(untilMs, (uint32_t)BLANKING_MAX_SLEEP);
+}
@@ -0,0 +1,55 @@
+#ifndef _BLANKING_SCHEDULER_H
+#define _BLANKING_SCHEDULER_H
+
+#include <Arduino.h>
+#include <time.h>
+#include "MovementSensor.h"
+#include "BlankingSchedule.h"
+#include "TimeSource.h"
+
+#define BLANKING_MAX_SLEEP 60000	// Never trust a computed transition for longer than this
+
+/*
+ * Works out whether the clock should be on, dim or off from the blanking schedule
+ * and the movement timeout, and when that can next change. The schedule is only
+ * looked up when the cached transition has passed or something it depends on
+ * (the schedule, time zone, the time itself) has changed, so the SPP task can
+ * sleep until the next transition instead of polling.
+ */
+class BlankingScheduler {
+public:
+	struct Stats {
+		uint32_t evaluations;
+		uint32_t recomputes;
+	};
+
+	BlankingScheduler(TimeSource &time, MovementSensor &mov, BlankingSchedule &schedule) :
+		time(time), mov(mov), schedule(schedule) {}
+
+	void invalidate() { valid = false; }
+
+	// What the display does once movement has timed out
+	void setIdleState(DisplayState idleState) { this->idleState = idleState; }
+
+	DisplayState state();
+	uint32_t msUntilChange();	// Call after state()
+
+	time_t getNextChange() const { return nextChange; }
+	Stats getStats() const { return stats; }
+
+private:
+	void recompute(time_t now);
+	bool movementOn(uint32_t nowMs, uint32_t &untilMs);
+
+	TimeSource &time;
+	MovementSensor &mov;
+	BlankingSchedule &schedule;
+
+	volatile bool valid = false;
+	DisplayState scheduled = DISPLAY_ON;
+	DisplayState idleState = DISPLAY_OFF;
+	time_t nextChange = 0;	// 0 = never
+	Stats stats = {};
+};
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef _BOOT_PROFILE_H
+#define _BOOT_PROFILE_H
+
+#include <Arduino.h>
+#include "esp_timer.h"
+
+#define MAX_BOOT_PHASES 16
+
+/*
+ * Timestamps (since the chip started) of the milestones between power on and the
+ * first command reaching the clock. Each phase is recorded once.
+ */
+class BootProfile {
+public:
+	void mark(const char *phase) {
+		if (numPhases >= MAX_BOOT_PHASES) {
+			return;
+		}
+
+		for (int i=0; i < numPhases; i++) {
+			if (phases[i].name == phase) {
+				return;
+			}
+		}
+
+		phases[numPhases].name = phase;
+		phases[numPhases].us = esp_timer_get_time();
+		numPhases++;
+	}
+
+	String getSummary() {
+		String summary;
+		char line[48];
+		int64_t last = 0;
+
+		for (int i=0; i < numPhases; i++) {
+			snprintf(line, sizeof(line), "%s%s: %lums (+%lu)", i == 0 ? "" : "<br>", phases[i].name,
+				(unsigned long)(phases[i].us / 1000), (unsigned long)((phases[i].us - last) / 1000));
+			summary += line;
+			last = phases[i].us;
+		}
+
+		return summary;
+	}
+
+private:
+	struct Phase {
+		const char *name;
+		int64_t us;
+	};
+
+	Phase phases[MAX_BOOT_PHASES];
+	int numPhases = 0;
+};
+
+#endif
@@ -0,0 +1,146 @@
+#include "esp_log.h"
+#include "Capture.h"
+
+extern const char* TIME_FLIES_TAG;
+
+static void put16(uint8_t *p, uint16_t v) {
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+static void put32(uint8_t *p, uint32_t v) {
+	put16(p, v);
+	put16(p + 2, v >> 16);
+}
+
+Capture::Capture(FS &fs, const char *path) : fs(fs), path(path) {
+	mutex = xSemaphoreCreateMutex();
+	pending = xSemaphoreCreateBinary();
+}
+
+bool Capture::start() {
+	if (buffers == NULL) {
+		buffers = (uint8_t *)malloc(2 * CAPTURE_BUFFER_SIZE);
+		if (buffers == NULL) {
+			ESP_LOGE(TIME_FLIES_TAG, "No memory for capture buffers");
+			return false;
+		}
+	}
+
+	if (xSemaphoreTake(mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+		ESP_LOGE(TIME_FLIES_TAG, "Failed to obtain capture mutex");
+		return false;
+	}
+
+	File file = fs.open(path, "w");
+	bool opened = file;
+	if (opened) {
+		uint8_t header[12] = {};
+		memcpy(header, CAPTURE_MAGIC, 4);
+		header[4] = CAPTURE_VERSION;
+		put32(header + 8, time(NULL));
+		file.write(header, sizeof(header));
+		file.close();
+
+		portENTER_CRITICAL(&mux);
+		used[0] = used[1] = 0;
+		startMs = millis();
+		stats = {};
+		stats.bytes = sizeof(header);
+		enabled = true;
+		portEXIT_CRITICAL(&mux);
+	} else {
+		ESP_LOGE(TIME_FLIES_TAG, "Couldn't create %s", path);
+	}
+
+	xSemaphoreGive(mutex);
+
+	return opened;
+}
+
+void Capture::stop() {
+	enabled = false;
+
+	// Whatever was recorded up to now
+	step();
+}
+
+void Capture::record(RecordType type, uint8_t channel, const void *data, size_t len) {
+	if (!enabled) {
+		return;
+	}
+
+	len = min(len, (size_t)CAPTURE_MAX_PAYLOAD);
+	bool wake = false;
+
+	portENTER_CRITICAL(&mux);
+	uint8_t *buffer = buffers + active * CAPTURE_BUFFER_SIZE;
+	size_t &n = used[active];
+	if (n + 8 + len <= CAPTURE_BUFFER_SIZE && stats.bytes + n + 8 + len <= CAPTURE_MAX_SIZE) {
+		buffer[n] = type;
+		buffer[n + 1] = channel;
+		put16(buffer + n + 2, len);
+		put32(buffer + n + 4, millis() - startMs);
+		memcpy(buffer + n + 8, data, len);
+		n += 8 + len;
+		stats.records++;
+		wake = n >= CAPTURE_BUFFER_SIZE / 2;
+	} else {
+		stats.dropped++;
+	}
+	portEXIT_CRITICAL(&mux);
+
+	if (wake) {
+		xSemaphoreGive(pending);
+		if (pendingCallback) {
+			pendingCallback();
+		}
+	}
+}
+
+void Capture::loop() {
+	while (true) {
+		uint32_t wait = step();
+		xSemaphoreTake(pending, wait == CAPTURE_IDLE ? portMAX_DELAY : pdMS_TO_TICKS(wait));
+	}
+}
+
+uint32_t Capture::step() {
+	if (xSemaphoreTake(mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+		ESP_LOGE(TIME_FLIES_TAG, "Failed to obtain capture mutex");
+		return CAPTURE_FLUSH_INTERVAL;
+	}
+
+	// Records carry on into the other buffer while this one is written
+	portENTER_CRITICAL(&mux);
+	int full = active;
+	active = 1 - active;
+	portEXIT_CRITICAL(&mux);
+
+	if (used[full] > 0) {
+		write(buffers + full * CAPTURE_BUFFER_SIZE, used[full]);
+		portENTER_CRITICAL(&mux);
+		used[full] = 0;
+		portEXIT_CRITICAL(&mux);
+	}
+
+	xSemaphoreGive(mutex);
+
+	return enabled ? CAPTURE_FLUSH_INTERVAL : CAPTURE_IDLE;
+}
+
+// Called with mutex held
+void Capture::write(const uint8_t *data, size_t len) {
+	File file = fs.open(path, "a");
+	if (!file) {
+		ESP_LOGE(TIME_FLIES_TAG, "Couldn't append to %s", path);
+		return;
+	}
+
+	file.write(data, len);
+	file.close();
+
+	portENTER_CRITICAL(&mux);
+	stats.bytes += len;
+	portEXIT_CRITICAL(&mux);
+}
@@ -0,0 +1,80 @@
+#ifndef _CAPTURE_H
+#define _CAPTURE_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include <functional>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#define CAPTURE_MAGIC "TFCP"
+#define CAPTURE_VERSION 1
+#define CAPTURE_BUFFER_SIZE 2048		// Each of two, records go in one while the other is written out
+#define CAPTURE_MAX_SIZE (256 * 1024)	// Recording stops when the file gets this big
+#define CAPTURE_FLUSH_INTERVAL 1000
+#define CAPTURE_MAX_PAYLOAD 512
+#define CAPTURE_IDLE UINT32_MAX
+
+/*
+ * Records what comes into the bridge, and what it says to the SPP server, so a
+ * session can be played back against the native build with tools/replay.py.
+ * Off until start(), which is also when the buffers are allocated. record() only
+ * copies into RAM; step() appends what has built up to the file, so it runs on a
+ * task that can afford to wait for flash.
+ *
+ * The file is a 12 byte header: "TFCP", version, 3 reserved bytes and the epoch
+ * seconds when recording started. Then records, each an 8 byte header of type,
+ * channel, payload length (16 bits) and ms since the start (32 bits), then the
+ * payload. All little endian. The channel is the WebSocket client id's low byte.
+ */
+class Capture {
+public:
+	typedef enum {
+		WS_CONNECT = 1,
+		WS_DISCONNECT,
+		WS_IN,			// A text message from a client
+		SERIAL_TX,		// A line sent to the SPP server, without the CRLF
+		SERIAL_RX,		// A line from it, without the LF
+		NTP,			// The time was synced, payload is what TimeSync said
+		SYNC_IN			// A sync bus packet
+	} RecordType;
+
+	struct Stats {
+		uint32_t records;
+		uint32_t dropped;	// Buffer full, or the file was
+		uint32_t bytes;		// In the file, header included
+	};
+
+	Capture(FS &fs, const char *path);
+
+	bool start();
+	void stop();
+	bool isEnabled() const { return enabled; }
+
+	void record(RecordType type, uint8_t channel, const void *data, size_t len);
+
+	void loop();		// Runs forever on its own task
+	uint32_t step();	// Writes out what is buffered, returns ms until it next needs to
+	void setPendingCallback(std::function<void()> callback) { pendingCallback = callback; }
+
+	Stats getStats() const { return stats; }
+	const char *getPath() const { return path; }
+
+private:
+	void write(const uint8_t *data, size_t len);
+
+	FS &fs;
+	const char *path;
+	SemaphoreHandle_t mutex;		// Taken for as long as a file write, so not by record()
+	SemaphoreHandle_t pending;
+	std::function<void()> pendingCallback;	// For when there is no task waiting on pending
+	portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+	volatile bool enabled = false;
+	uint32_t startMs = 0;
+	uint8_t *buffers = NULL;		// Two of CAPTURE_BUFFER_SIZE
+	size_t used[2] = {};
+	int active = 0;
+	Stats stats = {};
+};
+
+#endif
@@ -0,0 +1,149 @@
+#include "esp_log.h"
+#include "CommandQueue.h"
+
+extern const char* TIME_FLIES_TAG;
+
+CommandQueue::CommandQueue() {
+	mutex = xSemaphoreCreateMutex();
+	available = xSemaphoreCreateBinary();
+}
+
+bool CommandQueue::coalescable(const char *msg) {
+	return strstr(msg, "$LED") != NULL;
+}
+
+// e.g. 0x13,$LED2,R,5*** and 0x13,$LED2,R,7*** match
+bool CommandQueue::sameTarget(const char *a, const char *b) {
+	const char *aEnd = strrchr(a, ',');
+	const char *bEnd = strrchr(b, ',');
+
+	return aEnd != NULL && bEnd != NULL && aEnd - a == bEnd - b && strncmp(a, b, aEnd - a) == 0;
+}
+
+bool CommandQueue::push(const char *msg, Priority priority) {
+	if (xSemaphoreTake(mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+		ESP_LOGE(TIME_FLIES_TAG, "Failed to obtain command queue mutex");
+		return false;
+	}
+
+	Ring &ring = rings[priority];
+	bool queued = false;
+	uint32_t now = micros();
+
+	if (priority == NORMAL && coalescable(msg)) {
+		for (int i=0; i < ring.count && !queued; i++) {
+			int index = (ring.head + i) % SPP_QUEUE_SIZE;
+			char *queuedMsg = ring.msgs[index];
+			if (sameTarget(queuedMsg, msg)) {
+				strncpy(queuedMsg, msg, MAX_MSG_SIZE - 1);
+				queuedMsg[MAX_MSG_SIZE - 1] = 0;
+				ring.queuedUs[index] = now;	// The latency that matters is the new value's
+				stats.coalesced++;
+				queued = true;
+			}
+		}
+	}
+
+	if (!queued) {
+		if (ring.count < SPP_QUEUE_SIZE) {
+			int index = (ring.head + ring.count) % SPP_QUEUE_SIZE;
+			char *tail = ring.msgs[index];
+			strncpy(tail, msg, MAX_MSG_SIZE - 1);
+			tail[MAX_MSG_SIZE - 1] = 0;
+			ring.queuedUs[index] = now;
+			ring.count++;
+			stats.enqueued++;
+			queued = true;
+		} else {
+			stats.dropped++;
+		}
+	}
+
+	xSemaphoreGive(mutex);
+
+	if (queued) {
+		xSemaphoreGive(available);
+		if (availableCallback) {
+			availableCallback();
+		}
+	}
+
+	return queued;
+}
+
+// Each command is copied out on its own, so nothing is shared between callers
+int CommandQueue::pushAll(const char *commands, Priority priority) {
+	char msg[MAX_MSG_SIZE];
+	int queued = 0;
+
+	while (*commands) {
+		const char *end = strchr(commands, ';');
+		size_t len = end != NULL ? end - commands : strlen(commands);
+		if (len > 0) {
+			len = min(len, (size_t)MAX_MSG_SIZE - 1);
+			memcpy(msg, commands, len);
+			msg[len] = 0;
+			if (push(msg, priority)) {
+				queued++;
+			}
+		}
+
+		if (end == NULL) {
+			break;
+		}
+		commands = end + 1;
+	}
+
+	return queued;
+}
+
+bool CommandQueue::wait(TickType_t ticks) {
+	if (depth(URGENT) + depth(NORMAL) > 0) {
+		return true;
+	}
+
+	xSemaphoreTake(available, ticks);
+
+	return depth(URGENT) + depth(NORMAL) > 0;
+}
+
+bool CommandQueue::pop(char *msg, uint32_t *queuedUs) {
+	if (xSemaphoreTake(mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+		ESP_LOGE(TIME_FLIES_TAG, "Failed to obtain command queue mutex");
+		return false;
+	}
+
+	bool popped = false;
+	for (int priority=URGENT; priority < NUM_PRIORITIES && !popped; priority++) {
+		Ring &ring = rings[priority];
+		if (ring.count > 0) {
+			strcpy(msg, ring.msgs[ring.head]);
+			if (queuedUs != 0) {
+				*queuedUs = ring.queuedUs[ring.head];
+			}
+			ring.head = (ring.head + 1) % SPP_QUEUE_SIZE;
+			ring.count--;
+			popped = true;
+		}
+	}
+
+	xSemaphoreGive(mutex);
+
+	return popped;
+}
+
+void CommandQueue::kick() {
+	xSemaphoreGive(available);
+	if (availableCallback) {
+		availableCallback();
+	}
+}
+
+int CommandQueue::depth(Priority priority) {
+	// A single int read, no need to lock
+	return rings[priority].count;
+}
+
+int CommandQueue::spaces(Priority priority) {
+	return SPP_QUEUE_SIZE - rings[priority].count;
+}
@@ -0,0 +1,62 @@
+#ifndef _COMMAND_QUEUE_H
+#define _COMMAND_QUEUE_H
+
+#include <Arduino.h>
+#include <functional>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#define MAX_MSG_SIZE 40
+#define SPP_QUEUE_SIZE 40
+
+/*
+ * Commands waiting to go to the clock. Urgent commands (time, display on/off) jump
+ * ahead of normal ones. A normal LED command replaces one for the same LED and
+ * color that hasn't been sent yet, so dragging a slider doesn't fill the queue.
+ */
+class CommandQueue {
+public:
+	typedef enum {
+		URGENT = 0,
+		NORMAL,
+		NUM_PRIORITIES
+	} Priority;
+
+	struct Stats {
+		uint32_t enqueued;
+		uint32_t coalesced;
+		uint32_t dropped;
+	};
+
+	CommandQueue();
+
+	bool push(const char *msg, Priority priority);
+	int pushAll(const char *commands, Priority priority);	// ; separated, returns how many were queued
+	bool wait(TickType_t ticks);	// True if there is something to pop
+	bool pop(char *msg, uint32_t *queuedUs = 0);	// queuedUs is micros() when msg was pushed
+	void kick();	// Makes wait() return early with nothing to pop
+	void setAvailableCallback(std::function<void()> callback) { availableCallback = callback; }	// For when nobody is in wait()
+
+	int depth(Priority priority);
+	int spaces(Priority priority);
+	Stats getStats() const { return stats; }
+
+private:
+	struct Ring {
+		char msgs[SPP_QUEUE_SIZE][MAX_MSG_SIZE];
+		uint32_t queuedUs[SPP_QUEUE_SIZE];
+		int head;
+		int count;
+	};
+
+	static bool coalescable(const char *msg);
+	static bool sameTarget(const char *a, const char *b);
+
+	SemaphoreHandle_t mutex;
+	SemaphoreHandle_t available;
+	std::function<void()> availableCallback;
+	Ring rings[NUM_PRIORITIES] = {};
+	Stats stats = {};
+};
+
+#endif
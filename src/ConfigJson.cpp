@@ -0,0 +1,16 @@
+#include "ConfigJson.h"
+
+ConfigJson::Entry ConfigJson::entries[CONFIG_JSON_ITEMS];
+int ConfigJson::numEntries = 0;
+
+void ConfigJson::write(JsonWriter &writer, BaseConfigItem &item) {
+	for (int i=0; i < numEntries; i++) {
+		if (entries[i].item == &item) {
+			entries[i].write(writer, item);
+			return;
+		}
+	}
+
+	writer.raw(item.toJSON());
+	writer.allocated();
+}
@@ -0,0 +1,52 @@
+#ifndef _CONFIG_JSON_H
+#define _CONFIG_JSON_H
+
+#include <Arduino.h>
+#include <ConfigItem.h>
+#include "JsonWriter.h"
+
+#define CONFIG_JSON_ITEMS 48
+
+/*
+ * Writes config values straight into a JsonWriter. toJSON() builds a String for
+ * every value, so items registered here as they go into their composite are
+ * written from their typed value instead. Anything else still uses toJSON().
+ *
+ *   BaseConfigItem* syncSet[] { ConfigJson::add(sync_port), ..., 0 };
+ */
+class ConfigJson {
+public:
+	template<typename T> static BaseConfigItem *add(ConfigItem<T> &item) {
+		if (numEntries < CONFIG_JSON_ITEMS) {
+			entries[numEntries].item = &item;
+			entries[numEntries].write = writeItem<T>;
+			numEntries++;
+		}
+
+		return &item;
+	}
+
+	static void write(JsonWriter &writer, BaseConfigItem &item);
+
+private:
+	typedef void (*WriteFunc)(JsonWriter &writer, const BaseConfigItem &item);
+
+	struct Entry {
+		const BaseConfigItem *item;
+		WriteFunc write;
+	};
+
+	template<typename T> static void writeItem(JsonWriter &writer, const BaseConfigItem &item) {
+		writeValue(writer, static_cast<const ConfigItem<T>&>(item).value);
+	}
+
+	static void writeValue(JsonWriter &writer, byte value) { writer.number(value); }
+	static void writeValue(JsonWriter &writer, int value) { writer.integer(value); }
+	static void writeValue(JsonWriter &writer, bool value) { writer.raw(value ? "true" : "false"); }
+	static void writeValue(JsonWriter &writer, const String &value) { writer.string(value.c_str()); }
+
+	static Entry entries[CONFIG_JSON_ITEMS];
+	static int numEntries;
+};
+
+#endif
@@ -0,0 +1,130 @@
+#include "esp_log.h"
+#include "ConfigPersistence.h"
+#include "Trace.h"
+
+extern const char* TIME_FLIES_TAG;
+
+ConfigPersistence::ConfigPersistence(ConfigStore &store, TimeSource &time) : store(store), time(time) {
+	mutex = xSemaphoreCreateMutex();
+	changed = xSemaphoreCreateBinary();
+}
+
+void ConfigPersistence::put(BaseConfigItem &item) {
+	store.put(item);
+	markDirty(&item);
+}
+
+void ConfigPersistence::markDirty(const BaseConfigItem *item) {
+	if (xSemaphoreTake(mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+		ESP_LOGE(TIME_FLIES_TAG, "Failed to obtain persistence mutex");
+		return;
+	}
+
+	bool found = false;
+	for (int i=0; i < numDirty && !found; i++) {
+		found = dirtyItems[i] == item;
+	}
+
+	if (!found) {
+		if (numDirty < CONFIG_DIRTY_SLOTS) {
+			dirtyItems[numDirty++] = item;
+		} else {
+			overflowed = true;
+		}
+	}
+
+	uint32_t now = time.ms();
+	if (numDirty == 1 && !found) {
+		firstChange = now;
+	}
+	lastChange = now;
+
+	xSemaphoreGive(mutex);
+	xSemaphoreGive(changed);
+	if (changedCallback) {
+		changedCallback();
+	}
+}
+
+void ConfigPersistence::requestCommit() {
+	commitRequested = true;
+	xSemaphoreGive(changed);
+	if (changedCallback) {
+		changedCallback();
+	}
+}
+
+void ConfigPersistence::commitNow() {
+	commit();
+}
+
+int ConfigPersistence::getDirtyCount() {
+	return numDirty;
+}
+
+bool ConfigPersistence::commit() {
+	TRACE_SPAN("config commit");
+
+	if (xSemaphoreTake(mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+		ESP_LOGE(TIME_FLIES_TAG, "Failed to obtain persistence mutex");
+		return false;
+	}
+
+	int items = numDirty;
+	commitRequested = false;
+
+	if (items > 0) {
+		unsigned long start = micros();
+		store.commit(dirtyItems, numDirty, overflowed);
+		uint32_t elapsed = micros() - start;
+
+		stats.commits++;
+		stats.itemsWritten += items;
+		stats.lastCommitUs = elapsed;
+		stats.maxCommitUs = max(stats.maxCommitUs, elapsed);
+		stats.totalCommitUs += elapsed;
+
+		numDirty = 0;
+		overflowed = false;
+
+		ESP_LOGD(TIME_FLIES_TAG, "Committed %d config items in %luus", items, (unsigned long)elapsed);
+
+		// Still holding the mutex, a compaction must not drop an append made in the meantime
+		store.maintain();
+	}
+
+	xSemaphoreGive(mutex);
+
+	return true;
+}
+
+void ConfigPersistence::loop() {
+	while (true) {
+		uint32_t wait = step();
+		xSemaphoreTake(changed, wait == CONFIG_IDLE ? portMAX_DELAY : pdMS_TO_TICKS(wait));
+	}
+}
+
+uint32_t ConfigPersistence::step() {
+	if (numDirty == 0) {
+		// Nothing to do until something changes
+		commitRequested = false;
+		return CONFIG_IDLE;
+	}
+
+	uint32_t now = time.ms();
+	long quietLeft = CONFIG_QUIET_PERIOD - (long)(now - lastChange);
+	long maxLeft = CONFIG_MAX_DELAY - (long)(now - firstChange);
+	long wait = min(quietLeft, maxLeft);
+
+	if (commitRequested || wait <= 0) {
+		if (!commit()) {
+			// Still dirty, but returning 0 would spin the event loop on the mutex
+			return CONFIG_RETRY;
+		}
+
+		return numDirty == 0 ? CONFIG_IDLE : 0;
+	}
+
+	return wait;
+}
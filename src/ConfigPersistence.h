@@ -0,0 +1,64 @@
+#ifndef _CONFIG_PERSISTENCE_H
+#define _CONFIG_PERSISTENCE_H
+
+#include <Arduino.h>
+#include <functional>
+#include <ConfigItem.h>
+#include "ConfigStore.h"
+#include "TimeSource.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#define CONFIG_QUIET_PERIOD 5000	// Commit once nothing has changed for this long
+#define CONFIG_MAX_DELAY 60000		// but don't sit on a change for longer than this
+#define CONFIG_DIRTY_SLOTS 32
+#define CONFIG_IDLE UINT32_MAX		// step() has nothing to do until something changes
+#define CONFIG_RETRY 100			// Back off this long when the mutex is busy
+
+/*
+ * Decides when config gets written to flash. Changes are marked dirty as they are
+ * put() and coalesced into one commit after a quiet period, or straight away before
+ * a planned restart. Nothing is written if nothing changed.
+ */
+class ConfigPersistence {
+public:
+	struct Stats {
+		uint32_t commits;
+		uint32_t itemsWritten;
+		uint32_t lastCommitUs;
+		uint32_t maxCommitUs;
+		uint64_t totalCommitUs;
+	};
+
+	ConfigPersistence(ConfigStore &store, TimeSource &time);
+
+	void put(BaseConfigItem &item);			// Stage it with the store and mark it dirty
+	void markDirty(const BaseConfigItem *item);
+	void requestCommit();					// Commit on the persistence task without waiting for quiet
+	void commitNow();						// Commit on this task, e.g. before ESP.restart()
+	void loop();							// Runs forever on its own task
+	uint32_t step();						// One go round loop() without blocking, returns ms until the next
+	void setChangedCallback(std::function<void()> callback) { changedCallback = callback; }
+
+	int getDirtyCount();
+	Stats getStats() const { return stats; }
+	ConfigStore &getStore() { return store; }
+
+private:
+	bool commit();					// false if it couldn't get the mutex
+
+	ConfigStore &store;
+	TimeSource &time;
+	SemaphoreHandle_t mutex;
+	SemaphoreHandle_t changed;
+	std::function<void()> changedCallback;	// For when there is no task waiting on changed
+	const BaseConfigItem *dirtyItems[CONFIG_DIRTY_SLOTS];
+	int numDirty = 0;
+	bool overflowed = false;	// More dirty items than slots, but we still know we are dirty
+	bool commitRequested = false;
+	uint32_t firstChange = 0;
+	uint32_t lastChange = 0;
+	Stats stats = {};
+};
+
+#endif
@@ -0,0 +1,310 @@
+#include "esp_log.h"
+#include "ConfigReplicator.h"
+
+extern const char* TIME_FLIES_TAG;
+
+ConfigReplicator::ConfigReplicator(SyncProtocol &protocol, StateJournal &journal, BaseConfigItem **composites, ApplyFunc apply, SaveFunc save) :
+	protocol(protocol), journal(journal), composites(composites), apply(apply), save(save) {
+}
+
+void ConfigReplicator::setRole(Role role) {
+	this->role = role;
+	started = false;
+	requested = false;
+	transferring = false;
+	behind = true;
+	behindSince = millis();
+	lastRequest = behindSince - REPLICATION_RETRY;
+	deltasSinceBatch = 0;
+}
+
+void ConfigReplicator::setPosition(const String &position) {
+	unsigned long l = 0, e = 0, v = 0;
+
+	if (sscanf(position.c_str(), "%lx:%lx:%lx", &l, &e, &v) == 3) {
+		leader = l;
+		epoch = e;
+		version = v;
+	}
+}
+
+String ConfigReplicator::getPosition() const {
+	char buf[27];
+	snprintf(buf, sizeof(buf), "%08lx:%08lx:%08lx", (unsigned long)leader, (unsigned long)epoch, (unsigned long)version);
+	return String(buf);
+}
+
+bool ConfigReplicator::replicated(const BaseConfigItem *item) {
+	return find(item->name) == item;
+}
+
+BaseConfigItem *ConfigReplicator::find(const char *key) {
+	for (int i=0; composites[i] != 0; i++) {
+		CompositeConfigItem *composite = static_cast<CompositeConfigItem*>(composites[i]);
+		for (BaseConfigItem **pItem = composite->value; *pItem != 0; pItem++) {
+			if (strcmp((*pItem)->name, key) == 0) {
+				return *pItem;
+			}
+		}
+	}
+
+	return 0;
+}
+
+ConfigReplicator::DeltaResult ConfigReplicator::queueDelta(const BaseConfigItem *item) {
+	uint8_t buf[SYNC_MAX_EVENT];
+	String value = item->toString();
+	size_t keyLen = strlen(item->name);
+	size_t len = 2 + keyLen + value.length();
+
+	if (len > SYNC_MAX_EVENT) {
+		ESP_LOGE(TIME_FLIES_TAG, "%s is too long to replicate", item->name);
+		return SKIPPED;	// Don't hold up the rest
+	}
+
+	buf[0] = keyLen;
+	memcpy(buf + 1, item->name, keyLen);
+	buf[1 + keyLen] = value.length();
+	memcpy(buf + 2 + keyLen, value.c_str(), value.length());
+
+	if (!protocol.queue(SyncProtocol::CONFIG_DELTA, buf, len, false)) {
+		return FULL;
+	}
+
+	stats.deltasOut++;
+	return QUEUED;
+}
+
+/*
+ * Works out what to send: everything replicated that changed after version from,
+ * or all of it if asked to or the journal doesn't go back that far. A batch from
+ * version 0 means everything. continueTransfer() sends it.
+ */
+void ConfigReplicator::startTransfer(uint32_t from, bool full) {
+	transferTo = journal.getVersion();
+	numTransferItems = 0;
+	nextTransferItem = 0;
+	transferCount = 0;
+
+	bool incremental = !full && journal.changesSince(journal.getEpoch(), from, [&](StateJournal::EntryType type, const BaseConfigItem *item) {
+		if (type == StateJournal::CONFIG && replicated(item)) {
+			addTransferItem(item);
+		}
+	});
+
+	if (!incremental) {
+		from = 0;
+		numTransferItems = 0;
+		for (int i=0; composites[i] != 0; i++) {
+			CompositeConfigItem *composite = static_cast<CompositeConfigItem*>(composites[i]);
+			for (BaseConfigItem **pItem = composite->value; *pItem != 0; pItem++) {
+				addTransferItem(*pItem);
+			}
+		}
+		stats.fullTransfers++;
+	}
+
+	transferFrom = from;
+	transferring = true;
+}
+
+void ConfigReplicator::addTransferItem(const BaseConfigItem *item) {
+	// An item that changed more than once only needs sending once
+	for (int i=0; i < numTransferItems; i++) {
+		if (transferItems[i] == item) {
+			return;
+		}
+	}
+
+	if (numTransferItems >= REPLICATION_MAX_ITEMS) {
+		ESP_LOGE(TIME_FLIES_TAG, "Too many items to replicate, %s left out", item->name);
+		return;
+	}
+
+	transferItems[numTransferItems++] = item;
+}
+
+/*
+ * Queues as much of the transfer as the outbox takes, then the batch marker.
+ * Values are read as they are queued, anything that changes after that goes in
+ * the next transfer. Returns false if there is more to send after this frame.
+ */
+bool ConfigReplicator::continueTransfer() {
+	while (nextTransferItem < numTransferItems) {
+		DeltaResult result = queueDelta(transferItems[nextTransferItem]);
+		if (result == FULL) {
+			return false;
+		}
+
+		transferCount += result == QUEUED;	// The follower counts what arrives
+		nextTransferItem++;
+	}
+
+	uint8_t batch[13];
+	SyncProtocol::put32(batch, journal.getEpoch());
+	SyncProtocol::put32(batch + 4, transferFrom);
+	SyncProtocol::put32(batch + 8, transferTo);
+	batch[12] = transferCount;
+
+	if (!protocol.queue(SyncProtocol::CONFIG_BATCH, batch, sizeof(batch), false)) {
+		return false;
+	}
+
+	transferring = false;
+	return true;
+}
+
+void ConfigReplicator::loop(uint32_t nowMs) {
+	if (role == LEADER) {
+		uint32_t current = journal.getVersion();
+
+		// Followers ask for what they missed while we were down
+		if (!started) {
+			published = current;
+			started = true;
+		}
+
+		if (transferring) {
+			continueTransfer();
+		} else if (requested) {
+			requested = false;
+			startTransfer(requestFrom, requestFull);
+			published = current;
+			continueTransfer();
+		} else if (current != published) {
+			bool changed = false;
+			journal.changesSince(journal.getEpoch(), published, [&](StateJournal::EntryType type, const BaseConfigItem *item) {
+				changed |= type == StateJournal::CONFIG && replicated(item);
+			});
+
+			// Log lines move the version too, only bother followers with real changes
+			if (changed) {
+				startTransfer(published, false);
+				continueTransfer();
+			}
+			published = current;
+		}
+
+		if (nowMs - lastHeartbeat > REPLICATION_HEARTBEAT) {
+			lastHeartbeat = nowMs;
+			uint8_t payload[8];
+			SyncProtocol::put32(payload, journal.getEpoch());
+			SyncProtocol::put32(payload + 4, published);
+			protocol.queue(SyncProtocol::CONFIG_VERSION, payload, sizeof(payload));
+		}
+	} else if (role == FOLLOWER) {
+		if (behind && nowMs - behindSince > REPLICATION_SETTLE && nowMs - lastRequest > REPLICATION_RETRY) {
+			lastRequest = nowMs;
+			uint8_t payload[12];
+			SyncProtocol::put32(payload, leader);
+			SyncProtocol::put32(payload + 4, epoch);
+			SyncProtocol::put32(payload + 8, version);
+			if (protocol.queue(SyncProtocol::CONFIG_REQUEST, payload, sizeof(payload))) {
+				stats.requests++;
+			}
+		}
+	}
+}
+
+void ConfigReplicator::setBehind(uint32_t nowMs) {
+	if (!behind) {
+		behind = true;
+		behindSince = nowMs;
+	}
+}
+
+void ConfigReplicator::applyDelta(const uint8_t *data, uint8_t len) {
+	if (len < 2 || 1 + data[0] + 1 > len || 2 + data[0] + data[1 + data[0]] > len) {
+		return;
+	}
+
+	char key[SYNC_MAX_EVENT];
+	memcpy(key, data + 1, data[0]);
+	key[data[0]] = 0;
+
+	const uint8_t *pValue = data + 2 + data[0];
+	String value;
+	value.reserve(data[1 + data[0]]);
+	for (int i=0; i < data[1 + data[0]]; i++) {
+		value += (char)pValue[i];
+	}
+
+	BaseConfigItem *item = find(key);
+	if (item != 0) {
+		stats.deltasIn++;
+		apply(item, value);
+	}
+}
+
+void ConfigReplicator::applyBatch(uint32_t sender, const uint8_t *data, uint8_t len, uint32_t nowMs) {
+	if (len < 13) {
+		return;
+	}
+
+	uint32_t batchEpoch = SyncProtocol::get32(data);
+	uint32_t from = SyncProtocol::get32(data + 4);
+	uint32_t to = SyncProtocol::get32(data + 8);
+
+	// If a frame went missing we haven't got everything the batch covers
+	bool complete = data[12] == deltasSinceBatch;
+	deltasSinceBatch = 0;
+	stats.batchesIn++;
+
+	if (from == 0 && leader != 0 && sender != leader) {
+		// Another bridge has taken over and its deltas were ignored, ask it for everything
+		leader = sender;
+		epoch = 0;
+		version = 0;
+		setBehind(nowMs);
+		return;
+	}
+
+	if (complete && (from == 0 || (sender == leader && batchEpoch == epoch && from <= version))) {
+		if (from == 0 || sender != leader || batchEpoch != epoch || to > version) {
+			leader = sender;
+			epoch = batchEpoch;
+			version = to;
+			save(getPosition());
+		}
+		behind = false;
+	} else {
+		setBehind(nowMs);
+	}
+}
+
+void ConfigReplicator::onEvent(uint32_t sender, SyncProtocol::EventType type, const uint8_t *data, uint8_t len, uint32_t nowMs) {
+	switch (type) {
+	case SyncProtocol::CONFIG_VERSION:
+		if (role == FOLLOWER && sender == leader && len >= 8 &&
+				(SyncProtocol::get32(data) != epoch || SyncProtocol::get32(data + 4) > version)) {
+			setBehind(nowMs);
+		}
+		break;
+	case SyncProtocol::CONFIG_DELTA:
+		// Until the first complete batch anyone can be the leader, after that only it
+		if (role == FOLLOWER && (sender == leader || leader == 0)) {
+			deltasSinceBatch++;
+			applyDelta(data, len);
+		}
+		break;
+	case SyncProtocol::CONFIG_BATCH:
+		if (role == FOLLOWER) {
+			applyBatch(sender, data, len, nowMs);
+		}
+		break;
+	case SyncProtocol::CONFIG_REQUEST:
+		if (role == LEADER && len >= 12) {
+			uint32_t from = SyncProtocol::get32(data + 8);
+
+			// Asking someone else, or about a previous boot of ours, means starting over
+			bool full = SyncProtocol::get32(data) != protocol.getId() || SyncProtocol::get32(data + 4) != journal.getEpoch();
+
+			requestFull = full || (requested && requestFull);
+			requestFrom = requested ? min(requestFrom, from) : from;
+			requested = true;
+		}
+		break;
+	default:
+		break;
+	}
+}
@@ -0,0 +1,112 @@
+#ifndef _CONFIG_REPLICATOR_H
+#define _CONFIG_REPLICATOR_H
+
+#include <Arduino.h>
+#include <functional>
+#include <ConfigItem.h>
+#include "SyncProtocol.h"
+#include "StateJournal.h"
+
+#define REPLICATION_HEARTBEAT 60000	// Leader re-advertises its version this often
+#define REPLICATION_SETTLE 2000		// Give a batch this long to arrive before asking to catch up
+#define REPLICATION_RETRY 5000		// Don't ask to catch up more often than this
+#define REPLICATION_PACE 20			// Between the frames of a transfer that doesn't fit in one
+#define REPLICATION_MAX_ITEMS 32	// Items a transfer can carry
+
+/*
+ * Keeps the clock and LED settings of a group of bridges the same. The leader
+ * sends the items that changed since the version it last published, taken from
+ * its state journal, followed by a batch marker saying which versions they cover.
+ * A transfer bigger than the outbox goes out over several frames, batch last.
+ * A follower remembers (leader, epoch, version) of the last complete batch and
+ * asks for just the changes since then when it finds it is behind; the leader
+ * sends everything if its journal no longer goes back that far.
+ */
+class ConfigReplicator {
+public:
+	typedef enum {
+		OFF = 0,
+		LEADER,
+		FOLLOWER
+	} Role;
+
+	struct Stats {
+		uint32_t deltasOut;
+		uint32_t deltasIn;
+		uint32_t batchesIn;
+		uint32_t fullTransfers;
+		uint32_t requests;
+	};
+
+	typedef std::function<void(BaseConfigItem *item, const String &value)> ApplyFunc;
+	typedef std::function<void(const String &position)> SaveFunc;
+
+	// composites is a 0 terminated list of the composites to replicate
+	ConfigReplicator(SyncProtocol &protocol, StateJournal &journal, BaseConfigItem **composites, ApplyFunc apply, SaveFunc save);
+
+	void setRole(Role role);
+	Role getRole() const { return role; }
+
+	// Where a follower had got to, as saved by SaveFunc
+	void setPosition(const String &position);
+	String getPosition() const;
+
+	// Sync bus task
+	void loop(uint32_t nowMs);
+	void onEvent(uint32_t sender, SyncProtocol::EventType type, const uint8_t *data, uint8_t len, uint32_t nowMs);
+
+	bool isTransferring() const { return transferring; }
+	bool replicated(const BaseConfigItem *item);
+	Stats getStats() const { return stats; }
+
+private:
+	typedef enum {
+		QUEUED,
+		SKIPPED,	// Too long to send, nothing we can do about it
+		FULL		// Try again once the outbox has gone
+	} DeltaResult;
+
+	BaseConfigItem *find(const char *key);
+	DeltaResult queueDelta(const BaseConfigItem *item);
+	void startTransfer(uint32_t from, bool full);
+	void addTransferItem(const BaseConfigItem *item);
+	bool continueTransfer();
+	void applyDelta(const uint8_t *data, uint8_t len);
+	void applyBatch(uint32_t sender, const uint8_t *data, uint8_t len, uint32_t nowMs);
+	void setBehind(uint32_t nowMs);
+
+	SyncProtocol &protocol;
+	StateJournal &journal;
+	BaseConfigItem **composites;
+	ApplyFunc apply;
+	SaveFunc save;
+	Role role = OFF;
+
+	// Leader
+	uint32_t published = 0;
+	bool started = false;
+	bool requested = false;
+	uint32_t requestFrom = 0;
+	bool requestFull = false;
+	uint32_t lastHeartbeat = 0;
+	const BaseConfigItem *transferItems[REPLICATION_MAX_ITEMS];
+	int numTransferItems = 0;
+	int nextTransferItem = 0;
+	uint8_t transferCount = 0;	// Deltas queued so far
+	uint32_t transferFrom = 0;
+	uint32_t transferTo = 0;
+	bool transferring = false;
+
+	// Follower
+	uint32_t leader = 0;
+	uint32_t epoch = 0;
+	uint32_t version = 0;
+	int deltasSinceBatch = 0;
+	bool behind = true;
+	uint32_t behindSince = 0;
+	uint32_t lastRequest = 0;
+
+	Stats stats = {};
+};
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef _CONFIG_STORE_H
+#define _CONFIG_STORE_H
+
+#include <Arduino.h>
+#include <ConfigItem.h>
+#include <EEPROMConfig.h>
+
+/*
+ * Where config values live between boots.
+ */
+class ConfigStore {
+public:
+	virtual ~ConfigStore() {}
+
+	virtual const char *getName() const = 0;
+
+	// Read every value into the config items
+	virtual void load() = 0;
+
+	// Stage a changed value for the next commit
+	virtual void put(BaseConfigItem &item) { item.put(); }
+
+	// Persist the given items, or everything if all is true
+	virtual void commit(const BaseConfigItem **items, int numItems, bool all) = 0;
+
+	// Anything slow that can wait until after a commit, called with commits locked out
+	virtual void maintain() {}
+
+	uint32_t getLoadUs() const { return loadUs; }
+	uint32_t getBytesWritten() const { return bytesWritten; }
+
+protected:
+	uint32_t loadUs = 0;
+	uint32_t bytesWritten = 0;
+};
+
+/*
+ * The original layout: every item at a fixed offset in an emulated EEPROM image,
+ * and the whole image is rewritten on commit.
+ */
+class EEPROMConfigStore : public ConfigStore {
+public:
+	EEPROMConfigStore(EEPROMConfig &config, BaseConfigItem &rootConfig, size_t size) :
+		config(config), rootConfig(rootConfig), size(size) {
+	}
+
+	virtual const char *getName() const { return "EEPROM"; }
+
+	virtual void load() {
+		unsigned long start = micros();
+		config.init();
+		rootConfig.get();	// Read all of the config values from EEPROM
+		loadUs = micros() - start;
+	}
+
+	virtual void commit(const BaseConfigItem **items, int numItems, bool all) {
+		config.commit();
+		bytesWritten += size;
+	}
+
+private:
+	EEPROMConfig &config;
+	BaseConfigItem &rootConfig;
+	size_t size;
+};
+
+#endif
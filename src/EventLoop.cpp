@@ -0,0 +1,101 @@
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "EventLoop.h"
+
+extern const char* TIME_FLIES_TAG;
+
+EventLoop::EventLoop() {
+	stats.maxRunName = "";
+}
+
+int EventLoop::add(const char *name, Handler handler) {
+	if (numSlots >= EVENT_LOOP_HANDLERS) {
+		ESP_LOGE(TIME_FLIES_TAG, "No room in event loop for %s", name);
+		return -1;
+	}
+
+	Slot &slot = slots[numSlots];
+	slot.name = name;
+	slot.handler = handler;
+	slot.lastRun = 0;
+	slot.wait = 0;
+
+	return numSlots++;
+}
+
+void EventLoop::post(int id) {
+	if (id < 0 || id >= numSlots) {
+		return;
+	}
+
+	portENTER_CRITICAL(&readyMux);
+	ready |= 1 << id;
+	stats.posts++;
+	portEXIT_CRITICAL(&readyMux);
+
+	wake();
+}
+
+void EventLoop::setWait(WaitFunc wait, WakeFunc wake) {
+	waitFunc = wait;
+	wakeFunc = wake;
+}
+
+void EventLoop::wake() {
+	if (task == NULL) {
+		return;
+	}
+
+	if (wakeFunc) {
+		wakeFunc();
+	} else {
+		xTaskNotifyGive(task);
+	}
+}
+
+void EventLoop::run() {
+	task = xTaskGetCurrentTaskHandle();
+
+	while (true) {
+		portENTER_CRITICAL(&readyMux);
+		uint32_t posted = ready;
+		ready = 0;
+		portEXIT_CRITICAL(&readyMux);
+
+		uint32_t sleep = EVENT_LOOP_IDLE;
+		for (int i=0; i < numSlots; i++) {
+			Slot &slot = slots[i];
+			unsigned long now = millis();
+
+			if ((posted & (1 << i)) || (slot.wait != EVENT_LOOP_IDLE && now - slot.lastRun >= slot.wait)) {
+				int64_t start = esp_timer_get_time();
+				slot.wait = slot.handler(now);
+				slot.lastRun = millis();
+
+				uint32_t elapsed = esp_timer_get_time() - start;
+				stats.runs++;
+				if (elapsed > stats.maxRunUs) {
+					stats.maxRunUs = elapsed;
+					stats.maxRunName = slot.name;
+				}
+			}
+
+			if (slot.wait != EVENT_LOOP_IDLE) {
+				unsigned long since = millis() - slot.lastRun;
+				sleep = min(sleep, since >= slot.wait ? 0 : (uint32_t)(slot.wait - since));
+			}
+		}
+
+		// Something was posted while we were running handlers
+		if (ready != 0) {
+			continue;
+		}
+
+		stats.wakeups++;
+		if (waitFunc) {
+			waitFunc(sleep);
+		} else {
+			ulTaskNotifyTake(pdTRUE, sleep == EVENT_LOOP_IDLE ? portMAX_DELAY : pdMS_TO_TICKS(sleep));
+		}
+	}
+}
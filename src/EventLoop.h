@@ -0,0 +1,64 @@
+#ifndef _EVENT_LOOP_H
+#define _EVENT_LOOP_H
+
+#include <Arduino.h>
+#include <functional>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define EVENT_LOOP_HANDLERS 8
+#define EVENT_LOOP_IDLE UINT32_MAX	// Handler only wants to run when posted
+
+/*
+ * Runs work that used to have a task each on one task. Each handler does a bit of
+ * work without blocking and returns how long until it next wants to run. post()
+ * marks a handler ready from any task and wakes the loop. The loop sleeps in a
+ * wait function, by default a task notification, which can be replaced with one
+ * that also does I/O (e.g. select on a socket) as long as wake() interrupts it.
+ */
+class EventLoop {
+public:
+	typedef std::function<uint32_t(unsigned long now)> Handler;
+	typedef std::function<void(uint32_t timeoutMs)> WaitFunc;
+	typedef std::function<void()> WakeFunc;
+
+	struct Stats {
+		uint32_t wakeups;
+		uint32_t runs;
+		uint32_t posts;
+		uint32_t maxRunUs;		// Longest any one handler held the loop
+		const char *maxRunName;
+	};
+
+	EventLoop();
+
+	int add(const char *name, Handler handler);	// Runs once straight away
+	void post(int id);
+	void setWait(WaitFunc wait, WakeFunc wake);
+
+	void run();		// Never returns
+	TaskHandle_t getTask() const { return task; }
+
+	Stats getStats() const { return stats; }
+
+private:
+	struct Slot {
+		const char *name;
+		Handler handler;
+		unsigned long lastRun;
+		uint32_t wait;
+	};
+
+	void wake();
+
+	TaskHandle_t task = NULL;
+	portMUX_TYPE readyMux = portMUX_INITIALIZER_UNLOCKED;
+	uint32_t ready = 0;	// Bit per slot
+	Slot slots[EVENT_LOOP_HANDLERS];
+	int numSlots = 0;
+	WaitFunc waitFunc;
+	WakeFunc wakeFunc;
+	Stats stats = {};
+};
+
+#endif
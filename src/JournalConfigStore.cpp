@@ -0,0 +1,192 @@
+#include "esp_log.h"
+#include "JournalConfigStore.h"
+#include "Trace.h"
+
+extern const char* TIME_FLIES_TAG;
+
+static uint8_t checksum(const uint8_t *data, size_t len, uint8_t sum) {
+	for (size_t i=0; i < len; i++) {
+		sum = (sum << 1 | sum >> 7) ^ data[i];
+	}
+
+	return sum;
+}
+
+bool JournalConfigStore::writeRecord(fs::File &file, const BaseConfigItem *item) {
+	String value = item->toString();
+	uint8_t keyLen = strlen(item->name);
+	uint8_t valueLen[2] = { (uint8_t)(value.length() & 0xff), (uint8_t)(value.length() >> 8) };
+
+	uint8_t sum = checksum(&keyLen, 1, 0);
+	sum = checksum((const uint8_t*)item->name, keyLen, sum);
+	sum = checksum(valueLen, 2, sum);
+	sum = checksum((const uint8_t*)value.c_str(), value.length(), sum);
+
+	size_t written = file.write(&keyLen, 1);
+	written += file.write((const uint8_t*)item->name, keyLen);
+	written += file.write(valueLen, 2);
+	written += file.write((const uint8_t*)value.c_str(), value.length());
+	written += file.write(&sum, 1);
+
+	bytesWritten += written;
+
+	return written == 4 + keyLen + value.length();
+}
+
+/*
+ * Returns the number of records applied, or -1 if a damaged record was found
+ */
+int JournalConfigStore::replay(const char *path) {
+	TRACE_SPAN("config replay");
+
+	if (!fs.exists(path)) {
+		return 0;
+	}
+
+	fs::File file = fs.open(path, "r");
+	if (!file) {
+		return -1;
+	}
+
+	int records = 0;
+	char key[64];
+	uint8_t keyLen;
+	uint8_t valueLen[2];
+	uint8_t storedSum;
+
+	while (file.read(&keyLen, 1) == 1) {
+		if (keyLen >= sizeof(key) || file.read((uint8_t*)key, keyLen) != keyLen || file.read(valueLen, 2) != 2) {
+			records = -1;
+			break;
+		}
+		key[keyLen] = 0;
+
+		size_t len = valueLen[0] | valueLen[1] << 8;
+		String value;
+		value.reserve(len);
+		for (size_t i=0; i < len; i++) {
+			int c = file.read();
+			if (c < 0) {
+				break;
+			}
+			value += (char)c;
+		}
+
+		uint8_t sum = checksum(&keyLen, 1, 0);
+		sum = checksum((const uint8_t*)key, keyLen, sum);
+		sum = checksum(valueLen, 2, sum);
+		sum = checksum((const uint8_t*)value.c_str(), value.length(), sum);
+
+		if (value.length() != len || file.read(&storedSum, 1) != 1 || storedSum != sum) {
+			records = -1;
+			break;
+		}
+
+		BaseConfigItem *item = rootConfig.get(key);
+		if (item != 0) {
+			item->fromString(value);
+		}
+		records++;
+	}
+
+	file.close();
+
+	if (records < 0) {
+		ESP_LOGW(TIME_FLIES_TAG, "Damaged record in %s", path);
+	}
+
+	return records;
+}
+
+bool JournalConfigStore::compact() {
+	TRACE_SPAN("config compact");
+
+	fs::File file = fs.open(CONFIG_COMPACT_TMP_FILE, "w");
+	if (!file) {
+		ESP_LOGE(TIME_FLIES_TAG, "Failed to open %s", CONFIG_COMPACT_TMP_FILE);
+		return false;
+	}
+
+	bool ok = true;
+	for (int i=0; composites[i] != 0 && ok; i++) {
+		CompositeConfigItem *composite = static_cast<CompositeConfigItem*>(composites[i]);
+		for (BaseConfigItem **pItem = composite->value; *pItem != 0 && ok; pItem++) {
+			ok = writeRecord(file, *pItem);
+		}
+	}
+
+	file.close();
+
+	// rename() replaces the old snapshot in one step, then the journal it covered can go
+	if (ok && fs.rename(CONFIG_COMPACT_TMP_FILE, CONFIG_SNAPSHOT_FILE)) {
+		fs.remove(CONFIG_JOURNAL_FILE);
+		compactions++;
+		return true;
+	}
+
+	ESP_LOGE(TIME_FLIES_TAG, "Failed to compact config");
+	return false;
+}
+
+void JournalConfigStore::load() {
+	unsigned long start = micros();
+
+	// Power lost between writing a snapshot and renaming it
+	if (!fs.exists(CONFIG_SNAPSHOT_FILE) && fs.exists(CONFIG_COMPACT_TMP_FILE)) {
+		fs.rename(CONFIG_COMPACT_TMP_FILE, CONFIG_SNAPSHOT_FILE);
+	}
+
+	if (!fs.exists(CONFIG_SNAPSHOT_FILE) && !fs.exists(CONFIG_JOURNAL_FILE)) {
+		ESP_LOGI(TIME_FLIES_TAG, "Migrating config from %s", legacyStore.getName());
+		legacyStore.load();
+		compact();
+	} else {
+		int snapshotRecords = replay(CONFIG_SNAPSHOT_FILE);
+		int journalRecords = replay(CONFIG_JOURNAL_FILE);
+		ESP_LOGD(TIME_FLIES_TAG, "Config: %d snapshot records, %d journal records", snapshotRecords, journalRecords);
+
+		if (snapshotRecords < 0 || journalRecords < 0) {
+			// Don't append after garbage, start again from what we managed to read
+			compact();
+		}
+	}
+
+	loadUs = micros() - start;
+}
+
+void JournalConfigStore::commit(const BaseConfigItem **items, int numItems, bool all) {
+	TRACE_SPAN("config append");
+
+	if (all) {
+		compact();
+		return;
+	}
+
+	fs::File file = fs.open(CONFIG_JOURNAL_FILE, "a");
+	if (!file) {
+		ESP_LOGE(TIME_FLIES_TAG, "Failed to open %s", CONFIG_JOURNAL_FILE);
+		return;
+	}
+
+	for (int i=0; i < numItems; i++) {
+		writeRecord(file, items[i]);
+	}
+
+	file.close();
+}
+
+void JournalConfigStore::maintain() {
+	TRACE_SPAN("config maintain");
+
+	if (!fs.exists(CONFIG_JOURNAL_FILE)) {
+		return;
+	}
+
+	fs::File file = fs.open(CONFIG_JOURNAL_FILE, "r");
+	size_t size = file.size();
+	file.close();
+
+	if (size > CONFIG_JOURNAL_MAX) {
+		compact();
+	}
+}
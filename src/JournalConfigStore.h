@@ -0,0 +1,49 @@
+#ifndef _JOURNAL_CONFIG_STORE_H
+#define _JOURNAL_CONFIG_STORE_H
+
+#include <FS.h>
+#include "ConfigStore.h"
+
+#define CONFIG_SNAPSHOT_FILE "/config.snap"
+#define CONFIG_JOURNAL_FILE "/config.log"
+#define CONFIG_COMPACT_TMP_FILE "/config.tmp"
+#define CONFIG_JOURNAL_MAX 4096		// Compact once the journal gets this big
+
+/*
+ * Log structured store on a file system. A commit appends one record per changed
+ * item to the journal; once that gets big enough everything is written to a fresh
+ * snapshot and the journal starts again. Loading replays the snapshot then the
+ * journal, stopping at the first damaged record (e.g. power lost mid-write).
+ *
+ * A record is: key length (1 byte), key, value length (2 bytes LE), value, checksum (1 byte)
+ *
+ * If neither file exists the values are read from the legacy EEPROM layout and a
+ * snapshot is written, so existing devices keep their settings.
+ */
+class JournalConfigStore : public ConfigStore {
+public:
+	JournalConfigStore(fs::FS &fs, BaseConfigItem &rootConfig, BaseConfigItem **composites, ConfigStore &legacyStore) :
+		fs(fs), rootConfig(rootConfig), composites(composites), legacyStore(legacyStore) {
+	}
+
+	virtual const char *getName() const { return "Journal"; }
+
+	virtual void load();
+	virtual void commit(const BaseConfigItem **items, int numItems, bool all);
+	virtual void maintain();
+
+	uint32_t getCompactions() const { return compactions; }
+
+private:
+	bool writeRecord(fs::File &file, const BaseConfigItem *item);
+	int replay(const char *path);
+	bool compact();
+
+	fs::FS &fs;
+	BaseConfigItem &rootConfig;
+	BaseConfigItem **composites;
+	ConfigStore &legacyStore;
+	uint32_t compactions = 0;
+};
+
+#endif
@@ -0,0 +1,70 @@
+#include "JsonWriter.h"
+
+JsonWriter& JsonWriter::raw(const char *s) {
+	while (*s) {
+		put(*s++);
+	}
+
+	return *this;
+}
+
+JsonWriter& JsonWriter::raw(const char *s, size_t n) {
+	for (size_t i=0; i < n; i++) {
+		put(s[i]);
+	}
+
+	return *this;
+}
+
+JsonWriter& JsonWriter::string(const char *s) {
+	static const char *hex = "0123456789abcdef";
+
+	put('"');
+	for (const char *c = s; *c; c++) {
+		switch (*c) {
+		case '"': put('\\'); put('"'); break;
+		case '\\': put('\\'); put('\\'); break;
+		case '\b': put('\\'); put('b'); break;
+		case '\f': put('\\'); put('f'); break;
+		case '\n': put('\\'); put('n'); break;
+		case '\r': put('\\'); put('r'); break;
+		case '\t': put('\\'); put('t'); break;
+		default:
+			if ('\x00' <= *c && *c <= '\x1f') {
+				raw("\\u00");
+				put(hex[(*c >> 4) & 0xf]);
+				put(hex[*c & 0xf]);
+			} else {
+				put(*c);
+			}
+		}
+	}
+	put('"');
+
+	return *this;
+}
+
+JsonWriter& JsonWriter::number(unsigned long n) {
+	char digits[12];
+	int i = 0;
+
+	do {
+		digits[i++] = '0' + n % 10;
+		n /= 10;
+	} while (n != 0);
+
+	while (i > 0) {
+		put(digits[--i]);
+	}
+
+	return *this;
+}
+
+JsonWriter& JsonWriter::integer(long n) {
+	if (n < 0) {
+		put('-');
+		return number(0UL - (unsigned long)n);
+	}
+
+	return number(n);
+}
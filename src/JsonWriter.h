@@ -0,0 +1,54 @@
+#ifndef _JSON_WRITER_H
+#define _JSON_WRITER_H
+
+#include <Arduino.h>
+
+/*
+ * Writes JSON text straight into a caller supplied buffer. Constructed without
+ * a buffer it only counts, so the same code can be run once to measure the exact
+ * size and once more to write it.
+ */
+class JsonWriter {
+public:
+	struct Stats {
+		uint32_t responses;
+		uint32_t allocations;
+		uint32_t retries;
+		uint32_t bytes;
+	};
+
+	JsonWriter() : buf(NULL), capacity(0), len(0) {}
+	JsonWriter(char *buf, size_t capacity) : buf(buf), capacity(capacity), len(0) {}
+
+	JsonWriter& raw(const char *s);
+	JsonWriter& raw(const char *s, size_t n);
+	JsonWriter& raw(const String &s) { return raw(s.c_str(), s.length()); }
+	JsonWriter& string(const char *s);	// Quoted and escaped
+	JsonWriter& number(unsigned long n);
+	JsonWriter& integer(long n);
+
+	size_t length() const { return len; }
+	bool measuring() const { return buf == NULL; }
+	bool overflowed() const { return buf != NULL && len > capacity; }
+
+	// Count a heap allocation made to produce this response
+	void allocated() { allocations++; }
+	uint32_t getAllocations() const { return allocations; }
+
+	static Stats& getStats() { static Stats stats = {}; return stats; }
+
+private:
+	void put(char c) {
+		if (buf != NULL && len < capacity) {
+			buf[len] = c;
+		}
+		len++;
+	}
+
+	char *buf;
+	size_t capacity;
+	size_t len;
+	uint32_t allocations = 0;
+};
+
+#endif
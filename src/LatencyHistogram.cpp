@@ -0,0 +1,79 @@
+#include "LatencyHistogram.h"
+
+int LatencyHistogram::bucketFor(uint32_t us) {
+	if (us < (1UL << HISTOGRAM_MIN_SHIFT)) {
+		return 0;
+	}
+
+	int shift = 31 - __builtin_clz(us);
+	if (shift >= HISTOGRAM_MAX_SHIFT) {
+		return HISTOGRAM_BUCKETS - 1;
+	}
+
+	// The two bits after the top one pick the sub-bucket
+	int sub = (us >> (shift - 2)) & (HISTOGRAM_SUB_BUCKETS - 1);
+
+	return (shift - HISTOGRAM_MIN_SHIFT) * HISTOGRAM_SUB_BUCKETS + sub;
+}
+
+uint32_t LatencyHistogram::bucketTop(int bucket) {
+	int shift = bucket / HISTOGRAM_SUB_BUCKETS + HISTOGRAM_MIN_SHIFT;
+	int sub = bucket % HISTOGRAM_SUB_BUCKETS;
+
+	return ((uint32_t)(HISTOGRAM_SUB_BUCKETS + sub + 1) << (shift - 2)) - 1;
+}
+
+void LatencyHistogram::record(uint32_t us) {
+	int bucket = bucketFor(us);
+
+	portENTER_CRITICAL(&mux);
+	buckets[bucket]++;
+	count++;
+	total += us;
+	if (us > max) {
+		max = us;
+	}
+	portEXIT_CRITICAL(&mux);
+}
+
+void LatencyHistogram::reset() {
+	portENTER_CRITICAL(&mux);
+	memset(buckets, 0, sizeof(buckets));
+	count = 0;
+	total = 0;
+	max = 0;
+	portEXIT_CRITICAL(&mux);
+}
+
+LatencyHistogram::Summary LatencyHistogram::summarize() {
+	static const uint32_t percents[] = { 50, 95, 99 };
+	uint32_t snapshot[HISTOGRAM_BUCKETS];
+	Summary summary = {};
+	uint64_t sum;
+
+	portENTER_CRITICAL(&mux);
+	memcpy(snapshot, buckets, sizeof(snapshot));
+	summary.count = count;
+	summary.max = max;
+	sum = total;
+	portEXIT_CRITICAL(&mux);
+
+	if (summary.count == 0) {
+		return summary;
+	}
+
+	summary.mean = sum / summary.count;
+
+	uint32_t *results[] = { &summary.p50, &summary.p95, &summary.p99 };
+	uint32_t seen = 0;
+	int p = 0;
+	for (int bucket=0; bucket < HISTOGRAM_BUCKETS && p < 3; bucket++) {
+		seen += snapshot[bucket];
+		// Rank of the percentile, rounded up so p99 of a handful of samples is the largest
+		while (p < 3 && (uint64_t)seen * 100 >= (uint64_t)summary.count * percents[p]) {
+			*results[p++] = min(bucketTop(bucket), summary.max);
+		}
+	}
+
+	return summary;
+}
@@ -0,0 +1,48 @@
+#ifndef _LATENCY_HISTOGRAM_H
+#define _LATENCY_HISTOGRAM_H
+
+#include <Arduino.h>
+#include "freertos/FreeRTOS.h"
+
+#define HISTOGRAM_SUB_BUCKETS 4		// Per power of two, so a bucket is at most 25% wide
+#define HISTOGRAM_MIN_SHIFT 4		// Anything under 16us goes in the first bucket
+#define HISTOGRAM_MAX_SHIFT 26		// and anything over ~67s in the last
+#define HISTOGRAM_BUCKETS ((HISTOGRAM_MAX_SHIFT - HISTOGRAM_MIN_SHIFT) * HISTOGRAM_SUB_BUCKETS)
+
+/*
+ * Fixed, log-scale buckets of microsecond latencies. Recording is a couple of
+ * shifts and an increment, so it can go anywhere. Percentiles come out as the
+ * top of the bucket they fall in, clipped to the largest value seen.
+ */
+class LatencyHistogram {
+public:
+	struct Summary {
+		uint32_t count;
+		uint32_t p50;
+		uint32_t p95;
+		uint32_t p99;
+		uint32_t max;
+		uint32_t mean;
+	};
+
+	LatencyHistogram(const char *name) : name(name) {}
+
+	void record(uint32_t us);
+	void reset();
+	Summary summarize();
+
+	const char *getName() const { return name; }
+
+	static int bucketFor(uint32_t us);
+	static uint32_t bucketTop(int bucket);
+
+private:
+	const char *name;
+	portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+	uint32_t buckets[HISTOGRAM_BUCKETS] = {};
+	uint32_t count = 0;
+	uint64_t total = 0;
+	uint32_t max = 0;
+};
+
+#endif
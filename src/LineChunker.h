@@ -0,0 +1,49 @@
+#ifndef _LINE_CHUNKER_H
+#define _LINE_CHUNKER_H
+
+#include <Arduino.h>
+
+/*
+ * Fills the buffers of a chunked response from lines rendered one at a time, so
+ * nothing bigger than a line is ever held. Whole lines go in where they fit. One
+ * too long for an empty buffer is split, and offset keeps how much of it went
+ * out. It is rendered again next time for the rest, so anything it shows that
+ * changed in between comes out torn, unless the cursor keeps a copy.
+ *
+ *   more()                  whether there is a line left, may skip ahead
+ *   renderLine(line, size)  writes the current line, returns its length
+ *   next()                  moves on once all of it has gone out
+ */
+template<size_t LINE_SIZE>
+class LineChunker {
+public:
+	template<class More, class RenderLine, class Next>
+	static size_t fill(char *buf, size_t size, uint16_t &offset, More more, RenderLine renderLine, Next next) {
+		char line[LINE_SIZE];
+		size_t out = 0;
+
+		while (out < size && more()) {
+			size_t len = min((size_t)renderLine(line, sizeof(line)), sizeof(line) - 1);
+
+			// Whole lines where possible, otherwise the rest of it next time
+			if (offset == 0 && out > 0 && out + len > size) {
+				break;
+			}
+
+			size_t chunk = min(len - min((size_t)offset, len), size - out);
+			memcpy(buf + out, line + offset, chunk);
+			out += chunk;
+
+			if (offset + chunk < len) {
+				offset += chunk;
+			} else {
+				offset = 0;
+				next();
+			}
+		}
+
+		return out;
+	}
+};
+
+#endif
@@ -1,12 +1,13 @@
 #include "esp_log.h"
 #include "Logger.h"
+#include "PooledJsonAllocator.h"
 
 #define LOG_ENTRY_SIZE 100
 #define MAX_LOG_ENTRIES 40
 
 extern const char* TIME_FLIES_TAG;
 
-void Logger::setUpdateCallback(std::function<void(const JsonDocument&)> updateCallback) {
+void Logger::setUpdateCallback(std::function<void(JsonDocument&)> updateCallback) {
     this->updateCallback = updateCallback;
 }
 
@@ -52,58 +53,28 @@ void Logger::log(LogLevel lvl, const char *format, ...) {
     va_end(args); 
 }
     
-String Logger::escape_json(const char *s) {
-    String ret("\"");
-    ret.reserve(strlen(s) + 10);
-    const char *start = s;
-    const char *end = start + strlen(s);
-    for (const char *c = start; c != end; c++) {
-        switch (*c) {
-        case '"': ret += "\\\""; break;
-        case '\\': ret += "\\\\"; break;
-        case '\b': ret += "\\b"; break;
-        case '\f': ret += "\\f"; break;
-        case '\n': ret += "\\n"; break;
-        case '\r': ret += "\\r"; break;
-        case '\t': ret += "\\t"; break;
-        default:
-            if ('\x00' <= *c && *c <= '\x1f') {
-                char buf[10];
-                sprintf(buf, "\\u%04x", (int)*c);
-                ret += buf;
-            } else {
-                ret += *c;
-            }
-        }
+void Logger::writeJsonLog(JsonWriter &writer) {
+    const char *sep = "";
+    writer.raw("\"console_data\":[");
+    for (int count=0, index=startLogIndex; count < numLogEntries; count++, index = (index+1) % MAX_LOG_ENTRIES) {
+        writer.raw(sep).string(logBuffer[index]);
+        sep = ",";
     }
-    ret += "\"";
-
-    return ret;
+    writer.raw("]");
 }
-    
-String Logger::getSerializedJsonLog() {
-    char *comma = ",";
-    String s = "\"console_data\":[";
-    char *sep = "";
-    if (numLogEntries > 0) {
-        for (int count=0, index=startLogIndex; count < numLogEntries; count++, index = (index+1) % MAX_LOG_ENTRIES) {
-            s += sep;
-            s += escape_json(logBuffer[index]);
-            sep = comma;
-        }
 
-        s += "]";
+void Logger::getJsonLog(JsonObject value) {
+    for (int count=0, index=startLogIndex; count < numLogEntries; count++, index = (index+1) % MAX_LOG_ENTRIES) {    
+        value["console_data"][count] = logBuffer[index];
     }
-    return s;
 }
-    
+
 void Logger::broadcastUpdate() {
     if (numLogEntries > 0) {
-        JsonDocument doc;
+        PooledJsonAllocator allocator;
+        JsonDocument doc(&allocator);
         doc["type"] = "sv.update";
-        for (int count=0, index=startLogIndex; count < numLogEntries; count++, index = (index+1) % MAX_LOG_ENTRIES) {    
-            doc["value"]["console_data"][count] = logBuffer[index];
-        }
+        getJsonLog(doc["value"].to<JsonObject>());
 
         updateCallback(doc);
     }
@@ -3,6 +3,7 @@
 
 #include <Arduino.h>
 #include <ArduinoJson.h>
+#include "JsonWriter.h"
 
 
 #define LOG_ENTRY_SIZE 100
@@ -19,14 +20,14 @@ public:
     } LogLevel;
         
     void log(LogLevel lvl, const char *format, ...);    
-    String getSerializedJsonLog();
-    void setUpdateCallback(std::function<void(const JsonDocument&)> updateCallback);
+    void writeJsonLog(JsonWriter &writer);
+    void getJsonLog(JsonObject value);
+    void setUpdateCallback(std::function<void(JsonDocument&)> updateCallback);
 
 private:
     void broadcastUpdate();
-    String escape_json(const char *s);
 
-    std::function<void(const JsonDocument &doc)> updateCallback;
+    std::function<void(JsonDocument &doc)> updateCallback;
     int startLogIndex = 0;
     int numLogEntries = 0;
     char logBuffer[MAX_LOG_ENTRIES][LOG_ENTRY_SIZE] = {};
@@ -0,0 +1,47 @@
+#include "Metrics.h"
+#include "LineChunker.h"
+
+Metric *Metric::first = 0;
+Metric *Metric::last = 0;
+
+Metric::Metric(const char *name, const char *help, Type type, const char *labels) :
+		name(name), help(help), labels(labels), type(type) {
+	// Keep definition order, so families stay together
+	prev = last;
+	if (last == 0) {
+		first = this;
+	} else {
+		last->next = this;
+	}
+	last = this;
+}
+
+size_t Metric::renderOne(char *buf, size_t size, bool header) {
+	int len = 0;
+
+	if (header) {
+		len = snprintf(buf, size, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type == COUNTER ? "counter" : "gauge");
+	}
+
+	int64_t v = value();
+	if (v != METRIC_ABSENT && len >= 0 && (size_t)len < size) {
+		len += snprintf(buf + len, size - len, "%s%s%s%s %lld\n", name,
+			labels ? "{" : "", labels ? labels : "", labels ? "}" : "", (long long)v);
+	}
+
+	return len < 0 ? 0 : len;
+}
+
+size_t Metric::render(char *buf, size_t size, Cursor &cursor) {
+	return LineChunker<METRICS_LINE_SIZE>::fill(buf, size, cursor.offset,
+		[&cursor] { return cursor.metric != 0; },
+		[&cursor](char *line, size_t size) {
+			Metric *metric = cursor.metric;
+
+			// The first of a family gets the HELP and TYPE
+			bool header = metric->prev == 0 || strcmp(metric->prev->name, metric->name) != 0;
+
+			return metric->renderOne(line, size, header);
+		},
+		[&cursor] { cursor.metric = cursor.metric->next; });
+}
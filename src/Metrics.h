@@ -0,0 +1,92 @@
+#ifndef _METRICS_H
+#define _METRICS_H
+
+#include <Arduino.h>
+#include <atomic>
+
+#define METRICS_LINE_SIZE 256	// Longest HELP + TYPE + sample we will write in one go
+#define METRIC_ABSENT INT64_MIN		// value() for something that doesn't exist right now, no sample is written
+
+/*
+ * Counters and gauges that register themselves when constructed, so there is no
+ * heap involved in defining them or in writing them out. Define them as globals;
+ * ones with the same name but different labels must be defined next to each other
+ * so they come out as one family.
+ */
+class Metric {
+public:
+	typedef enum {
+		COUNTER,
+		GAUGE
+	} Type;
+
+	Metric(const char *name, const char *help, Type type, const char *labels = 0);
+
+	// Where a scrape has got to. Small enough to capture in a std::function without allocating.
+	struct Cursor {
+		Metric *metric;
+		uint16_t offset;	// Into metric's lines, when they didn't all fit last time
+	};
+
+	virtual int64_t value() = 0;
+
+	/*
+	 * Writes as much as fits, starting at cursor, in Prometheus text format.
+	 * Returns the number of bytes written, 0 once there is no more.
+	 */
+	static size_t render(char *buf, size_t size, Cursor &cursor);
+	static Cursor begin() { return { first, 0 }; }
+
+	const char *getName() const { return name; }
+
+private:
+	size_t renderOne(char *buf, size_t size, bool header);
+
+	const char *name;
+	const char *help;
+	const char *labels;
+	Type type;
+	Metric *prev;
+	Metric *next = 0;
+
+	static Metric *first;
+	static Metric *last;
+};
+
+class Counter : public Metric {
+public:
+	Counter(const char *name, const char *help, const char *labels = 0) : Metric(name, help, COUNTER, labels) {}
+
+	void inc(uint32_t n = 1) { count.fetch_add(n, std::memory_order_relaxed); }
+	int64_t value() override { return count.load(std::memory_order_relaxed); }
+
+private:
+	std::atomic<uint32_t> count{0};
+};
+
+class Gauge : public Metric {
+public:
+	Gauge(const char *name, const char *help, const char *labels = 0) : Metric(name, help, GAUGE, labels) {}
+
+	void set(int32_t v) { current.store(v, std::memory_order_relaxed); }
+	int64_t value() override { return current.load(std::memory_order_relaxed); }
+
+private:
+	std::atomic<int32_t> current{0};
+};
+
+// For values something else already keeps, read when scraped
+class SampledMetric : public Metric {
+public:
+	typedef int64_t (*SampleFunc)();
+
+	SampledMetric(const char *name, const char *help, Type type, SampleFunc sample, const char *labels = 0) :
+		Metric(name, help, type, labels), sample(sample) {}
+
+	int64_t value() override { return sample(); }
+
+private:
+	SampleFunc sample;
+};
+
+#endif
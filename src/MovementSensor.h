@@ -27,10 +27,18 @@ public:
 		this->enabled = enabled;
 	}
 
+	bool isEnabled() {
+		return enabled;
+	}
+
 	void setOnTime(unsigned long onTime) {
 		this->onTime = onTime;
 	}
 
+	unsigned long getOnTime() {
+		return onTime;
+	}
+
 	bool isOn() {
 		return !isOff();
 	}
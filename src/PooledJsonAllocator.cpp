@@ -0,0 +1,91 @@
+#include "PooledJsonAllocator.h"
+
+uint8_t *JsonArenaPool::acquire() {
+	uint8_t *arena = NULL;
+
+	portENTER_CRITICAL(&mux);
+	for (int i=0; i < JSON_ARENA_COUNT; i++) {
+		if (!inUse[i]) {
+			inUse[i] = true;
+			arena = arenas[i];
+			stats.acquired++;
+			break;
+		}
+	}
+
+	if (arena == NULL) {
+		stats.exhausted++;
+	}
+	portEXIT_CRITICAL(&mux);
+
+	return arena;
+}
+
+void JsonArenaPool::release(uint8_t *arena, size_t used) {
+	portENTER_CRITICAL(&mux);
+	inUse[(arena - arenas[0]) / JSON_ARENA_SIZE] = false;
+	if (used > stats.peak) {
+		stats.peak = used;
+	}
+	portEXIT_CRITICAL(&mux);
+}
+
+void JsonArenaPool::fallback() {
+	portENTER_CRITICAL(&mux);
+	stats.fallbacks++;
+	portEXIT_CRITICAL(&mux);
+}
+
+void* PooledJsonAllocator::allocate(size_t size) {
+	if (arena != NULL && used + HEADER_SIZE + align(size) <= JSON_ARENA_SIZE) {
+		*(Header*)(arena + used) = size;
+		void *ptr = arena + used + HEADER_SIZE;
+		used += HEADER_SIZE + align(size);
+		peak = max(peak, used);
+		return ptr;
+	}
+
+	if (arena != NULL) {
+		JsonArenaPool::getInstance().fallback();
+	}
+
+	return malloc(size);
+}
+
+void PooledJsonAllocator::deallocate(void* ptr) {
+	if (JsonArenaPool::getInstance().contains(arena, ptr)) {
+		// Space is only reclaimed if this was the most recent block
+		if (isLast(ptr)) {
+			used = (uint8_t*)ptr - arena - HEADER_SIZE;
+		}
+	} else {
+		free(ptr);
+	}
+}
+
+void* PooledJsonAllocator::reallocate(void* ptr, size_t new_size) {
+	if (ptr == NULL) {
+		return allocate(new_size);
+	}
+
+	if (!JsonArenaPool::getInstance().contains(arena, ptr)) {
+		return realloc(ptr, new_size);
+	}
+
+	size_t offset = (uint8_t*)ptr - arena;
+	if (isLast(ptr) && offset + align(new_size) <= JSON_ARENA_SIZE) {
+		// Grow or shrink in place
+		*(Header*)((uint8_t*)ptr - HEADER_SIZE) = new_size;
+		used = offset + align(new_size);
+		peak = max(peak, used);
+		return ptr;
+	}
+
+	void *newPtr = allocate(new_size);
+	if (newPtr != NULL) {
+		memcpy(newPtr, ptr, min(blockSize(ptr), new_size));
+		deallocate(ptr);
+	}
+
+	return newPtr;
+}
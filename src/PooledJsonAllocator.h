@@ -0,0 +1,86 @@
+#ifndef _POOLED_JSON_ALLOCATOR_H
+#define _POOLED_JSON_ALLOCATOR_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "freertos/FreeRTOS.h"
+
+// The biggest document is the console log broadcast: 40 entries of up to 100 chars plus slots
+#ifndef JSON_ARENA_SIZE
+#define JSON_ARENA_SIZE 6144
+#endif
+
+#ifndef JSON_ARENA_COUNT
+#define JSON_ARENA_COUNT 3
+#endif
+
+/*
+ * A fixed set of arenas that JsonDocuments on the broadcast and info paths borrow
+ * for their lifetime, so those paths stop churning the heap.
+ */
+class JsonArenaPool {
+public:
+	struct Stats {
+		uint32_t acquired;
+		uint32_t exhausted;		// No arena was free, document used the heap
+		uint32_t fallbacks;		// Allocations that didn't fit in the arena
+		size_t peak;			// Most bytes any document has used
+	};
+
+	static JsonArenaPool& getInstance() { static JsonArenaPool pool; return pool; }
+
+	uint8_t *acquire();
+	void release(uint8_t *arena, size_t used);
+	void fallback();
+
+	bool contains(const uint8_t *arena, const void *ptr) const {
+		return arena != NULL && ptr >= arena && ptr < arena + JSON_ARENA_SIZE;
+	}
+
+	Stats getStats() const { return stats; }
+
+private:
+	JsonArenaPool() {}
+
+	portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+	bool inUse[JSON_ARENA_COUNT] = {};
+	Stats stats = {};
+	uint8_t arenas[JSON_ARENA_COUNT][JSON_ARENA_SIZE] __attribute__((aligned(8)));
+};
+
+/*
+ * Declare one of these before the JsonDocument that uses it so it outlives the document:
+ *
+ *   PooledJsonAllocator allocator;
+ *   JsonDocument doc(&allocator);
+ *
+ * Blocks are bump allocated from the arena; anything that doesn't fit goes to the heap.
+ */
+class PooledJsonAllocator : public ArduinoJson::Allocator {
+public:
+	PooledJsonAllocator() : arena(JsonArenaPool::getInstance().acquire()) {}
+	~PooledJsonAllocator() {
+		if (arena != NULL) {
+			JsonArenaPool::getInstance().release(arena, peak);
+		}
+	}
+
+	void* allocate(size_t size) override;
+	void deallocate(void* ptr) override;
+	void* reallocate(void* ptr, size_t new_size) override;
+
+private:
+	typedef uint32_t Header;	// Size of the block, stored just before it
+
+	static size_t align(size_t size) { return (size + 7) & ~(size_t)7; }
+	static const size_t HEADER_SIZE = 8;	// Keep blocks 8 byte aligned
+
+	size_t blockSize(void *ptr) const { return *(Header*)((uint8_t*)ptr - HEADER_SIZE); }
+	bool isLast(void *ptr) const { return (uint8_t*)ptr + align(blockSize(ptr)) == arena + used; }
+
+	uint8_t *arena;
+	size_t used = 0;
+	size_t peak = 0;
+};
+
+#endif
@@ -0,0 +1,92 @@
+#include "esp_log.h"
+#include "esp_system.h"
+#include "StateJournal.h"
+
+extern const char* TIME_FLIES_TAG;
+
+StateJournal::StateJournal() {
+	mutex = xSemaphoreCreateMutex();
+	epoch = esp_random() ^ micros();	// Distinguishes this boot from the last one
+	if (epoch == 0) {
+		epoch = 1;
+	}
+}
+
+uint32_t StateJournal::record(EntryType type, const BaseConfigItem *item) {
+	if (xSemaphoreTake(mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+		ESP_LOGE(TIME_FLIES_TAG, "Failed to obtain journal mutex");
+		return version;
+	}
+
+	Entry &entry = entries[head];
+	entry.version = ++version;
+	entry.type = type;
+	entry.item = item;
+
+	head = (head + 1) % STATE_JOURNAL_SIZE;
+	count = min(count + 1, STATE_JOURNAL_SIZE);
+
+	uint32_t ret = version;
+	xSemaphoreGive(mutex);
+
+	return ret;
+}
+
+uint32_t StateJournal::getVersion() {
+	if (xSemaphoreTake(mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+		ESP_LOGE(TIME_FLIES_TAG, "Failed to obtain journal mutex");
+		return 0;
+	}
+
+	uint32_t ret = version;
+	xSemaphoreGive(mutex);
+
+	return ret;
+}
+
+bool StateJournal::changesSince(uint32_t clientEpoch, uint32_t clientVersion, ChangeCallback callback) {
+	if (clientEpoch != epoch) {
+		return false;
+	}
+
+	Entry changes[STATE_JOURNAL_SIZE];
+	int numChanges = 0;
+
+	if (xSemaphoreTake(mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+		ESP_LOGE(TIME_FLIES_TAG, "Failed to obtain journal mutex");
+		return false;
+	}
+
+	// Versions in the journal are contiguous, so the oldest one we still have is version - count + 1
+	if (clientVersion > version || clientVersion < version - count) {
+		xSemaphoreGive(mutex);
+		return false;
+	}
+
+	// Walk newest to oldest, keeping only the first (i.e. latest) change to each thing
+	for (int i=0, index=head; i < count; i++) {
+		index = (index + STATE_JOURNAL_SIZE - 1) % STATE_JOURNAL_SIZE;
+		const Entry &entry = entries[index];
+		if (entry.version <= clientVersion) {
+			break;
+		}
+
+		bool seen = false;
+		for (int j=0; j < numChanges && !seen; j++) {
+			seen = changes[j].type == entry.type && changes[j].item == entry.item;
+		}
+
+		if (!seen) {
+			changes[numChanges++] = entry;
+		}
+	}
+
+	xSemaphoreGive(mutex);
+
+	// Callbacks serialize values so don't hold the mutex while calling them
+	for (int i=numChanges - 1; i >= 0; i--) {
+		callback(changes[i].type, changes[i].item);
+	}
+
+	return true;
+}
@@ -0,0 +1,53 @@
+#ifndef _STATE_JOURNAL_H
+#define _STATE_JOURNAL_H
+
+#include <Arduino.h>
+#include <functional>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <ConfigItem.h>
+
+#ifndef STATE_JOURNAL_SIZE
+#define STATE_JOURNAL_SIZE 64
+#endif
+
+/*
+ * Records which bits of state changed at which version so a reconnecting
+ * client can be sent just the changes since the last version it saw. Values
+ * aren't stored - the current value is sent for anything that changed.
+ */
+class StateJournal {
+public:
+	typedef enum {
+		CONFIG = 1,
+		LOG,
+		SPP_STATE
+	} EntryType;
+
+	typedef std::function<void(EntryType type, const BaseConfigItem *item)> ChangeCallback;
+
+	StateJournal();
+
+	uint32_t record(EntryType type, const BaseConfigItem *item = 0);
+	uint32_t getVersion();
+	uint32_t getEpoch() const { return epoch; }
+
+	// Returns false if the journal no longer covers the requested version
+	bool changesSince(uint32_t epoch, uint32_t version, ChangeCallback callback);
+
+private:
+	struct Entry {
+		uint32_t version;
+		EntryType type;
+		const BaseConfigItem *item;
+	};
+
+	SemaphoreHandle_t mutex;
+	uint32_t epoch;
+	uint32_t version = 0;
+	int head = 0;	// Next slot to write
+	int count = 0;
+	Entry entries[STATE_JOURNAL_SIZE];
+};
+
+#endif
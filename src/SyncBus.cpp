@@ -0,0 +1,135 @@
+#include "esp_log.h"
+#include "lwip/sockets.h"
+#include "SyncBus.h"
+
+extern const char* TIME_FLIES_TAG;
+
+bool SyncBus::begin(uint16_t port, uint32_t group) {
+	stop();
+
+	int s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (s < 0) {
+		ESP_LOGE(TIME_FLIES_TAG, "Failed to create sync bus socket: %d", errno);
+		return false;
+	}
+
+	int yes = 1;
+	setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+	setsockopt(s, SOL_SOCKET, SO_BROADCAST, &yes, sizeof(yes));
+
+	struct sockaddr_in addr = {};
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+
+	if (bind(s, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		ESP_LOGE(TIME_FLIES_TAG, "Failed to bind sync bus to port %d: %d", port, errno);
+		close(s);
+		return false;
+	}
+
+	if (group != 0) {
+		struct ip_mreq mreq = {};
+		mreq.imr_multiaddr.s_addr = group;
+		mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+
+		if (setsockopt(s, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) {
+			// Still usable for broadcasts, and we'll try again when the config next changes
+			ESP_LOGE(TIME_FLIES_TAG, "Failed to join sync group: %d", errno);
+			group = 0;
+		}
+	}
+
+	this->port = port;
+	this->group = group;
+	sock = s;
+
+	return true;
+}
+
+void SyncBus::stop() {
+	int s = sock;
+	sock = -1;
+	port = 0;
+	group = 0;
+
+	if (s >= 0) {
+		close(s);
+	}
+}
+
+int SyncBus::receive(char *buf, size_t size, uint32_t timeoutMs) {
+	int s = sock;
+	if (s < 0) {
+		return -1;
+	}
+
+	fd_set readSet;
+	FD_ZERO(&readSet);
+	FD_SET(s, &readSet);
+
+	struct timeval timeout;
+	timeout.tv_sec = timeoutMs / 1000;
+	timeout.tv_usec = (timeoutMs % 1000) * 1000;
+
+	int ready = select(s + 1, &readSet, NULL, NULL, &timeout);
+	stats.wakeups++;
+
+	if (ready < 0) {
+		return -1;
+	}
+
+	if (ready == 0) {
+		return 0;
+	}
+
+	int len = recv(s, buf, size, MSG_DONTWAIT);
+	if (len > 0) {
+		stats.packets++;
+	}
+
+	// A zero length packet is what wake() sends
+	return len < 0 ? 0 : len;
+}
+
+bool SyncBus::send(uint32_t address, const char *msg, size_t len) {
+	int s = sock;
+	if (s < 0) {
+		return false;
+	}
+
+	struct sockaddr_in addr = {};
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = address;	// Already in network order
+
+	if (sendto(s, msg, len, 0, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		ESP_LOGE(TIME_FLIES_TAG, "Sync bus send failed: %d", errno);
+		return false;
+	}
+
+	stats.sent++;
+
+	return true;
+}
+
+void SyncBus::wake() {
+	int s = sock;
+	if (s < 0) {
+		return;
+	}
+
+	struct sockaddr_in addr = {};
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	sendto(s, "", 0, 0, (struct sockaddr *)&addr, sizeof(addr));
+}
+
+void SyncBus::recordMovementLatency(uint32_t us) {
+	stats.lastMovementUs = us;
+	if (us > stats.maxMovementUs) {
+		stats.maxMovementUs = us;
+	}
+}
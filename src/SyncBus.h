@@ -0,0 +1,46 @@
+#ifndef _SYNC_BUS_H
+#define _SYNC_BUS_H
+
+#include <Arduino.h>
+
+/*
+ * UDP socket for the sync group. receive() blocks in select() until a packet
+ * arrives, the timeout passes or wake() is called from another task, so the
+ * task using it only runs when there is something to do. It can also join a
+ * multicast group so sync traffic doesn't wake every host on the LAN.
+ */
+class SyncBus {
+public:
+	struct Stats {
+		uint32_t wakeups;		// Times receive() returned
+		uint32_t packets;		// Non-empty packets received
+		uint32_t sent;
+		uint32_t lastMovementUs;	// Movement packet to the SPP task seeing it
+		uint32_t maxMovementUs;
+	};
+
+	// group is a multicast address in network order to join, or 0 for none
+	bool begin(uint16_t port, uint32_t group = 0);
+	void stop();
+	bool isOpen() const { return sock >= 0; }
+	uint16_t getPort() const { return port; }
+	uint32_t getGroup() const { return group; }
+
+	// Returns the number of bytes read, 0 on timeout or wake(), -1 on error
+	int receive(char *buf, size_t size, uint32_t timeoutMs);
+	bool send(uint32_t address, const char *msg, size_t len);
+
+	// Makes a blocked receive() return early
+	void wake();
+
+	void recordMovementLatency(uint32_t us);
+	Stats getStats() const { return stats; }
+
+private:
+	volatile int sock = -1;
+	uint16_t port = 0;
+	uint32_t group = 0;
+	Stats stats = {};
+};
+
+#endif
@@ -0,0 +1,163 @@
+#include "esp_log.h"
+#include "SyncProtocol.h"
+
+extern const char* TIME_FLIES_TAG;
+
+SyncProtocol::SyncProtocol(uint32_t id, uint32_t boot) : id(id), boot(boot) {
+	mutex = xSemaphoreCreateMutex();
+}
+
+void SyncProtocol::put32(uint8_t *p, uint32_t v) {
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+uint32_t SyncProtocol::get32(const uint8_t *p) {
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+bool SyncProtocol::queue(EventType type, const void *data, uint8_t len, bool replace) {
+	if (len > SYNC_MAX_EVENT) {
+		return false;
+	}
+
+	if (xSemaphoreTake(mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+		ESP_LOGE(TIME_FLIES_TAG, "Failed to obtain sync protocol mutex");
+		return false;
+	}
+
+	Event *event = 0;
+	for (int i=0; replace && i < numPending && event == 0; i++) {
+		if (outbox[i].type == type) {
+			event = &outbox[i];
+		}
+	}
+
+	if (event == 0 && numPending < SYNC_OUTBOX_SIZE) {
+		event = &outbox[numPending++];
+	}
+
+	if (event != 0) {
+		event->type = type;
+		event->len = len;
+		memcpy(event->data, data, len);
+	}
+
+	xSemaphoreGive(mutex);
+
+	return event != 0;
+}
+
+size_t SyncProtocol::takeFrame(uint8_t *buf, size_t size) {
+	if (numPending == 0 || size < SYNC_HEADER_SIZE) {
+		return 0;
+	}
+
+	if (xSemaphoreTake(mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+		ESP_LOGE(TIME_FLIES_TAG, "Failed to obtain sync protocol mutex");
+		return 0;
+	}
+
+	size_t len = SYNC_HEADER_SIZE;
+	int count = 0;
+
+	// Whatever doesn't fit stays queued for the next frame
+	while (count < numPending && len + 2 + outbox[count].len <= size) {
+		Event &event = outbox[count++];
+		buf[len++] = event.type;
+		buf[len++] = event.len;
+		memcpy(buf + len, event.data, event.len);
+		len += event.len;
+	}
+
+	memmove(outbox, outbox + count, (numPending - count) * sizeof(Event));
+	numPending -= count;
+
+	xSemaphoreGive(mutex);
+
+	buf[0] = SYNC_MAGIC_0;
+	buf[1] = SYNC_MAGIC_1;
+	buf[2] = SYNC_VERSION;
+	buf[3] = count;
+	put32(buf + 4, id);
+	put32(buf + 8, boot);
+	put32(buf + 12, ++seq);
+
+	stats.framesOut++;
+	stats.eventsOut += count;
+
+	return len;
+}
+
+bool SyncProtocol::accept(uint32_t sender, uint32_t senderBoot, uint32_t senderSeq, uint32_t nowMs) {
+	Peer *peer = 0;
+	Peer *oldest = &peers[0];
+
+	for (int i=0; i < SYNC_PEERS && peer == 0; i++) {
+		if (peers[i].id == sender) {
+			peer = &peers[i];
+		} else if (peers[i].lastSeen < oldest->lastSeen) {
+			oldest = &peers[i];
+		}
+	}
+
+	if (peer != 0 && peer->boot == senderBoot && (int32_t)(senderSeq - peer->seq) <= 0) {
+		stats.duplicates++;
+		return false;
+	}
+
+	// New sender, or it restarted. Forget whoever we heard from least recently.
+	if (peer == 0) {
+		peer = oldest;
+		peer->id = sender;
+	}
+
+	peer->boot = senderBoot;
+	peer->seq = senderSeq;
+	peer->lastSeen = nowMs;
+
+	return true;
+}
+
+bool SyncProtocol::parse(const uint8_t *buf, size_t len, uint32_t nowMs, EventCallback callback) {
+	if (len < SYNC_HEADER_SIZE || buf[0] != SYNC_MAGIC_0 || buf[1] != SYNC_MAGIC_1) {
+		return false;
+	}
+
+	if (buf[2] != SYNC_VERSION) {
+		stats.malformed++;
+		return false;
+	}
+
+	uint32_t sender = get32(buf + 4);
+	if (sender == id) {
+		return false;	// Multicast loops our own frames back to us
+	}
+
+	// Check the whole frame before acting on any of it
+	size_t pos = SYNC_HEADER_SIZE;
+	for (int i=0; i < buf[3]; i++) {
+		if (pos + 2 > len || pos + 2 + buf[pos + 1] > len) {
+			stats.malformed++;
+			return false;
+		}
+		pos += 2 + buf[pos + 1];
+	}
+
+	if (!accept(sender, get32(buf + 8), get32(buf + 12), nowMs)) {
+		return false;
+	}
+
+	stats.framesIn++;
+
+	pos = SYNC_HEADER_SIZE;
+	for (int i=0; i < buf[3]; i++) {
+		stats.eventsIn++;
+		callback(sender, (EventType)buf[pos], buf + pos + 2, buf[pos + 1]);
+		pos += 2 + buf[pos + 1];
+	}
+
+	return true;
+}
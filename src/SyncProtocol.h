@@ -0,0 +1,102 @@
+#ifndef _SYNC_PROTOCOL_H
+#define _SYNC_PROTOCOL_H
+
+#include <Arduino.h>
+#include <functional>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#define SYNC_MAGIC_0 'T'
+#define SYNC_MAGIC_1 'F'
+#define SYNC_VERSION 2
+#define SYNC_HEADER_SIZE 16
+#define SYNC_MAX_FRAME 256
+#define SYNC_MAX_EVENT 160	// Largest event payload, enough for a config key and a 127 character value
+#define SYNC_OUTBOX_SIZE 16	// Config transfers that need more go out over several frames
+#define SYNC_PEERS 8
+
+/*
+ * Version 2 of the sync bus protocol. A frame is
+ *
+ *   'T' 'F' version count | sender (4) | boot (4) | seq (4) | events...
+ *
+ * with each event type (1), length (1), payload. Multi-byte values are little
+ * endian. seq goes up by one per frame, boot changes each time the sender
+ * restarts, so a receiver can drop duplicates and stale frames per sender.
+ *
+ * Events queued before the next frame goes out are batched into it. Unless told
+ * otherwise, a newer event of a type replaces an older one still waiting.
+ */
+class SyncProtocol {
+public:
+	typedef enum {
+		MOVEMENT = 1,	// No payload
+		BLANKING,		// 1 byte, 1 if the clock is on
+		CONFIG_VERSION,	// epoch (4), version (4) of the sender's state journal
+		TIME_BEACON,	// seconds (4), microseconds (4) since the epoch, sent on a second boundary
+		ANNOUNCE,		// 1 byte, the sender's role
+		CONFIG_DELTA,	// key length (1), key, value length (1), value
+		CONFIG_BATCH,	// epoch (4), from version (4), to version (4), number of deltas before it (1)
+		CONFIG_REQUEST	// leader (4), epoch (4), version (4) the sender last applied
+	} EventType;
+
+	struct Stats {
+		uint32_t framesOut;
+		uint32_t eventsOut;
+		uint32_t framesIn;
+		uint32_t eventsIn;
+		uint32_t duplicates;
+		uint32_t malformed;
+		uint32_t legacy;
+	};
+
+	typedef std::function<void(uint32_t sender, EventType type, const uint8_t *data, uint8_t len)> EventCallback;
+
+	SyncProtocol(uint32_t id, uint32_t boot);
+
+	// Any task
+	bool queue(EventType type, const void *data = 0, uint8_t len = 0, bool replace = true);
+	bool pending() const { return numPending > 0; }
+
+	// Builds a frame out of everything queued. Returns its length, 0 if there was nothing.
+	size_t takeFrame(uint8_t *buf, size_t size);
+
+	// Returns false if the frame was rejected (not ours, malformed, duplicate or our own)
+	bool parse(const uint8_t *buf, size_t len, uint32_t nowMs, EventCallback callback);
+
+	uint32_t getId() const { return id; }
+	Stats getStats() const { return stats; }
+	void countLegacy() { stats.legacy++; }
+
+	static void put32(uint8_t *p, uint32_t v);
+	static uint32_t get32(const uint8_t *p);
+
+private:
+	struct Event {
+		uint8_t type;
+		uint8_t len;
+		uint8_t data[SYNC_MAX_EVENT];
+	};
+
+	struct Peer {
+		uint32_t id;
+		uint32_t boot;
+		uint32_t seq;
+		uint32_t lastSeen;
+	};
+
+	bool accept(uint32_t sender, uint32_t boot, uint32_t seq, uint32_t nowMs);
+
+	uint32_t id;
+	uint32_t boot;
+	uint32_t seq = 0;
+
+	SemaphoreHandle_t mutex;
+	Event outbox[SYNC_OUTBOX_SIZE];
+	int numPending = 0;
+
+	Peer peers[SYNC_PEERS] = {};
+	Stats stats = {};
+};
+
+#endif
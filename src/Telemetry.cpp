@@ -0,0 +1,157 @@
+#include "esp_log.h"
+#include "Telemetry.h"
+
+extern const char* TIME_FLIES_TAG;
+
+Telemetry::Telemetry(SampleFunc sampler) : sampler(sampler) {
+	due = xSemaphoreCreateBinary();
+}
+
+void Telemetry::begin() {
+	esp_timer_create_args_t args = {};
+	args.callback = timerCallback;
+	args.arg = this;
+	args.name = "telemetry";
+
+	if (esp_timer_create(&args, &timer) != ESP_OK || esp_timer_start_periodic(timer, 1000000) != ESP_OK) {
+		ESP_LOGE(TIME_FLIES_TAG, "Failed to start telemetry timer");
+	}
+}
+
+void Telemetry::timerCallback(void *arg) {
+	Telemetry *telemetry = (Telemetry *)arg;
+	xSemaphoreGive(telemetry->due);
+	if (telemetry->dueCallback) {
+		telemetry->dueCallback();
+	}
+}
+
+void Telemetry::loop() {
+	while (true) {
+		xSemaphoreTake(due, portMAX_DELAY);
+		sample();
+	}
+}
+
+uint32_t Telemetry::step() {
+	if (xSemaphoreTake(due, 0) == pdTRUE) {
+		sample();
+	}
+
+	return TELEMETRY_IDLE;	// Until the timer posts again
+}
+
+void Telemetry::push(Ring &ring, const Point &point) {
+	ring.points[ring.head] = point;
+	ring.head = (ring.head + 1) % ring.capacity;
+	if (ring.count < ring.capacity) {
+		ring.count++;
+	}
+}
+
+void Telemetry::accumulate(Rollup &rollup, const Point &point) {
+	for (int i=0; i < NUM_SERIES; i++) {
+		if (rollup.count == 0 || point.min[i] < rollup.min[i]) {
+			rollup.min[i] = point.min[i];
+		}
+		if (rollup.count == 0 || point.max[i] > rollup.max[i]) {
+			rollup.max[i] = point.max[i];
+		}
+		rollup.sum[i] = (rollup.count == 0 ? 0 : rollup.sum[i]) + point.avg[i];
+	}
+	rollup.count++;
+}
+
+// Once every points have gone in, makes a point of them and starts again
+bool Telemetry::flush(Rollup &rollup, Point &point, uint16_t every) {
+	if (rollup.count < every) {
+		return false;
+	}
+
+	for (int i=0; i < NUM_SERIES; i++) {
+		point.min[i] = rollup.min[i];
+		point.avg[i] = (rollup.sum[i] + rollup.count / 2) / rollup.count;
+		point.max[i] = rollup.max[i];
+	}
+	rollup.count = 0;
+
+	return true;
+}
+
+void Telemetry::sample() {
+	Point point;
+	sampler(point.avg);
+	memcpy(point.min, point.avg, sizeof(point.min));
+	memcpy(point.max, point.avg, sizeof(point.max));
+
+	portENTER_CRITICAL(&mux);
+	push(rings[0], point);
+	accumulate(minuteRollup, point);
+	if (flush(minuteRollup, point, rings[1].interval / rings[0].interval)) {
+		push(rings[1], point);
+		accumulate(quarterRollup, point);
+		if (flush(quarterRollup, point, rings[2].interval / rings[1].interval)) {
+			push(rings[2], point);
+		}
+	}
+	portEXIT_CRITICAL(&mux);
+}
+
+size_t Telemetry::size() {
+	size_t size = 8 + 3 * 8;
+
+	portENTER_CRITICAL(&mux);
+	for (int r=0; r < 3; r++) {
+		size += rings[r].count * sizeof(Point);
+	}
+	portEXIT_CRITICAL(&mux);
+
+	return size;
+}
+
+static void write16(Print &out, uint16_t v) {
+	out.write((uint8_t)v);
+	out.write((uint8_t)(v >> 8));
+}
+
+static void write32(Print &out, uint32_t v) {
+	write16(out, v);
+	write16(out, v >> 16);
+}
+
+void Telemetry::write(Print &out) {
+	// Take a copy of the ring positions. Each point is read whole under the lock, but a
+	// full ring that takes a sample meanwhile overwrites its oldest points, so those
+	// can come out newer than the ones after them.
+	Ring snapshot[3];
+	portENTER_CRITICAL(&mux);
+	memcpy(snapshot, rings, sizeof(snapshot));
+	portEXIT_CRITICAL(&mux);
+
+	out.write((const uint8_t *)TELEMETRY_MAGIC, 4);
+	out.write((uint8_t)NUM_SERIES);
+	out.write((uint8_t)3);
+	write16(out, 0);
+
+	for (int r=0; r < 3; r++) {
+		write32(out, snapshot[r].interval);
+		write16(out, snapshot[r].capacity);
+		write16(out, snapshot[r].count);
+	}
+
+	for (int r=0; r < 3; r++) {
+		Ring &ring = snapshot[r];
+		for (int i=0; i < ring.count; i++) {
+			Point point;
+			portENTER_CRITICAL(&mux);
+			point = ring.points[(ring.head + ring.capacity - ring.count + i) % ring.capacity];
+			portEXIT_CRITICAL(&mux);
+
+			for (int s=0; s < NUM_SERIES; s++) {
+				write16(out, point.min[s]);
+				write16(out, point.avg[s]);
+				write16(out, point.max[s]);
+			}
+		}
+	}
+}
@@ -0,0 +1,103 @@
+#ifndef _TELEMETRY_H
+#define _TELEMETRY_H
+
+#include <Arduino.h>
+#include <functional>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+
+#ifndef TELEMETRY_SECONDS
+#define TELEMETRY_SECONDS 60	// A minute of 1s samples
+#endif
+#ifndef TELEMETRY_MINUTES
+#define TELEMETRY_MINUTES 60	// An hour of 1 minute rollups
+#endif
+#ifndef TELEMETRY_QUARTERS
+#define TELEMETRY_QUARTERS 96	// A day of 15 minute rollups
+#endif
+
+#define TELEMETRY_MAGIC "TFT1"
+#define TELEMETRY_IDLE UINT32_MAX
+
+/*
+ * A fixed amount of history for a handful of values, sampled every second and
+ * rolled up into min/avg/max per minute and per 15 minutes. All storage is static
+ * and sized by the defines above. An esp_timer only marks a sample due, the
+ * sampler runs from loop() or step() on a task, since it calls into WiFi and the
+ * heap, which mustn't hold up the other timers.
+ *
+ * write() produces one packed little-endian array:
+ *   "TFT1", u8 series, u8 rings, u16 reserved
+ *   per ring: u32 interval (s), u16 capacity, u16 count
+ *   per ring, oldest first: count points of series x { u16 min, u16 avg, u16 max }
+ */
+class Telemetry {
+public:
+	typedef enum {
+		FREE_HEAP = 0,		// 16 byte units
+		MAX_BLOCK,			// 16 byte units
+		QUEUE_DEPTH,
+		RSSI,				// -dBm, 0 when not connected
+		SPP_CONNECTED,		// Percent of the time
+		NUM_SERIES
+	} Series;
+
+	typedef void (*SampleFunc)(uint16_t values[NUM_SERIES]);
+
+	Telemetry(SampleFunc sampler);
+
+	void begin();			// Starts the 1s timer
+	void loop();			// Runs forever on its own task
+	uint32_t step();		// Takes a sample if one is due, returns ms until it next needs to
+	void setDueCallback(std::function<void()> callback) { dueCallback = callback; }
+	void sample();			// Public so it can be driven by hand
+	size_t size();
+	void write(Print &out);
+
+private:
+	struct Point {
+		uint16_t min[NUM_SERIES];
+		uint16_t avg[NUM_SERIES];
+		uint16_t max[NUM_SERIES];
+	};
+
+	struct Ring {
+		Point *points;
+		uint16_t capacity;
+		uint16_t head;		// Next to write
+		uint16_t count;
+		uint32_t interval;
+	};
+
+	struct Rollup {
+		uint16_t min[NUM_SERIES];
+		uint16_t max[NUM_SERIES];
+		uint32_t sum[NUM_SERIES];
+		uint16_t count;
+	};
+
+	static void timerCallback(void *arg);
+	static void push(Ring &ring, const Point &point);
+	static void accumulate(Rollup &rollup, const Point &point);
+	static bool flush(Rollup &rollup, Point &point, uint16_t every);
+
+	SampleFunc sampler;
+	esp_timer_handle_t timer = NULL;
+	SemaphoreHandle_t due;
+	std::function<void()> dueCallback;	// For when there is no task waiting on due
+	portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+
+	Point seconds[TELEMETRY_SECONDS];
+	Point minutes[TELEMETRY_MINUTES];
+	Point quarters[TELEMETRY_QUARTERS];
+	Ring rings[3] = {
+		{ seconds, TELEMETRY_SECONDS, 0, 0, 1 },
+		{ minutes, TELEMETRY_MINUTES, 0, 0, 60 },
+		{ quarters, TELEMETRY_QUARTERS, 0, 0, 900 },
+	};
+	Rollup minuteRollup = {};
+	Rollup quarterRollup = {};
+};
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef _TIME_SOURCE_H
+#define _TIME_SOURCE_H
+
+#include <Arduino.h>
+#include <time.h>
+
+/*
+ * Where the blanking scheduler and config persistence get the time. The system
+ * one reads the RTC and millis(), the virtual one is set by hand so transitions
+ * and quiet periods can be played off the device.
+ */
+class TimeSource {
+public:
+	virtual ~TimeSource() {}
+	virtual time_t now() = 0;
+	virtual uint32_t ms() = 0;
+};
+
+class SystemTimeSource : public TimeSource {
+public:
+	time_t now() { return time(NULL); }
+	uint32_t ms() { return millis(); }
+};
+
+class VirtualTimeSource : public TimeSource {
+public:
+	VirtualTimeSource(time_t start = 0) : seconds(start), millisecond(0) {}
+
+	time_t now() { return seconds; }
+	uint32_t ms() { return millisecond; }
+
+	void advance(uint32_t delta) {
+		uint32_t sub = (millisecond % 1000) + delta;
+		seconds += sub / 1000;
+		millisecond += delta;
+	}
+
+	void set(time_t seconds) { this->seconds = seconds; }
+
+private:
+	time_t seconds;
+	uint32_t millisecond;
+};
+
+#endif
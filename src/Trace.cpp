@@ -0,0 +1,146 @@
+#include "Trace.h"
+#include "LineChunker.h"
+
+#define TRACE_INSTANT_DURATION UINT32_MAX
+
+enum {
+	STAGE_PREFIX,
+	STAGE_TASKS,
+	STAGE_EVENTS,
+	STAGE_SUFFIX,
+	STAGE_DONE
+};
+
+std::atomic<bool> Trace::enabled{false};
+portMUX_TYPE Trace::mux = portMUX_INITIALIZER_UNLOCKED;
+Trace::Event Trace::events[TRACE_EVENTS];
+uint32_t Trace::written = 0;
+uint32_t Trace::generation = 0;
+TaskHandle_t Trace::tasks[TRACE_TASKS];
+int Trace::numTasks = 0;
+
+void Trace::start() {
+	portENTER_CRITICAL(&mux);
+	written = 0;
+	generation++;
+	portEXIT_CRITICAL(&mux);
+
+	enabled = true;
+}
+
+void Trace::stop() {
+	enabled = false;
+}
+
+// Called inside the critical section
+uint8_t Trace::taskId() {
+	TaskHandle_t task = xTaskGetCurrentTaskHandle();
+
+	for (int i=0; i < numTasks; i++) {
+		if (tasks[i] == task) {
+			return i;
+		}
+	}
+
+	if (numTasks < TRACE_TASKS) {
+		tasks[numTasks] = task;
+		return numTasks++;
+	}
+
+	return TRACE_TASKS;	// Shows up as an unnamed thread
+}
+
+void Trace::instant(const char *name) {
+	record(name, esp_timer_get_time(), TRACE_INSTANT_DURATION);
+}
+
+void Trace::record(const char *name, int64_t start, uint32_t duration) {
+	if (!enabled) {
+		return;
+	}
+
+	portENTER_CRITICAL(&mux);
+	Event &event = events[written % TRACE_EVENTS];
+	event.name = name;
+	event.start = start;
+	event.duration = duration;
+	event.task = taskId();
+	written++;
+	portEXIT_CRITICAL(&mux);
+}
+
+Trace::Cursor Trace::begin() {
+	Cursor cursor = {};
+
+	portENTER_CRITICAL(&mux);
+	cursor.end = written;
+	cursor.seq = written > TRACE_EVENTS ? written - TRACE_EVENTS : 0;
+	cursor.generation = generation;
+	portEXIT_CRITICAL(&mux);
+
+	return cursor;
+}
+
+// Everything after the prefix starts with a comma, there's always something before it
+size_t Trace::renderLine(char *line, size_t size, Cursor &cursor) {
+	switch (cursor.stage) {
+	case STAGE_PREFIX:
+		return snprintf(line, size, "{\"traceEvents\":[{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"Time Flies\"}}");
+
+	case STAGE_TASKS: {
+		TaskHandle_t task = tasks[cursor.task];
+		return snprintf(line, size, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+			cursor.task, pcTaskGetName(task));
+	}
+
+	case STAGE_EVENTS: {
+		// The rest of a split line has to come from the same event
+		if (cursor.offset == 0) {
+			portENTER_CRITICAL(&mux);
+			// The ring may have lapped us since the dump started. After a restart written
+			// is smaller than seq, render() stops at the next line
+			if (cursor.generation == generation && written - cursor.seq > TRACE_EVENTS) {
+				cursor.seq = written - TRACE_EVENTS;
+			}
+			cursor.event = events[cursor.seq % TRACE_EVENTS];
+			portEXIT_CRITICAL(&mux);
+		}
+		const Event &event = cursor.event;
+
+		if (event.duration == TRACE_INSTANT_DURATION) {
+			return snprintf(line, size, ",\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%llu,\"pid\":1,\"tid\":%u}",
+				event.name, (unsigned long long)event.start, event.task);
+		}
+
+		return snprintf(line, size, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%llu,\"dur\":%lu,\"pid\":1,\"tid\":%u}",
+			event.name, (unsigned long long)event.start, (unsigned long)event.duration, event.task);
+	}
+
+	case STAGE_SUFFIX:
+		return snprintf(line, size, "\n],\"displayTimeUnit\":\"ms\"}\n");
+	}
+
+	return 0;
+}
+
+size_t Trace::render(char *buf, size_t size, Cursor &cursor) {
+	return LineChunker<TRACE_LINE_SIZE>::fill(buf, size, cursor.offset,
+		[&cursor] {
+			// Skip stages with nothing in them
+			while ((cursor.stage == STAGE_TASKS && cursor.task >= numTasks) ||
+					(cursor.stage == STAGE_EVENTS && cursor.offset == 0 && (cursor.seq >= cursor.end || cursor.generation != generation))) {
+				cursor.stage++;
+			}
+			return cursor.stage != STAGE_DONE;
+		},
+		[&cursor](char *line, size_t size) { return renderLine(line, size, cursor); },
+		[&cursor] {
+			if (cursor.stage == STAGE_TASKS) {
+				cursor.task++;
+			} else if (cursor.stage == STAGE_EVENTS) {
+				cursor.seq++;
+			} else {
+				cursor.stage++;
+			}
+		});
+}
@@ -0,0 +1,96 @@
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+
+#ifndef TRACE_EVENTS
+#define TRACE_EVENTS 256
+#endif
+#define TRACE_TASKS 12
+#define TRACE_LINE_SIZE 160
+
+/*
+ * A RAM ring of what each task was doing, dumped as Chrome Trace Event JSON for
+ * chrome://tracing or Perfetto. Names must be string literals, only the pointer is
+ * kept. Off until start() is called, and then recording an event is a critical
+ * section around a few stores.
+ *
+ *   TRACE_SPAN("getSPPState");		// From here to the end of the scope
+ *   TRACE_INSTANT("overflow");
+ *
+ * Build with -D TRACE_DISABLED to compile them out altogether.
+ */
+class Trace {
+public:
+	struct Event {
+		const char *name;
+		int64_t start;		// esp_timer_get_time(), 32 bits would wrap every 71 minutes
+		uint32_t duration;	// UINT32_MAX for an instant
+		uint8_t task;
+	};
+
+	struct Cursor {
+		uint32_t seq;		// Next event to write
+		uint32_t end;		// Events recorded after the dump started aren't included
+		uint32_t generation;	// The dump stops if start() is called under it
+		Event event;		// The one being written, for when its line is split
+		uint16_t offset;	// Into the current line, when it didn't all fit last time
+		uint8_t stage;
+		uint8_t task;
+	};
+
+	class Span {
+	public:
+		Span(const char *name) : name(name), active(Trace::enabled), start(active ? esp_timer_get_time() : 0) {}
+		~Span() {
+			if (active) {
+				Trace::record(name, start, (uint32_t)(esp_timer_get_time() - start));
+			}
+		}
+
+	private:
+		const char *name;
+		bool active;
+		int64_t start;
+	};
+
+	static void start();	// Clears what was there
+	static void stop();
+	static bool isEnabled() { return enabled; }
+
+	static void instant(const char *name);
+	static void record(const char *name, int64_t start, uint32_t duration);
+
+	static Cursor begin();
+	static size_t render(char *buf, size_t size, Cursor &cursor);	// 0 once there is no more
+	static uint32_t getRecorded() { return written; }
+
+	static std::atomic<bool> enabled;
+
+private:
+	static uint8_t taskId();
+	static size_t renderLine(char *line, size_t size, Cursor &cursor);
+
+	static portMUX_TYPE mux;
+	static Event events[TRACE_EVENTS];
+	static uint32_t written;
+	static uint32_t generation;
+	static TaskHandle_t tasks[TRACE_TASKS];
+	static int numTasks;
+};
+
+#ifdef TRACE_DISABLED
+#define TRACE_SPAN(name)
+#define TRACE_INSTANT(name)
+#else
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+#define TRACE_SPAN(name) Trace::Span TRACE_CONCAT(traceSpan, __LINE__)(name)
+#define TRACE_INSTANT(name) do { if (Trace::enabled) Trace::instant(name); } while (0)
+#endif
+
+#endif
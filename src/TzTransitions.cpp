@@ -0,0 +1,296 @@
+#include "esp_log.h"
+#include "TzTransitions.h"
+
+extern const char* TIME_FLIES_TAG;
+
+static bool isLeap(int year) {
+	return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+// Days since 1970-01-01 of 1 January of year
+static long daysToYear(int year) {
+	long days = 0;
+	for (int y=1970; y < year; y++) {
+		days += isLeap(y) ? 366 : 365;
+	}
+	return days;
+}
+
+TzTransitions::TzTransitions() {
+	mutex = xSemaphoreCreateMutex();
+}
+
+const char *TzTransitions::parseName(const char *p) {
+	if (*p == '<') {
+		const char *end = strchr(p, '>');
+		return end == NULL ? NULL : end + 1;
+	}
+
+	const char *start = p;
+	while (isalpha((unsigned char)*p)) {
+		p++;
+	}
+
+	return p - start >= 3 ? p : NULL;
+}
+
+// POSIX offsets are hours west of UTC, we keep seconds east
+const char *TzTransitions::parseOffset(const char *p, int32_t &seconds) {
+	int sign = -1;
+	if (*p == '+' || *p == '-') {
+		sign = *p == '-' ? 1 : -1;
+		p++;
+	}
+
+	if (!isdigit((unsigned char)*p)) {
+		return NULL;
+	}
+
+	int32_t parts[3] = {0, 0, 0};
+	for (int i=0; i < 3; i++) {
+		while (isdigit((unsigned char)*p)) {
+			parts[i] = parts[i] * 10 + (*p++ - '0');
+		}
+		if (*p != ':' || i == 2) {
+			break;
+		}
+		p++;
+	}
+
+	seconds = sign * (parts[0] * 3600 + parts[1] * 60 + parts[2]);
+	return p;
+}
+
+const char *TzTransitions::parseRule(const char *p, int &type, int &a, int &b, int &c, int32_t &time) {
+	if (*p == 'M') {
+		type = 'M';
+		if (sscanf(p + 1, "%d.%d.%d", &a, &b, &c) != 3 || a < 1 || a > 12 || b < 1 || b > 5 || c < 0 || c > 6) {
+			return NULL;
+		}
+		p++;
+		while (isdigit((unsigned char)*p) || *p == '.') {
+			p++;
+		}
+	} else {
+		type = 'D';
+		if (*p == 'J') {
+			type = 'J';
+			p++;
+		}
+		if (!isdigit((unsigned char)*p)) {
+			return NULL;
+		}
+		a = 0;
+		while (isdigit((unsigned char)*p)) {
+			a = a * 10 + (*p++ - '0');
+		}
+	}
+
+	time = 2 * 3600;
+	if (*p == '/') {
+		// Same form as an offset but not negated, so undo parseOffset's west/east flip
+		p = parseOffset(p + 1, time);
+		time = -time;
+	}
+
+	return p;
+}
+
+bool TzTransitions::setTz(const char *tz) {
+	bool ok = false;
+	const char *p = parseName(tz);
+	int32_t stdOff = 0, dstOff = 0;
+	bool hasDst = false;
+	int sType = 'M', sA = 3, sB = 2, sC = 0, eType = 'M', eA = 11, eB = 1, eC = 0;
+	int32_t sTime = 7200, eTime = 7200;
+
+	if (p != NULL && (p = parseOffset(p, stdOff)) != NULL) {
+		ok = true;
+		if (*p) {
+			p = parseName(p);
+			ok = p != NULL;
+			hasDst = ok;
+			dstOff = stdOff + 3600;
+			if (ok && *p && *p != ',') {
+				p = parseOffset(p, dstOff);
+				ok = p != NULL;
+			}
+			// No rule means the US one
+			if (ok && *p == ',') {
+				p = parseRule(p + 1, sType, sA, sB, sC, sTime);
+				ok = p != NULL && *p == ',';
+				if (ok) {
+					p = parseRule(p + 1, eType, eA, eB, eC, eTime);
+					ok = p != NULL && *p == 0;
+				}
+			}
+		}
+	}
+
+	if (xSemaphoreTake(mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+		ESP_LOGE(TIME_FLIES_TAG, "Failed to obtain TZ mutex");
+		return false;
+	}
+
+	valid = ok;
+	dst = ok && hasDst;
+	stdOffset = stdOff;
+	dstOffset = dstOff;
+	startType = sType; startA = sA; startB = sB; startC = sC; startTime = sTime;
+	endType = eType; endA = eA; endB = eB; endC = eC; endTime = eTime;
+	numTransitions = 0;
+	firstYear = 0;
+	nextPush = 0;
+
+	xSemaphoreGive(mutex);
+
+	if (!ok) {
+		ESP_LOGE(TIME_FLIES_TAG, "Can't work out DST transitions for %s", tz);
+	}
+
+	return ok;
+}
+
+void TzTransitions::reset() {
+	nextPush = 0;
+}
+
+// Zero based day of the year a rule falls on
+int TzTransitions::dayOfYear(int year, int type, int a, int b, int c) {
+	static const int monthDays[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+
+	if (type == 'J') {
+		// Feb 29 is never counted
+		return a - 1 + (isLeap(year) && a > 59 ? 1 : 0);
+	}
+
+	if (type == 'D') {
+		return a;
+	}
+
+	int day = 0;
+	for (int m=0; m < a - 1; m++) {
+		day += monthDays[m] + (m == 1 && isLeap(year) ? 1 : 0);
+	}
+
+	int daysInMonth = monthDays[a - 1] + (a == 2 && isLeap(year) ? 1 : 0);
+
+	// 1970-01-01 was a Thursday
+	int firstWeekday = (daysToYear(year) + day + 4) % 7;
+	int first = (c - firstWeekday + 7) % 7;	// First such weekday of the month
+	int date = first + (b - 1) * 7;
+	if (date >= daysInMonth) {
+		date -= 7;	// Week 5 means the last one
+	}
+
+	return day + date;
+}
+
+void TzTransitions::compute(int year) {
+	numTransitions = 0;
+	firstYear = year;
+	recomputes++;
+
+	if (!dst) {
+		return;
+	}
+
+	for (int y=year; y < year + 2; y++) {
+		long base = daysToYear(y) * 86400L;
+
+		// Rule times are local, in whatever offset is in force just before
+		Transition start = { (time_t)(base + dayOfYear(y, startType, startA, startB, startC) * 86400L + startTime - stdOffset), dstOffset, true };
+		Transition end = { (time_t)(base + dayOfYear(y, endType, endA, endB, endC) * 86400L + endTime - dstOffset), stdOffset, false };
+
+		// Southern hemisphere rules end before they start
+		if (start.at < end.at) {
+			transitions[numTransitions++] = start;
+			transitions[numTransitions++] = end;
+		} else {
+			transitions[numTransitions++] = end;
+			transitions[numTransitions++] = start;
+		}
+	}
+}
+
+void TzTransitions::ensure(time_t now) {
+	struct tm utc;
+	gmtime_r(&now, &utc);
+	int year = utc.tm_year + 1900;
+
+	if (numTransitions == 0 ? firstYear != year : (year < firstYear || now >= transitions[numTransitions - 1].at)) {
+		compute(year);
+	}
+}
+
+bool TzTransitions::lookup(time_t now, int32_t &offset, bool &isDst) {
+	if (xSemaphoreTake(mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+		ESP_LOGE(TIME_FLIES_TAG, "Failed to obtain TZ mutex");
+		return false;
+	}
+
+	ensure(now);
+
+	// Before the first transition of the year we're in whatever the last one of the year set
+	offset = stdOffset;
+	isDst = false;
+	if (numTransitions > 0 && now < transitions[0].at) {
+		offset = transitions[1].offset;
+		isDst = transitions[1].isDst;
+	}
+	for (int i=0; i < numTransitions && transitions[i].at <= now; i++) {
+		offset = transitions[i].offset;
+		isDst = transitions[i].isDst;
+	}
+
+	bool ret = valid;
+	xSemaphoreGive(mutex);
+
+	return ret;
+}
+
+time_t TzTransitions::nextTransition(time_t now) {
+	if (xSemaphoreTake(mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+		ESP_LOGE(TIME_FLIES_TAG, "Failed to obtain TZ mutex");
+		return 0;
+	}
+
+	ensure(now);
+
+	time_t next = 0;
+	for (int i=0; i < numTransitions && next == 0; i++) {
+		if (transitions[i].at > now) {
+			next = transitions[i].at;
+		}
+	}
+
+	xSemaphoreGive(mutex);
+
+	return next;
+}
+
+bool TzTransitions::due(time_t now) {
+	if (nextPush == 0) {
+		time_t next = nextTransition(now);
+		nextPush = next == 0 ? 0 : next + TZ_PUSH_DELAY;
+		return false;
+	}
+
+	if (now < nextPush) {
+		return false;
+	}
+
+	time_t next = nextTransition(now);
+	nextPush = next == 0 ? 0 : next + TZ_PUSH_DELAY;
+
+	return true;
+}
+
+uint32_t TzTransitions::msUntilDue(time_t now) {
+	if (nextPush == 0) {
+		return UINT32_MAX;
+	}
+
+	// A transition can be months away, more seconds than fit in uint32_t ms
+	return nextPush > now ? (uint32_t)min(nextPush - now, (time_t)(UINT32_MAX / 1000)) * 1000 : 0;
+}
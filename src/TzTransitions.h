@@ -0,0 +1,73 @@
+#ifndef _TZ_TRANSITIONS_H
+#define _TZ_TRANSITIONS_H
+
+#include <Arduino.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#define TZ_MAX_TRANSITIONS 4	// This year and next
+#define TZ_PUSH_DELAY 1			// Seconds after a transition to push, so local time has definitely moved
+
+/*
+ * The UTC offset changes described by a POSIX TZ string (e.g. EST5EDT,M3.2.0,M11.1.0),
+ * worked out once when the string changes and again each new year, so the time
+ * can be pushed to the clock right when DST starts or ends.
+ */
+class TzTransitions {
+public:
+	struct Transition {
+		time_t at;			// UTC
+		int32_t offset;		// Seconds east of UTC from then on
+		bool isDst;
+	};
+
+	TzTransitions();
+
+	// Returns false if the string couldn't be understood, in which case there are no transitions
+	bool setTz(const char *tz);
+
+	// The time may have jumped, work out the next push again
+	void reset();
+
+	// True once per transition, at or just after it
+	bool due(time_t now);
+	uint32_t msUntilDue(time_t now);
+
+	bool lookup(time_t now, int32_t &offset, bool &isDst);
+	time_t nextTransition(time_t now);
+
+	bool hasDst() const { return dst; }
+	int32_t getStdOffset() const { return stdOffset; }
+	uint32_t getRecomputes() const { return recomputes; }
+
+private:
+	static const char *parseName(const char *p);
+	static const char *parseOffset(const char *p, int32_t &seconds);
+	static const char *parseRule(const char *p, int &type, int &a, int &b, int &c, int32_t &time);
+	static int dayOfYear(int year, int type, int a, int b, int c);
+
+	void compute(int year);
+	void ensure(time_t now);
+
+	SemaphoreHandle_t mutex;
+
+	bool valid = false;
+	bool dst = false;
+	int32_t stdOffset = 0;	// Seconds east of UTC
+	int32_t dstOffset = 0;
+
+	// type: 'J' (1-365, no Feb 29), 'D' (0-365), 'M' (month, week, weekday)
+	int startType, startA, startB, startC;
+	int32_t startTime;
+	int endType, endA, endB, endC;
+	int32_t endTime;
+
+	int firstYear = 0;
+	Transition transitions[TZ_MAX_TRANSITIONS];
+	int numTransitions = 0;
+	time_t nextPush = 0;
+	uint32_t recomputes = 0;
+};
+
+#endif
@@ -0,0 +1,198 @@
+#include "esp_log.h"
+#include "WSClientMonitor.h"
+
+extern const char* TIME_FLIES_TAG;
+
+void WSClientMonitor::setMaxClients(uint8_t maxClients) {
+	if (maxClients == 0 || maxClients > WS_CLIENT_SLOTS) {
+		maxClients = 4;
+	}
+
+	this->maxClients = maxClients;
+}
+
+WSClientMonitor::Slot *WSClientMonitor::find(uint32_t id) {
+	for (int i=0; i < WS_CLIENT_SLOTS; i++) {
+		if (slots[i].used && slots[i].id == id) {
+			return &slots[i];
+		}
+	}
+
+	return NULL;
+}
+
+int WSClientMonitor::countUsed() {
+	int count = 0;
+	for (int i=0; i < WS_CLIENT_SLOTS; i++) {
+		if (slots[i].used) {
+			count++;
+		}
+	}
+
+	return count;
+}
+
+void WSClientMonitor::onConnect(AsyncWebSocketClient *client, unsigned long now) {
+	if (xSemaphoreTake(mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+		ESP_LOGE(TIME_FLIES_TAG, "Failed to obtain client monitor mutex");
+		return;
+	}
+
+	// Make room if we are full, and pick the oldest idle client to go if we are over the limit
+	Slot *oldest = NULL;
+	for (int i=0; i < WS_CLIENT_SLOTS; i++) {
+		if (slots[i].used && (oldest == NULL || now - slots[i].lastActivity > now - oldest->lastActivity)) {
+			oldest = &slots[i];
+		}
+	}
+
+	// This runs on the async_tcp task, which mustn't wait for broadcasts, so loop() does the closing
+	if (oldest != NULL && countUsed() >= maxClients && numEvicts < WS_CLIENT_SLOTS) {
+		evictIds[numEvicts++] = oldest->id;
+		oldest->used = false;
+		evicted++;
+	}
+
+	Slot *slot = NULL;
+	for (int i=0; i < WS_CLIENT_SLOTS && slot == NULL; i++) {
+		if (!slots[i].used) {
+			slot = &slots[i];
+		}
+	}
+
+	if (slot != NULL) {
+		slot->used = true;
+		slot->id = client->id();
+		slot->connected = now;
+		slot->lastActivity = now;
+		slot->pingSent = 0;
+		slot->bytesIn = 0;
+		slot->messagesIn = 0;
+	}
+
+	xSemaphoreGive(mutex);
+}
+
+void WSClientMonitor::onDisconnect(AsyncWebSocketClient *client) {
+	if (xSemaphoreTake(mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+		ESP_LOGE(TIME_FLIES_TAG, "Failed to obtain client monitor mutex");
+		return;
+	}
+
+	Slot *slot = find(client->id());
+	if (slot != NULL) {
+		slot->used = false;
+	}
+
+	xSemaphoreGive(mutex);
+}
+
+void WSClientMonitor::onActivity(AsyncWebSocketClient *client, size_t bytesIn, unsigned long now) {
+	if (xSemaphoreTake(mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+		ESP_LOGE(TIME_FLIES_TAG, "Failed to obtain client monitor mutex");
+		return;
+	}
+
+	Slot *slot = find(client->id());
+	if (slot != NULL) {
+		slot->lastActivity = now;
+		slot->pingSent = 0;
+		if (bytesIn > 0) {
+			slot->bytesIn += bytesIn;
+			slot->messagesIn++;
+		}
+	}
+
+	xSemaphoreGive(mutex);
+}
+
+void WSClientMonitor::loop(unsigned long now) {
+	uint32_t pingIds[WS_CLIENT_SLOTS];
+	uint32_t closeIds[WS_CLIENT_SLOTS];
+	uint32_t evictees[WS_CLIENT_SLOTS];
+	int numPings = 0;
+	int numCloses = 0;
+
+	if (xSemaphoreTake(mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+		ESP_LOGE(TIME_FLIES_TAG, "Failed to obtain client monitor mutex");
+		return;
+	}
+
+	int numEvictees = numEvicts;
+	memcpy(evictees, evictIds, numEvicts * sizeof(evictIds[0]));
+	numEvicts = 0;
+
+	for (int i=0; i < WS_CLIENT_SLOTS; i++) {
+		Slot &slot = slots[i];
+		if (!slot.used) {
+			continue;
+		}
+
+		if (slot.pingSent != 0 && now - slot.pingSent > WS_PONG_TIMEOUT) {
+			closeIds[numCloses++] = slot.id;
+			slot.used = false;
+			timedOut++;
+		} else if (slot.pingSent == 0 && now - slot.lastActivity > WS_PING_INTERVAL) {
+			pingIds[numPings++] = slot.id;
+			slot.pingSent = now;
+		}
+	}
+
+	xSemaphoreGive(mutex);
+
+	for (int i=0; i < numPings; i++) {
+		AsyncWebSocketClient *client = ws.client(pingIds[i]);
+		if (client != NULL) {
+			client->ping();
+		}
+	}
+
+	for (int i=0; i < numEvictees; i++) {
+		AsyncWebSocketClient *client = ws.client(evictees[i]);
+		if (client != NULL) {
+			ESP_LOGD(TIME_FLIES_TAG, "Evicting idle WS client %lu", (unsigned long)evictees[i]);
+			client->close();
+		}
+	}
+
+	for (int i=0; i < numCloses; i++) {
+		AsyncWebSocketClient *client = ws.client(closeIds[i]);
+		if (client != NULL) {
+			ESP_LOGD(TIME_FLIES_TAG, "WS client %lu timed out", (unsigned long)closeIds[i]);
+			client->close();
+		}
+	}
+
+	// Free anything that has disconnected and enforce the limit on what is left
+	ws.cleanupClients(maxClients);
+}
+
+String WSClientMonitor::getSummary(unsigned long now) {
+	String summary;
+	char line[96];
+
+	if (xSemaphoreTake(mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+		ESP_LOGE(TIME_FLIES_TAG, "Failed to obtain client monitor mutex");
+		return summary;
+	}
+
+	snprintf(line, sizeof(line), "%d of %d, %lu evicted, %lu timed out", countUsed(), maxClients,
+		(unsigned long)evicted, (unsigned long)timedOut);
+	summary += line;
+
+	for (int i=0; i < WS_CLIENT_SLOTS; i++) {
+		Slot &slot = slots[i];
+		if (slot.used) {
+			AsyncWebSocketClient *client = ws.client(slot.id);
+			snprintf(line, sizeof(line), "<br>#%lu: up %lus, idle %lus, %lu msgs/%lu bytes in, %u queued",
+				(unsigned long)slot.id, (now - slot.connected) / 1000, (now - slot.lastActivity) / 1000,
+				(unsigned long)slot.messagesIn, (unsigned long)slot.bytesIn,
+				client != NULL ? (unsigned)client->queueLen() : 0);
+			summary += line;
+		}
+	}
+
+	xSemaphoreGive(mutex);
+
+	return summary;
+}
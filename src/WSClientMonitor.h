@@ -0,0 +1,57 @@
+#ifndef WSCLIENTMONITOR_H_
+#define WSCLIENTMONITOR_H_
+
+#include <ESPAsyncWebServer.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#define WS_CLIENT_SLOTS 16
+#define WS_PING_INTERVAL 30000	// Ping a client that has been quiet this long
+#define WS_PONG_TIMEOUT 10000	// and drop it if it doesn't answer within this
+
+/*
+ * Keeps track of WebSocket clients so dead ones can be reaped and the number
+ * taking part in broadcasts stays bounded.
+ */
+class WSClientMonitor {
+public:
+	WSClientMonitor(AsyncWebSocket &ws) : ws(ws) {
+		mutex = xSemaphoreCreateMutex();
+	}
+
+	void setMaxClients(uint8_t maxClients);
+
+	void onConnect(AsyncWebSocketClient *client, unsigned long now);
+	void onDisconnect(AsyncWebSocketClient *client);
+	void onActivity(AsyncWebSocketClient *client, size_t bytesIn, unsigned long now);
+
+	// Call periodically with the same lock held as used for broadcasting
+	void loop(unsigned long now);
+
+	String getSummary(unsigned long now);
+
+private:
+	struct Slot {
+		bool used;
+		uint32_t id;
+		unsigned long connected;
+		unsigned long lastActivity;
+		unsigned long pingSent;	// 0 = no ping outstanding
+		uint32_t bytesIn;
+		uint32_t messagesIn;
+	};
+
+	Slot *find(uint32_t id);
+	int countUsed();
+
+	AsyncWebSocket &ws;
+	SemaphoreHandle_t mutex;
+	uint8_t maxClients = 4;
+	uint32_t evicted = 0;
+	uint32_t timedOut = 0;
+	Slot slots[WS_CLIENT_SLOTS] = {};
+	uint32_t evictIds[WS_CLIENT_SLOTS];	// Picked on connect, closed by loop() under the broadcast lock
+	int numEvicts = 0;
+};
+
+#endif /* WSCLIENTMONITOR_H_ */
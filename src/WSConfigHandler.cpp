@@ -1,33 +1,47 @@
 #include <WSConfigHandler.h>
+#include "ConfigJson.h"
 
 void WSConfigHandler::handle(AsyncWebSocketClient *client, const char *data) {
-	client->text(getData(data));
+	// Read the version first so the client can never think it is more up to date than it is
+	uint32_t version = pJournal != NULL ? pJournal->getVersion() : 0;
+	AsyncWebSocketMessageBuffer *buffer = makeBuffer(*client->server(), [this, version](JsonWriter &writer) { getData(writer, version); });
+	if (buffer) {
+		client->text(buffer);
+	}
 }
 
 void WSConfigHandler::broadcast(AsyncWebSocket &ws, const char *data) {
-	ws.textAll(getData(data));
+	uint32_t version = pJournal != NULL ? pJournal->getVersion() : 0;
+	AsyncWebSocketMessageBuffer *buffer = makeBuffer(ws, [this, version](JsonWriter &writer) { getData(writer, version); });
+	if (buffer) {
+		ws.textAll(buffer);
+	}
 }
 
-String WSConfigHandler::getData(const char *data) {
-	String json("{\"type\":\"sv.init.");
-	json.concat(name);
-	json.concat("\", \"value\":{");
-    BaseConfigItem *clockConfig = rootConfig.get(name);
-    char *sep = "";
+void WSConfigHandler::getData(JsonWriter &writer, uint32_t version) {
+	writer.raw("{\"type\":\"sv.init.").raw(name).raw("\", ");
+	if (pJournal != NULL) {
+		writer.raw("\"epoch\":").number(pJournal->getEpoch());
+		writer.raw(", \"version\":").number(version).raw(", ");
+	}
+	writer.raw("\"value\":{");
+
+    CompositeConfigItem *clockConfig = static_cast<CompositeConfigItem*>(rootConfig.get(name));
+    const char *sep = "";
 
     if (clockConfig != 0) {
-        json.concat(sep);
-        json.concat(clockConfig->toJSON(true));
-		sep = ",";
+		// Write each member rather than building the whole composite as one String
+		for (BaseConfigItem **pItem = clockConfig->value; *pItem != 0; pItem++) {
+			writer.raw(sep).string((*pItem)->name).raw(":");
+			ConfigJson::write(writer, **pItem);
+			sep = ",";
+		}
     }
 
 	if (cbFunc != NULL) {
-		json.concat(sep);
-		json.concat(cbFunc());
+		writer.raw(sep);
+		cbFunc(writer);
 	}
 
-	json.concat("}}");
-
-	return json;
+	writer.raw("}}");
 }
-
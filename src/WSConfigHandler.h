@@ -3,28 +3,37 @@
 
 #include <ConfigItem.h>
 #include <WSHandler.h>
+#include "StateJournal.h"
 
 class WSConfigHandler: public WSHandler {
 public:
 	WSConfigHandler(BaseConfigItem& rootConfig, const char *name) :
 		cbFunc(NULL),
+		pJournal(NULL),
 		rootConfig(rootConfig),
 		name(name) {
 	}
 
-	WSConfigHandler(BaseConfigItem& rootConfig, const char *name, std::function<String()> callback) :
+	WSConfigHandler(BaseConfigItem& rootConfig, const char *name, std::function<void(JsonWriter&)> callback) :
 		cbFunc(callback),
+		pJournal(NULL),
 		rootConfig(rootConfig),
 		name(name) {
 	}
 
 	virtual void handle(AsyncWebSocketClient *client, const char *data);
 	virtual void broadcast(AsyncWebSocket &ws, const char *data);
+	virtual bool isVersioned() { return pJournal != NULL; }
+
+	void setJournal(StateJournal *pJournal) {
+		this->pJournal = pJournal;
+	}
 
 private:
-	std::function<String()> cbFunc;
+	std::function<void(JsonWriter&)> cbFunc;
+	StateJournal *pJournal;
 
-	String getData(const char *data);
+	void getData(JsonWriter &writer, uint32_t version);
 	
 	BaseConfigItem& rootConfig;
 	const char *name;
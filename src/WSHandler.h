@@ -1,11 +1,50 @@
 #ifndef WSHANDLER_H_
 #define WSHANDLER_H_
 #include <ESPAsyncWebServer.h>
+#include "JsonWriter.h"
 
 class WSHandler {
 public:
 	virtual void handle(AsyncWebSocketClient *client, const char *data) = 0;
+
+	// True if everything this handler sends is tracked by the state journal
+	virtual bool isVersioned() { return false; }
+
+	/*
+	 * Runs producer once to measure the message and once more to write it into a
+	 * buffer of exactly that size. Returns NULL if the buffer couldn't be made.
+	 */
+	static AsyncWebSocketMessageBuffer *makeBuffer(AsyncWebSocket &ws, std::function<void(JsonWriter&)> producer) {
+		JsonWriter::Stats &stats = JsonWriter::getStats();
+
+		// Something may change between the two passes, if so just go round again
+		for (int attempt=0; attempt < 3; attempt++) {
+			JsonWriter measure;
+			producer(measure);
+
+			size_t len = measure.length();
+			AsyncWebSocketMessageBuffer *buffer = ws.makeBuffer(len);	//  creates a buffer (len + 1) for you.
+			if (!buffer) {
+				return NULL;
+			}
+
+			JsonWriter writer((char *)buffer->get(), len);
+			producer(writer);
+
+			if (writer.length() == len) {
+				stats.responses++;
+				stats.allocations += writer.getAllocations() + 1;
+				stats.bytes += len;
+				return buffer;
+			}
+
+			stats.retries++;
+			delete buffer;
+		}
+
+		return NULL;
+	}
 };
 
 
-#endif /* WSHANDLER_H_ */
\ No newline at end of file
+#endif /* WSHANDLER_H_ */
@@ -1,6 +1,7 @@
 #include <WSInfoHandler.h>
 // #include <Uptime.h>
 #include <ArduinoJson.h>
+#include "PooledJsonAllocator.h"
 #include <AsyncWebSocket.h>
 extern "C" {
 #include "esp_ota_ops.h"
@@ -26,10 +27,23 @@ static uint32_t sketchSize(sketchSize_t response) {
 }
     
 void WSInfoHandler::handle(AsyncWebSocketClient *client, const char *data) {
+	String serializedJSON;
+	getData(serializedJSON);
+	client->text(serializedJSON);
+}
+
+void WSInfoHandler::broadcast(AsyncWebSocket &ws, const char *data) {
+	String serializedJSON;
+	getData(serializedJSON);
+	ws.textAll(serializedJSON);
+}
+
+void WSInfoHandler::getData(String &serializedJSON) {
 	cbFunc();
 
 	// static Uptime uptime;
-	JsonDocument doc;
+	PooledJsonAllocator allocator;
+	JsonDocument doc(&allocator);
 
 	doc["type"] = "sv.init.info";
 	size_t freeHeap = ESP.getFreeHeap();
@@ -58,6 +72,29 @@ void WSInfoHandler::handle(AsyncWebSocketClient *client, const char *data) {
 	doc["value"]["brightness"] = brightness;
 	doc["value"]["triggered"] = triggered;
 	doc["value"]["clock_on"] = clockOn;
+	doc["value"]["spp_state"] = sppState;
+	doc["value"]["ws_clients"] = wsClients;
+	doc["value"]["config_writes"] = configWrites;
+	doc["value"]["reset_reason"] = resetReason;
+	doc["value"]["boot_phases"] = bootPhases;
+	doc["value"]["sync_bus"] = syncBus;
+	doc["value"]["time_zone"] = timeZone;
+	doc["value"]["task_stacks"] = taskStacks;
+	doc["value"]["latency"] = latency;
+
+	JsonWriter::Stats &jsonStats = JsonWriter::getStats();
+	if (jsonStats.responses > 0) {
+		char buf[48];
+		snprintf(buf, sizeof(buf), "%lu (%.1f allocs, %lu bytes avg)", (unsigned long)jsonStats.responses,
+			(float)jsonStats.allocations / jsonStats.responses, (unsigned long)(jsonStats.bytes / jsonStats.responses));
+		doc["value"]["json_responses"] = buf;
+	}
+
+	JsonArenaPool::Stats arenaStats = JsonArenaPool::getInstance().getStats();
+	char arenaBuf[64];
+	snprintf(arenaBuf, sizeof(arenaBuf), "peak %u/%u bytes, %lu fallbacks, %lu exhausted",
+		(unsigned)arenaStats.peak, (unsigned)JSON_ARENA_SIZE, (unsigned long)arenaStats.fallbacks, (unsigned long)arenaStats.exhausted);
+	doc["value"]["json_arenas"] = arenaBuf;
 
 	doc["value"]["up_time"] = uptime;
 	doc["value"]["sync_time"] = lastUpdateTime;
@@ -69,9 +106,7 @@ void WSInfoHandler::handle(AsyncWebSocketClient *client, const char *data) {
 	// 	value["off_time"] = pBlankingMonitor->offTime();
 	// }
 
-	String serializedJSON;
 	serializeJson(doc, serializedJSON);
-	client->text(serializedJSON);
 }
 
 
@@ -14,6 +14,7 @@ public:
 	}
 
 	virtual void handle(AsyncWebSocketClient *client, const char *data);
+	void broadcast(AsyncWebSocket &ws, const char *data);
 
     void setFSFree(const String& free) {
         fsFree = free;
@@ -66,7 +67,45 @@ public:
 		this->revision = revision;
 	}
 
+	void setSppState(const String& sppState) {
+		this->sppState = sppState;
+	}
+
+	void setWSClients(const String& wsClients) {
+		this->wsClients = wsClients;
+	}
+
+	void setConfigWrites(const String& configWrites) {
+		this->configWrites = configWrites;
+	}
+
+	void setResetReason(const String& resetReason) {
+		this->resetReason = resetReason;
+	}
+
+	void setBootPhases(const String& bootPhases) {
+		this->bootPhases = bootPhases;
+	}
+
+	void setSyncBus(const String& syncBus) {
+		this->syncBus = syncBus;
+	}
+
+	void setTimeZone(const String& timeZone) {
+		this->timeZone = timeZone;
+	}
+
+	void setTaskStacks(const String& taskStacks) {
+		this->taskStacks = taskStacks;
+	}
+
+	void setLatency(const String& latency) {
+		this->latency = latency;
+	}
+
 private:
+	void getData(String &serializedJSON);
+
 	CbFunc cbFunc;
 
 	// BlankTimeMonitor *pBlankingMonitor;
@@ -82,6 +121,15 @@ private:
 	String hostname;
 	String revision;
 	String uptime;
+	String sppState;
+	String wsClients;
+	String configWrites;
+	String resetReason;
+	String bootPhases;
+	String syncBus;
+	String timeZone;
+	String taskStacks;
+	String latency;
 };
 
 
@@ -0,0 +1,41 @@
+#include <WSLatencyHandler.h>
+#include "PooledJsonAllocator.h"
+
+void WSLatencyHandler::handle(AsyncWebSocketClient *client, const char *data) {
+	if (strcmp(data, "7:reset") == 0) {
+		reset();
+	}
+
+	PooledJsonAllocator allocator;
+	JsonDocument doc(&allocator);
+	doc["type"] = "sv.latency";
+	toJson(doc["value"].to<JsonObject>());
+
+	String serializedJSON;
+	serializeJson(doc, serializedJSON);
+	client->text(serializedJSON);
+}
+
+void WSLatencyHandler::toJson(JsonObject value) {
+	JsonArray array = value["stages"].to<JsonArray>();
+
+	for (int i=0; stages[i] != 0; i++) {
+		LatencyHistogram::Summary summary = stages[i]->summarize();
+		JsonObject stage = array.add<JsonObject>();
+		stage["name"] = stages[i]->getName();
+		stage["count"] = summary.count;
+		stage["p50"] = summary.p50;
+		stage["p95"] = summary.p95;
+		stage["p99"] = summary.p99;
+		stage["max"] = summary.max;
+		stage["mean"] = summary.mean;
+	}
+
+	value["units"] = "us";
+}
+
+void WSLatencyHandler::reset() {
+	for (int i=0; stages[i] != 0; i++) {
+		stages[i]->reset();
+	}
+}
@@ -0,0 +1,27 @@
+#ifndef WSLATENCYHANDLER_H_
+#define WSLATENCYHANDLER_H_
+
+#include <ArduinoJson.h>
+#include <WSHandler.h>
+#include "LatencyHistogram.h"
+
+/*
+ * Handles "7:" by sending the percentiles of each command pipeline stage, and
+ * "7:reset" by clearing them first.
+ */
+class WSLatencyHandler : public WSHandler {
+public:
+	WSLatencyHandler(LatencyHistogram **stages) : stages(stages) {
+	}
+
+	virtual void handle(AsyncWebSocketClient *client, const char *data);
+
+	// Shared with the HTTP endpoint
+	void toJson(JsonObject value);
+	void reset();
+
+private:
+	LatencyHistogram **stages;	// NULL terminated
+};
+
+#endif /* WSLATENCYHANDLER_H_ */
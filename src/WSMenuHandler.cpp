@@ -7,13 +7,26 @@ String WSMenuHandler::infoMenu = "{\"4\": { \"url\" : \"info.html\", \"title\" :
 String WSMenuHandler::syncMenu = "{\"5\": { \"url\" : \"sync.html\", \"title\" : \"Network\" }}";
 
 void WSMenuHandler::handle(AsyncWebSocketClient *client, const char *data) {
-	String json("{\"type\":\"sv.init.menu\", \"value\":[");
-	char *sep = "";
+	AsyncWebSocketMessageBuffer *buffer = makeBuffer(*client->server(), [this](JsonWriter &writer) { getData(writer); });
+	if (buffer) {
+		client->text(buffer);
+	}
+}
+
+void WSMenuHandler::broadcast(AsyncWebSocket &ws, const char *data) {
+	AsyncWebSocketMessageBuffer *buffer = makeBuffer(ws, [this](JsonWriter &writer) { getData(writer); });
+	if (buffer) {
+		ws.textAll(buffer);
+	}
+}
+
+void WSMenuHandler::getData(JsonWriter &writer) {
+	writer.raw("{\"type\":\"sv.init.menu\", \"value\":[");
+	const char *sep = "";
 	for (int i=0; items[i] != 0; i++) {
-		json.concat(sep);json.concat(*items[i]);sep=",";
+		writer.raw(sep).raw(*items[i]);sep=",";
 	}
-	json.concat("]}");
-	client->text(json);
+	writer.raw("]}");
 }
 
 void WSMenuHandler::setItems(String **items) {
@@ -9,6 +9,7 @@ class WSMenuHandler : public WSHandler {
 public:
 	WSMenuHandler(String **items) : items(items) { }
 	virtual void handle(AsyncWebSocketClient *client, const char *data);
+	void broadcast(AsyncWebSocket &ws, const char *data);
 	void setItems(String **items);
 
 	static String clockMenu;
@@ -18,6 +19,8 @@ public:
 	static String syncMenu;
 
 private:
+	void getData(JsonWriter &writer);
+
 	String **items;
 };
 
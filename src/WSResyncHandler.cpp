@@ -0,0 +1,38 @@
+#include <WSResyncHandler.h>
+#include "PooledJsonAllocator.h"
+
+void WSResyncHandler::handle(AsyncWebSocketClient *client, const char *data) {
+	unsigned int page = 0;
+	unsigned long epoch = 0;
+	unsigned long version = 0;
+
+	if (sscanf(data, "6:%u:%lu:%lu", &page, &epoch, &version) < 1 || page >= numPages) {
+		return;
+	}
+
+	WSHandler *pageHandler = pageHandlers[page];
+	if (pageHandler == NULL) {
+		return;
+	}
+
+	PooledJsonAllocator allocator;
+	JsonDocument doc(&allocator);
+	doc["type"] = "sv.update";
+	doc["epoch"] = journal.getEpoch();
+	doc["version"] = journal.getVersion();	// Before looking at the changes, see WSConfigHandler
+	JsonObject value = doc["value"].to<JsonObject>();
+
+	bool covered = pageHandler->isVersioned() && journal.changesSince(epoch, version,
+		[this, value](StateJournal::EntryType type, const BaseConfigItem *item) {
+			valueFunc(value, type, item);
+		});
+
+	if (covered) {
+		String serializedJSON;
+		serializeJson(doc, serializedJSON);
+		client->text(serializedJSON);
+	} else {
+		// Journal has wrapped (or we rebooted), fall back to a full snapshot
+		pageHandler->handle(client, data);
+	}
+}
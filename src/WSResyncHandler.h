@@ -0,0 +1,33 @@
+#ifndef WSRESYNCHANDLER_H_
+#define WSRESYNCHANDLER_H_
+
+#include <ArduinoJson.h>
+#include <WSHandler.h>
+#include "StateJournal.h"
+
+/*
+ * Handles "6:<page>:<epoch>:<version>" from a reconnecting client. If the journal still
+ * covers that version the client just gets the changes since then, otherwise it gets
+ * the page's normal init message.
+ */
+class WSResyncHandler : public WSHandler {
+public:
+	typedef std::function<void(JsonObject value, StateJournal::EntryType type, const BaseConfigItem *item)> ValueFunc;
+
+	WSResyncHandler(StateJournal &journal, WSHandler **pageHandlers, int numPages, ValueFunc valueFunc) :
+		journal(journal),
+		pageHandlers(pageHandlers),
+		numPages(numPages),
+		valueFunc(valueFunc) {
+	}
+
+	virtual void handle(AsyncWebSocketClient *client, const char *data);
+
+private:
+	StateJournal &journal;
+	WSHandler **pageHandlers;
+	int numPages;
+	ValueFunc valueFunc;
+};
+
+#endif /* WSRESYNCHANDLER_H_ */
@@ -0,0 +1,56 @@
+#include "esp_log.h"
+#include "WarmRestart.h"
+
+extern const char* TIME_FLIES_TAG;
+
+RTC_NOINIT_ATTR WarmRestart::State WarmRestart::state;
+
+void WarmRestart::begin() {
+	reason = esp_reset_reason();
+
+	// After a power loss or brownout the clock has most likely been reset too, so start from scratch
+	warm = (reason == ESP_RST_SW || reason == ESP_RST_PANIC || reason == ESP_RST_INT_WDT ||
+		reason == ESP_RST_TASK_WDT || reason == ESP_RST_WDT) && valid();
+
+	if (!warm) {
+		state.displayState = 0;
+		state.sppState = 0;
+		state.time = 0;
+		seal();
+		return;
+	}
+
+	ESP_LOGI(TIME_FLIES_TAG, "Warm restart: display state %d, SPP state %d", state.displayState, state.sppState);
+
+	// If the RTC didn't keep the time, what we saved is at most a few seconds out until NTP syncs
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	if (now.tv_sec < state.time && state.time != 0) {
+		now.tv_sec = state.time;
+		now.tv_usec = 0;
+		settimeofday(&now, NULL);
+	}
+}
+
+void WarmRestart::saveTime() {
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	state.time = now.tv_sec;
+	seal();
+}
+
+const char *WarmRestart::getResetReason() const {
+	switch (reason) {
+	case ESP_RST_POWERON: return "power on";
+	case ESP_RST_EXT: return "external";
+	case ESP_RST_SW: return "software";
+	case ESP_RST_PANIC: return "panic";
+	case ESP_RST_INT_WDT: return "interrupt watchdog";
+	case ESP_RST_TASK_WDT: return "task watchdog";
+	case ESP_RST_WDT: return "watchdog";
+	case ESP_RST_DEEPSLEEP: return "deep sleep";
+	case ESP_RST_BROWNOUT: return "brownout";
+	case ESP_RST_SDIO: return "SDIO";
+	default: return "unknown";
+	}
+}
@@ -0,0 +1,55 @@
+#ifndef _WARM_RESTART_H
+#define _WARM_RESTART_H
+
+#include <Arduino.h>
+#include "esp_system.h"
+#include "esp_attr.h"
+#include "rom/crc.h"
+#include <sys/time.h>
+
+/*
+ * State that survives a software reset in RTC memory the bootloader doesn't clear.
+ * The clock itself keeps running while we restart, so if we know what we last told
+ * it we can skip waiting for the SPP server and re-pushing the same display state.
+ */
+class WarmRestart {
+public:
+	// Call once, early in setup()
+	void begin();
+
+	bool isWarm() const { return warm; }
+	const char *getResetReason() const;
+
+	uint8_t getDisplayState() const { return state.displayState; }
+	uint8_t getSppState() const { return state.sppState; }
+
+	void setDisplayState(uint8_t displayState) { state.displayState = displayState; seal(); }
+	void setSppState(uint8_t sppState) { state.sppState = sppState; seal(); }
+	void saveTime();	// Call just before restarting
+
+private:
+	struct State {
+		uint32_t magic;
+		uint8_t displayState;	// DisplayState last sent to the clock
+		uint8_t sppState;
+		int64_t time;	// Seconds since the epoch when we went down, 0 if unknown
+		uint32_t crc;
+	};
+
+	void seal() {
+		state.magic = MAGIC;
+		state.crc = crc32_le(0, (const uint8_t*)&state, offsetof(State, crc));
+	}
+
+	bool valid() const {
+		return state.magic == MAGIC && state.crc == crc32_le(0, (const uint8_t*)&state, offsetof(State, crc));
+	}
+
+	static const uint32_t MAGIC = 0x54464232;	// TFB2
+	static State state;
+
+	bool warm = false;
+	esp_reset_reason_t reason = ESP_RST_UNKNOWN;
+};
+
+#endif
@@ -2,6 +2,7 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_log.h"
+#include "esp_system.h"
 #if ESP_ARDUINO_VERSION_MAJOR >= 3
 #include "esp_mac.h"
 #endif
@@ -16,23 +17,87 @@
 #include <Update.h>
 #include <ASyncOTAWebUpdate.h>
 #include <EspSNTPTimeSync.h>
+#include <StreamString.h>
 #include <unordered_map>
 #include "WSHandler.h"
 #include "WSMenuHandler.h"
 #include "WSInfoHandler.h"
 #include "WSConfigHandler.h"
+#include "ConfigJson.h"
+#include "WSResyncHandler.h"
+#include "WSClientMonitor.h"
 #include "TimeFliesClock.h"
 #include "LEDs.h"
 #include "MovementSensor.h"
 #include "Uptime.h"
+#include "ClockTimer.h"
 #include "Logger.h"
+#include "CommandQueue.h"
+#include "ConfigPersistence.h"
+#include "JournalConfigStore.h"
+#include "StateJournal.h"
+#include "PooledJsonAllocator.h"
+#include "BootProfile.h"
+#include "WarmRestart.h"
+#include "SyncBus.h"
+#include "SyncProtocol.h"
+#include "ConfigReplicator.h"
+#include "BlankingScheduler.h"
+#include "TzTransitions.h"
+#include "EventLoop.h"
+#include "Metrics.h"
+#include "LatencyHistogram.h"
+#include "WSLatencyHandler.h"
+#include "Trace.h"
+#include "Capture.h"
+#include "Telemetry.h"
+#include "Benchmark.h"
+#ifdef HEAP_SOAK
+#include "esp_heap_caps.h"
+#include <NativeAlloc.h>
+#endif
 
 #include "time.h"
 #include "sys/time.h"
 
 #define OTA
-#define MAX_MSG_SIZE 40
-#define SPP_QUEUE_SIZE 40
+#define EEPROM_SIZE 2048
+#define STATUS_INTERVAL 500		// Most often we send pipeline status to the UI
+#define SPP_ADMIT_SPACES 5		// Refuse UI changes when fewer slots than this are left
+#define SPP_BOOT_WAIT 10000		// Longest we wait for the SPP module to answer after a cold start
+#define SYNC_BUS_TIMEOUT 60000	// Config changes wake the sync bus task, this is just a backstop
+#define SYNC_BEACON_INTERVAL 600	// Seconds between time beacons, beacons go out on a multiple of this
+#define SPP_POLL_CONNECTED 2000	// How often to check the SPP connection when there is nothing to send
+#define SPP_POLL_DISCONNECTED 500
+
+// Stack sizes, tune these from the high water marks on the Info page
+#ifndef SPP_TASK_STACK
+#define SPP_TASK_STACK 8192
+#endif
+#ifndef WIFI_TASK_STACK
+#define WIFI_TASK_STACK 3000
+#endif
+#ifndef SYNC_TASK_STACK
+#define SYNC_TASK_STACK 4096
+#endif
+#ifndef EEPROM_TASK_STACK
+#define EEPROM_TASK_STACK 2048
+#endif
+#ifndef EVENT_LOOP_TASK_STACK
+#define EVENT_LOOP_TASK_STACK (SYNC_TASK_STACK + EEPROM_TASK_STACK)	// What the tasks it replaces reserved
+#endif
+#ifndef CAPTURE_TASK_STACK
+#define CAPTURE_TASK_STACK 3072
+#endif
+#ifndef TELEMETRY_TASK_STACK
+#define TELEMETRY_TASK_STACK 2048
+#endif
+#ifndef BENCH_TASK_STACK
+#define BENCH_TASK_STACK 8192
+#endif
+#ifndef SOAK_TASK_STACK
+#define SOAK_TASK_STACK 8192
+#endif
 
 const char *manifest[]{
     // Firmware name
@@ -48,10 +113,14 @@ const char *manifest[]{
 const char* TIME_FLIES_TAG = "TIME_FLIES";
 
 void broadcastUpdate(String originalKey, const BaseConfigItem& item);
-void broadcastUpdate(const JsonDocument &doc);
+void broadcastUpdate(JsonDocument &doc, StateJournal::EntryType type, const BaseConfigItem *item = 0);
+void broadcastJson(const JsonDocument &doc);
 
 Uptime uptime;
 Logger logger;
+StateJournal stateJournal;
+BootProfile bootProfile;
+WarmRestart warmRestart;
 
 typedef enum {
 	NOT_INITIALIZED = 0,
@@ -75,38 +144,73 @@ StringConfigItem hostName("hostname", 63, "timefliesbridge");
 
 AsyncWebServer server(80);
 AsyncWebSocket ws("/ws"); // access at ws://[esp ip]/ws
+WSClientMonitor wsClientMonitor(ws);
 DNSServer dns;
 AsyncWiFiManager wifiManager(&server, &dns);
 ASyncOTAWebUpdate otaUpdater(Update, "update", "secretsauce");
-WiFiUDP syncBus;
+SyncBus syncBus;
 
 AsyncWiFiManagerParameter *hostnameParam;
 EspSNTPTimeSync *timeSync;
 TimeFliesClock timeFliesClock;
 MovementSensor mov;
+SystemTimeSource systemTime;
+BlankingSchedule blankingSchedule;
+BlankingScheduler blanking(systemTime, mov, blankingSchedule);
+TzTransitions tzTransitions;
+#ifdef UNIFIED_EVENT_LOOP
+EventLoop eventLoop;
+int syncHandler = -1;
+int persistenceHandler = -1;
+int captureHandler = -1;
+int telemetryHandler = -1;
+#endif
 
 TaskHandle_t commitEEPROMTask;
+TaskHandle_t captureTask;
 TaskHandle_t sppTask;
 TaskHandle_t wifiManagerTask;
 TaskHandle_t syncBusTask;
+TaskHandle_t eventLoopTask;
+TaskHandle_t telemetryTask;
 
 SemaphoreHandle_t wsMutex;
-QueueHandle_t sppQueue;
+CommandQueue sppQueue;
+
+// Things only main.cpp sees happen. Values other classes already keep are sampled next to sendMetrics()
+Counter commandsSent("timeflies_spp_commands_sent_total", "Commands written to the clock");
+Counter atTimeouts("timeflies_spp_at_timeouts_total", "AT commands the SPP module didn't answer in time");
+Counter sppTransitions("timeflies_spp_state_transitions_total", "SPP connection state changes");
+Counter uartOverflows("timeflies_uart_rx_overflows_total", "Lines from the clock too long for the receive buffer");
+Counter wsFramesIn("timeflies_ws_frames_in_total", "WebSocket frames received");
+Counter wsBytesIn("timeflies_ws_bytes_in_total", "WebSocket bytes received");
+Counter broadcastDrops("timeflies_ws_broadcast_drops_total", "Broadcasts dropped because wsMutex timed out");
+std::atomic<uint32_t> wsFramesOut{0};	// Handlers' responses are counted by JsonWriter
+std::atomic<uint32_t> wsBytesOut{0};
+
+// How long each stage of getting a change from the UI to the clock takes
+LatencyHistogram wsLatency("ws_to_update");			// WS frame received to updateValue() done
+LatencyHistogram queueLatency("queued");				// sendCommands() to popped by the SPP task
+LatencyHistogram writeLatency("write");				// Popped to Serial1.println() done
+LatencyHistogram responseLatency("clock_response");	// Written to the first line back from the clock
+LatencyHistogram stateLatency("at_state");				// AT+STATE round trip
+LatencyHistogram *latencyStages[] = { &wsLatency, &queueLatency, &writeLatency, &responseLatency, &stateLatency, 0 };
+uint32_t awaitingResponseUs = 0;
 
 String ssid = "TFB";
 
 BaseConfigItem* clockSet[] {
 	// Clock
-	&TimeFliesClock::getDateFormat(),
-	&TimeFliesClock::getTimeOrDate(),
-	&TimeFliesClock::getHourFormat(),
-	&TimeFliesClock::getDisplayOn(),
-	&TimeFliesClock::getDisplayOff(),
-	&TimeFliesClock::getOffStateOff(),
-	&TimeFliesClock::getTimeZone(),
-	&TimeFliesClock::getEffect(),
-	&TimeFliesClock::getRippleDirection(),
-	&TimeFliesClock::getRippleSpeed(),
+	ConfigJson::add(TimeFliesClock::getDateFormat()),
+	ConfigJson::add(TimeFliesClock::getTimeOrDate()),
+	ConfigJson::add(TimeFliesClock::getHourFormat()),
+	ConfigJson::add(TimeFliesClock::getDisplayOn()),
+	ConfigJson::add(TimeFliesClock::getDisplayOff()),
+	ConfigJson::add(TimeFliesClock::getOffStateOff()),
+	ConfigJson::add(TimeFliesClock::getTimeZone()),
+	ConfigJson::add(TimeFliesClock::getEffect()),
+	ConfigJson::add(TimeFliesClock::getRippleDirection()),
+	ConfigJson::add(TimeFliesClock::getRippleSpeed()),
 	0
 };
 
@@ -114,27 +218,27 @@ CompositeConfigItem clockConfig("clock", 0, clockSet);
 
 BaseConfigItem* ledsSet[] {
 	// LEDs
-	&LEDs::getBacklights(),
-	&LEDs::getBacklightRed(),
-	&LEDs::getBacklightGreen(),
-	&LEDs::getBacklightBlue(),
-
-	&LEDs::getUnderlights(),
-	&LEDs::getUnderlightRed(),
-	&LEDs::getUnderlightGreen(),
-	&LEDs::getUnderlightBlue(),
-
-	&LEDs::getBaselights(),
-	&LEDs::getBaselightRed(),
-	&LEDs::getBaselightGreen(),
-	&LEDs::getBaselightBlue(),
+	ConfigJson::add(LEDs::getBacklights()),
+	ConfigJson::add(LEDs::getBacklightRed()),
+	ConfigJson::add(LEDs::getBacklightGreen()),
+	ConfigJson::add(LEDs::getBacklightBlue()),
+
+	ConfigJson::add(LEDs::getUnderlights()),
+	ConfigJson::add(LEDs::getUnderlightRed()),
+	ConfigJson::add(LEDs::getUnderlightGreen()),
+	ConfigJson::add(LEDs::getUnderlightBlue()),
+
+	ConfigJson::add(LEDs::getBaselights()),
+	ConfigJson::add(LEDs::getBaselightRed()),
+	ConfigJson::add(LEDs::getBaselightGreen()),
+	ConfigJson::add(LEDs::getBaselightBlue()),
 	0
 };
 
 CompositeConfigItem ledsConfig("leds", 0, ledsSet);
 
 BaseConfigItem* extraSet[] {
-	&TimeFliesClock::getCommand(),
+	ConfigJson::add(TimeFliesClock::getCommand()),
 	0
 };
 
@@ -142,7 +246,7 @@ CompositeConfigItem extraConfig("extra", 0, extraSet);
 
 // Global configuration
 BaseConfigItem* configSetGlobal[] = {
-	&hostName,
+	ConfigJson::add(hostName),
 	0
 };
 
@@ -152,36 +256,75 @@ CompositeConfigItem globalConfig("global", 0, configSetGlobal);
 IntConfigItem sync_port("sync_port", 4920);
 BooleanConfigItem sync_role("sync_role", false);	// false = no sync, true = slave (remote sync)
 ByteConfigItem mov_delay("mov_delay", 20);
+ByteConfigItem ws_max_clients("ws_max_clients", 4);
+StringConfigItem sync_group("sync_group", 15, "239.84.70.1");	// Multicast group for v2 frames
+BooleanConfigItem sync_beacon("sync_beacon", false);	// Send time beacons so the group sets its clocks together
+ByteConfigItem config_sync("config_sync", 0);	// 0 = off, 1 = leader, 2 = follower
+StringConfigItem config_sync_state("config_sync_state", 26, "");	// leader:epoch:version a follower last applied
 
+// New items go at the end so existing EEPROM contents stay where they were
 BaseConfigItem* syncSet[] {
-	&sync_port,
-	&sync_role,
-	&mov_delay,
+	ConfigJson::add(sync_port),
+	ConfigJson::add(sync_role),
+	ConfigJson::add(mov_delay),
+	ConfigJson::add(ws_max_clients),
+	ConfigJson::add(sync_group),
+	ConfigJson::add(sync_beacon),
+	ConfigJson::add(config_sync),
+	ConfigJson::add(config_sync_state),
 	0
 };
 
 CompositeConfigItem syncConfig("sync", 0, syncSet);
 
+// Shown on the clock page, but the clock composite can't grow without moving everything after it
+BaseConfigItem* blankingSet[] {
+	ConfigJson::add(TimeFliesClock::getSchedule()),
+	ConfigJson::add(TimeFliesClock::getDimming()),
+	0
+};
+
+CompositeConfigItem blankingConfig("blanking", 0, blankingSet);
+
 BaseConfigItem* rootConfigSet[] = {
     &globalConfig,
 	&clockConfig,
 	&ledsConfig,
 	&extraConfig,
 	&syncConfig,
+	&blankingConfig,
     0
 };
 
 CompositeConfigItem rootConfig("root", 0, rootConfigSet);
 
 EEPROMConfig config(rootConfig);
+EEPROMConfigStore eepromStore(config, rootConfig, EEPROM_SIZE);
+#ifdef CONFIG_STORE_JOURNAL
+JournalConfigStore journalStore(LittleFS, rootConfig, rootConfigSet, eepromStore);
+ConfigStore &configStore = journalStore;
+#else
+ConfigStore &configStore = eepromStore;
+#endif
+#ifdef HEAP_SOAK
+VirtualTimeSource soakTime;	// Commits wait for quiet on the soak's simulated clock, so only a soak moves them on
+ConfigPersistence persistence(configStore, soakTime);
+#else
+ConfigPersistence persistence(configStore, systemTime);
+#endif
+Capture capture(LittleFS, "/capture.bin");
 
 // Declare some functions
 void setWiFiAP(bool);
 void infoCallback();
 
+void onMaxClientsChanged(ConfigItem<byte> &item) {
+	wsClientMonitor.setMaxClients(item);
+}
+
 template<class T>
 void onHostnameChanged(ConfigItem<T> &item) {
-	config.commit();
+	persistence.commitNow();
 	ESP.restart();
 }
 
@@ -202,96 +345,278 @@ void createSSID() {
 	ssid = (chipId + hostName).substring(0, 31);
 }
 
-String wifiCallback() {
-	String wifiStatus = "\"wifi_ap\":";
+void wifiCallback(JsonWriter &writer) {
+	writer.raw("\"wifi_ap\":");
 
 	if ((WiFi.getMode() & WIFI_MODE_AP) != 0) {
-		wifiStatus += "true";
+		writer.raw("true");
 	} else {
-		wifiStatus += "false";
+		writer.raw("false");
 	}
 
-	wifiStatus += ",";
-	wifiStatus += "\"hostname\":\"";
-	wifiStatus += hostName.value;
-	wifiStatus += "\"";
+	writer.raw(",");
+	writer.raw("\"hostname\":").string(hostName.value.c_str());
+}
+
+uint32_t getSyncId() {
+	uint8_t macid[6];
 
-	return wifiStatus;
+	esp_efuse_mac_get_default(macid);
+	return macid[2] | (macid[3] << 8) | (macid[4] << 16) | ((uint32_t)macid[5] << 24);
 }
 
-uint16_t syncBusPort = 0;
+SyncProtocol syncProtocol(getSyncId(), esp_random());
 unsigned long lastMoved = 0;
+volatile uint32_t movTriggeredUs = 0;	// A single word so the SPP task can read it without a lock
+time_t nextBeacon = 0;
+int32_t lastBeaconOffsetMs = 0;
 
-void writeSyncBus(const char msg[]) {
+void sendCurrentTime();
+void applyReplicated(BaseConfigItem *item, const String &value);
+
+BaseConfigItem* replicatedSet[] {
+	&clockConfig,
+	&ledsConfig,
+	&blankingConfig,
+	0
+};
+
+ConfigReplicator replicator(syncProtocol, stateJournal, replicatedSet, applyReplicated, [](const String &position) {
+	config_sync_state = position;
+	persistence.put(config_sync_state);
+});
+
+uint32_t broadcastAddress() {
 	IPAddress broadcastIP(~WiFi.subnetMask() | WiFi.gatewayIP());
-	syncBusPort = sync_port;
-	syncBus.beginPacket(broadcastIP, syncBusPort);
-	syncBus.write((unsigned char*)msg, strlen(msg));
-	syncBus.endPacket();
+	return broadcastIP;
+}
+
+uint32_t syncGroupAddress() {
+	IPAddress group;
+	if (!group.fromString(sync_group.value) || group[0] < 224 || group[0] > 239) {
+		return 0;
+	}
+
+	return group;
+}
+
+// Legacy ASCII messages always go to the subnet broadcast address
+void writeSyncBus(const char msg[]) {
+	syncBus.send(broadcastAddress(), msg, strlen(msg));
+}
+
+// Any task. Goes out in the next frame the sync bus task sends.
+void queueSyncEvent(SyncProtocol::EventType type, const void *data = 0, uint8_t len = 0) {
+	if (syncBus.isOpen() && syncProtocol.queue(type, data, len)) {
+#ifdef UNIFIED_EVENT_LOOP
+		eventLoop.post(syncHandler);
+#else
+		syncBus.wake();
+#endif
+	}
+}
+
+void flushSyncBus() {
+	static uint8_t frame[SYNC_MAX_FRAME];
+	uint32_t dest = syncBus.getGroup() != 0 ? syncBus.getGroup() : broadcastAddress();
+
+	size_t len;
+	while ((len = syncProtocol.takeFrame(frame, sizeof(frame))) > 0) {
+		syncBus.send(dest, (const char *)frame, len);
+	}
 }
 
 void announceSlave() {
 	static char syncMsg[] = "slave";
 	if (sync_role) {
-		writeSyncBus(syncMsg);
+		writeSyncBus(syncMsg);	// Older masters only understand this
+		uint8_t role = 1;
+		queueSyncEvent(SyncProtocol::ANNOUNCE, &role, 1);
 	}
 }
 
-void readSyncBus() {
-	static char incomingMsg[10];
+void onMovement() {
+	lastMoved = millis();
+	mov.trigger();
 
-	int size = syncBus.parsePacket();
+	// Don't leave it to the SPP task's next poll to notice the clock should come on
+	movTriggeredUs = (uint32_t)esp_timer_get_time() | 1;
+	sppQueue.kick();
+}
 
-	if (size) {
-		int len = syncBus.read(incomingMsg, 9);
-		if (len > 0 && len < 10) {
-			incomingMsg[len] = 0;
+void onTimeBeacon(const uint8_t *data, uint8_t len) {
+	if (len < 8) {
+		return;
+	}
 
-			if (strncmp("mov", incomingMsg, 3) == 0) {
-				lastMoved = millis();
-				mov.trigger();
-			}
-		}
+	struct timeval beacon;
+	beacon.tv_sec = SyncProtocol::get32(data);
+	beacon.tv_usec = SyncProtocol::get32(data + 4);
+
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	lastBeaconOffsetMs = (int32_t)((now.tv_sec - beacon.tv_sec) * 1000 + (now.tv_usec - beacon.tv_usec) / 1000);
+
+	if (now.tv_sec < 1600000000) {
+		// We haven't got NTP time yet, so the master's is better than nothing
+		settimeofday(&beacon, NULL);
 	}
-}
 
-void syncBusTaskFn(void *pArg) {
-	static bool currentRole = false;
+	// Every follower gets this at the same moment, so their clocks get set in phase
+	sendCurrentTime();
+}
 
-	mov.setOnTime(millis());
+void onSyncEvent(uint32_t sender, SyncProtocol::EventType type, const uint8_t *data, uint8_t len) {
+	switch (type) {
+	case SyncProtocol::MOVEMENT:
+		if (sync_role) {
+			onMovement();
+		}
+		break;
+	case SyncProtocol::TIME_BEACON:
+		if (sync_role) {
+			onTimeBeacon(data, len);
+		}
+		break;
+	case SyncProtocol::BLANKING:
+		ESP_LOGD(TIME_FLIES_TAG, "Sync %08lx: clock %s", (unsigned long)sender, len > 0 && data[0] ? "on" : "off");
+		break;
+	case SyncProtocol::CONFIG_VERSION:
+	case SyncProtocol::CONFIG_DELTA:
+	case SyncProtocol::CONFIG_BATCH:
+	case SyncProtocol::CONFIG_REQUEST:
+		replicator.onEvent(sender, type, data, len, millis());
+		break;
+	case SyncProtocol::ANNOUNCE:
+	default:
+		ESP_LOGD(TIME_FLIES_TAG, "Sync %08lx: event %d", (unsigned long)sender, type);
+		break;
+	}
+}
 
-	while (true) {
-		mov.setDelay(mov_delay);
-		mov.setEnabled(sync_role);
+void readSyncBus(uint32_t timeoutMs) {
+	static uint8_t incomingMsg[SYNC_MAX_FRAME];
 
+	int len = syncBus.receive((char *)incomingMsg, sizeof(incomingMsg), timeoutMs);
+	if (len > 0) {
+		capture.record(Capture::SYNC_IN, 0, incomingMsg, len);
+	}
+	if (len >= 3 && strncmp("mov", (const char *)incomingMsg, 3) == 0) {
+		syncProtocol.countLegacy();
 		if (sync_role) {
-			// If port has changed, set new port and announce status
-			if (syncBusPort != sync_port) {
-				syncBusPort = sync_port;
-				currentRole = false;	// Force a begin
-			}
-		} else {
-			// We aren't in a sync group, stop the sync bus
-			currentRole = sync_role;
-			syncBus.stop();
+			onMovement();
 		}
+	} else if (len > 0) {
+		syncProtocol.parse(incomingMsg, len, millis(), onSyncEvent);
+	}
+}
 
-		if (currentRole != sync_role) {
-			if (sync_role) {
-				// We used to not be in a sync group, or the sync group has changed
-				syncBus.begin(syncBusPort);
-			}
+// Time beacons go out on a second boundary so receivers can push them straight to their clocks
+void sendTimeBeacon() {
+	struct timeval now;
+	gettimeofday(&now, NULL);
+
+	if (!sync_beacon || now.tv_sec < nextBeacon || now.tv_sec < 1600000000) {
+		return;
+	}
+
+	uint8_t payload[8];
+	SyncProtocol::put32(payload, now.tv_sec);
+	SyncProtocol::put32(payload + 4, now.tv_usec);
+	queueSyncEvent(SyncProtocol::TIME_BEACON, payload, sizeof(payload));
 
-			currentRole = sync_role;
+	nextBeacon = now.tv_sec - now.tv_sec % SYNC_BEACON_INTERVAL + SYNC_BEACON_INTERVAL;
+}
+
+uint32_t syncBusTimeout() {
+	if (replicator.isTransferring()) {
+		return REPLICATION_PACE;
+	}
+
+	if (config_sync != ConfigReplicator::OFF) {
+		return REPLICATION_SETTLE;	// Often enough to notice being behind, or to publish
+	}
+
+	if (!sync_beacon) {
+		return SYNC_BUS_TIMEOUT;
+	}
 
-			if (currentRole) {
+	struct timeval now;
+	gettimeofday(&now, NULL);
+
+	if (now.tv_sec >= nextBeacon) {
+		return 1000;	// Waiting for NTP
+	}
+
+	return min((uint32_t)((nextBeacon - now.tv_sec) * 1000 - now.tv_usec / 1000), (uint32_t)SYNC_BUS_TIMEOUT);
+}
+
+void applySyncConfig() {
+	static uint32_t wantedGroup = 0;
+	static unsigned long lastBegin = 0;
+
+	unsigned long delayMs = mov.getDelayMs();
+	bool enabled = mov.isEnabled();
+	mov.setDelay(mov_delay);
+	mov.setEnabled(sync_role);
+
+	// The SPP task may be asleep until a movement timeout that has just moved
+	if (delayMs != mov.getDelayMs() || enabled != mov.isEnabled()) {
+		sppQueue.kick();
+	}
+
+	if (replicator.getRole() != config_sync) {
+		replicator.setRole((ConfigReplicator::Role)(byte)config_sync);
+	}
+
+	if (sync_role || sync_beacon || config_sync != ConfigReplicator::OFF) {
+		uint32_t group = syncGroupAddress();
+
+		// Config changed, or we couldn't join the group last time (e.g. WiFi wasn't up yet)
+		if (!syncBus.isOpen() || syncBus.getPort() != sync_port || group != wantedGroup ||
+				(syncBus.getGroup() != group && millis() - lastBegin > SYNC_BUS_TIMEOUT)) {
+			wantedGroup = group;
+			lastBegin = millis();
+
+			if (syncBus.begin(sync_port, group)) {
 				// We have become a slave
 				announceSlave();
 			}
 		}
+	} else {
+		// We aren't in a sync group, stop the sync bus
+		syncBus.stop();
+	}
+}
+
+template<class T>
+void onSyncConfigChanged(ConfigItem<T> &item) {
+#ifdef UNIFIED_EVENT_LOOP
+	eventLoop.post(syncHandler);
+#else
+	if (syncBusTask != NULL) {
+		xTaskNotifyGive(syncBusTask);
+		syncBus.wake();
+	}
+#endif
+}
 
-		readSyncBus();
-		delay(10);
+void syncBusTaskFn(void *pArg) {
+	mov.setOnTime(millis());
+
+	while (true) {
+		ulTaskNotifyTake(pdTRUE, 0);	// We're about to look at the config anyway
+		applySyncConfig();
+
+		if (syncBus.isOpen()) {
+			sendTimeBeacon();
+			replicator.loop(millis());
+			flushSyncBus();
+			readSyncBus(syncBusTimeout());
+		} else {
+			// Nothing to do until the config changes
+			ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+		}
 	}
 }
 
@@ -307,26 +632,9 @@ void pushAllValues() {
 	}
 }
 
-void sendCommands(const char *commands) {
-	static char buf[256 + MAX_MSG_SIZE];
-	if (strchr(commands, ';')) {
-		strncpy(buf, commands, 255);
-		char *token;
-		const char *delimiters = ";";
-
-		// Get the first token
-		token = strtok(buf, delimiters);
-
-		// Loop through the rest of the tokens
-		while (token != NULL) {
-			ESP_LOGD(TIME_FLIES_TAG, "Queueing command %s", token);
-			xQueueSend(sppQueue, token, 0);
-			token = strtok(NULL, delimiters);
-		}
-	} else {
-		ESP_LOGD(TIME_FLIES_TAG, "Queueing command %s", commands);
-		xQueueSend(sppQueue, commands, 0);
-	}
+void sendCommands(const char *commands, CommandQueue::Priority priority = CommandQueue::NORMAL) {
+	ESP_LOGD(TIME_FLIES_TAG, "Queueing commands %s", commands);
+	sppQueue.pushAll(commands, priority);
 }
 
 void sendCurrentTime() {
@@ -340,6 +648,14 @@ void sendCurrentTime() {
 	// EST                   0x13,$PSU,6,4,17,6*** i.e. TZ offset = 12 - 17 = -5
 	int tzo = -(_timezone / 60 / 60);
 
+	// Take DST from the transition table so a push scheduled for a transition agrees with it
+	int32_t offset;
+	bool isDst;
+	if (tzTransitions.lookup(time(NULL), offset, isDst)) {
+		tzo = tzTransitions.getStdOffset() / 60 / 60;
+		now.tm_isdst = isDst;
+	}
+
 	if (tzo < 0) {
 		tzo = 12 - tzo;
 	}
@@ -348,12 +664,26 @@ void sendCurrentTime() {
 	snprintf(msg, 128, "0x13,$BIT13,%d***;0x13,$PSU,6,4,%d,6***;0x13,$TIM,%2.2d,%2.2d,%2.2d,%2.2d,%2.2d,%2.2d***",
 		now.tm_isdst, tzo, now.tm_hour, now.tm_min, now.tm_sec, now.tm_mday, now.tm_mon, now.tm_year);
 	
-	sendCommands(msg);
+	sendCommands(msg, CommandQueue::URGENT);
 }
 
 uint8_t r_buffer[50];
 uint8_t r_position = 0;
 
+void sendToServer(const char *line) {
+	capture.record(Capture::SERIAL_TX, 0, line, strlen(line));
+	Serial1.println(line);
+}
+
+String readServerLine() {
+	String line = Serial1.readStringUntil('\n');
+	if (line.length() > 0) {
+		capture.record(Capture::SERIAL_RX, 0, line.c_str(), line.length());
+	}
+
+	return line;
+}
+
 void readFromServer() {
     while (Serial1.available() > 0) {
         int c = Serial1.read();
@@ -361,6 +691,7 @@ void readFromServer() {
             delay(1);
             if (r_position < sizeof(r_buffer)) {
                 if (c == '\n') {
+                    capture.record(Capture::SERIAL_RX, 0, r_buffer, r_position);
                     if (r_position >= 1 && r_buffer[r_position-1] == '\r') {
                         r_buffer[r_position-1] = 0;
                     } else {
@@ -369,6 +700,10 @@ void readFromServer() {
 
 					// If there was something other than just CRLF
 					if (r_position > 1) {
+						if (awaitingResponseUs != 0) {
+							responseLatency.record(micros() - awaitingResponseUs);
+							awaitingResponseUs = 0;
+						}
 						logger.log(Logger::INFO, "< %s", r_buffer);
 					}
 
@@ -379,6 +714,8 @@ void readFromServer() {
             } else {
                 if (c == '\n') {
                     ESP_LOGE(TIME_FLIES_TAG, "Receive buffer overlow");
+                    uartOverflows.inc();
+                    TRACE_INSTANT("rx overflow");
                     r_position = 0;
                 }
             }
@@ -386,12 +723,49 @@ void readFromServer() {
     }
 }
 
+void compileSchedule() {
+	int errors = blankingSchedule.compile(TimeFliesClock::getSchedule().value.c_str(),
+		TimeFliesClock::getDisplayOn(), TimeFliesClock::getDisplayOff(), TimeFliesClock::getOffStateOff());
+	if (errors) {
+		logger.log(Logger::WARN, "! %d schedule entries ignored", errors);
+	}
+
+	switch (TimeFliesClock::getDimming().value) {
+	case 0:
+		blanking.setIdleState(DISPLAY_ON);
+		break;
+	case 1:
+		blanking.setIdleState(DISPLAY_DIM);
+		break;
+	default:
+		blanking.setIdleState(TimeFliesClock::getOffStateOff() ? DISPLAY_OFF : DISPLAY_DIM);
+		break;
+	}
+
+	blanking.invalidate();
+}
+
+template<class T>
+void onBlankingChanged(ConfigItem<T> &item) {
+	compileSchedule();
+	sppQueue.kick();
+}
+
 void asyncTimeSetCallback(String time) {
 	ESP_LOGD(TIME_FLIES_TAG, "Time: %s", time.c_str());
 
+	blanking.invalidate();	// The time may have jumped
+	tzTransitions.reset();
+	sppQueue.kick();
+
 	sendCurrentTime();
 }
 
+void ntpTimeSetCallback(String time) {
+	capture.record(Capture::NTP, 0, time.c_str(), time.length());
+	asyncTimeSetCallback(time);
+}
+
 void onCommandChanged(ConfigItem<String> &item) {
 	sendCommands(item.value.c_str());
 }
@@ -460,6 +834,9 @@ void onHourFormatChanged(ConfigItem<boolean> &item) {
 
 void onTimezoneChanged(ConfigItem<String> &tzItem) {
 	timeSync->setTz(tzItem);
+	tzTransitions.setTz(tzItem.value.c_str());
+	blanking.invalidate();
+	sppQueue.kick();
 	sendCurrentTime();
 }
 
@@ -573,6 +950,59 @@ void onBlueBaselightsChanged(ConfigItem<byte> &item) {
 }
 
 SPPConnectionState connectionStatus = NOT_INITIALIZED;
+unsigned long lastTransmitTime = 0;
+
+bool pipelineSaturated() {
+	return sppQueue.spaces(CommandQueue::NORMAL) < SPP_ADMIT_SPACES;
+}
+
+// Only changes that end up as clock commands are subject to admission control
+bool needsAdmission(String pair) {
+	String _key = pair.substring(0, pair.indexOf(':'));
+	const char *key = _key.c_str();
+
+	return clockConfig.get(key) != 0 || ledsConfig.get(key) != 0 || extraConfig.get(key) != 0 || _key.startsWith("push_");
+}
+
+/*
+ * Let the UI know how backed up we are. Only sent when something other than the
+ * time since the last transmit changes, and not more often than STATUS_INTERVAL.
+ */
+void publishStatus() {
+	static unsigned long lastSent = 0;
+	static int lastUrgent = -1;
+	static int lastNormal = -1;
+	static SPPConnectionState lastState = NOT_INITIALIZED;
+
+	int urgent = sppQueue.depth(CommandQueue::URGENT);
+	int normal = sppQueue.depth(CommandQueue::NORMAL);
+	unsigned long now = millis();
+
+	if (urgent == lastUrgent && normal == lastNormal && connectionStatus == lastState) {
+		return;
+	}
+
+	if (now - lastSent < STATUS_INTERVAL) {
+		return;
+	}
+
+	lastSent = now;
+	lastUrgent = urgent;
+	lastNormal = normal;
+	lastState = connectionStatus;
+
+	PooledJsonAllocator allocator;
+	JsonDocument doc(&allocator);
+	doc["type"] = "sv.status";
+	doc["value"]["urgent"] = urgent;
+	doc["value"]["normal"] = normal;
+	doc["value"]["drain_ms"] = (urgent + normal) * cmdDelay;
+	doc["value"]["spp_state"] = state2string[connectionStatus];
+	doc["value"]["last_tx_ms"] = lastTransmitTime == 0 ? -1 : (long)(now - lastTransmitTime);
+	doc["value"]["saturated"] = pipelineSaturated();
+
+	broadcastJson(doc);
+}
 
 #define LED_PIN 2
 #define RXD 16
@@ -581,9 +1011,13 @@ SPPConnectionState connectionStatus = NOT_INITIALIZED;
 String OK_RESPONSE("OK\r");
 
 bool verifySPPCommand(String command) {
-	Serial1.println(command);
-	String response = Serial1.readStringUntil('\n');
+	TRACE_SPAN("AT command");
+	sendToServer(command.c_str());
+	String response = readServerLine();
 	bool ret = response.equals(OK_RESPONSE);
+	if (response.length() == 0) {
+		atTimeouts.inc();
+	}
 	if (!ret) {
 		logger.log(Logger::WARN, "! %s", response.c_str());
 	}
@@ -592,31 +1026,45 @@ bool verifySPPCommand(String command) {
 }
 
 void getSPPState() {
-	Serial1.println("AT+STATE");
-	String result = Serial1.readStringUntil('\n');
+	TRACE_SPAN("AT+STATE");
+	uint32_t sentUs = micros();
+	sendToServer("AT+STATE");
+	String result = readServerLine();
+	stateLatency.record(micros() - sentUs);
 	int status = result.charAt(0) - '0';
 	if (status >= 0 && status <= 9) {
 		if (connectionStatus != status) {
+			sppTransitions.inc();
+			TRACE_INSTANT("SPP state change");
 			connectionStatus = (SPPConnectionState)status;
+			warmRestart.setSppState(connectionStatus);
 			logger.log(Logger::INFO, "+ %s", state2string[connectionStatus].c_str());
+
+			PooledJsonAllocator allocator;
+			JsonDocument doc(&allocator);
+			doc["type"] = "sv.update";
+			doc["value"]["spp_state"] = state2string[connectionStatus];
+			broadcastUpdate(doc, StateJournal::SPP_STATE);
 		}
 	} else {
 		logger.log(Logger::WARN, "! %s", result.c_str());
 	}
 	// Read OK\r\n - keep going until we get OK or until 1s passes
+	TRACE_SPAN("AT+STATE OK");
 	unsigned long start = millis();
 	do
 	{	
-		result = Serial1.readStringUntil('\n');
+		result = readServerLine();
 		if (millis() - start > 1000) {
 			// Give up after 1s
+			atTimeouts.inc();
 			break;
 		}
 	} while (!result.equals(OK_RESPONSE));
 }
 
-void setRname() {
-	verifySPPCommand("AT+RNAME=Time Flies");
+bool setRname() {
+	return verifySPPCommand("AT+RNAME=Time Flies");
 }
 
 void initiateConnection() {
@@ -627,100 +1075,264 @@ void closeConnection() {
 	verifySPPCommand("AT+DISCONNECT");
 }
 
-void sppTaskFn(void *pArg) {
-    static char msg[MAX_MSG_SIZE];
+uint32_t delayNextMsg = 1;
+bool sppPacing = false;		// There are commands to send, but it is too soon after the last one
+int lastState = -1;			// Force a clock state message initially
+uint32_t lastConnectedTime = 0;
+bool ledOn = false;
+uint32_t lastLedOn = 0;
+uint32_t lastSaved = 0;
+
+void sppBegin() {
+	if (warmRestart.isWarm() && warmRestart.getSppState() == CONNECTED) {
+		// The SPP module and the clock stayed up while we restarted, and the clock is showing what we last sent
+		lastState = warmRestart.getDisplayState();
+		setRname();
+	} else {
+		// Rather than sleeping for the worst case, go as soon as the module answers
+		unsigned long start = millis();
+		while (!setRname() && millis() - start < SPP_BOOT_WAIT) {
+			delay(250);
+		}
+	}
+
+	bootProfile.mark("spp ready");
+	lastConnectedTime = millis();
+	lastLedOn = millis();
+	lastSaved = millis();
+}
+
+/*
+ * One go round the SPP loop: check the connection, send a command if there is
+ * one (result) and it's time, and bring the display into line with the schedule.
+ * Returns how long until it needs to run again.
+ */
+uint32_t sppStep(bool result) {
+	TRACE_SPAN("sppStep");
+	static char msg[MAX_MSG_SIZE];
+
+	// Pace commands without blocking, the event loop has other things to do
+	sppPacing = false;
+	if (result && connectionStatus == CONNECTED && millis() - lastTransmitTime < delayNextMsg) {
+		sppPacing = true;
+		return delayNextMsg - (millis() - lastTransmitTime);
+	}
 
+	readFromServer();	// Do this before we send a command in getSPPState();
+	getSPPState();
+
+	if (result) {
+		if (connectionStatus == CONNECTED) {
+			// If we are connected, just drain the queue
+			lastConnectedTime = millis();
+			uint32_t queuedUs = micros();
+			sppQueue.pop(msg, &queuedUs);
+			uint32_t poppedUs = micros();
+			queueLatency.record(poppedUs - queuedUs);
+			logger.log(Logger::INFO, "> %s", msg);
+			sendToServer(msg);
+			awaitingResponseUs = micros() | 1;
+			writeLatency.record(awaitingResponseUs - poppedUs);
+			commandsSent.inc();
+			lastTransmitTime = millis();
+			bootProfile.mark("first command");
+			delayNextMsg = cmdDelay;
+			return 0;
+		} else if (connectionStatus == NOT_CONNECTED) {
+			initiateConnection();
+		}
+	} else {
+		cmdDelay = 1000;
+		delayNextMsg = 1;
+	}
+
+	if (movTriggeredUs != 0) {
+		syncBus.recordMovementLatency((uint32_t)esp_timer_get_time() - movTriggeredUs);
+		movTriggeredUs = 0;
+	}
+
+	// NOTE: sendCommands(...) just puts them on the queue
+	DisplayState state = blanking.state();
+	if (state != lastState) {
+		lastState = state;
+		warmRestart.setDisplayState(state);
+		uint8_t on = state == DISPLAY_ON;
+		queueSyncEvent(SyncProtocol::BLANKING, &on, 1);
+		if (state == DISPLAY_ON) {
+			// Full brightness and on
+			sendCommands("0x13,$BIT4,0***;0x13,$BIT15,0***", CommandQueue::URGENT);
+		} else if (state == DISPLAY_OFF) {
+			// Full brightness, but off
+			sendCommands("0x13,$BIT15,1***;0x13,$BIT4,0***", CommandQueue::URGENT);
+		} else {
+			// Dim, but on
+			sendCommands("0x13,$BIT4,1***;0x13,$BIT15,0***", CommandQueue::URGENT);
+		}
+	}
+
+#ifdef DISCONNECT_ON_DILE
+	if (connectionStatus == CONNECTED && millis() - lastConnectedTime > 30000) {
+		logger.log(INFO, "Disconnecting");
+		closeConnection();
+	}
+#endif
+
+	if (connectionStatus == NOT_CONNECTED) {
+		initiateConnection();
+	}
+
+	// The clock works out local time itself, so tell it the moment DST starts or ends
+	if (tzTransitions.due(time(NULL))) {
+		logger.log(Logger::INFO, "DST transition, pushing time");
+		sendCurrentTime();
+	}
+
+	// Sleep until the display could next change, new commands arrive, or the connection needs checking
+	uint32_t maxWait = min(blanking.msUntilChange(), (uint32_t)(connectionStatus == CONNECTED ? SPP_POLL_CONNECTED : SPP_POLL_DISCONNECTED));
+	return min(maxWait, tzTransitions.msUntilDue(time(NULL)));
+}
+
+// Solid when connected, otherwise blink
+uint32_t blinkLed(unsigned long now) {
+	if (connectionStatus == CONNECTED) {
+		ledOn = true;
+	} else if (now - lastLedOn > 1000) {
+		lastLedOn = now;
+		ledOn = !ledOn;
+	}
+
+	digitalWrite(LED_PIN, ledOn ? HIGH : LOW);
+
+	return connectionStatus == CONNECTED ? SPP_POLL_CONNECTED : 1000 - min(now - lastLedOn, 1000UL);
+}
+
+uint32_t tickSecond(unsigned long now) {
+	uptime.loop();
+
+	if (now - lastSaved >= 1000) {
+		lastSaved = now;
+		warmRestart.saveTime();	// Panics don't run the shutdown handler, so keep it fresh
+	}
+
+	return 1000 - min(now - lastSaved, 1000UL);
+}
+
+void sppTaskFn(void *pArg) {
 	ESP_LOGD(TIME_FLIES_TAG, "%s", "sppTaskFn()");
 
-	uint32_t delayNextMsg = 1;
-	bool wasOn = !timeFliesClock.clockOn();	// Force a clock state message initially
-	uint32_t maxWait = 500;
-	setRname();
-	delay(10000);
-	uint32_t lastConnectedTime = millis();
-	bool ledOn = false;
-	uint32_t lastLedOn = millis();
+	uint32_t maxWait = SPP_POLL_DISCONNECTED;
+
+	sppBegin();
 
+#ifndef UNIFIED_EVENT_LOOP
 	xTaskCreatePinnedToCore(
 		syncBusTaskFn, /* Function to implement the task */
 		"Sync bus task", /* Name of the task */
-		4096,  /* Stack size in words */
+		SYNC_TASK_STACK,  /* Stack size in words */
 		NULL,  /* Task input parameter */
 		tskIDLE_PRIORITY,  /* More than background tasks */
 		&syncBusTask,  /* Task handle. */
 		0
 		);
+#endif
 
 	while(true) {
-		BaseType_t result = xQueuePeek(sppQueue, msg, pdMS_TO_TICKS(maxWait));
-		uptime.loop();
+		publishStatus();
 
-		readFromServer();	// Do this before we send a command in getSPPState();
-		getSPPState();
-
-		if (result == pdTRUE) {
-			if (connectionStatus == CONNECTED) {
-				// If we are connected, just drain the queue
-				lastConnectedTime = millis();
-				xQueueReceive(sppQueue, msg, 0);
-				delay(delayNextMsg);
-				logger.log(Logger::INFO, "> %s", msg);
-				Serial1.println(msg);
-				delayNextMsg = cmdDelay;
-				continue;
-			} else if (connectionStatus == NOT_CONNECTED) {
-				initiateConnection();
-			}
-		} else {
-			cmdDelay = 1000;
-			delayNextMsg = 1;
+		if (sppPacing) {
+			delay(maxWait);	// Commands are waiting, but not allowed out yet
 		}
 
-		timeFliesClock.setMov(mov.isOn());
+		bool result;
+		{
+			TRACE_SPAN("sppQueue.wait");
+			result = sppQueue.wait(pdMS_TO_TICKS(maxWait));
+		}
+#ifndef UNIFIED_EVENT_LOOP
+		uptime.loop();
+#endif
 
-		// NOTE: sendCommands(...) just puts them on the queue
-		if (timeFliesClock.clockOn() != wasOn) {
-			wasOn = timeFliesClock.clockOn();
-			if (wasOn) {
-				// Full brightness and on
-				sendCommands("0x13,$BIT4,0***;0x13,$BIT15,0***");
-			} else {
-				if (TimeFliesClock::getOffStateOff()) {
-					// Full brightness, but off
-					sendCommands("0x13,$BIT15,1***;0x13,$BIT4,0***");
-				} else {
-					// Dim, but on
-					sendCommands("0x13,$BIT4,1***;0x13,$BIT15,0***");
-				}
-			}
+		maxWait = sppStep(result);
+		if (maxWait == 0) {
+			continue;
 		}
 
-		if (connectionStatus == CONNECTED) {
-			ledOn = true;
-#ifdef DISCONNECT_ON_DILE
-			if (millis() - lastConnectedTime > 30000) {
-				logger.log(INFO, "Disconnecting");
-				closeConnection();
-			}
+#ifndef UNIFIED_EVENT_LOOP
+		blinkLed(millis());
+		tickSecond(millis());
 #endif
-		}
+	}
+}
 
-		if (connectionStatus == NOT_CONNECTED) {
-			initiateConnection();
-		}
+// Runs every second on the telemetry task, or the event loop, never on the timer
+void sampleTelemetry(uint16_t values[Telemetry::NUM_SERIES]) {
+	values[Telemetry::FREE_HEAP] = min(ESP.getFreeHeap() / 16, (uint32_t)UINT16_MAX);
+	values[Telemetry::MAX_BLOCK] = min(ESP.getMaxAllocHeap() / 16, (uint32_t)UINT16_MAX);
+	values[Telemetry::QUEUE_DEPTH] = sppQueue.depth(CommandQueue::URGENT) + sppQueue.depth(CommandQueue::NORMAL);
+	values[Telemetry::RSSI] = WiFi.isConnected() ? -WiFi.RSSI() : 0;
+	values[Telemetry::SPP_CONNECTED] = connectionStatus == CONNECTED ? 100 : 0;
+}
+
+Telemetry telemetry(sampleTelemetry);
 
-		if (ledOn) {
-			digitalWrite(LED_PIN, HIGH);
+void telemetryTaskFn(void *pArg) {
+	ESP_LOGD(TIME_FLIES_TAG, "%s", "telemetryTaskFn()");
+	telemetry.loop();
+}
+
+#ifdef UNIFIED_EVENT_LOOP
+uint32_t syncStep(unsigned long now) {
+	applySyncConfig();
+
+	if (!syncBus.isOpen()) {
+		return EVENT_LOOP_IDLE;	// Until the config changes
+	}
+
+	sendTimeBeacon();
+	replicator.loop(now);
+	flushSyncBus();
+
+	return syncBusTimeout();
+}
+
+/*
+ * Does the work of the sync bus and EEPROM commit tasks, the LED and the uptime
+ * tick on one stack. SPP keeps its own task, its AT round trips block for up to
+ * a second. The loop sleeps in select() on the sync bus while it is open, so
+ * packets are handled as soon as they arrive, and posting wakes it with a
+ * loopback packet.
+ */
+void eventLoopTaskFn(void *pArg) {
+	ESP_LOGD(TIME_FLIES_TAG, "%s", "eventLoopTaskFn()");
+
+	mov.setOnTime(millis());
+
+	syncHandler = eventLoop.add("sync", syncStep);
+	persistenceHandler = eventLoop.add("eeprom", [](unsigned long now) { return persistence.step(); });
+	captureHandler = eventLoop.add("capture", [](unsigned long now) { return capture.step(); });
+	telemetryHandler = eventLoop.add("telemetry", [](unsigned long now) { return telemetry.step(); });
+	eventLoop.add("led", blinkLed);
+	eventLoop.add("uptime", tickSecond);
+
+	persistence.setChangedCallback([] { eventLoop.post(persistenceHandler); });
+	capture.setPendingCallback([] { eventLoop.post(captureHandler); });
+	telemetry.setDueCallback([] { eventLoop.post(telemetryHandler); });
+
+	eventLoop.setWait([](uint32_t timeoutMs) {
+		if (syncBus.isOpen()) {
+			ulTaskNotifyTake(pdTRUE, 0);	// wake() also sent a packet, which select() will see
+			readSyncBus(timeoutMs);
 		} else {
-			digitalWrite(LED_PIN, LOW);
+			ulTaskNotifyTake(pdTRUE, timeoutMs == EVENT_LOOP_IDLE ? portMAX_DELAY : pdMS_TO_TICKS(timeoutMs));
 		}
+	}, [] {
+		xTaskNotifyGive(eventLoop.getTask());
+		syncBus.wake();
+	});
 
-		if (millis() - lastLedOn > 1000) {
-			lastLedOn = millis();
-			ledOn = !ledOn;
-		}
-	}
+	eventLoop.run();
 }
+#endif
 
 String* items[] {
 	&WSMenuHandler::clockMenu,
@@ -732,12 +1344,36 @@ String* items[] {
 };
 
 WSMenuHandler wsMenuHandler(items);
-WSConfigHandler wsClockHandler(rootConfig, "clock");
+WSConfigHandler wsClockHandler(rootConfig, "clock", [](JsonWriter &writer) {
+	writer.raw("\"schedule\":");
+	ConfigJson::write(writer, TimeFliesClock::getSchedule());
+	writer.raw(",\"dimming\":");
+	ConfigJson::write(writer, TimeFliesClock::getDimming());
+});
 WSConfigHandler wsLEDsHandler(rootConfig, "leds");
-WSConfigHandler wsExtrasHandler(rootConfig, "extra", []() { return logger.getSerializedJsonLog(); });
+WSConfigHandler wsExtrasHandler(rootConfig, "extra", [](JsonWriter &writer) { logger.writeJsonLog(writer); });
 WSConfigHandler wsSyncHandler(rootConfig, "sync", wifiCallback);
 WSInfoHandler wsInfoHandler(infoCallback);
 
+void journalValue(JsonObject value, StateJournal::EntryType type, const BaseConfigItem *item) {
+	switch (type) {
+	case StateJournal::CONFIG:
+		value[item->name] = serialized(item->toJSON());
+		break;
+	case StateJournal::LOG:
+		logger.getJsonLog(value);
+		break;
+	case StateJournal::SPP_STATE:
+		value["spp_state"] = state2string[connectionStatus];
+		break;
+	}
+}
+
+WSLatencyHandler wsLatencyHandler(latencyStages);
+
+extern WSHandler* wsHandlers[];
+WSResyncHandler wsResyncHandler(stateJournal, wsHandlers, 6, journalValue);	// Pages 0-5 below
+
 // Order of this needs to match the numbers in WSMenuHandler.cpp
 WSHandler* wsHandlers[] {
 	&wsMenuHandler,
@@ -746,8 +1382,8 @@ WSHandler* wsHandlers[] {
 	&wsExtrasHandler,
 	&wsInfoHandler,
 	&wsSyncHandler,
-	NULL,
-	NULL,
+	&wsResyncHandler,
+	&wsLatencyHandler,
 	NULL
 };
 
@@ -764,13 +1400,149 @@ void infoCallback() {
 	wsInfoHandler.setLastFailedMessage(syncStats.lastFailedMessage);
 	wsInfoHandler.setLastUpdateTime(syncStats.lastUpdateTime);
 	wsInfoHandler.setHostname(hostName);
+	wsInfoHandler.setSppState(state2string[connectionStatus].c_str());
+	wsInfoHandler.setWSClients(wsClientMonitor.getSummary(millis()));
+
+	ConfigPersistence::Stats persistStats = persistence.getStats();
+	char persistBuf[160];
+	snprintf(persistBuf, sizeof(persistBuf), "%s: %lu writes, %lu items, %lu bytes, last %lums, max %lums, %d pending, loaded in %lums",
+		configStore.getName(), (unsigned long)persistStats.commits, (unsigned long)persistStats.itemsWritten,
+		(unsigned long)configStore.getBytesWritten(),
+		(unsigned long)(persistStats.lastCommitUs / 1000), (unsigned long)(persistStats.maxCommitUs / 1000),
+		persistence.getDirtyCount(), (unsigned long)(configStore.getLoadUs() / 1000));
+	wsInfoHandler.setConfigWrites(persistBuf);
+	wsInfoHandler.setResetReason(String(warmRestart.getResetReason()) + (warmRestart.isWarm() ? " (warm)" : " (cold)"));
+	wsInfoHandler.setBootPhases(bootProfile.getSummary());
+
+	BlankingScheduler::Stats blankingStats = blanking.getStats();
+	time_t nextChange = blanking.getNextChange();
+	struct tm nextLocal;
+	static const char *stateNames[] = { "on", "dim", "off" };
+	char blankingBuf[128];
+	char nextBuf[24] = "never";
+	if (nextChange != 0) {
+		localtime_r(&nextChange, &nextLocal);
+		strftime(nextBuf, sizeof(nextBuf), "%a %H:%M", &nextLocal);
+	}
+	snprintf(blankingBuf, sizeof(blankingBuf), "%s, schedule changes %s (%d segments, %d bad entries, %lu evaluations, %lu recomputes)",
+		stateNames[blanking.state()], nextBuf, blankingSchedule.getNumSegments(), blankingSchedule.getErrors(),
+		(unsigned long)blankingStats.evaluations, (unsigned long)blankingStats.recomputes);
+	wsInfoHandler.setClockOn(blankingBuf);
+
+	time_t nowTime = time(NULL);
+	time_t nextDst = tzTransitions.nextTransition(nowTime);
+	int32_t tzOffset;
+	bool tzDst;
+	bool tzValid = tzTransitions.lookup(nowTime, tzOffset, tzDst);
+	char tzBuf[128];
+	char dstBuf[24] = "never";
+	if (nextDst != 0) {
+		localtime_r(&nextDst, &nextLocal);
+		strftime(dstBuf, sizeof(dstBuf), "%a %d %b %H:%M", &nextLocal);
+	}
+	snprintf(tzBuf, sizeof(tzBuf), "%s, UTC%+.2g%s, next change %s (%lu recomputes)",
+		tzValid ? "ok" : "not understood", tzOffset / 3600.0, tzDst ? " DST" : "", dstBuf,
+		(unsigned long)tzTransitions.getRecomputes());
+	wsInfoHandler.setTimeZone(tzBuf);
+
+	static uint32_t lastWakeups = 0;
+	static unsigned long lastInfo = 0;
+	SyncBus::Stats busStats = syncBus.getStats();
+	unsigned long now = millis();
+	SyncProtocol::Stats protoStats = syncProtocol.getStats();
+	ConfigReplicator::Stats replStats = replicator.getStats();
+	char syncBuf[384];
+	snprintf(syncBuf, sizeof(syncBuf), "%s%s, %.2f wakeups/s, %lu in, %lu out, movement latency %lums (max %lums)"
+		"<br>v2: %lu/%lu frames in/out, %lu events in, %lu duplicates, %lu malformed, %lu legacy, beacon offset %ldms"
+		"<br>config: %lu/%lu deltas in/out, %lu batches, %lu full, %lu requests, at %s",
+		syncBus.isOpen() ? "open" : "closed", syncBus.getGroup() != 0 ? " (multicast)" : "",
+		lastInfo == 0 ? 0.0f : (busStats.wakeups - lastWakeups) * 1000.0f / max(now - lastInfo, 1UL),
+		(unsigned long)busStats.packets, (unsigned long)busStats.sent,
+		(unsigned long)(busStats.lastMovementUs / 1000), (unsigned long)(busStats.maxMovementUs / 1000),
+		(unsigned long)protoStats.framesIn, (unsigned long)protoStats.framesOut, (unsigned long)protoStats.eventsIn,
+		(unsigned long)protoStats.duplicates, (unsigned long)protoStats.malformed, (unsigned long)protoStats.legacy,
+		(long)lastBeaconOffsetMs,
+		(unsigned long)replStats.deltasIn, (unsigned long)replStats.deltasOut, (unsigned long)replStats.batchesIn,
+		(unsigned long)replStats.fullTransfers, (unsigned long)replStats.requests, replicator.getPosition().c_str());
+	lastWakeups = busStats.wakeups;
+	lastInfo = now;
+	wsInfoHandler.setSyncBus(syncBuf);
+
+	// Stack sizes are in bytes on the ESP32, whatever xTaskCreate's comments say
+	struct { const char *name; TaskHandle_t task; uint32_t size; } tasks[] = {
+		{ "spp", sppTask, SPP_TASK_STACK },
+#ifdef UNIFIED_EVENT_LOOP
+		{ "event loop", eventLoopTask, EVENT_LOOP_TASK_STACK },
+#endif
+		{ "wifi", wifiManagerTask, WIFI_TASK_STACK },
+		{ "sync", syncBusTask, SYNC_TASK_STACK },
+		{ "eeprom", commitEEPROMTask, EEPROM_TASK_STACK },
+		{ "telemetry", telemetryTask, TELEMETRY_TASK_STACK },
+	};
+	char stackBuf[256];
+	int stackLen = 0;
+	uint32_t reserved = 0;
+	uint32_t freed = 0;
+	for (int i=0; i < (int)(sizeof(tasks) / sizeof(tasks[0])); i++) {
+		if (tasks[i].task == NULL) {
+			freed += tasks[i].size;
+			continue;
+		}
+		reserved += tasks[i].size;
+		stackLen += snprintf(stackBuf + stackLen, sizeof(stackBuf) - stackLen, "%s %lu (%lu unused), ",
+			tasks[i].name, (unsigned long)tasks[i].size, (unsigned long)uxTaskGetStackHighWaterMark(tasks[i].task));
+	}
+#ifdef UNIFIED_EVENT_LOOP
+	EventLoop::Stats loopStats = eventLoop.getStats();
+	snprintf(stackBuf + stackLen, sizeof(stackBuf) - stackLen, "%lu reserved, %lu freed by the event loop<br>loop: %lu wakeups, %lu runs, %lu posts, longest %lums (%s)",
+		(unsigned long)reserved, (unsigned long)freed, (unsigned long)loopStats.wakeups, (unsigned long)loopStats.runs,
+		(unsigned long)loopStats.posts, (unsigned long)(loopStats.maxRunUs / 1000), loopStats.maxRunName);
+#else
+	snprintf(stackBuf + stackLen, sizeof(stackBuf) - stackLen, "%lu reserved", (unsigned long)reserved);
+#endif
+	wsInfoHandler.setTaskStacks(stackBuf);
+
+	char latencyBuf[384];
+	int latencyLen = 0;
+	for (int i=0; latencyStages[i] != 0; i++) {
+		LatencyHistogram::Summary summary = latencyStages[i]->summarize();
+		latencyLen += snprintf(latencyBuf + latencyLen, sizeof(latencyBuf) - latencyLen, "%s%s: %lu, %.1f/%.1f/%.1f/%.1fms",
+			i == 0 ? "" : "<br>", latencyStages[i]->getName(), (unsigned long)summary.count,
+			summary.p50 / 1000.0f, summary.p95 / 1000.0f, summary.p99 / 1000.0f, summary.max / 1000.0f);
+		latencyLen = min(latencyLen, (int)sizeof(latencyBuf) - 1);
+	}
+	wsInfoHandler.setLatency(latencyBuf);
 
 	wsInfoHandler.setUptime(uptime.uptime());
 }
 
-void broadcastUpdate(const JsonDocument &doc) {
-	if (xSemaphoreTake(wsMutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+void broadcastUpdate(JsonDocument &doc, StateJournal::EntryType type, const BaseConfigItem *item) {
+	// Stamp every update so a client knows what it has seen if it has to reconnect
+	doc["epoch"] = stateJournal.getEpoch();
+	doc["version"] = stateJournal.record(type, item);
+
+	// Only the leader's replicated items are worth waking followers for
+	if (type == StateJournal::CONFIG && replicator.getRole() == ConfigReplicator::LEADER && item != 0 && replicator.replicated(item)) {
+		uint8_t payload[8];
+		SyncProtocol::put32(payload, stateJournal.getEpoch());
+		SyncProtocol::put32(payload + 4, doc["version"].as<uint32_t>());
+		queueSyncEvent(SyncProtocol::CONFIG_VERSION, payload, sizeof(payload));
+	}
+
+	broadcastJson(doc);
+}
+
+void broadcastJson(const JsonDocument &doc) {
+	TRACE_SPAN("broadcast");
+	bool locked;
+	{
+		TRACE_SPAN("wsMutex");
+		locked = xSemaphoreTake(wsMutex, pdMS_TO_TICKS(1000)) == pdTRUE;
+	}
+
+	if (!locked) {
 		ESP_LOGE(TIME_FLIES_TAG, "Failed to obtain wsMutex");
+		broadcastDrops.inc();
 		return;
 	}
 
@@ -780,19 +1552,34 @@ void broadcastUpdate(const JsonDocument &doc) {
 	if (buffer) {
 		serializeJson(doc, (char *)buffer->get(), len);
 		ws.textAll(buffer);
+		wsFramesOut += ws.count();
+		wsBytesOut += len * ws.count();
 	}
 
 	xSemaphoreGive(wsMutex);
 }
 
 void broadcastUpdate(String originalKey, const BaseConfigItem& item) {
-	JsonDocument doc;
+	PooledJsonAllocator allocator;
+	JsonDocument doc(&allocator);
 	doc["type"] = "sv.update";
 	
 	String rawJSON = item.toJSON();	// This object needs to hang around until we are done serializing.
 	doc["value"][originalKey] = serialized(rawJSON.c_str());
 
-	broadcastUpdate(doc);
+	broadcastUpdate(doc, StateJournal::CONFIG, &item);
+}
+
+// A change from the group leader, treated the same as one from our own UI
+void applyReplicated(BaseConfigItem *item, const String &value) {
+	if (item->toString() == value) {
+		return;	// Don't push what the clock already has
+	}
+
+	item->fromString(value);
+	persistence.put(*item);
+	broadcastUpdate(item->name, *item);
+	item->notify();
 }
 
 void updateValue(String originalKey, String _key, String value, BaseConfigItem *item) {
@@ -802,7 +1589,7 @@ void updateValue(String originalKey, String _key, String value, BaseConfigItem *
 		item = item->get(key);
 		if (item != 0) {
 			item->fromString(value);
-			item->put();
+			persistence.put(*item);
 
 			// Order of below is important to maintain external consistency
 			broadcastUpdate(originalKey, *item);
@@ -813,9 +1600,8 @@ void updateValue(String originalKey, String _key, String value, BaseConfigItem *
 			setWiFiAP(value == "true" ? true : false);
 		} else if (_key == "hostname") {
 			hostName = value;
-			hostName.put();
-			config.commit();
-			ESP.restart();
+			persistence.put(hostName);
+			ESP.restart();	// Commits on the way down
 		} else if (_key == "push_all_values") {
 			pushAllValues();
 		} else if (_key == "push_time") {
@@ -839,10 +1625,47 @@ void updateValue(int screen, String pair) {
 	updateValue(_key, _key, value, &rootConfig);
 }
 
+/*
+ * The clock can't keep up, so tell the client and put its control back to where it was
+ */
+void rejectUpdate(AsyncWebSocketClient *client, String pair) {
+	String _key = pair.substring(0, pair.indexOf(':'));
+	BaseConfigItem *item = rootConfig.get(_key.c_str());
+
+	PooledJsonAllocator allocator;
+	JsonDocument doc(&allocator);
+	String serializedJSON;
+
+	doc["type"] = "sv.status";
+	doc["value"]["busy"] = true;
+	doc["value"]["urgent"] = sppQueue.depth(CommandQueue::URGENT);
+	doc["value"]["normal"] = sppQueue.depth(CommandQueue::NORMAL);
+	doc["value"]["drain_ms"] = (sppQueue.depth(CommandQueue::URGENT) + sppQueue.depth(CommandQueue::NORMAL)) * cmdDelay;
+	doc["value"]["spp_state"] = state2string[connectionStatus];
+	doc["value"]["saturated"] = true;
+	serializeJson(doc, serializedJSON);
+	client->text(serializedJSON);
+	wsFramesOut++;
+	wsBytesOut += serializedJSON.length();
+
+	if (item != 0) {
+		String rawJSON = item->toJSON();
+		doc.clear();
+		doc["type"] = "sv.update";
+		doc["value"][_key] = serialized(rawJSON.c_str());
+		serializedJSON = "";
+		serializeJson(doc, serializedJSON);
+		client->text(serializedJSON);
+		wsFramesOut++;
+		wsBytesOut += serializedJSON.length();
+	}
+}
+
 /*
  * Handle application protocol
  */
-void handleWSMsg(AsyncWebSocketClient *client, const char *data) {
+void handleWSMsg(AsyncWebSocketClient *client, const char *data, uint32_t receivedUs) {
+	TRACE_SPAN("ws dispatch");
 	String wholeMsg(data);
 	int code = wholeMsg.substring(0, wholeMsg.indexOf(':')).toInt();
 
@@ -855,7 +1678,12 @@ void handleWSMsg(AsyncWebSocketClient *client, const char *data) {
 		String message = wholeMsg.substring(wholeMsg.indexOf(':')+1);
 		int screen = message.substring(0, message.indexOf(':')).toInt();
 		String pair = message.substring(message.indexOf(':')+1);
-		updateValue(screen, pair);
+		if (pipelineSaturated() && needsAdmission(pair)) {
+			rejectUpdate(client, pair);
+		} else {
+			updateValue(screen, pair);
+			wsLatency.record(micros() - receivedUs);
+		}
 	}
 }
 
@@ -864,25 +1692,35 @@ void wsHandler(AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventTyp
 	switch (type) {
 	case WS_EVT_CONNECT:
 		ESP_LOGD(TIME_FLIES_TAG, "WS connected");
+		wsClientMonitor.onConnect(client, millis());
+		capture.record(Capture::WS_CONNECT, client->id(), NULL, 0);
 		break;
 	case WS_EVT_DISCONNECT:
 		ESP_LOGD(TIME_FLIES_TAG, "WS disconnected");
+		wsClientMonitor.onDisconnect(client);
+		capture.record(Capture::WS_DISCONNECT, client->id(), NULL, 0);
 		break;
 	case WS_EVT_ERROR:
 		ESP_LOGD(TIME_FLIES_TAG, "WS Error, data: %s", (char* )data);
 		break;
 	case WS_EVT_PONG:
 		ESP_LOGD(TIME_FLIES_TAG, "WS pong");
+		wsClientMonitor.onActivity(client, 0, millis());
 		break;
 	case WS_EVT_DATA:	// Yay we got something!
+		uint32_t receivedUs = micros();
 		ESP_LOGD(TIME_FLIES_TAG, "WS data");
+		wsClientMonitor.onActivity(client, len, millis());
+		wsFramesIn.inc();
+		wsBytesIn.inc(len);
 		AwsFrameInfo * info = (AwsFrameInfo*) arg;
 		if (info->final && info->index == 0 && info->len == len) {
 			//the whole message is in a single frame and we got all of it's data
 			if (info->opcode == WS_TEXT) {
 				ESP_LOGD(TIME_FLIES_TAG, "WS text data");
 				data[len] = 0;
-				handleWSMsg(client, reinterpret_cast<const char*>(data));
+				capture.record(Capture::WS_IN, client->id(), data, len);
+				handleWSMsg(client, reinterpret_cast<const char*>(data), receivedUs);
 			} else {
 				ESP_LOGD(TIME_FLIES_TAG, "WS binary data");
 			}
@@ -917,10 +1755,629 @@ void sendFavicon(AsyncWebServerRequest *request) {
 	request->send(LittleFS, "/assets/favicon-32x32.png", "image/png");
 }
 
+int64_t taskStackUnused(TaskHandle_t task) {
+	return task == NULL ? METRIC_ABSENT : uxTaskGetStackHighWaterMark(task);
+}
+
+SampledMetric queueUrgent("timeflies_spp_queue_depth", "Commands waiting to go to the clock", Metric::GAUGE,
+	[]() -> int64_t { return sppQueue.depth(CommandQueue::URGENT); }, "priority=\"urgent\"");
+SampledMetric queueNormal("timeflies_spp_queue_depth", "Commands waiting to go to the clock", Metric::GAUGE,
+	[]() -> int64_t { return sppQueue.depth(CommandQueue::NORMAL); }, "priority=\"normal\"");
+SampledMetric commandsEnqueued("timeflies_spp_commands_enqueued_total", "Commands queued for the clock", Metric::COUNTER,
+	[]() -> int64_t { return sppQueue.getStats().enqueued; });
+SampledMetric commandsCoalesced("timeflies_spp_commands_coalesced_total", "Queued commands replaced by a newer one for the same LED", Metric::COUNTER,
+	[]() -> int64_t { return sppQueue.getStats().coalesced; });
+SampledMetric commandsDropped("timeflies_spp_commands_dropped_total", "Commands dropped because the queue was full", Metric::COUNTER,
+	[]() -> int64_t { return sppQueue.getStats().dropped; });
+SampledMetric sppStateMetric("timeflies_spp_state", "SPP module state, 4 is connected", Metric::GAUGE,
+	[]() -> int64_t { return connectionStatus; });
+SampledMetric wsFramesOutMetric("timeflies_ws_frames_out_total", "WebSocket frames sent", Metric::COUNTER,
+	[]() -> int64_t { return wsFramesOut + JsonWriter::getStats().responses; });
+SampledMetric wsBytesOutMetric("timeflies_ws_bytes_out_total", "WebSocket bytes sent", Metric::COUNTER,
+	[]() -> int64_t { return wsBytesOut + JsonWriter::getStats().bytes; });
+SampledMetric wsClientsMetric("timeflies_ws_clients", "Connected WebSocket clients", Metric::GAUGE,
+	[]() -> int64_t { return ws.count(); });
+SampledMetric configCommits("timeflies_config_commits_total", "Config writes to flash", Metric::COUNTER,
+	[]() -> int64_t { return persistence.getStats().commits; });
+SampledMetric configItems("timeflies_config_items_written_total", "Config items written to flash", Metric::COUNTER,
+	[]() -> int64_t { return persistence.getStats().itemsWritten; });
+SampledMetric syncPacketsIn("timeflies_sync_packets_in_total", "Sync bus packets received", Metric::COUNTER,
+	[]() -> int64_t { return syncBus.getStats().packets; });
+SampledMetric syncPacketsOut("timeflies_sync_packets_out_total", "Sync bus packets sent", Metric::COUNTER,
+	[]() -> int64_t { return syncBus.getStats().sent; });
+SampledMetric ntpFailures("timeflies_ntp_failures_total", "Failed NTP syncs", Metric::COUNTER,
+	[]() -> int64_t { return timeSync == NULL ? 0 : timeSync->getStats().failedCount.toInt(); });	// Kept as a String by TimeSync
+SampledMetric heapFree("timeflies_heap_free_bytes", "Free heap", Metric::GAUGE,
+	[]() -> int64_t { return ESP.getFreeHeap(); });
+SampledMetric heapMin("timeflies_heap_min_free_bytes", "Lowest free heap since boot", Metric::GAUGE,
+	[]() -> int64_t { return ESP.getMinFreeHeap(); });
+SampledMetric heapMaxAlloc("timeflies_heap_max_alloc_bytes", "Largest free heap block", Metric::GAUGE,
+	[]() -> int64_t { return ESP.getMaxAllocHeap(); });
+SampledMetric uptimeMetric("timeflies_uptime_seconds", "Seconds since boot", Metric::GAUGE,
+	[]() -> int64_t { return esp_timer_get_time() / 1000000; });
+SampledMetric stackSpp("timeflies_task_stack_unused_bytes", "Least stack a task has had free", Metric::GAUGE,
+	[]() -> int64_t { return taskStackUnused(sppTask); }, "task=\"spp\"");
+SampledMetric stackWifi("timeflies_task_stack_unused_bytes", "Least stack a task has had free", Metric::GAUGE,
+	[]() -> int64_t { return taskStackUnused(wifiManagerTask); }, "task=\"wifi\"");
+SampledMetric stackSync("timeflies_task_stack_unused_bytes", "Least stack a task has had free", Metric::GAUGE,
+	[]() -> int64_t { return taskStackUnused(syncBusTask); }, "task=\"sync\"");
+SampledMetric stackEeprom("timeflies_task_stack_unused_bytes", "Least stack a task has had free", Metric::GAUGE,
+	[]() -> int64_t { return taskStackUnused(commitEEPROMTask); }, "task=\"eeprom\"");
+SampledMetric stackTelemetry("timeflies_task_stack_unused_bytes", "Least stack a task has had free", Metric::GAUGE,
+	[]() -> int64_t { return taskStackUnused(telemetryTask); }, "task=\"telemetry\"");
+#ifdef UNIFIED_EVENT_LOOP
+SampledMetric stackEventLoop("timeflies_task_stack_unused_bytes", "Least stack a task has had free", Metric::GAUGE,
+	[]() -> int64_t { return taskStackUnused(eventLoopTask); }, "task=\"event_loop\"");
+#endif
+
+// Written straight into the response's buffers as they go out, nothing is built up per scrape
+void sendMetrics(AsyncWebServerRequest *request) {
+	Metric::Cursor cursor = Metric::begin();
+	AsyncWebServerResponse *response = request->beginChunkedResponse("text/plain; version=0.0.4",
+		[cursor](uint8_t *buffer, size_t maxLen, size_t index) mutable -> size_t {
+			return Metric::render((char *)buffer, maxLen, cursor);
+		});
+	request->send(response);
+}
+
+void sendLatency(AsyncWebServerRequest *request) {
+	PooledJsonAllocator allocator;
+	JsonDocument doc(&allocator);
+	wsLatencyHandler.toJson(doc.to<JsonObject>());
+
+	AsyncResponseStream *response = request->beginResponseStream("application/json");
+	serializeJson(doc, *response);
+	request->send(response);
+}
+
+void resetLatency(AsyncWebServerRequest *request) {
+	wsLatencyHandler.reset();
+	sendLatency(request);
+}
+
+void sendTrace(AsyncWebServerRequest *request) {
+	Trace::Cursor cursor = Trace::begin();
+	AsyncWebServerResponse *response = request->beginChunkedResponse("application/json",
+		[cursor](uint8_t *buffer, size_t maxLen, size_t index) mutable -> size_t {
+			return Trace::render((char *)buffer, maxLen, cursor);
+		});
+	response->addHeader("Content-Disposition", "attachment; filename=\"trace.json\"");
+	request->send(response);
+}
+
+void startTrace(AsyncWebServerRequest *request) {
+	Trace::start();
+	request->send(200, "text/plain", "Tracing");
+}
+
+void stopTrace(AsyncWebServerRequest *request) {
+	Trace::stop();
+	request->send(200, "text/plain", "Stopped");
+}
+
+void captureTaskFn(void *pArg) {
+	ESP_LOGD(TIME_FLIES_TAG, "%s", "captureTaskFn()");
+	capture.loop();
+}
+
+void sendCapture(AsyncWebServerRequest *request) {
+	if (capture.isEnabled()) {
+		capture.step();	// So the download is up to date
+	}
+	request->send(LittleFS, capture.getPath(), "application/octet-stream", true);
+}
+
+void startCapture(AsyncWebServerRequest *request) {
+	if (!capture.start()) {
+		request->send(500, "text/plain", "Couldn't start capture");
+		return;
+	}
+
+#ifdef UNIFIED_EVENT_LOOP
+	eventLoop.post(captureHandler);
+#else
+	// Only costs a stack once someone wants a capture
+	if (captureTask == NULL) {
+		xTaskCreatePinnedToCore(
+			captureTaskFn,
+			"Capture task",
+			CAPTURE_TASK_STACK,
+			NULL,
+			tskIDLE_PRIORITY,
+			&captureTask,
+			xPortGetCoreID());
+	}
+#endif
+	request->send(200, "text/plain", "Capturing");
+}
+
+void stopCapture(AsyncWebServerRequest *request) {
+	capture.stop();
+
+	Capture::Stats stats = capture.getStats();
+	char msg[96];
+	snprintf(msg, sizeof(msg), "Stopped, %lu records, %lu dropped, %lu bytes",
+		(unsigned long)stats.records, (unsigned long)stats.dropped, (unsigned long)stats.bytes);
+	request->send(200, "text/plain", msg);
+}
+
+void sendTelemetry(AsyncWebServerRequest *request) {
+	AsyncResponseStream *response = request->beginResponseStream("application/octet-stream", telemetry.size());
+	telemetry.write(*response);
+	request->send(response);
+}
+
+#ifdef BENCHMARKS
+/*
+ * Build with -D BENCHMARKS (the *_bench environments), POST /bench/start, optionally
+ * with ?filter=name&min_ms=100, then GET /bench for the results. They run on their
+ * own task at idle priority so the web server and the watchdog carry on. The kernels
+ * use a queue, settings store, journal and socket of their own, so nothing reaches the
+ * clock, flash or a browser. The page handlers read the live config, as a page load does.
+ */
+// Takes everything and keeps nothing, so dispatch pays for persistence without writing flash
+class NullConfigStore : public ConfigStore {
+public:
+	virtual const char *getName() const { return "Null"; }
+	virtual void load() {}
+	virtual void put(BaseConfigItem &item) {}
+	virtual void commit(const BaseConfigItem **items, int numItems, bool all) {}
+};
+
+AsyncWebSocket benchWs("/bench");	// Never has any clients, so messages to it are only built
+CommandQueue benchQueue;
+NullConfigStore benchStore;
+ConfigPersistence benchPersistence(benchStore, systemTime);
+StateJournal benchJournal;
+Logger benchLogger;
+char benchCommands[256];
+
+ByteConfigItem benchBacklightRed("backlight_red", 7);
+BaseConfigItem *benchSet[] = { &benchBacklightRed, 0 };
+CompositeConfigItem benchConfig("bench", 0, benchSet);
+BlankingScheduler benchBlanking(systemTime, mov, blankingSchedule);
+
+TaskHandle_t benchTask;
+StreamString benchResults;
+String benchFilter;
+uint32_t benchMinMs;
+std::atomic<bool> benchRunning{false};
+
+void benchBroadcast(JsonDocument &doc) {
+	size_t len = measureJson(doc);
+	AsyncWebSocketMessageBuffer *buffer = benchWs.makeBuffer(len);
+	if (buffer) {
+		serializeJson(doc, (char *)buffer->get(), len);
+		benchWs.textAll(buffer);
+	}
+}
+
+// What setLights does, onto benchQueue
+void benchSetLights(byte value, const char **pTemplates) {
+	char msg[MAX_MSG_SIZE] = {0};
+	while(*pTemplates) {
+		snprintf(msg, MAX_MSG_SIZE, *pTemplates, value);
+		benchQueue.pushAll(msg, CommandQueue::NORMAL);
+		pTemplates++;
+	}
+}
+
+void onBenchBacklightRedChanged(ConfigItem<byte> &item) {
+	benchSetLights(item, backlightsRedTemplates);
+}
+
+// What the SPP task would do with the commands
+void drainBenchQueue() {
+	char msg[MAX_MSG_SIZE];
+	while (benchQueue.pop(msg)) {
+	}
+}
+
+Benchmark logBenchmark("Logger::log", []() {
+	benchLogger.log(Logger::DEBUG, "Sent %s in %dms", "0x13,$LED2,R,7***", 12);
+});
+
+Benchmark jsonStringBenchmark("JsonWriter::string", []() {
+	static char buf[LOG_ENTRY_SIZE * 2];
+	JsonWriter writer(buf, sizeof(buf));
+	writer.string("Reply \"OK\"\tafter 0x13,$LED2,R,7*** took 12ms\r\n");
+});
+
+Benchmark jsonLogBenchmark("Logger::writeJsonLog", []() {
+	delete WSHandler::makeBuffer(benchWs, [](JsonWriter &writer) { benchLogger.writeJsonLog(writer); });
+});
+
+Benchmark clockDataBenchmark("WSConfigHandler::getData/clock", []() {
+	wsClockHandler.broadcast(benchWs, "");
+});
+
+Benchmark menuBenchmark("WSMenuHandler::getData", []() {
+	wsMenuHandler.broadcast(benchWs, "");
+});
+
+// handleWSMsg() to updateValue(), broadcastUpdate() and notify() step for step, but on bench state
+Benchmark dispatchBenchmark("handleWSMsg/backlight_red", []() {
+	char data[32];
+	snprintf(data, sizeof(data), "9:2:backlight_red:%d", benchBacklightRed.value);
+
+	String wholeMsg(data);
+	String message = wholeMsg.substring(wholeMsg.indexOf(':')+1);
+	String pair = message.substring(message.indexOf(':')+1);
+	String _key = pair.substring(0, pair.indexOf(':'));
+	String value = pair.substring(pair.indexOf(':')+1);
+
+	BaseConfigItem *item = benchConfig.get(_key.c_str());
+	if (item == 0) {
+		return;
+	}
+	item->fromString(value);
+	benchPersistence.put(*item);
+
+	PooledJsonAllocator allocator;
+	JsonDocument doc(&allocator);
+	doc["type"] = "sv.update";
+	String rawJSON = item->toJSON();
+	doc["value"][_key] = serialized(rawJSON.c_str());
+	doc["epoch"] = benchJournal.getEpoch();
+	doc["version"] = benchJournal.record(StateJournal::CONFIG, item);
+	benchBroadcast(doc);
+
+	item->notify();
+	drainBenchQueue();
+});
+
+Benchmark pushAllBenchmark("CommandQueue::pushAll", []() {
+	benchQueue.pushAll(benchCommands, CommandQueue::NORMAL);
+	drainBenchQueue();
+});
+
+Benchmark setLightsBenchmark("setLights", []() {
+	benchSetLights(benchBacklightRed, backlightsRedTemplates);
+	drainBenchQueue();
+});
+
+Benchmark blankingBenchmark("BlankingScheduler::state", []() {
+	static volatile DisplayState state;
+	state = benchBlanking.state();
+});
+
+void benchTaskFn(void *pArg) {
+	ESP_LOGD(TIME_FLIES_TAG, "%s", "benchTaskFn()");
+
+	benchBacklightRed.setCallback(onBenchBacklightRedChanged);
+	benchLogger.setUpdateCallback(benchBroadcast);
+	for (int i=0; i < MAX_LOG_ENTRIES; i++) {
+		benchLogger.log(Logger::DEBUG, "Filling the log, entry %d of %d", i, MAX_LOG_ENTRIES);
+	}
+
+	// The same commands setLights sends, joined up as sendCommands gets them
+	int len = 0;
+	for (const char **pTemplate = backlightsRedTemplates; *pTemplate; pTemplate++) {
+		len += snprintf(benchCommands + len, sizeof(benchCommands) - len, "%s", len ? ";" : "");
+		len += snprintf(benchCommands + len, sizeof(benchCommands) - len, *pTemplate, benchBacklightRed.value);
+	}
+
+	while (true) {
+		benchResults.remove(0);
+		Benchmark::runAll(benchResults, benchFilter.c_str(), benchMinMs);
+		benchRunning = false;
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+	}
+}
+
+void startBenchmarks(AsyncWebServerRequest *request) {
+	if (benchRunning) {
+		request->send(409, "text/plain", "Already running");
+		return;
+	}
+
+	benchFilter = request->hasArg("filter") ? request->arg("filter") : String();
+	benchMinMs = request->hasArg("min_ms") ? constrain(request->arg("min_ms").toInt(), 1, 500) : 100;
+	benchRunning = true;
+
+	// Only costs a stack once someone wants benchmarks
+	if (benchTask == NULL) {
+		xTaskCreatePinnedToCore(
+			benchTaskFn,
+			"Bench task",
+			BENCH_TASK_STACK,
+			NULL,
+			tskIDLE_PRIORITY,
+			&benchTask,
+			xPortGetCoreID());
+	} else {
+		xTaskNotifyGive(benchTask);
+	}
+	request->send(202, "text/plain", "Running");
+}
+
+void sendBenchmarks(AsyncWebServerRequest *request) {
+	if (benchRunning) {
+		request->send(202, "text/plain", "Running");
+	} else if (benchTask == NULL) {
+		request->send(404, "text/plain", "Nothing run yet, POST /bench/start");
+	} else {
+		request->send(200, "text/plain", benchResults);
+	}
+}
+#endif
+
+#ifdef HEAP_SOAK
+/*
+ * Build with -D HEAP_SOAK (the native_soak environment), POST /soak/start, optionally
+ * with ?days=7&seed=1&every=4, then GET /soak for the report. Plays days of use through
+ * the real code as fast as it goes, on a task of its own, and reports what it did to
+ * the model of the ESP32's heap. The household's settings changes, page loads, Info
+ * page polls, clock replies and NTP syncs are scheduled on a simulated clock, and so
+ * are settings commits. Timers, the SPP task and the event loop still run on the real
+ * one, so unless a clock is connected the soak takes the commands off the queue itself.
+ */
+AsyncWebSocket soakWs("/soak");	// Never has any clients, like benchWs
+uint32_t soakState;
+
+TaskHandle_t soakTask;
+StreamString soakResults;
+uint32_t soakDays;
+uint32_t soakEvery;
+uint32_t soakSeed;
+std::atomic<bool> soakRunning{false};
+
+// The report is the harness's own, so it is kept out of the heap being measured
+void soakPrintf(const char *format, ...) {
+	char line[192];
+	va_list args;
+	va_start(args, format);
+	vsnprintf(line, sizeof(line), format, args);
+	va_end(args);
+
+	nativeHeapExclude(true);
+	soakResults.print(line);
+	nativeHeapExclude(false);
+}
+
+uint32_t soakRandom() {
+	// xorshift32, so a seed always plays the same days
+	soakState ^= soakState << 13;
+	soakState ^= soakState >> 17;
+	soakState ^= soakState << 5;
+	return soakState;
+}
+
+uint32_t soakInterval(uint32_t meanSeconds) {
+	double u = (soakRandom() + 1.0) / 4294967297.0;
+	return (uint32_t)(-log(u) * meanSeconds) + 1;
+}
+
+void soakDrain() {
+	char msg[MAX_MSG_SIZE];
+
+	if (connectionStatus == CONNECTED) {
+		return;
+	}
+
+	while (sppQueue.pop(msg)) {
+		logger.log(Logger::INFO, "> %s", msg);
+		logger.log(Logger::INFO, "< OK");
+	}
+}
+
+void soakEdit() {
+	static const char *keys[] = {
+		"backlight_red", "backlight_green", "backlight_blue",
+		"underlight_red", "underlight_green", "underlight_blue",
+		"baselight_red", "baselight_green", "baselight_blue",
+		"backlights", "underlights", "baselights"
+	};
+	char msg[40];
+
+	// A saturated pipeline would reject the update, which needs a real client
+	if (pipelineSaturated()) {
+		soakDrain();
+	}
+
+	int key = soakRandom() % 12;
+	if (key < 9) {
+		snprintf(msg, sizeof(msg), "9:2:%s:%u", keys[key], soakRandom() % 8);
+	} else {
+		snprintf(msg, sizeof(msg), "9:2:%s:%s", keys[key], soakRandom() % 2 ? "true" : "false");
+	}
+	handleWSMsg(NULL, msg, micros());
+
+	soakDrain();
+}
+
+void soakPageLoad() {
+	wsMenuHandler.broadcast(soakWs, "");
+	wsClockHandler.broadcast(soakWs, "");
+	wsLEDsHandler.broadcast(soakWs, "");
+	wsExtrasHandler.broadcast(soakWs, "");
+}
+
+void soakInfo() {
+	wsInfoHandler.broadcast(soakWs, "");
+}
+
+void soakReply() {
+	logger.log(Logger::INFO, "< OK");
+}
+
+void soakNtp() {
+	asyncTimeSetCallback("soak");
+	soakDrain();
+}
+
+struct SoakEvent {
+	const char *name;
+	uint32_t meanSeconds;	// 0 for every hour on the hour
+	void (*play)();
+	uint32_t next;
+	uint32_t count;
+};
+
+void soak(uint32_t days, uint32_t every) {
+	SoakEvent events[] = {
+		{ "settings changes", 600, soakEdit },
+		{ "page loads", 1800, soakPageLoad },
+		{ "info polls", 300, soakInfo },
+		{ "clock replies", 60, soakReply },
+		{ "NTP syncs", 0, soakNtp },
+	};
+	const int numEvents = sizeof(events) / sizeof(events[0]);
+
+	soakPrintf("%5s %5s %8s %8s %8s %8s %8s\n", "day", "hour", "free", "largest", "min free", "blocks", "failures");
+
+	NativeHeapInfo info;
+	nativeHeapInfo(MALLOC_CAP_8BIT, &info);
+	size_t lowestLargest = info.largestFree;
+	uint32_t lowestHour = 0;
+	uint32_t startFailures = info.failures;
+
+	nativeHeapTrackSites(true);
+	unsigned long startMs = millis();
+	for (int i=0; i < numEvents; i++) {
+		events[i].next = events[i].meanSeconds ? soakInterval(events[i].meanSeconds) : 3600;
+	}
+	uint32_t now = 0;
+	uint32_t commitDue = UINT32_MAX;	// When persistence.step() asked to be called again
+	uint32_t commits = persistence.getStats().commits;
+
+	for (uint32_t hour=1; hour <= days * 24; hour++) {
+		uint32_t end = hour * 3600;
+		for (;;) {
+			SoakEvent *event = 0;
+			for (int i=0; i < numEvents; i++) {
+				if (events[i].next <= end && (event == 0 || events[i].next < event->next)) {
+					event = &events[i];
+				}
+			}
+			uint32_t next = event != 0 ? event->next : end;
+			if (commitDue <= next) {
+				next = commitDue;
+				event = 0;
+			} else if (event == 0) {
+				break;
+			}
+
+			soakTime.advance((next - now) * 1000);
+			now = next;
+			if (event != 0) {
+				event->play();
+				event->count++;
+				event->next += event->meanSeconds ? soakInterval(event->meanSeconds) : 3600;
+			}
+
+			// As the persistence task would, let step() say when it wants to commit
+			uint32_t wait = persistence.step();
+			commitDue = wait == CONFIG_IDLE ? UINT32_MAX : now + max((wait + 999) / 1000, 1U);
+		}
+
+		nativeHeapInfo(MALLOC_CAP_8BIT, &info);
+		if (info.largestFree < lowestLargest) {
+			lowestLargest = info.largestFree;
+			lowestHour = hour;
+		}
+		if (hour % every == 0) {
+			soakPrintf("%5u %5u %8u %8u %8u %8u %8u\n", hour / 24, hour % 24, (unsigned)info.free,
+				(unsigned)info.largestFree, (unsigned)info.minimumFree, info.allocatedBlocks, info.failures - startFailures);
+		}
+	}
+	unsigned long elapsedMs = millis() - startMs;
+
+	NativeHeapSite sites[15];
+	int numSites = nativeHeapTopSites(sites, 15);
+	nativeHeapTrackSites(false);
+
+	soakPrintf("\n%u days in %lums:", days, elapsedMs);
+	for (int i=0; i < numEvents; i++) {
+		soakPrintf("%s %u %s", i ? "," : "", events[i].count, events[i].name);
+	}
+	soakPrintf(", %u settings commits", persistence.getStats().commits - commits);
+	soakPrintf("\nLowest largest free block %u bytes, on day %u hour %u\n", (unsigned)lowestLargest, lowestHour / 24, lowestHour % 24);
+	soakPrintf("%u allocations wouldn't have fitted, the largest %u bytes\n", info.failures - startFailures, (unsigned)info.largestFailure);
+
+	soakPrintf("\n%10s %8s %8s %8s  %s\n", "bytes", "allocs", "frees", "live", "site");
+	for (int i=0; i < numSites; i++) {
+		char where[160];
+		nativeHeapDescribe(sites[i], 4, where, sizeof(where));
+		soakPrintf("%10llu %8llu %8llu %8u  %s\n", (unsigned long long)sites[i].bytes, (unsigned long long)sites[i].allocations,
+			(unsigned long long)sites[i].frees, (unsigned)sites[i].live, where);
+	}
+}
+
+void soakTaskFn(void *pArg) {
+	ESP_LOGD(TIME_FLIES_TAG, "%s", "soakTaskFn()");
+
+	while (true) {
+		soakResults.remove(0);
+		soakState = soakSeed;
+		soak(soakDays, soakEvery);
+		soakRunning = false;
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+	}
+}
+
+void startSoak(AsyncWebServerRequest *request) {
+	if (soakRunning) {
+		request->send(409, "text/plain", "Already running");
+		return;
+	}
+
+	soakDays = request->hasArg("days") ? constrain(request->arg("days").toInt(), 1, 365) : 7;
+	soakEvery = request->hasArg("every") ? constrain(request->arg("every").toInt(), 1, 24 * 365) : max(1UL, soakDays * 24UL / 48);
+	soakSeed = request->hasArg("seed") ? request->arg("seed").toInt() : 1;
+	if (soakSeed == 0) {
+		soakSeed = 1;
+	}
+	soakRunning = true;
+
+	if (soakTask == NULL) {
+		xTaskCreatePinnedToCore(
+			soakTaskFn,
+			"Soak task",
+			SOAK_TASK_STACK,
+			NULL,
+			tskIDLE_PRIORITY,
+			&soakTask,
+			xPortGetCoreID());
+	} else {
+		xTaskNotifyGive(soakTask);
+	}
+	request->send(202, "text/plain", "Running");
+}
+
+void sendSoak(AsyncWebServerRequest *request) {
+	if (soakRunning) {
+		request->send(202, "text/plain", "Running");
+	} else if (soakTask == NULL) {
+		request->send(404, "text/plain", "Nothing run yet, POST /soak/start");
+	} else {
+		request->send(200, "text/plain", soakResults);
+	}
+}
+#endif
+
 void configureWebServer() {
 	server.serveStatic("/", LittleFS, "/");
 	server.on("/", HTTP_GET, mainHandler).setFilter(ON_STA_FILTER);
 	server.on("/assets/favicon-32x32.png", HTTP_GET, sendFavicon);
+	server.on("/metrics", HTTP_GET, sendMetrics);
+	server.on("/latency", HTTP_GET, sendLatency);
+	server.on("/latency/reset", HTTP_POST, resetLatency);
+	server.on("/trace", HTTP_GET, sendTrace);
+	server.on("/telemetry", HTTP_GET, sendTelemetry);
+	server.on("/trace/start", HTTP_POST, startTrace);
+	server.on("/trace/stop", HTTP_POST, stopTrace);
+	server.on("/capture", HTTP_GET, sendCapture);
+	server.on("/capture/start", HTTP_POST, startCapture);
+	server.on("/capture/stop", HTTP_POST, stopCapture);
+#ifdef BENCHMARKS
+	server.on("/bench", HTTP_GET, sendBenchmarks);
+	server.on("/bench/start", HTTP_POST, startBenchmarks);
+#endif
+#ifdef HEAP_SOAK
+	server.on("/soak", HTTP_GET, sendSoak);
+	server.on("/soak/start", HTTP_POST, startSoak);
+#endif
 	server.serveStatic("/assets", LittleFS, "/assets");
 	
 #ifdef OTA
@@ -957,8 +2414,8 @@ void setWiFiAP(bool on) {
 void setupServer() {
 	ESP_LOGD(TIME_FLIES_TAG, "setupServer()");
 	hostName = String(hostnameParam->getValue());
-	hostName.put();
-	config.commit();
+	persistence.put(hostName);
+	persistence.requestCommit();
 	createSSID();
 	wifiManager.setAPCredentials(ssid.c_str(), "secretsauce");
 	ESP_LOGD(TIME_FLIES_TAG, "Hostname: %s", hostName.value.c_str());
@@ -968,13 +2425,24 @@ void setupServer() {
 
 void wifiManagerTaskFn(void *pArg) {
 	ESP_LOGD(TIME_FLIES_TAG, "%s", "wifiManagerTaskFn()");
+	ClockTimer::Timer clientTimer(1000);
 
 	while(true) {
 		if (xSemaphoreTake(wsMutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
 			ESP_LOGE(TIME_FLIES_TAG, "Failed to obtain wsMutex");
 			continue;
 		}
-		wifiManager.loop();
+		{
+			TRACE_SPAN("wifiManager.loop");
+			wifiManager.loop();
+		}
+
+		// Reap dead clients under the same lock broadcasts use
+		unsigned long now = millis();
+		if (clientTimer.expired(now)) {
+			clientTimer.init(now, 1000);
+			wsClientMonitor.loop(now);
+		}
 		xSemaphoreGive(wsMutex);
 
 		delay(50);
@@ -983,56 +2451,72 @@ void wifiManagerTaskFn(void *pArg) {
 
 void commitEEPROMTaskFn(void *pArg) {
 	ESP_LOGD(TIME_FLIES_TAG, "%s", "commitEEPROMTaskFn()");
-	while(true) {
-		delay(60000);
-		ESP_LOGD(TIME_FLIES_TAG, "Committing config");
-		config.commit();
-	}
+	persistence.loop();
+}
+
+// Called by esp_restart() so planned restarts (including OTA) don't lose pending changes
+void commitOnShutdown() {
+	persistence.commitNow();
+	warmRestart.saveTime();
 }
 
-void initFromEEPROM() {
+void initConfig() {
 //	config.setDebugPrint(debugPrint);
-	config.init();
 //	rootConfig.debug(debugPrint);
 	ESP_LOGD(TIME_FLIES_TAG, "Hostname: %s", hostName.value.c_str());
-	rootConfig.get();	// Read all of the config values from EEPROM
+	configStore.load();	// Read all of the config values
+	ESP_LOGD(TIME_FLIES_TAG, "Config loaded from %s in %luus", configStore.getName(), (unsigned long)configStore.getLoadUs());
 	ESP_LOGD(TIME_FLIES_TAG, "Hostname: %s", hostName.value.c_str());
 
+	replicator.setPosition(config_sync_state);
+
 	hostnameParam = new AsyncWiFiManagerParameter("Hostname", "device host name", hostName.value.c_str(), 63);
 }
 
 void setup() {
     Serial.begin(115200);
     Serial.setDebugOutput(true);
-	logger.setUpdateCallback([] (const JsonDocument& doc) { broadcastUpdate(doc); });
+	warmRestart.begin();
+	bootProfile.mark("setup");
+	logger.setUpdateCallback([] (JsonDocument& doc) { broadcastUpdate(doc, StateJournal::LOG); });
+
+	wsClockHandler.setJournal(&stateJournal);
+	wsLEDsHandler.setJournal(&stateJournal);
+	wsExtrasHandler.setJournal(&stateJournal);
+	wsSyncHandler.setJournal(&stateJournal);
 
 	pinMode(COMMAND_PIN, OUTPUT);
 	pinMode(LED_PIN, OUTPUT);
   	Serial1.begin(38400, SERIAL_8N1, RXD, TXD);
 
 	wsMutex = xSemaphoreCreateMutex();
-    sppQueue = xQueueCreate(SPP_QUEUE_SIZE, MAX_MSG_SIZE);
  
 	createSSID();
 
-	EEPROM.begin(2048);
-	initFromEEPROM();
-
-	LittleFS.begin();
+	EEPROM.begin(EEPROM_SIZE);
+	bootProfile.mark("eeprom");
+	LittleFS.begin();	// Before the config, it may live there
+	bootProfile.mark("littlefs");
+	initConfig();
+	bootProfile.mark("config");
 
-	timeSync = new EspSNTPTimeSync(TimeFliesClock::getTimeZone(), asyncTimeSetCallback, NULL);
+	tzTransitions.setTz(TimeFliesClock::getTimeZone().value.c_str());
+	timeSync = new EspSNTPTimeSync(TimeFliesClock::getTimeZone(), ntpTimeSetCallback, NULL);
 	timeSync->init();
+	bootProfile.mark("ntp");
 
+	esp_register_shutdown_handler(commitOnShutdown);
+
+#ifndef UNIFIED_EVENT_LOOP
     xTaskCreatePinnedToCore(
         commitEEPROMTaskFn,   /* Function to implement the task */
         "Commit EEPROM task", /* Name of the task */
-        2048,                 /* Stack size in words */
+        EEPROM_TASK_STACK,    /* Stack size in words */
         NULL,                 /* Task input parameter */
         tskIDLE_PRIORITY,     /* More than background tasks */
         &commitEEPROMTask,    /* Task handle. */
         xPortGetCoreID());
-
-	timeFliesClock.setTimeSync(timeSync);
+#endif
 
 	TimeFliesClock::getTimeOrDate().setCallback(onDisplayChanged);
 	TimeFliesClock::getDateFormat().setCallback(onDateFormatChanged);
@@ -1042,6 +2526,12 @@ void setup() {
 	TimeFliesClock::getEffect().setCallback(onEffectChanged);
 	TimeFliesClock::getRippleDirection().setCallback(onRippleDirectionChanged);
 	TimeFliesClock::getRippleSpeed().setCallback(onRippleSpeedChanged);
+	TimeFliesClock::getDisplayOn().setCallback(onBlankingChanged);
+	TimeFliesClock::getDisplayOff().setCallback(onBlankingChanged);
+	TimeFliesClock::getOffStateOff().setCallback(onBlankingChanged);
+	TimeFliesClock::getSchedule().setCallback(onBlankingChanged);
+	TimeFliesClock::getDimming().setCallback(onBlankingChanged);
+	compileSchedule();
 
 	LEDs::getBacklightRed().setCallback(onRedBacklightsChanged);
 	LEDs::getBacklightGreen().setCallback(onGreenBacklightsChanged);
@@ -1064,29 +2554,61 @@ void setup() {
     wifiManager.setAPCallback(apChange);
     wifiManager.setAPCredentials(ssid.c_str(), "secretsauce");
     wifiManager.start();
+	bootProfile.mark("wifi manager");
 
     configureWebServer();
+	telemetry.begin();
+#ifndef UNIFIED_EVENT_LOOP
+	xTaskCreatePinnedToCore(
+		telemetryTaskFn,
+		"Telemetry task",
+		TELEMETRY_TASK_STACK,
+		NULL,
+		tskIDLE_PRIORITY,
+		&telemetryTask,
+		xPortGetCoreID());
+#endif
+	bootProfile.mark("web server");
 
     xTaskCreatePinnedToCore(
         wifiManagerTaskFn,    /* Function to implement the task */
         "WiFi Manager task",  /* Name of the task */
-        3000,                 /* Stack size in words */
+        WIFI_TASK_STACK,      /* Stack size in words */
         NULL,                 /* Task input parameter */
         tskIDLE_PRIORITY + 2, /* Priority of the task (idle) */
         &wifiManagerTask,     /* Task handle. */
         xPortGetCoreID());
 
 	hostName.setCallback(onHostnameChanged);
-
+	ws_max_clients.setCallback(onMaxClientsChanged);
+	sync_role.setCallback(onSyncConfigChanged);
+	sync_port.setCallback(onSyncConfigChanged);
+	mov_delay.setCallback(onSyncConfigChanged);
+	sync_group.setCallback(onSyncConfigChanged);
+	sync_beacon.setCallback(onSyncConfigChanged);
+	config_sync.setCallback(onSyncConfigChanged);
+	wsClientMonitor.setMaxClients(ws_max_clients);
+
+#ifdef UNIFIED_EVENT_LOOP
+    xTaskCreatePinnedToCore(
+        eventLoopTaskFn,   /* Function to implement the task */
+        "Event loop task", /* Name of the task */
+        EVENT_LOOP_TASK_STACK, /* Stack size in words */
+        NULL,                 /* Task input parameter */
+        tskIDLE_PRIORITY,     /* Like the sync bus and EEPROM tasks it replaces */
+        &eventLoopTask,       /* Task handle. */
+        xPortGetCoreID());
+#endif
     xTaskCreatePinnedToCore(
         sppTaskFn,   /* Function to implement the task */
         "BT SPP task", /* Name of the task */
-        8192,                 /* Stack size in words */
+        SPP_TASK_STACK,       /* Stack size in words */
         NULL,                 /* Task input parameter */
         tskIDLE_PRIORITY + 1,     /* More than background tasks */
         &sppTask,    /* Task handle. */
         xPortGetCoreID());
 
+	bootProfile.mark("tasks");
     logger.log(Logger::DEBUG, "setup() running on core %d", xPortGetCoreID());
 
     vTaskDelete(NULL);	// Delete this task (so loop() won't be called)
@@ -0,0 +1,156 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "BlankingScheduler.h"
+
+#define MONDAY 1704067200	// 2024-01-01 00:00 UTC
+#define AT(day, hour, minute) (MONDAY + (day) * 86400 + (hour) * 3600 + (minute) * 60)
+
+struct Change {
+	time_t at;
+	DisplayState state;
+};
+
+static VirtualTimeSource *virtualTime;
+static MovementSensor *mov;
+static BlankingSchedule *schedule;
+static BlankingScheduler *scheduler;
+
+void setUp() {
+	setenv("TZ", "UTC0", 1);
+	tzset();
+
+	virtualTime = new VirtualTimeSource(MONDAY);
+	mov = new MovementSensor();
+	schedule = new BlankingSchedule();
+	scheduler = new BlankingScheduler(*virtualTime, *mov, *schedule);
+}
+
+void tearDown() {
+	delete scheduler;
+	delete schedule;
+	delete mov;
+	delete virtualTime;
+}
+
+// Sleeps as long as the scheduler says it can, the way the SPP task does
+int run(time_t until, Change *changes, int maxChanges) {
+	int numChanges = 0;
+	DisplayState last = scheduler->state();
+
+	while (virtualTime->now() < until) {
+		virtualTime->advance(scheduler->msUntilChange());
+
+		DisplayState state = scheduler->state();
+		if (state != last && numChanges < maxChanges) {
+			changes[numChanges].at = virtualTime->now();
+			changes[numChanges].state = state;
+			numChanges++;
+		}
+		last = state;
+	}
+
+	return numChanges;
+}
+
+void test_schedule_parsing() {
+	TEST_ASSERT_EQUAL(0, schedule->compile("1-5,12:00-13:00,d;*,23:00-06:30,o", 6, 24, true));
+	TEST_ASSERT_EQUAL(2, schedule->compile("1-5,12:00-13:00,d;8,10:00-11:00;*,25:00-06:00", 6, 24, true));
+
+	uint16_t until;
+	TEST_ASSERT_EQUAL(DISPLAY_DIM, schedule->lookup(MINUTES_PER_DAY + 12 * 60, until));
+	TEST_ASSERT_EQUAL(60, until);
+	TEST_ASSERT_EQUAL(DISPLAY_ON, schedule->lookup(12 * 60, until));	// Not on Sunday
+}
+
+void test_empty_schedule_uses_display_on_off() {
+	schedule->compile("", 6, 22, true);
+
+	uint16_t until;
+	TEST_ASSERT_EQUAL(DISPLAY_OFF, schedule->lookup(5 * 60, until));
+	TEST_ASSERT_EQUAL(60, until);
+	TEST_ASSERT_EQUAL(DISPLAY_ON, schedule->lookup(6 * 60, until));
+	TEST_ASSERT_EQUAL(DISPLAY_OFF, schedule->lookup(22 * 60, until));
+}
+
+void test_week_of_transitions() {
+	schedule->compile("1-5,12:00-13:00,d;*,23:00-06:30,o", 6, 24, true);
+	Change changes[32];
+
+	TEST_ASSERT_EQUAL(DISPLAY_OFF, scheduler->state());
+	int numChanges = run(AT(7, 0, 0), changes, 32);
+
+	// Four a weekday, two at the weekend
+	TEST_ASSERT_EQUAL(24, numChanges);
+	TEST_ASSERT_EQUAL(AT(0, 6, 30), changes[0].at);
+	TEST_ASSERT_EQUAL(DISPLAY_ON, changes[0].state);
+	TEST_ASSERT_EQUAL(AT(0, 12, 0), changes[1].at);
+	TEST_ASSERT_EQUAL(DISPLAY_DIM, changes[1].state);
+	TEST_ASSERT_EQUAL(AT(0, 13, 0), changes[2].at);
+	TEST_ASSERT_EQUAL(DISPLAY_ON, changes[2].state);
+	TEST_ASSERT_EQUAL(AT(0, 23, 0), changes[3].at);
+	TEST_ASSERT_EQUAL(DISPLAY_OFF, changes[3].state);
+	TEST_ASSERT_EQUAL(AT(5, 6, 30), changes[20].at);
+	TEST_ASSERT_EQUAL(AT(5, 23, 0), changes[21].at);
+
+	// The schedule is only looked up again when a transition is due
+	TEST_ASSERT_EQUAL(numChanges + 1, scheduler->getStats().recomputes);
+}
+
+void test_sleeps_are_capped() {
+	schedule->compile("*,23:00-06:30,o", 6, 24, true);
+
+	scheduler->state();
+	TEST_ASSERT_EQUAL(AT(0, 6, 30), scheduler->getNextChange());
+	TEST_ASSERT_EQUAL(BLANKING_MAX_SLEEP, scheduler->msUntilChange());
+
+	virtualTime->set(AT(0, 6, 29));
+	TEST_ASSERT_EQUAL(60000, scheduler->msUntilChange());
+	virtualTime->advance(59500);
+	TEST_ASSERT_EQUAL(1000, scheduler->msUntilChange());	// Whole seconds
+}
+
+void test_movement_timeout() {
+	schedule->compile("1-5,12:00-13:00,d", 6, 24, true);
+	scheduler->setIdleState(DISPLAY_DIM);
+	mov->setEnabled(true);
+	mov->setDelay(1);
+
+	virtualTime->set(AT(0, 10, 0));
+	mov->setOnTime(virtualTime->ms());
+	TEST_ASSERT_EQUAL(DISPLAY_ON, scheduler->state());
+	TEST_ASSERT_EQUAL(60000, scheduler->msUntilChange());
+
+	virtualTime->advance(45000);
+	TEST_ASSERT_EQUAL(15000, scheduler->msUntilChange());
+	virtualTime->advance(15000);
+	TEST_ASSERT_EQUAL(DISPLAY_DIM, scheduler->state());
+
+	// Off beats dim, whatever the movement sensor says
+	scheduler->setIdleState(DISPLAY_OFF);
+	TEST_ASSERT_EQUAL(DISPLAY_OFF, scheduler->state());
+	mov->setOnTime(virtualTime->ms());
+	TEST_ASSERT_EQUAL(DISPLAY_ON, scheduler->state());
+}
+
+void test_time_jump_needs_invalidate() {
+	schedule->compile("*,23:00-06:30,o", 6, 24, true);
+	virtualTime->set(AT(0, 12, 0));
+	TEST_ASSERT_EQUAL(DISPLAY_ON, scheduler->state());
+
+	// Jumping backwards doesn't reach the cached transition
+	virtualTime->set(AT(0, 1, 0));
+	TEST_ASSERT_EQUAL(DISPLAY_ON, scheduler->state());
+	scheduler->invalidate();
+	TEST_ASSERT_EQUAL(DISPLAY_OFF, scheduler->state());
+}
+
+int main(int argc, char **argv) {
+	UNITY_BEGIN();
+	RUN_TEST(test_schedule_parsing);
+	RUN_TEST(test_empty_schedule_uses_display_on_off);
+	RUN_TEST(test_week_of_transitions);
+	RUN_TEST(test_sleeps_are_capped);
+	RUN_TEST(test_movement_timeout);
+	RUN_TEST(test_time_jump_needs_invalidate);
+	return UNITY_END();
+}
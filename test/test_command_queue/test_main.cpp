@@ -0,0 +1,115 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "CommandQueue.h"
+
+static CommandQueue *queue;
+
+void setUp() {
+	queue = new CommandQueue();
+}
+
+void tearDown() {
+	delete queue;
+}
+
+void test_urgent_goes_first() {
+	char msg[MAX_MSG_SIZE];
+
+	queue->push("0x13,$LED2,R,5***", CommandQueue::NORMAL);
+	queue->push("0x13,$TIME,12:00:00***", CommandQueue::URGENT);
+
+	TEST_ASSERT_TRUE(queue->pop(msg));
+	TEST_ASSERT_EQUAL_STRING("0x13,$TIME,12:00:00***", msg);
+	TEST_ASSERT_TRUE(queue->pop(msg));
+	TEST_ASSERT_EQUAL_STRING("0x13,$LED2,R,5***", msg);
+	TEST_ASSERT_FALSE(queue->pop(msg));
+}
+
+void test_led_commands_coalesce() {
+	char msg[MAX_MSG_SIZE];
+
+	queue->push("0x13,$LED2,R,5***", CommandQueue::NORMAL);
+	queue->push("0x13,$LED2,G,1***", CommandQueue::NORMAL);
+	queue->push("0x13,$LED2,R,7***", CommandQueue::NORMAL);
+
+	TEST_ASSERT_EQUAL(2, queue->depth(CommandQueue::NORMAL));
+	TEST_ASSERT_EQUAL(1, queue->getStats().coalesced);
+
+	// The newer value takes the older one's place in the queue
+	TEST_ASSERT_TRUE(queue->pop(msg));
+	TEST_ASSERT_EQUAL_STRING("0x13,$LED2,R,7***", msg);
+	TEST_ASSERT_TRUE(queue->pop(msg));
+	TEST_ASSERT_EQUAL_STRING("0x13,$LED2,G,1***", msg);
+}
+
+void test_only_normal_led_commands_coalesce() {
+	queue->push("0x13,$LED2,R,5***", CommandQueue::URGENT);
+	queue->push("0x13,$LED2,R,7***", CommandQueue::URGENT);
+	queue->push("0x13,$DISP,1***", CommandQueue::NORMAL);
+	queue->push("0x13,$DISP,1***", CommandQueue::NORMAL);
+
+	TEST_ASSERT_EQUAL(2, queue->depth(CommandQueue::URGENT));
+	TEST_ASSERT_EQUAL(2, queue->depth(CommandQueue::NORMAL));
+	TEST_ASSERT_EQUAL(0, queue->getStats().coalesced);
+}
+
+void test_full_queue_drops() {
+	char msg[MAX_MSG_SIZE];
+
+	for (int i=0; i < SPP_QUEUE_SIZE; i++) {
+		snprintf(msg, sizeof(msg), "0x13,$LED%d,R,5***", i);
+		TEST_ASSERT_TRUE(queue->push(msg, CommandQueue::NORMAL));
+	}
+
+	TEST_ASSERT_EQUAL(0, queue->spaces(CommandQueue::NORMAL));
+	TEST_ASSERT_FALSE(queue->push("0x13,$DISP,1***", CommandQueue::NORMAL));
+	TEST_ASSERT_EQUAL(1, queue->getStats().dropped);
+
+	// Still coalesces when full, and the other priority has its own room
+	TEST_ASSERT_TRUE(queue->push("0x13,$LED3,R,9***", CommandQueue::NORMAL));
+	TEST_ASSERT_TRUE(queue->push("0x13,$DISP,1***", CommandQueue::URGENT));
+
+	TEST_ASSERT_TRUE(queue->pop(msg));
+	TEST_ASSERT_EQUAL_STRING("0x13,$DISP,1***", msg);
+	for (int i=0; i < 4; i++) {
+		queue->pop(msg);
+	}
+	TEST_ASSERT_EQUAL_STRING("0x13,$LED3,R,9***", msg);
+}
+
+void test_long_commands_are_truncated() {
+	char msg[MAX_MSG_SIZE];
+	char longMsg[MAX_MSG_SIZE * 2];
+
+	memset(longMsg, 'x', sizeof(longMsg) - 1);
+	longMsg[sizeof(longMsg) - 1] = 0;
+
+	TEST_ASSERT_TRUE(queue->push(longMsg, CommandQueue::NORMAL));
+	TEST_ASSERT_TRUE(queue->pop(msg));
+	TEST_ASSERT_EQUAL(MAX_MSG_SIZE - 1, strlen(msg));
+}
+
+void test_push_all_splits_commands() {
+	char msg[MAX_MSG_SIZE];
+
+	TEST_ASSERT_EQUAL(3, queue->pushAll("0x13,$BIT7,0***;;0x13,$BIT6,1***;0x13,$BIT5,1***;", CommandQueue::URGENT));
+
+	TEST_ASSERT_TRUE(queue->pop(msg));
+	TEST_ASSERT_EQUAL_STRING("0x13,$BIT7,0***", msg);
+	TEST_ASSERT_TRUE(queue->pop(msg));
+	TEST_ASSERT_EQUAL_STRING("0x13,$BIT6,1***", msg);
+	TEST_ASSERT_TRUE(queue->pop(msg));
+	TEST_ASSERT_EQUAL_STRING("0x13,$BIT5,1***", msg);
+	TEST_ASSERT_FALSE(queue->pop(msg));
+}
+
+int main(int argc, char **argv) {
+	UNITY_BEGIN();
+	RUN_TEST(test_urgent_goes_first);
+	RUN_TEST(test_led_commands_coalesce);
+	RUN_TEST(test_only_normal_led_commands_coalesce);
+	RUN_TEST(test_full_queue_drops);
+	RUN_TEST(test_long_commands_are_truncated);
+	RUN_TEST(test_push_all_splits_commands);
+	return UNITY_END();
+}
@@ -0,0 +1,246 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "ConfigReplicator.h"
+
+#define NUM_CLOCK 10
+#define NUM_LEDS 12
+
+// The same shape as what main.cpp replicates
+static const char *clockNames[NUM_CLOCK] = {
+	"date_format", "time_or_date", "hour_format", "display_on", "display_off",
+	"off_state_off", "time_zone", "effect", "ripple_direction", "ripple_speed"
+};
+
+static const char *ledNames[NUM_LEDS] = {
+	"backlights", "backlight_red", "backlight_green", "backlight_blue",
+	"underlights", "underlight_red", "underlight_green", "underlight_blue",
+	"baselights", "baselight_red", "baselight_green", "baselight_blue"
+};
+
+struct Node {
+	SyncProtocol protocol;
+	StateJournal journal;
+	BaseConfigItem *clockSet[NUM_CLOCK + 1] = {};
+	BaseConfigItem *ledsSet[NUM_LEDS + 1] = {};
+	StringConfigItem schedule;
+	IntConfigItem dimming;
+	BaseConfigItem *blankingSet[3] = { &schedule, &dimming, 0 };
+	CompositeConfigItem clock;
+	CompositeConfigItem leds;
+	CompositeConfigItem blanking;
+	BaseConfigItem *composites[4] = { &clock, &leds, &blanking, 0 };
+	ConfigReplicator replicator;
+	String position;
+	int frames = 0;
+
+	Node(uint32_t id) :
+		protocol(id, id),
+		schedule("schedule", 127, ""),
+		dimming("dimming", 2),
+		clock("clock", 0, clockSet),
+		leds("leds", 0, ledsSet),
+		blanking("blanking", 0, blankingSet),
+		replicator(protocol, journal, composites,
+			[](BaseConfigItem *item, const String &value) { item->fromString(value); },
+			[this](const String &position) { this->position = position; }) {
+		for (int i=0; i < NUM_CLOCK; i++) {
+			if (i == 6) {
+				clockSet[i] = new StringConfigItem(clockNames[i], 63, "EST5EDT,M3.2.0,M11.1.0");
+			} else {
+				clockSet[i] = new ByteConfigItem(clockNames[i], 0);
+			}
+		}
+		for (int i=0; i < NUM_LEDS; i++) {
+			ledsSet[i] = new ByteConfigItem(ledNames[i], 0);
+		}
+	}
+
+	~Node() {
+		for (int i=0; clockSet[i] != 0; i++) {
+			delete clockSet[i];
+		}
+		for (int i=0; ledsSet[i] != 0; i++) {
+			delete ledsSet[i];
+		}
+	}
+
+	BaseConfigItem *item(const char *name) {
+		for (int i=0; composites[i] != 0; i++) {
+			BaseConfigItem **set = static_cast<CompositeConfigItem*>(composites[i])->value;
+			for (int j=0; set[j] != 0; j++) {
+				if (strcmp(set[j]->name, name) == 0) {
+					return set[j];
+				}
+			}
+		}
+
+		return 0;
+	}
+
+	void change(const char *name, const String &value) {
+		item(name)->fromString(value);
+		journal.record(StateJournal::CONFIG, item(name));
+	}
+};
+
+static Node *leader;
+static Node *follower;
+static uint32_t now;
+
+void setUp() {
+	now = millis();	// setRole() reads millis()
+	leader = new Node(1);
+	follower = new Node(2);
+	leader->replicator.setRole(ConfigReplicator::LEADER);
+	follower->replicator.setRole(ConfigReplicator::FOLLOWER);
+}
+
+void tearDown() {
+	delete follower;
+	delete leader;
+}
+
+void deliver(Node &from, Node &to) {
+	uint8_t frame[SYNC_MAX_FRAME];
+	size_t len;
+
+	while ((len = from.protocol.takeFrame(frame, sizeof(frame))) > 0) {
+		from.frames++;
+		to.protocol.parse(frame, len, now, [&to](uint32_t sender, SyncProtocol::EventType type, const uint8_t *data, uint8_t len) {
+			to.replicator.onEvent(sender, type, data, len, now);
+		});
+	}
+}
+
+// Both sync bus tasks, with every frame arriving
+void run(uint32_t ms) {
+	for (uint32_t end = now + ms; (int32_t)(end - now) > 0; now += REPLICATION_PACE) {
+		leader->replicator.loop(now);
+		deliver(*leader, *follower);
+		follower->replicator.loop(now);
+		deliver(*follower, *leader);
+	}
+}
+
+void assertSame() {
+	for (int i=0; leader->composites[i] != 0; i++) {
+		BaseConfigItem **set = static_cast<CompositeConfigItem*>(leader->composites[i])->value;
+		for (int j=0; set[j] != 0; j++) {
+			TEST_ASSERT_EQUAL_STRING_MESSAGE(set[j]->toString().c_str(), follower->item(set[j]->name)->toString().c_str(), set[j]->name);
+		}
+	}
+}
+
+void setLeaderValues() {
+	for (int i=0; i < NUM_LEDS; i++) {
+		leader->ledsSet[i]->fromString(String(i + 1));
+	}
+	leader->item("date_format")->fromString("1");
+	leader->item("time_zone")->fromString("CET-1CEST,M3.5.0,M10.5.0/3");
+	leader->dimming.fromString("1");
+
+	// The longest value there is
+	String schedule = "1-5,12:00-13:00,d";
+	while (schedule.length() + 15 <= 127) {
+		schedule += ";*,23:00-06:30,o";
+	}
+	while (schedule.length() < 127) {
+		schedule += " ";
+	}
+	leader->schedule.fromString(schedule);
+}
+
+void test_full_transfer() {
+	setLeaderValues();
+	run(REPLICATION_SETTLE * 3);
+
+	assertSame();
+	TEST_ASSERT_EQUAL(127, follower->schedule.toString().length());
+	TEST_ASSERT_EQUAL(1, leader->replicator.getStats().fullTransfers);
+	TEST_ASSERT_EQUAL(NUM_CLOCK + NUM_LEDS + 2, leader->replicator.getStats().deltasOut);
+	TEST_ASSERT_EQUAL(NUM_CLOCK + NUM_LEDS + 2, follower->replicator.getStats().deltasIn);
+	TEST_ASSERT_GREATER_THAN(1, leader->frames);	// More than the outbox holds
+	TEST_ASSERT_FALSE(leader->replicator.isTransferring());
+
+	// The batch was complete, so the follower has nothing more to ask for
+	TEST_ASSERT_TRUE(follower->position.startsWith("00000001:"));
+	run(REPLICATION_RETRY * 3);
+	TEST_ASSERT_EQUAL(1, follower->replicator.getStats().requests);
+}
+
+void test_changes_follow_incrementally() {
+	run(REPLICATION_SETTLE * 3);
+	TEST_ASSERT_TRUE(follower->position.startsWith("00000001:"));
+
+	leader->change("backlight_red", "5");
+	leader->change("backlight_red", "6");
+	leader->change("time_zone", "JST-9");
+	run(REPLICATION_PACE * 5);
+
+	assertSame();
+	TEST_ASSERT_EQUAL(1, leader->replicator.getStats().fullTransfers);
+	TEST_ASSERT_EQUAL(NUM_CLOCK + NUM_LEDS + 2 + 2, follower->replicator.getStats().deltasIn);	// backlight_red once
+
+	char position[27];
+	snprintf(position, sizeof(position), "%08lx:%08lx:%08lx", 1UL, (unsigned long)leader->journal.getEpoch(), (unsigned long)leader->journal.getVersion());
+	TEST_ASSERT_EQUAL_STRING(position, follower->position.c_str());
+}
+
+void test_value_too_long_doesnt_stall() {
+	setLeaderValues();
+	String tooLong;
+	while (tooLong.length() < SYNC_MAX_EVENT) {
+		tooLong += "*,23:00-06:30,o;";
+	}
+	leader->schedule.value = tooLong;
+
+	run(REPLICATION_SETTLE * 3);
+
+	// Everything else arrives and the batch still counts as complete
+	TEST_ASSERT_EQUAL(NUM_CLOCK + NUM_LEDS + 1, follower->replicator.getStats().deltasIn);
+	TEST_ASSERT_EQUAL_STRING("CET-1CEST,M3.5.0,M10.5.0/3", follower->item("time_zone")->toString().c_str());
+	TEST_ASSERT_TRUE(follower->position.startsWith("00000001:"));
+	run(REPLICATION_RETRY * 3);
+	TEST_ASSERT_EQUAL(1, follower->replicator.getStats().requests);
+}
+
+void test_deltas_only_from_leader() {
+	run(REPLICATION_SETTLE * 3);
+	TEST_ASSERT_TRUE(follower->position.startsWith("00000001:"));
+
+	// A second bridge set up as leader by mistake
+	Node other(3);
+	other.replicator.setRole(ConfigReplicator::LEADER);
+	other.replicator.loop(now);
+	other.change("backlight_red", "9");
+	other.replicator.loop(now);
+	deliver(other, *follower);
+
+	TEST_ASSERT_EQUAL_STRING("0", follower->item("backlight_red")->toString().c_str());
+	TEST_ASSERT_TRUE(follower->position.startsWith("00000001:"));
+}
+
+void test_new_leader_takes_over() {
+	run(REPLICATION_SETTLE * 3);
+	TEST_ASSERT_TRUE(follower->position.startsWith("00000001:"));
+
+	delete leader;
+	leader = new Node(3);
+	leader->replicator.setRole(ConfigReplicator::LEADER);
+	setLeaderValues();
+	follower->replicator.setRole(ConfigReplicator::FOLLOWER);	// Restarted, still remembering bridge 1
+	run(REPLICATION_RETRY * 4);
+
+	assertSame();
+	TEST_ASSERT_TRUE(follower->position.startsWith("00000003:"));
+}
+
+int main(int argc, char **argv) {
+	UNITY_BEGIN();
+	RUN_TEST(test_full_transfer);
+	RUN_TEST(test_changes_follow_incrementally);
+	RUN_TEST(test_value_too_long_doesnt_stall);
+	RUN_TEST(test_deltas_only_from_leader);
+	RUN_TEST(test_new_leader_takes_over);
+	return UNITY_END();
+}
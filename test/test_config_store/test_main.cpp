@@ -0,0 +1,149 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <EEPROM.h>
+#include "ConfigStore.h"
+#include "JournalConfigStore.h"
+#include "LEDs.h"
+
+#define EEPROM_SIZE 2048	// As in main.cpp
+#define COMMITS 200
+
+// The real config tree and legacy store from main.cpp
+extern CompositeConfigItem rootConfig;
+extern BaseConfigItem* rootConfigSet[];
+extern EEPROMConfigStore eepromStore;
+
+static char dir[] = "/tmp/timeflies_config_XXXXXX";
+static String eepromPath;
+static fs::FS *journalFs;
+
+struct Cost {
+	uint32_t loadUs;
+	uint32_t commitUs;
+	uint32_t bytes;
+};
+
+/*
+ * What the UI does when one value changes: write it to the item, then persist just that item
+ */
+static Cost measure(ConfigStore &store) {
+	Cost cost;
+
+	store.load();
+	cost.loadUs = store.getLoadUs();
+
+	ByteConfigItem &item = LEDs::getBacklightRed();
+	const BaseConfigItem *items[] = { &item };
+	uint32_t bytesBefore = store.getBytesWritten();
+
+	unsigned long start = micros();
+	for (int i=0; i < COMMITS; i++) {
+		item.value = i & 7;
+		item.put();
+		store.commit(items, 1, false);
+		store.maintain();
+	}
+	cost.commitUs = (micros() - start) / COMMITS;
+	cost.bytes = (store.getBytesWritten() - bytesBefore) / COMMITS;
+
+	return cost;
+}
+
+static void report(ConfigStore &store, const Cost &cost) {
+	char line[96];
+	snprintf(line, sizeof(line), "%-8s load %6luus  commit %6luus  %5lu bytes/commit", store.getName(),
+		(unsigned long)cost.loadUs, (unsigned long)cost.commitUs, (unsigned long)cost.bytes);
+	TEST_MESSAGE(line);
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+void test_commit_cost(void) {
+	JournalConfigStore journal(*journalFs, rootConfig, rootConfigSet, eepromStore);
+
+	Cost eeprom = measure(eepromStore);
+	report(eepromStore, eeprom);
+	Cost log = measure(journal);
+	report(journal, log);
+
+	// Compactions are included, spread over the commits that caused them
+	TEST_ASSERT_EQUAL(EEPROM_SIZE, eeprom.bytes);
+	TEST_ASSERT_TRUE(journal.getCompactions() > 0);
+	TEST_ASSERT_TRUE(log.bytes < eeprom.bytes / 10);
+}
+
+void test_journal_reload(void) {
+	ByteConfigItem &item = LEDs::getBacklightRed();
+	const BaseConfigItem *items[] = { &item };
+
+	JournalConfigStore journal(*journalFs, rootConfig, rootConfigSet, eepromStore);
+	journal.load();
+	item.value = 5;
+	journal.commit(items, 1, false);
+
+	item.value = 0;
+	JournalConfigStore reloaded(*journalFs, rootConfig, rootConfigSet, eepromStore);
+	reloaded.load();
+	TEST_ASSERT_EQUAL(5, item.value);
+}
+
+void test_damaged_record(void) {
+	ByteConfigItem &item = LEDs::getBacklightRed();
+	const BaseConfigItem *items[] = { &item };
+
+	JournalConfigStore journal(*journalFs, rootConfig, rootConfigSet, eepromStore);
+	journal.load();
+	item.value = 6;
+	journal.commit(items, 1, false);
+
+	// Power lost part way through the next record
+	fs::File file = journalFs->open(CONFIG_JOURNAL_FILE, "a");
+	const uint8_t partial[] = { 13, 'b', 'a', 'c', 'k' };
+	file.write(partial, sizeof(partial));
+	file.close();
+
+	item.value = 0;
+	JournalConfigStore reloaded(*journalFs, rootConfig, rootConfigSet, eepromStore);
+	reloaded.load();
+	TEST_ASSERT_EQUAL(6, item.value);
+
+	// The damaged tail was compacted away, so later commits survive a reload
+	item.value = 3;
+	reloaded.commit(items, 1, false);
+	item.value = 0;
+	JournalConfigStore again(*journalFs, rootConfig, rootConfigSet, eepromStore);
+	again.load();
+	TEST_ASSERT_EQUAL(3, item.value);
+}
+
+int main(int argc, char **argv) {
+	if (mkdtemp(dir) == NULL) {
+		return 1;
+	}
+	eepromPath = String(dir) + "/eeprom.bin";
+	setenv("TIMEFLIES_EEPROM", eepromPath.c_str(), 1);
+	EEPROM.begin(EEPROM_SIZE);
+	journalFs = new fs::FS(dir);
+
+	UNITY_BEGIN();
+	RUN_TEST(test_commit_cost);
+	RUN_TEST(test_journal_reload);
+	RUN_TEST(test_damaged_record);
+	int failures = UNITY_END();
+
+	EEPROM.end();
+	delete journalFs;
+	const char *files[] = { "/eeprom.bin", CONFIG_SNAPSHOT_FILE, CONFIG_JOURNAL_FILE, CONFIG_COMPACT_TMP_FILE };
+	for (const char *file : files) {
+		unlink((String(dir) + file).c_str());
+	}
+	rmdir(dir);
+
+	return failures;
+}
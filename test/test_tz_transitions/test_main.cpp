@@ -0,0 +1,82 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "TzTransitions.h"
+
+#define NEW_YEAR_2024 1704067200
+#define DST_START_2024 1710054000	// 2024-03-10 07:00 UTC, 2am EST
+#define DST_END_2024 1730613600		// 2024-11-03 06:00 UTC, 2am EDT
+
+static TzTransitions *tz;
+
+void setUp() {
+	tz = new TzTransitions();
+}
+
+void tearDown() {
+	delete tz;
+}
+
+void test_us_eastern_rules() {
+	int32_t offset;
+	bool isDst;
+
+	TEST_ASSERT_TRUE(tz->setTz("EST5EDT,M3.2.0,M11.1.0"));
+	TEST_ASSERT_TRUE(tz->hasDst());
+	TEST_ASSERT_EQUAL(-5 * 3600, tz->getStdOffset());
+
+	TEST_ASSERT_EQUAL(DST_START_2024, tz->nextTransition(NEW_YEAR_2024));
+	TEST_ASSERT_EQUAL(DST_END_2024, tz->nextTransition(DST_START_2024));
+
+	TEST_ASSERT_TRUE(tz->lookup(DST_START_2024 - 1, offset, isDst));
+	TEST_ASSERT_EQUAL(-5 * 3600, offset);
+	TEST_ASSERT_FALSE(isDst);
+
+	TEST_ASSERT_TRUE(tz->lookup(DST_START_2024, offset, isDst));
+	TEST_ASSERT_EQUAL(-4 * 3600, offset);
+	TEST_ASSERT_TRUE(isDst);
+
+	TEST_ASSERT_TRUE(tz->lookup(DST_END_2024, offset, isDst));
+	TEST_ASSERT_EQUAL(-5 * 3600, offset);
+	TEST_ASSERT_FALSE(isDst);
+}
+
+void test_no_dst() {
+	TEST_ASSERT_TRUE(tz->setTz("JST-9"));
+	TEST_ASSERT_FALSE(tz->hasDst());
+	TEST_ASSERT_EQUAL(9 * 3600, tz->getStdOffset());
+	TEST_ASSERT_EQUAL(0, tz->nextTransition(NEW_YEAR_2024));
+	TEST_ASSERT_EQUAL(UINT32_MAX, tz->msUntilDue(NEW_YEAR_2024));
+}
+
+void test_bad_string() {
+	TEST_ASSERT_FALSE(tz->setTz("EST5EDT,M3.2"));
+	TEST_ASSERT_EQUAL(0, tz->nextTransition(NEW_YEAR_2024));
+}
+
+void test_due_once_per_transition() {
+	tz->setTz("EST5EDT,M3.2.0,M11.1.0");
+
+	TEST_ASSERT_FALSE(tz->due(DST_START_2024 - 60));	// Works out the next push
+	TEST_ASSERT_EQUAL(61000, tz->msUntilDue(DST_START_2024 - 60));
+	TEST_ASSERT_FALSE(tz->due(DST_START_2024));
+	TEST_ASSERT_TRUE(tz->due(DST_START_2024 + TZ_PUSH_DELAY));
+	TEST_ASSERT_FALSE(tz->due(DST_START_2024 + TZ_PUSH_DELAY + 1));
+}
+
+void test_distant_transition_doesnt_wrap() {
+	tz->setTz("EST5EDT,M3.2.0,M11.1.0");
+
+	// Over 49 days away is more milliseconds than uint32_t holds
+	tz->due(NEW_YEAR_2024);
+	TEST_ASSERT_EQUAL(UINT32_MAX / 1000 * 1000, tz->msUntilDue(NEW_YEAR_2024));
+}
+
+int main(int argc, char **argv) {
+	UNITY_BEGIN();
+	RUN_TEST(test_us_eastern_rules);
+	RUN_TEST(test_no_dst);
+	RUN_TEST(test_bad_string);
+	RUN_TEST(test_due_once_per_transition);
+	RUN_TEST(test_distant_transition_doesnt_wrap);
+	return UNITY_END();
+}
@@ -0,0 +1,436 @@
+#!/usr/bin/env python3
+"""
+Plays the SPP server and the clock on the other end of the bridge's Serial1.
+
+Start the native build and give this the pty it logs, or let this start it:
+
+    tools/clock_emulator.py /dev/pts/3
+    tools/clock_emulator.py --bridge .pio/build/native/program --duration 120
+
+AT commands are answered the way SPPServer answers them. Clock commands
+(0x13,$...***) go into a model of the clock's state, one at a time, each taking
+--processing-ms. Commands can be dropped, the link can go down, and replies
+can be late. When it stops (--duration, Ctrl-C or the bridge exiting) it
+reports throughput, how the final state differs from --expect and how far
+out the clock's time was set.
+
+--expect is either a JSON state, as written by --dump, or a file of clock
+commands, which are applied to an empty clock to get the state wanted.
+"""
+
+import argparse
+import calendar
+import heapq
+import json
+import os
+import random
+import re
+import select
+import signal
+import subprocess
+import sys
+import time
+import tty
+
+NOT_CONNECTED = 1
+CONNECTING = 3
+CONNECTED = 4
+
+COMMAND = re.compile(r'^0x13,\$([A-Z]+)(\d*)((?:,[^,*]*)*)\*\*\*$')
+
+
+class Clock:
+    """What the clock would be showing, as key -> value."""
+
+    def __init__(self):
+        self.state = {}
+
+    def apply(self, line):
+        """Returns the values of a $TIM command, None for anything else, and raises ValueError if it isn't a command."""
+        m = COMMAND.match(line)
+        if not m:
+            raise ValueError(line)
+
+        name, index, args = m.group(1), m.group(2), m.group(3).split(',')[1:]
+        if name == 'BIT' and len(args) == 1:
+            self.state['BIT' + index] = args[0]
+        elif name == 'LED' and len(args) == 2:
+            self.state['LED%s.%s' % (index, args[0])] = args[1]
+        elif name == 'TIM' and len(args) == 6:
+            return [int(a) for a in args]
+        else:
+            self.state[name + index] = ','.join(args)
+
+        return None
+
+
+def load_expected(path):
+    with open(path) as f:
+        text = f.read()
+
+    try:
+        return json.loads(text)
+    except ValueError:
+        clock = Clock()
+        for command in re.split(r'[;\n]', text):
+            command = command.strip()
+            if command and not command.startswith('#'):
+                clock.apply(command)
+        return clock.state
+
+
+def diff_states(expected, actual):
+    diffs = {}
+    for key in sorted(set(expected) | set(actual)):
+        if expected.get(key) != actual.get(key):
+            diffs[key] = {'expected': expected.get(key), 'actual': actual.get(key)}
+    return diffs
+
+
+def summarise(values):
+    if not values:
+        return None
+
+    values = sorted(values)
+    return {
+        'count': len(values),
+        'min': values[0],
+        'mean': sum(values) / len(values),
+        'p50': values[len(values) // 2],
+        'p95': values[min(len(values) - 1, int(len(values) * 0.95))],
+        'max': values[-1],
+    }
+
+
+class Emulator:
+    def __init__(self, fd, args):
+        self.fd = fd
+        self.args = args
+        self.clock = Clock()
+        self.events = []        # (when, seq, fn)
+        self.seq = 0
+        self.buf = b''
+
+        self.link = NOT_CONNECTED if args.start_disconnected else CONNECTED
+        self.clock_free_at = 0.0     # When the clock finishes what it's doing
+        self.clock_pending = 0
+        self.next_disconnect = self.disconnect_due(time.monotonic())
+
+        self.at_counts = {}
+        self.received = 0
+        self.applied = 0
+        self.dropped = 0
+        self.lost = 0           # Sent while the link was down
+        self.overflowed = 0     # More than --clock-buffer waiting
+        self.malformed = 0
+        self.disconnects = 0
+        self.first_command = None
+        self.last_command = None
+        self.queue_ms = []
+        self.time_errors = []
+
+    def disconnect_due(self, now):
+        if self.args.disconnect_every <= 0:
+            return None
+        return now + random.expovariate(1.0 / self.args.disconnect_every)
+
+    def later(self, delay, fn):
+        self.seq += 1
+        heapq.heappush(self.events, (time.monotonic() + delay, self.seq, fn))
+
+    def jitter(self):
+        return random.uniform(0, self.args.jitter_ms) / 1000.0
+
+    def send(self, text):
+        try:
+            os.write(self.fd, (text + '\r\n').encode())
+        except OSError:
+            pass
+
+    def reply_at(self, *lines):
+        def fn():
+            for line in lines:
+                self.send(line)
+        self.later(self.args.at_ms / 1000.0 + self.jitter(), fn)
+
+    def connected(self):
+        self.link = CONNECTED
+        self.next_disconnect = self.disconnect_due(time.monotonic())
+
+    def handle_at(self, line):
+        command = line.split('=')[0]
+        self.at_counts[command] = self.at_counts.get(command, 0) + 1
+
+        if command == 'AT+STATE':
+            self.reply_at(str(self.link), 'OK')
+        elif command == 'AT+CONNECT':
+            if self.link == NOT_CONNECTED:
+                self.link = CONNECTING
+                self.later(self.args.connect_ms / 1000.0 + self.jitter(), self.connected)
+            self.reply_at('OK')
+        elif command == 'AT+DISCONNECT':
+            self.link = NOT_CONNECTED
+            self.reply_at('OK')
+        else:
+            # AT+RNAME and anything else SPPServer knows
+            self.reply_at('OK')
+
+    def handle_command(self, line):
+        now = time.monotonic()
+        self.received += 1
+        if self.first_command is None:
+            self.first_command = now
+        self.last_command = now
+
+        if self.link != CONNECTED:
+            self.lost += 1
+            return
+
+        if random.random() < self.args.drop_rate:
+            self.dropped += 1
+            return
+
+        if self.args.clock_buffer > 0 and self.clock_pending >= self.args.clock_buffer:
+            self.overflowed += 1
+            return
+
+        # The clock works through commands one at a time
+        start = max(now, self.clock_free_at)
+        done = start + self.args.processing_ms / 1000.0 + self.jitter()
+        self.clock_free_at = done
+        self.clock_pending += 1
+
+        def apply():
+            self.clock_pending -= 1
+            self.queue_ms.append((start - now) * 1000.0)
+            try:
+                tim = self.clock.apply(line)
+            except ValueError:
+                self.malformed += 1
+                return
+
+            self.applied += 1
+            if tim is not None:
+                self.time_errors.append(self.time_error(tim))
+            if self.args.reply:
+                self.send(self.args.reply)
+
+        self.later(done - now, apply)
+
+    def utc_offset(self):
+        """Hours the clock thinks it is from UTC, from $PSU and $BIT13 as the clock has them."""
+        psu = self.clock.state.get('PSU', '').split(',')
+        tzo = int(psu[2]) if len(psu) == 4 and psu[2].isdigit() else 0
+        if tzo > 12:
+            tzo = 12 - tzo      # 13-23 are -1 to -11
+        return tzo + (1 if self.clock.state.get('BIT13') == '1' else 0)
+
+    def time_error(self, tim):
+        """Seconds the clock is ahead (+) or behind (-) once the time is set."""
+        hour, minute, sec, mday, mon, year = tim
+        if year < 100:
+            year += 100     # tm_year, or two digits
+        local = calendar.timegm((year + 1900, mon + 1, mday, hour, minute, sec, 0, 0, 0))
+        return local - self.utc_offset() * 3600 - time.time()
+
+    def handle_line(self, line):
+        line = line.strip()
+        if not line:
+            return
+
+        if self.args.verbose:
+            print('< ' + line, file=sys.stderr)
+
+        if line.startswith('AT'):
+            self.handle_at(line)
+        elif line.startswith('0x13'):
+            self.handle_command(line)
+        else:
+            self.malformed += 1
+
+    def step(self, timeout):
+        now = time.monotonic()
+        if self.next_disconnect is not None and now >= self.next_disconnect and self.link == CONNECTED:
+            self.disconnects += 1
+            self.link = NOT_CONNECTED
+            self.next_disconnect = None
+
+        wait = timeout
+        if self.events:
+            wait = min(wait, max(0, self.events[0][0] - now))
+        if self.next_disconnect is not None:
+            wait = min(wait, max(0, self.next_disconnect - now))
+
+        readable, _, _ = select.select([self.fd], [], [], wait)
+        if readable:
+            try:
+                data = os.read(self.fd, 4096)
+            except OSError:
+                data = b''
+            if not data:
+                return False
+            self.buf += data
+            while b'\n' in self.buf:
+                line, self.buf = self.buf.split(b'\n', 1)
+                self.handle_line(line.decode(errors='replace'))
+
+        now = time.monotonic()
+        while self.events and self.events[0][0] <= now:
+            _, _, fn = heapq.heappop(self.events)
+            fn()
+
+        return True
+
+    def report(self, elapsed):
+        active = (self.last_command - self.first_command) if self.first_command is not None else 0
+        result = {
+            'elapsed_s': round(elapsed, 3),
+            'commands': {
+                'received': self.received,
+                'applied': self.applied,
+                'dropped': self.dropped,
+                'lost_disconnected': self.lost,
+                'overflowed': self.overflowed,
+                'malformed': self.malformed,
+                'per_second': round(self.received / active, 3) if active > 0 else None,
+                'clock_queue_ms': summarise(self.queue_ms),
+            },
+            'at_commands': self.at_counts,
+            'disconnects': self.disconnects,
+            'time_set_error_s': summarise(self.time_errors),
+            'state': self.clock.state,
+        }
+
+        if self.args.expect:
+            result['state_diff'] = diff_states(load_expected(self.args.expect), self.clock.state)
+
+        return result
+
+
+def print_report(report):
+    c = report['commands']
+    print('Ran for %.1fs, %d disconnect(s)' % (report['elapsed_s'], report['disconnects']))
+    print('Commands: %d received, %d applied, %d dropped, %d lost while disconnected, %d overflowed, %d malformed' %
+        (c['received'], c['applied'], c['dropped'], c['lost_disconnected'], c['overflowed'], c['malformed']))
+    if c['per_second'] is not None:
+        print('Throughput: %.2f commands/s' % c['per_second'])
+    if c['clock_queue_ms']:
+        q = c['clock_queue_ms']
+        print('Waiting for the clock: mean %.0fms, p95 %.0fms, max %.0fms' % (q['mean'], q['p95'], q['max']))
+    print('AT commands: ' + (', '.join('%s %d' % kv for kv in sorted(report['at_commands'].items())) or 'none'))
+
+    t = report['time_set_error_s']
+    if t:
+        print('Time set %d time(s), error: mean %+.3fs, min %+.3fs, max %+.3fs' % (t['count'], t['mean'], t['min'], t['max']))
+    else:
+        print('Time never set')
+
+    if 'state_diff' in report:
+        diff = report['state_diff']
+        if not diff:
+            print('State matches')
+        else:
+            print('State differs in %d item(s):' % len(diff))
+            for key, d in diff.items():
+                print('  %s: expected %s, got %s' % (key, d['expected'], d['actual']))
+
+
+def open_port(path):
+    fd = os.open(path, os.O_RDWR | os.O_NOCTTY)
+    tty.setraw(fd)
+    return fd
+
+
+def start_bridge(command):
+    bridge = subprocess.Popen(command, shell=True, stderr=subprocess.PIPE, start_new_session=True)
+    pattern = re.compile(rb'Serial1 \(\d+ baud\) is (\S+)')
+    deadline = time.monotonic() + 10
+    while time.monotonic() < deadline:
+        line = bridge.stderr.readline()
+        if not line:
+            break
+        sys.stderr.buffer.write(line)
+        m = pattern.search(line)
+        if m:
+            return bridge, m.group(1).decode()
+
+    bridge.kill()
+    sys.exit('The bridge never said where Serial1 is')
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('port', nargs='?', help="the bridge's Serial1 pty")
+    parser.add_argument('--bridge', help='command that starts the native build, instead of giving a port')
+    parser.add_argument('--duration', type=float, default=0, help='seconds to run for, 0 for until Ctrl-C')
+    parser.add_argument('--processing-ms', type=float, default=50, help='time the clock takes over each command')
+    parser.add_argument('--clock-buffer', type=int, default=0, help='commands the clock can have waiting, 0 for no limit')
+    parser.add_argument('--at-ms', type=float, default=5, help='time SPPServer takes to answer an AT command')
+    parser.add_argument('--jitter-ms', type=float, default=0, help='up to this much extra on every reply')
+    parser.add_argument('--drop-rate', type=float, default=0, help='fraction of clock commands silently lost')
+    parser.add_argument('--disconnect-every', type=float, default=0, help='mean seconds between link drops, 0 for never')
+    parser.add_argument('--connect-ms', type=float, default=2000, help='time AT+CONNECT takes to connect')
+    parser.add_argument('--start-disconnected', action='store_true', help='wait for AT+CONNECT first')
+    parser.add_argument('--reply', default='OK', help="what the clock says after each command, '' for nothing")
+    parser.add_argument('--expect', help='state the clock should end up in, JSON or clock commands')
+    parser.add_argument('--dump', help='write the final state here, as JSON')
+    parser.add_argument('--report', help='write the whole report here, as JSON')
+    parser.add_argument('--seed', type=int, help='for repeatable drops, jitter and disconnects')
+    parser.add_argument('--verbose', '-v', action='store_true', help='print every line received')
+    args = parser.parse_args()
+
+    if (args.port is None) == (args.bridge is None):
+        parser.error('give either a port or --bridge')
+
+    if args.seed is not None:
+        random.seed(args.seed)
+
+    bridge = None
+    port = args.port
+    if args.bridge:
+        bridge, port = start_bridge(args.bridge)
+
+    emulator = Emulator(open_port(port), args)
+    stopping = []
+    signal.signal(signal.SIGINT, lambda *_: stopping.append(True))
+    signal.signal(signal.SIGTERM, lambda *_: stopping.append(True))
+
+    started = time.monotonic()
+    while not stopping:
+        if args.duration > 0 and time.monotonic() - started >= args.duration:
+            break
+        if bridge is not None and bridge.poll() is not None:
+            break
+        if bridge is not None:
+            # Keep the bridge's log moving so it never blocks on a full pipe
+            while select.select([bridge.stderr], [], [], 0)[0]:
+                line = bridge.stderr.readline()
+                if not line:
+                    break
+                if args.verbose:
+                    sys.stderr.buffer.write(line)
+        if not emulator.step(0.1):
+            break
+
+    report = emulator.report(time.monotonic() - started)
+
+    if bridge is not None and bridge.poll() is None:
+        os.killpg(bridge.pid, signal.SIGINT)
+        try:
+            bridge.wait(5)
+        except subprocess.TimeoutExpired:
+            os.killpg(bridge.pid, signal.SIGKILL)
+
+    print_report(report)
+    if args.dump:
+        with open(args.dump, 'w') as f:
+            json.dump(report['state'], f, indent=1, sort_keys=True)
+    if args.report:
+        with open(args.report, 'w') as f:
+            json.dump(report, f, indent=1, sort_keys=True)
+
+    return 1 if report.get('state_diff') else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
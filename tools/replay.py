@@ -0,0 +1,391 @@
+#!/usr/bin/env python3
+"""
+Plays a capture taken with POST /capture/start back into the native build, at
+the speed it was recorded or, with --fast, as quickly as the bridge takes it:
+
+    curl -X POST http://timefliesbridge.local/capture/start
+    ...
+    curl -X POST http://timefliesbridge.local/capture/stop
+    curl -o capture.bin http://timefliesbridge.local/capture
+    tools/replay.py capture.bin --bridge .pio/build/native/program --fast
+
+WebSocket messages go to the bridge from one connection per client in the
+capture, sync bus packets go to it over UDP and NTP syncs are a SIGUSR1, which
+the bridge only acts on when started with TIMEFLIES_NTP=signal (--bridge does
+that). Records are played strictly in order.
+
+The replay stands in for the SPP server on Serial1. AT commands are answered
+straight away, with the connection state the capture had got to. Anything else
+the clock said is sent once the bridge has sent the clock command it followed
+in the capture, so the two stay in step however fast things go. The clock
+commands the bridge sends are compared with the ones in the capture, and any
+difference is reported as a divergence.
+"""
+
+import argparse
+import asyncio
+import json
+import os
+import re
+import signal
+import socket
+import struct
+import sys
+import threading
+import time
+import urllib.parse
+import urllib.request
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from clock_emulator import open_port, start_bridge
+from ws_load import WebSocket
+
+# From src/Capture.h
+MAGIC = b'TFCP'
+WS_CONNECT, WS_DISCONNECT, WS_IN, SERIAL_TX, SERIAL_RX, NTP, SYNC_IN = range(1, 8)
+TYPE_NAMES = {WS_CONNECT: 'ws connect', WS_DISCONNECT: 'ws disconnect', WS_IN: 'ws in',
+    SERIAL_TX: 'serial tx', SERIAL_RX: 'serial rx', NTP: 'ntp', SYNC_IN: 'sync in'}
+
+TIM = re.compile(r'\$TIM,[\d,]*')
+LOOKAHEAD = 8       # How far ahead a clock command can turn up before it counts as out of order
+
+
+def load_capture(path):
+    with open(path, 'rb') as f:
+        data = f.read()
+    if len(data) < 12 or data[:4] != MAGIC:
+        sys.exit('%s is not a capture' % path)
+    if data[4] != 1:
+        sys.exit('%s is capture version %d, this reads version 1' % (path, data[4]))
+    epoch = struct.unpack_from('<I', data, 8)[0]
+
+    records = []
+    offset = 12
+    while offset + 8 <= len(data):
+        rtype, channel, length, ms = struct.unpack_from('<BBHI', data, offset)
+        payload = data[offset + 8:offset + 8 + length]
+        if len(payload) < length:
+            break   # Cut short, e.g. downloaded while it was being written
+        records.append((rtype, channel, ms, payload))
+        offset += 8 + length
+
+    return epoch, records
+
+
+def is_at(line):
+    return line.startswith('AT')
+
+
+def normalise(command):
+    """The time and date the bridge sends depend on when it runs."""
+    return TIM.sub('$TIM,...', command)
+
+
+class Script:
+    """What the bridge should say on Serial1 and what the SPP server said back."""
+
+    def __init__(self, records):
+        self.commands = []      # Clock commands the bridge sent, in order
+        self.states = {}        # Record index: the connection state the SPP module reported there
+        self.replies = {}       # Record index: how many commands had gone out before this clock reply
+        self.initial_state = None
+
+        at = None               # The AT command waiting for its OK
+        for i, (rtype, channel, ms, payload) in enumerate(records):
+            line = payload.decode(errors='replace')
+            if rtype == SERIAL_TX:
+                if is_at(line):
+                    at = line
+                else:
+                    self.commands.append(normalise(line))
+            elif rtype == SERIAL_RX:
+                text = line.rstrip('\r')
+                if at is not None:
+                    if text == 'OK':
+                        at = None
+                    elif at == 'AT+STATE' and text[:1].isdigit():
+                        self.states[i] = text[0]
+                        if self.initial_state is None:
+                            self.initial_state = text[0]
+                elif text:
+                    self.replies[i] = len(self.commands)
+
+        if self.initial_state is None:
+            self.initial_state = '2'    # Connected
+
+
+class Replay:
+    def __init__(self, records, script, fd, args, bridge):
+        self.records = records
+        self.script = script
+        self.fd = fd
+        self.args = args
+        self.bridge = bridge
+        self.url = urllib.parse.urlparse(args.url)
+        self.state = script.initial_state
+        self.started = False
+        self.received = b''
+        self.expected = 0           # Index of the next clock command due from the bridge
+        self.progress = asyncio.Event()
+        self.divergences = []
+        self.stalls = []
+        self.unmatched = 0          # Commands sent before the replay started
+        self.sockets = {}
+        self.readers = []
+        self.frames_in = 0
+        self.played = {t: 0 for t in TYPE_NAMES}
+        self.skipped = {t: 0 for t in TYPE_NAMES}
+        self.sync = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+
+    def write(self, text):
+        os.write(self.fd, text.encode())
+
+    def on_serial(self):
+        try:
+            self.received += os.read(self.fd, 4096)
+        except OSError:
+            return
+        while b'\n' in self.received:
+            line, self.received = self.received.split(b'\n', 1)
+            self.on_line(line.decode(errors='replace').rstrip('\r'))
+
+    def on_line(self, line):
+        if self.args.verbose:
+            print('> %s' % line)
+        if line == 'AT+STATE':
+            self.write('%s\r\nOK\r\n' % self.state)
+            return
+        if is_at(line):
+            self.write('OK\r\n')
+            return
+        if not line:
+            return
+
+        if not self.started:
+            self.unmatched += 1
+            return
+
+        line = normalise(line)
+        commands = self.script.commands
+        ahead = commands[self.expected:self.expected + LOOKAHEAD]
+        if line in ahead:
+            skipped = ahead.index(line)
+            for missing in ahead[:skipped]:
+                self.divergences.append((self.expected, 'missing', missing))
+                self.expected += 1
+            self.expected += 1
+        else:
+            self.divergences.append((self.expected, 'unexpected', line))
+        self.progress.set()
+
+    async def wait_for_commands(self, count):
+        deadline = time.monotonic() + self.args.wait_ms / 1000.0
+        while self.expected < count:
+            remaining = deadline - time.monotonic()
+            if remaining <= 0:
+                self.stalls.append((count - 1, self.script.commands[count - 1]))
+                for missing in self.script.commands[self.expected:count]:
+                    self.divergences.append((self.expected, 'missing', missing))
+                    self.expected += 1
+                return
+            self.progress.clear()
+            try:
+                await asyncio.wait_for(self.progress.wait(), remaining)
+            except asyncio.TimeoutError:
+                pass
+
+    async def drain(self, ws):
+        try:
+            while await ws.recv() is not None:
+                self.frames_in += 1
+        except (asyncio.IncompleteReadError, ConnectionError, OSError):
+            pass
+
+    async def connect(self, channel):
+        ws = await WebSocket.connect(self.url.hostname, self.url.port or 80, '/ws')
+        self.sockets[channel] = ws
+        self.readers.append(asyncio.ensure_future(self.drain(ws)))
+        return ws
+
+    async def play(self, i, rtype, channel, payload):
+        if rtype == WS_CONNECT:
+            if channel in self.sockets:
+                self.sockets.pop(channel).close()
+            await self.connect(channel)
+        elif rtype == WS_DISCONNECT:
+            ws = self.sockets.pop(channel, None)
+            if ws is None:
+                return False
+            ws.close()
+        elif rtype == WS_IN:
+            ws = self.sockets.get(channel)
+            if ws is None:
+                # Connected before the capture started
+                ws = await self.connect(channel)
+            await ws.send(payload.decode(errors='replace'))
+        elif rtype == SERIAL_TX:
+            pass    # Compared as the bridge sends them
+        elif rtype == SERIAL_RX:
+            if i in self.script.states:
+                self.state = self.script.states[i]
+            elif i in self.script.replies:
+                await self.wait_for_commands(self.script.replies[i])
+                self.write(payload.decode(errors='replace') + '\n')
+            else:
+                return False    # An AT reply, those are made up live
+        elif rtype == NTP:
+            if self.bridge is None:
+                return False
+            os.kill(self.bridge.pid, signal.SIGUSR1)
+        elif rtype == SYNC_IN:
+            self.sync.sendto(payload, ('127.0.0.1', self.args.sync_port))
+        return True
+
+    async def run(self):
+        self.started = True
+        started = time.monotonic()
+        for i, (rtype, channel, ms, payload) in enumerate(self.records):
+            if not self.args.fast:
+                delay = started + ms / 1000.0 - time.monotonic()
+                if delay > 0:
+                    await asyncio.sleep(delay)
+            try:
+                if await self.play(i, rtype, channel, payload):
+                    self.played[rtype] += 1
+                else:
+                    self.skipped[rtype] += 1
+            except (ConnectionError, OSError) as e:
+                print('Record %d (%s) failed: %s' % (i, TYPE_NAMES.get(rtype, rtype), e), file=sys.stderr)
+                self.skipped[rtype] += 1
+
+        # Let the last commands come out before calling anything missing
+        await self.wait_for_commands(len(self.script.commands))
+        elapsed = time.monotonic() - started
+
+        for ws in self.sockets.values():
+            ws.close()
+        for reader in self.readers:
+            reader.cancel()
+        await asyncio.gather(*self.readers, return_exceptions=True)
+
+        return elapsed
+
+
+def get_json(base, path):
+    with urllib.request.urlopen(base.rstrip('/') + path, timeout=5) as response:
+        return json.loads(response.read())
+
+
+def wait_for_http(base, seconds):
+    deadline = time.monotonic() + seconds
+    while time.monotonic() < deadline:
+        try:
+            urllib.request.urlopen(base.rstrip('/') + '/metrics', timeout=5).read()
+            return True
+        except OSError:
+            time.sleep(0.2)
+    return False
+
+
+def print_report(replay, records, elapsed, epoch, latency, recorded_s):
+    print('Capture started %s, %d records over %.1fs' % (time.strftime('%Y-%m-%d %H:%M:%S UTC', time.gmtime(epoch)),
+        len(records), recorded_s))
+    print('Replayed in %.2fs (%.1fx)' % (elapsed, recorded_s / elapsed if elapsed > 0 else 0))
+    for rtype, name in TYPE_NAMES.items():
+        if replay.played[rtype] or replay.skipped[rtype]:
+            print('  %-14s %6d played %6d skipped' % (name, replay.played[rtype], replay.skipped[rtype]))
+    print('WebSocket frames from the bridge: %d' % replay.frames_in)
+    print('Clock commands: %d expected, %d sent before the replay started' % (len(replay.script.commands), replay.unmatched))
+
+    if replay.stalls:
+        print('Gave up waiting %d time(s), first for command %d: %s' % ((len(replay.stalls),) + replay.stalls[0]))
+    if not replay.divergences:
+        print('No divergences')
+    else:
+        print('%d divergence(s):' % len(replay.divergences))
+        for index, kind, line in replay.divergences[:20]:
+            print('  #%d %s: %s' % (index, kind, line))
+        if len(replay.divergences) > 20:
+            print('  ...')
+
+    if latency:
+        print('Latency (us)     count     p50     p95     p99     max')
+        for stage in latency.get('stages', []):
+            print('  %-12s %7d %7.0f %7.0f %7.0f %7.0f' % (stage['name'], stage['count'], stage['p50'], stage['p95'], stage['p99'], stage['max']))
+
+
+def drain_log(bridge, verbose):
+    """Keeps the bridge's log moving so it never blocks on a full pipe."""
+    for line in bridge.stderr:
+        if verbose:
+            sys.stderr.buffer.write(line)
+
+
+async def main_async(args, records, script, fd, bridge):
+    replay = Replay(records, script, fd, args, bridge)
+    loop = asyncio.get_running_loop()
+    loop.add_reader(fd, replay.on_serial)
+
+    # Let the bridge get through startup and connecting before the clock commands count
+    await asyncio.sleep(args.warmup)
+    await loop.run_in_executor(None, lambda: urllib.request.urlopen(
+        urllib.request.Request(args.url.rstrip('/') + '/latency/reset', method='POST'), timeout=5).read())
+
+    return replay, await replay.run()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('capture', help='file downloaded from GET /capture')
+    parser.add_argument('port', nargs='?', help="the bridge's Serial1 pty")
+    parser.add_argument('--bridge', help='command that starts the native build, instead of giving a port')
+    parser.add_argument('--url', default='http://localhost:8080', help='where the bridge serves HTTP')
+    parser.add_argument('--fast', action='store_true', help="don't wait for each record's time")
+    parser.add_argument('--wait-ms', type=float, default=5000, help='longest to wait for the bridge to send a command')
+    parser.add_argument('--warmup', type=float, default=3, help='seconds to let the bridge start up first')
+    parser.add_argument('--sync-port', type=int, default=4920, help='where the bridge listens for the sync bus')
+    parser.add_argument('--list', action='store_true', help='print the records and exit')
+    parser.add_argument('--verbose', '-v', action='store_true', help="print the bridge's log and every line it sends")
+    args = parser.parse_args()
+
+    epoch, records = load_capture(args.capture)
+    if args.list:
+        for rtype, channel, ms, payload in records:
+            print('%9.3f %-14s %3d %r' % (ms / 1000.0, TYPE_NAMES.get(rtype, rtype), channel, payload))
+        return 0
+
+    if (args.port is None) == (args.bridge is None):
+        parser.error('give either a port or --bridge')
+
+    script = Script(records)
+    bridge = None
+    port = args.port
+    if args.bridge:
+        os.environ['TIMEFLIES_NTP'] = 'signal'
+        bridge, port = start_bridge('exec ' + args.bridge)
+        threading.Thread(target=drain_log, args=(bridge, args.verbose), daemon=True).start()
+
+    try:
+        fd = open_port(port)
+        if not wait_for_http(args.url, 10):
+            sys.exit('Nothing answering on %s' % args.url)
+        replay, elapsed = asyncio.run(main_async(args, records, script, fd, bridge))
+        try:
+            latency = get_json(args.url, '/latency')
+        except (OSError, ValueError):
+            latency = None
+    finally:
+        if bridge is not None and bridge.poll() is None:
+            os.killpg(bridge.pid, signal.SIGINT)
+            try:
+                bridge.wait(5)
+            except Exception:
+                bridge.kill()
+
+    recorded_s = records[-1][2] / 1000.0 if records else 0
+    print_report(replay, records, elapsed, epoch, latency, recorded_s)
+    return 1 if replay.divergences else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,475 @@
+#!/usr/bin/env python3
+"""
+Finds how many browser sessions the bridge can keep up to date. For each client
+count from 1 to --clients it opens that many WebSocket sessions, plays browser
+traffic at it for --step-seconds and then reports the step:
+
+    tools/ws_load.py http://localhost:8080 --clients 16 --ws-max-clients 16
+    tools/ws_load.py http://timefliesbridge.local --csv curve.csv
+
+Each session loads the menu and the LEDs page as app.html does. Client 0
+drags the red backlight slider, sending bursts of 9:2:backlight_red:N. Every
+fourth client also sits on the Info page and asks for it every
+--info-every seconds. Every fourth client from 3 on (--stallers) reads
+nothing for --stall-seconds at a time, like a tab in the background.
+
+Updates carry the state journal's version, so a gap in a client's versions is
+a broadcast it never got. The latency is from the drag message being sent to
+the update for it arriving, measured on the clients that aren't stalled. Heap
+and frame rates come from /metrics, which is polled every second.
+
+The bridge only keeps ws_max_clients (4 by default) sessions and closes the
+oldest beyond that. --ws-max-clients raises it for the run and puts it back
+at the end.
+"""
+
+import argparse
+import asyncio
+import base64
+import csv
+import hashlib
+import json
+import os
+import random
+import socket
+import struct
+import sys
+import time
+import urllib.parse
+import urllib.request
+
+WS_GUID = '258EAFA5-E914-47DA-95CA-C5AB0DC85B11'
+LED_MAX = 7     # The sliders on leds.html go 0-7
+
+
+def percentile(values, p):
+    if not values:
+        return None
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p / 100.0))]
+
+
+class WebSocket:
+    """Just enough of a client: text frames out, text and control frames in."""
+
+    def __init__(self, reader, writer):
+        self.reader = reader
+        self.writer = writer
+
+    @classmethod
+    async def connect(cls, host, port, path, rcvbuf=0):
+        sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        if rcvbuf:
+            # Small, so a client that stops reading backs up onto the bridge quickly
+            sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, rcvbuf)
+        sock.setblocking(False)
+        await asyncio.get_running_loop().sock_connect(sock, (host, port))
+        reader, writer = await asyncio.open_connection(sock=sock, limit=max(rcvbuf, 4096))
+
+        key = base64.b64encode(os.urandom(16)).decode()
+        writer.write(('GET %s HTTP/1.1\r\nHost: %s:%d\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n'
+            'Sec-WebSocket-Key: %s\r\nSec-WebSocket-Version: 13\r\n\r\n' % (path, host, port, key)).encode())
+
+        head = await reader.readuntil(b'\r\n\r\n')
+        lines = head.decode(errors='replace').split('\r\n')
+        if ' 101 ' not in lines[0] + ' ':
+            raise ConnectionError(lines[0])
+        accept = base64.b64encode(hashlib.sha1((key + WS_GUID).encode()).digest()).decode()
+        if not any(line.lower().startswith('sec-websocket-accept:') and line.split(':', 1)[1].strip() == accept for line in lines):
+            raise ConnectionError('bad Sec-WebSocket-Accept')
+
+        return cls(reader, writer)
+
+    def send_frame(self, opcode, payload):
+        header = bytes([0x80 | opcode])
+        n = len(payload)
+        if n < 126:
+            header += bytes([0x80 | n])
+        elif n < 65536:
+            header += bytes([0x80 | 126]) + struct.pack('!H', n)
+        else:
+            header += bytes([0x80 | 127]) + struct.pack('!Q', n)
+        mask = os.urandom(4)
+        self.writer.write(header + mask + bytes(b ^ mask[i % 4] for i, b in enumerate(payload)))
+
+    async def send(self, text):
+        self.send_frame(0x1, text.encode())
+        await self.writer.drain()
+
+    async def recv(self):
+        """The next text message, or None once the connection has closed."""
+        message = b''
+        while True:
+            b0, b1 = await self.reader.readexactly(2)
+            opcode = b0 & 0x0f
+            n = b1 & 0x7f
+            if n == 126:
+                n = struct.unpack('!H', await self.reader.readexactly(2))[0]
+            elif n == 127:
+                n = struct.unpack('!Q', await self.reader.readexactly(8))[0]
+            mask = await self.reader.readexactly(4) if b1 & 0x80 else None
+            payload = await self.reader.readexactly(n)
+            if mask:
+                payload = bytes(b ^ mask[i % 4] for i, b in enumerate(payload))
+
+            if opcode == 0x8:
+                self.send_frame(0x8, payload[:2])
+                return None
+            if opcode == 0x9:
+                self.send_frame(0xA, payload)
+                continue
+            if opcode == 0xA:
+                continue
+
+            message += payload
+            if b0 & 0x80:
+                return message.decode(errors='replace')
+
+    def close(self):
+        try:
+            self.send_frame(0x8, struct.pack('!H', 1000))
+        except Exception:
+            pass
+        self.writer.close()
+
+
+class Drags:
+    """What client 0 sent, so the others can work out how late each update was."""
+
+    def __init__(self):
+        self.sent = []      # (value, monotonic time)
+
+
+class Session:
+    def __init__(self, index, args, drags):
+        self.index = index
+        self.args = args
+        self.drags = drags
+        self.driver = index == 0
+        self.info = index % 4 == 1
+        self.stalls = args.stallers and index % 4 == 3
+
+        self.ws = None
+        self.received = 0
+        self.updates = 0
+        self.missed = 0
+        self.version = None
+        self.epoch = None
+        self.next_drag = 0      # Index into drags.sent of the first one not seen yet
+        self.latencies = []
+        self.disconnected = False
+        self.error = None
+        self.heap = []          # (esp_free_heap, esp_max_alloc_heap, esp_free_heap_min) from sv.init.info
+        self.ws_max_clients = None
+
+    async def run(self, host, port, stop):
+        try:
+            self.ws = await WebSocket.connect(host, port, '/ws', self.args.rcvbuf if self.stalls else 0)
+            await self.ws.send('0:')
+            await self.ws.send('2:')
+            tasks = [asyncio.ensure_future(self.read(stop))]
+            if self.driver:
+                tasks.append(asyncio.ensure_future(self.drag(stop)))
+            if self.info:
+                tasks.append(asyncio.ensure_future(self.poll_info(stop)))
+            await asyncio.wait(tasks, return_when=asyncio.FIRST_COMPLETED)
+            for task in tasks:
+                task.cancel()
+        except (OSError, asyncio.IncompleteReadError, ConnectionError) as e:
+            self.error = str(e) or type(e).__name__
+        finally:
+            if self.ws:
+                self.ws.close()
+
+    async def read(self, stop):
+        next_stall = time.monotonic() + random.uniform(1, self.args.stall_seconds + 1)
+        while not stop.is_set():
+            if self.stalls and time.monotonic() >= next_stall:
+                await asyncio.sleep(self.args.stall_seconds)
+                next_stall = time.monotonic() + self.args.stall_seconds
+
+            try:
+                text = await self.ws.recv()
+            except asyncio.IncompleteReadError:
+                text = None
+            if text is None:
+                self.disconnected = not stop.is_set()
+                return
+            self.on_message(text, time.monotonic())
+
+    def on_message(self, text, now):
+        self.received += 1
+        try:
+            msg = json.loads(text)
+        except ValueError:
+            return
+
+        kind = msg.get('type')
+        value = msg.get('value') or {}
+        if 'version' in msg:
+            if msg.get('epoch') != self.epoch:
+                self.epoch = msg.get('epoch')
+                self.version = msg['version']
+            elif kind == 'sv.update':
+                # Each update takes the next version, so any gap is one we didn't get
+                if self.version is not None and msg['version'] > self.version + 1:
+                    self.missed += msg['version'] - self.version - 1
+                self.version = max(self.version, msg['version'])
+            else:
+                self.version = max(self.version or 0, msg['version'])
+
+        if kind == 'sv.update':
+            self.updates += 1
+            if 'backlight_red' in value:
+                self.match_drag(value['backlight_red'], now)
+        elif kind == 'sv.init.info':
+            self.heap.append((value.get('esp_free_heap'), value.get('esp_max_alloc_heap'), value.get('esp_free_heap_min')))
+        elif kind == 'sv.init.sync' and 'ws_max_clients' in value:
+            self.ws_max_clients = value['ws_max_clients']
+
+    def match_drag(self, value, now):
+        # Consecutive drags always change the value, so the first match is the one
+        sent = self.drags.sent
+        for i in range(self.next_drag, len(sent)):
+            if sent[i][0] == value:
+                if not self.stalls:
+                    self.latencies.append((now - sent[i][1]) * 1000.0)
+                self.next_drag = i + 1
+                return
+
+    async def drag(self, stop):
+        value = random.randint(0, LED_MAX)
+        while not stop.is_set():
+            for _ in range(self.args.burst):
+                step = random.choice((-1, 1)) if 0 < value < LED_MAX else (1 if value == 0 else -1)
+                value += step
+                self.drags.sent.append((value, time.monotonic()))
+                await self.ws.send('9:2:backlight_red:%d' % value)
+                await asyncio.sleep(self.args.burst_gap_ms / 1000.0)
+            await asyncio.sleep(self.args.drag_every)
+
+    async def poll_info(self, stop):
+        while not stop.is_set():
+            await self.ws.send('4:')
+            await asyncio.sleep(self.args.info_every)
+
+
+class Metrics:
+    """Polls /metrics for the server's side of things."""
+
+    def __init__(self, base):
+        self.url = base.rstrip('/') + '/metrics'
+        self.samples = []   # (time, {name: value}), summed over labels
+
+    def scrape(self):
+        values = {}
+        try:
+            with urllib.request.urlopen(self.url, timeout=2) as response:
+                for line in response.read().decode(errors='replace').splitlines():
+                    if line and not line.startswith('#'):
+                        name, _, value = line.rpartition(' ')
+                        name = name.split('{')[0]
+                        values[name] = values.get(name, 0) + float(value)
+        except (OSError, ValueError):
+            return
+        self.samples.append((time.monotonic(), values))
+
+    async def poll(self, stop):
+        while not stop.is_set():
+            await asyncio.get_running_loop().run_in_executor(None, self.scrape)
+            try:
+                await asyncio.wait_for(stop.wait(), 1)
+            except asyncio.TimeoutError:
+                pass
+
+    def rate(self, name):
+        if len(self.samples) < 2:
+            return None
+        (t0, first), (t1, last) = self.samples[0], self.samples[-1]
+        if name not in first or name not in last or t1 <= t0:
+            return None
+        return (last[name] - first[name]) / (t1 - t0)
+
+    def delta(self, name):
+        if len(self.samples) < 2 or name not in self.samples[0][1]:
+            return None
+        return self.samples[-1][1].get(name, 0) - self.samples[0][1][name]
+
+    def lowest(self, name):
+        values = [s[name] for _, s in self.samples if name in s]
+        return min(values) if values else None
+
+
+async def run_step(n, host, port, args):
+    drags = Drags()
+    sessions = [Session(i, args, drags) for i in range(n)]
+    metrics = Metrics(args.url)
+    stop = asyncio.Event()
+
+    poller = asyncio.ensure_future(metrics.poll(stop))
+    tasks = []
+    for session in sessions:
+        tasks.append(asyncio.ensure_future(session.run(host, port, stop)))
+        await asyncio.sleep(args.stagger_ms / 1000.0)
+
+    await asyncio.sleep(args.step_seconds)
+    stop.set()
+    await asyncio.wait(tasks + [poller], timeout=args.stall_seconds + 5)
+    for task in tasks + [poller]:
+        task.cancel()   # Anyone still waiting for a message
+    await asyncio.gather(*tasks, poller, return_exceptions=True)
+
+    live = [s for s in sessions if not s.stalls]
+    latencies = [l for s in live for l in s.latencies]
+    updates = sum(s.updates for s in sessions)
+    missed = sum(s.missed for s in sessions)
+    heap = [h for s in sessions for h in s.heap if h[0] is not None]
+
+    return {
+        'clients': n,
+        'drags_sent': len(drags.sent),
+        'latency_p50_ms': percentile(latencies, 50),
+        'latency_p95_ms': percentile(latencies, 95),
+        'latency_p99_ms': percentile(latencies, 99),
+        'latency_max_ms': max(latencies) if latencies else None,
+        'updates_received': updates,
+        'updates_missed': missed,
+        'missed_percent': 100.0 * missed / (updates + missed) if updates + missed else 0.0,
+        'missed_by_stalled': sum(s.missed for s in sessions if s.stalls),
+        'frames_per_client_per_s': sum(s.received for s in sessions) / float(n) / args.step_seconds,
+        'server_frames_out_per_s': metrics.rate('timeflies_ws_frames_out_total'),
+        'server_broadcast_drops': metrics.delta('timeflies_ws_broadcast_drops_total'),
+        'server_clients_min': metrics.lowest('timeflies_ws_clients'),
+        'heap_free_min': metrics.lowest('timeflies_heap_free_bytes') or (min(h[0] for h in heap) if heap else None),
+        'heap_max_block_min': metrics.lowest('timeflies_heap_max_alloc_bytes') or (min(h[1] for h in heap if h[1] is not None) if heap else None),
+        'disconnected': sum(1 for s in sessions if s.disconnected),
+        'errors': sorted(set(s.error for s in sessions if s.error)),
+    }
+
+
+async def set_max_clients(host, port, value, args):
+    """Sets ws_max_clients, returning what it was."""
+    ws = await WebSocket.connect(host, port, '/ws')
+    session = Session(-1, args, Drags())
+    try:
+        await ws.send('5:')
+        deadline = time.monotonic() + 5
+        while session.ws_max_clients is None and time.monotonic() < deadline:
+            try:
+                text = await asyncio.wait_for(ws.recv(), deadline - time.monotonic())
+            except asyncio.TimeoutError:
+                break
+            if text is None:
+                break
+            session.on_message(text, time.monotonic())
+        if session.ws_max_clients is None:
+            print("Couldn't read ws_max_clients, it will be left at %d" % value, file=sys.stderr)
+        await ws.send('9:5:ws_max_clients:%d' % value)
+        await asyncio.sleep(0.5)
+    finally:
+        ws.close()
+    return session.ws_max_clients
+
+
+def fmt(value, spec='%.0f'):
+    return '-' if value is None else spec % value
+
+
+def print_row(row):
+    print('%7d %6d %8s %8s %8s %7s %6s %9s %9s %6s %9s %9s %5s' % (
+        row['clients'], row['drags_sent'],
+        fmt(row['latency_p50_ms'], '%.1f'), fmt(row['latency_p95_ms'], '%.1f'), fmt(row['latency_max_ms'], '%.1f'),
+        fmt(row['missed_percent'], '%.1f'), fmt(row['missed_by_stalled']),
+        fmt(row['frames_per_client_per_s'], '%.1f'), fmt(row['server_frames_out_per_s'], '%.1f'),
+        fmt(row['server_broadcast_drops']), fmt(row['heap_free_min']), fmt(row['heap_max_block_min']),
+        row['disconnected']))
+    for error in row['errors']:
+        print('        error: %s' % error)
+    sys.stdout.flush()
+
+
+async def main_async(args):
+    parsed = urllib.parse.urlparse(args.url)
+    host = socket.gethostbyname(parsed.hostname)
+    port = parsed.port or 80
+
+    original = None
+    if args.ws_max_clients:
+        original = await set_max_clients(host, port, args.ws_max_clients, args)
+
+    rows = []
+    try:
+        print('%7s %6s %8s %8s %8s %7s %6s %9s %9s %6s %9s %9s %5s' % (
+            'clients', 'drags', 'p50 ms', 'p95 ms', 'max ms', 'miss %', 'stall', 'fps/clnt', 'srv fps',
+            'drops', 'heap min', 'max block', 'disc'))
+        for n in range(args.start, args.clients + 1):
+            row = await run_step(n, host, port, args)
+            rows.append(row)
+            print_row(row)
+            await asyncio.sleep(args.settle_seconds)
+    finally:
+        if original is not None and original != args.ws_max_clients:
+            await set_max_clients(host, port, original, args)
+
+    return rows
+
+
+def capacity(rows, budget_ms):
+    """The most clients with no updates missed by live readers and p95 inside the budget."""
+    best = 0
+    for row in rows:
+        live_missed = row['updates_missed'] - row['missed_by_stalled']
+        p95 = row['latency_p95_ms']
+        if live_missed == 0 and row['disconnected'] == 0 and p95 is not None and p95 <= budget_ms:
+            best = row['clients']
+        else:
+            break
+    return best
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('url', help='the bridge, e.g. http://localhost:8080')
+    parser.add_argument('--clients', type=int, default=16, help='most clients to try')
+    parser.add_argument('--start', type=int, default=1, help='fewest clients to try')
+    parser.add_argument('--step-seconds', type=float, default=20, help='how long to run each client count for')
+    parser.add_argument('--settle-seconds', type=float, default=2, help='pause between steps')
+    parser.add_argument('--stagger-ms', type=float, default=50, help='between clients connecting')
+    parser.add_argument('--burst', type=int, default=10, help='slider messages in each drag')
+    parser.add_argument('--burst-gap-ms', type=float, default=30, help='between slider messages in a drag')
+    parser.add_argument('--drag-every', type=float, default=1, help='seconds between drags')
+    parser.add_argument('--info-every', type=float, default=2, help='seconds between Info page requests')
+    parser.add_argument('--stallers', type=int, default=1, choices=(0, 1), help='whether every fourth client stalls')
+    parser.add_argument('--stall-seconds', type=float, default=5, help='how long a stalled client stops reading for')
+    parser.add_argument('--rcvbuf', type=int, default=4096, help="stalled clients' socket receive buffer")
+    parser.add_argument('--ws-max-clients', type=int, help='raise ws_max_clients to this for the run')
+    parser.add_argument('--budget-ms', type=float, default=250, help='p95 latency that still counts as keeping up')
+    parser.add_argument('--csv', help='write the curve here')
+    parser.add_argument('--json', help='write the curve here')
+    parser.add_argument('--seed', type=int)
+    args = parser.parse_args()
+
+    if args.seed is not None:
+        random.seed(args.seed)
+
+    try:
+        rows = asyncio.run(main_async(args))
+    except KeyboardInterrupt:
+        return 1
+
+    print('Keeps up with %d client(s): nothing missed by the ones reading, p95 within %.0fms' % (capacity(rows, args.budget_ms), args.budget_ms))
+
+    if args.csv:
+        with open(args.csv, 'w', newline='') as f:
+            writer = csv.DictWriter(f, fieldnames=[k for k in rows[0] if k != 'errors'], extrasaction='ignore')
+            writer.writeheader()
+            writer.writerows(rows)
+    if args.json:
+        with open(args.json, 'w') as f:
+            json.dump(rows, f, indent=1)
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())